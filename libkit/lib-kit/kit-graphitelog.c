@@ -2,13 +2,19 @@
  * This module takes all defined counters (see kit-counters.c) and outputs their
  * values to a file on at a regular interval, in a format that can be sent to a
  * graphite instance for monitoring.
+ *
+ * The binary format (see kit-graphitelog.h) is for agents that read the file
+ * directly: names are written once, and each interval costs one combine of the
+ * counters plus a few bytes per counter that changed, with no text formatting.
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <sxe-log.h>
 #include <time.h>
 
 #include "kit.h"
+#include "kit-alloc.h"
 #include "kit-counters.h"
 #include "kit-safe-rw.h"
 #include "kit-graphitelog.h"
@@ -16,6 +22,7 @@
 static __thread int graphitelog_fd = -1;
 static volatile unsigned graphitelog_json_limit;
 static volatile unsigned graphitelog_interval = 0;
+static volatile unsigned graphitelog_format = KIT_GRAPHITELOG_FORMAT_JSON;
 static volatile bool timetodie = false;
 
 struct kit_graphitelog_buffer {
@@ -64,6 +71,177 @@ kit_graphitelog_counter_callback(void *v, const char *key, const char *value)
     }
 }
 
+/* State of the binary writer; only used by the graphitelog thread */
+struct kit_graphitelog_binary {
+    unsigned long long previous[MAXCOUNTERS];    /* values written in the last values record, in sorted index order */
+    unsigned           count;                    /* number of counters in the last dictionary, or 0 if none written */
+    uint8_t           *buf;
+    size_t             size;
+};
+
+static size_t
+kit_graphitelog_varint(uint8_t *out, uint64_t value)
+{
+    size_t len = 0;
+
+    while (value >= 0x80) {
+        out[len++] = (uint8_t)(value | 0x80);
+        value    >>= 7;
+    }
+
+    out[len++] = (uint8_t)value;
+    return len;
+}
+
+static void
+kit_graphitelog_binary_record(struct kit_graphitelog_binary *binary, uint8_t type, size_t len)
+{
+    binary->buf[0] = type;
+    binary->buf[1] = (uint8_t)(len - KIT_GRAPHITELOG_RECORD_HEADER);
+    binary->buf[2] = (uint8_t)((len - KIT_GRAPHITELOG_RECORD_HEADER) >> 8);
+    binary->buf[3] = (uint8_t)((len - KIT_GRAPHITELOG_RECORD_HEADER) >> 16);
+    binary->buf[4] = (uint8_t)((len - KIT_GRAPHITELOG_RECORD_HEADER) >> 24);
+    kit_safe_write(graphitelog_fd, binary->buf, len, -1);
+}
+
+static void
+kit_graphitelog_binary_reserve(struct kit_graphitelog_binary *binary, size_t size)
+{
+    if (size > binary->size) {
+        SXEA1(binary->buf = kit_realloc(binary->buf, size), "Failed to allocate %zu bytes for the binary graphitelog", size);
+        binary->size = size;
+    }
+}
+
+/* Write a dictionary record if counters have been added since the last one, then a values record
+ */
+static void
+kit_graphitelog_binary_write(struct kit_graphitelog_binary *binary, time_t now)
+{
+    struct kit_counters counter_totals;
+    unsigned long long  value;
+    uint64_t            delta;
+    const char         *name;
+    unsigned            count = kit_num_counters();
+    unsigned            i;
+    size_t              len;
+
+    if (count != binary->count) {
+        for (len = KIT_GRAPHITELOG_RECORD_HEADER + 10, i = 0; i < count; i++)
+            len += strlen(kit_counter_txt(kit_sorted_index(i))) + 1;
+
+        kit_graphitelog_binary_reserve(binary, len);
+        len = KIT_GRAPHITELOG_RECORD_HEADER + kit_graphitelog_varint(binary->buf + KIT_GRAPHITELOG_RECORD_HEADER, count);
+
+        for (i = 0; i < count; i++) {
+            name = kit_counter_txt(kit_sorted_index(i));
+            memcpy(binary->buf + len, name, strlen(name) + 1);
+            len += strlen(name) + 1;
+        }
+
+        kit_graphitelog_binary_record(binary, KIT_GRAPHITELOG_RECORD_DICTIONARY, len);
+        memset(binary->previous, '\0', sizeof(binary->previous));    /* Values restart from zero after a dictionary */
+        binary->count = count;
+    }
+
+    memset(&counter_totals, '\0', sizeof(counter_totals));
+    kit_counters_combine(&counter_totals, -1);
+    kit_graphitelog_binary_reserve(binary, KIT_GRAPHITELOG_RECORD_HEADER + 10 * (2 + (size_t)count));
+    len  = KIT_GRAPHITELOG_RECORD_HEADER;
+    len += kit_graphitelog_varint(binary->buf + len, (uint64_t)now);
+    len += kit_graphitelog_varint(binary->buf + len, count);
+
+    for (i = 0; i < count; i++) {
+        value  = counter_totals.val[kit_sorted_index(i)];
+        delta  = value - binary->previous[i];                                         /* Two's complement difference */
+        len   += kit_graphitelog_varint(binary->buf + len, delta << 1 ^ (uint64_t)((int64_t)delta >> 63));    /* Zigzag */
+        binary->previous[i] = value;
+    }
+
+    kit_graphitelog_binary_record(binary, KIT_GRAPHITELOG_RECORD_VALUES, len);
+}
+
+static bool
+kit_graphitelog_varint_read(const uint8_t **pos, const uint8_t *end, uint64_t *value)
+{
+    unsigned shift;
+
+    for (*value = 0, shift = 0; *pos < end && shift < 64; shift += 7) {
+        *value |= (uint64_t)(**pos & 0x7F) << shift;
+
+        if (!(*(*pos)++ & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * Decode records from a binary graphitelog stream
+ *
+ * @param reader State of the stream; zero it before the first call
+ * @param data   Bytes read from the stream; must stay allocated while reader->names are used
+ * @param length Number of bytes of data
+ * @param cb     NULL or function called with the reader after each values record is decoded
+ * @param v      Passed to cb
+ *
+ * @return The number of bytes consumed; a partial record at the end of data is left for the next call. If the data is
+ *         corrupt, decoding stops at the bad record.
+ */
+size_t
+kit_graphitelog_binary_read(struct kit_graphitelog_reader *reader, const void *data, size_t length, kit_graphitelog_reader_cb_t cb,
+                            void *v)
+{
+    const uint8_t *record = data;
+    const uint8_t *end    = record + length;
+    const uint8_t *pos;
+    const uint8_t *next;
+    uint64_t       count, delta, timestamp;
+    unsigned       i;
+
+    for (; end - record >= KIT_GRAPHITELOG_RECORD_HEADER; record = next) {
+        pos  = record + KIT_GRAPHITELOG_RECORD_HEADER;
+        next = pos + (record[1] | record[2] << 8 | record[3] << 16 | (uint32_t)record[4] << 24);
+
+        if (next > end)
+            break;
+
+        if (record[0] == KIT_GRAPHITELOG_RECORD_DICTIONARY) {
+            if (!kit_graphitelog_varint_read(&pos, next, &count) || count > MAXCOUNTERS)
+                break;
+
+            for (i = 0; i < count && pos < next; i++) {
+                reader->names[i]  = (const char *)pos;
+                reader->values[i] = 0;
+                pos              += strnlen((const char *)pos, next - pos) + 1;
+            }
+
+            if (i < count || pos > next)
+                break;
+
+            reader->count = count;
+        }
+        else if (record[0] == KIT_GRAPHITELOG_RECORD_VALUES) {
+            if (!kit_graphitelog_varint_read(&pos, next, &timestamp) || !kit_graphitelog_varint_read(&pos, next, &count)
+             || count != reader->count)
+                break;
+
+            for (i = 0; i < count && kit_graphitelog_varint_read(&pos, next, &delta); i++)
+                reader->values[i] += delta >> 1 ^ -(delta & 1);    /* Undo zigzag */
+
+            if (i < count)
+                break;
+
+            reader->timestamp = timestamp;
+
+            if (cb)
+                cb(reader, v);
+        }
+    }
+
+    return record - (const uint8_t *)data;
+}
+
 /**
  * Set or update the configurable options
  *
@@ -78,6 +256,20 @@ kit_graphitelog_update_set_options(unsigned json_limit, unsigned interval)
 
 }
 
+/**
+ * Set the output format
+ *
+ * @param format KIT_GRAPHITELOG_FORMAT_JSON (the default) or KIT_GRAPHITELOG_FORMAT_BINARY
+ *
+ * @note Readers of the file must handle a change of format; normally the format is set before the thread is started
+ */
+void
+kit_graphitelog_set_format(unsigned format)
+{
+    SXEA1(format == KIT_GRAPHITELOG_FORMAT_JSON || format == KIT_GRAPHITELOG_FORMAT_BINARY, "Invalid graphitelog format %u", format);
+    graphitelog_format = format;
+}
+
 /**
  * Launch the graphite logging thread
  *
@@ -89,6 +281,7 @@ kit_graphitelog_start_routine(void *arg)
 {
     struct kit_graphitelog_thread *thr = arg;
     struct kit_graphitelog_buffer buffer;
+    struct kit_graphitelog_binary binary;
     uint64_t now_usec, sleep_ms;
     bool bedtime, exittime;
 
@@ -96,6 +289,7 @@ kit_graphitelog_start_routine(void *arg)
     kit_counters_init_thread(thr->counter_slot);
     graphitelog_fd = thr->fd;
     SXEL6("Graphitelog is %s", graphitelog_fd >= 0 ? "enabled" : "disabled");
+    memset(&binary, '\0', sizeof(binary));
 
     for (exittime = false; !exittime; ) {
         if (timetodie)
@@ -104,7 +298,10 @@ kit_graphitelog_start_routine(void *arg)
         SXEA1(graphitelog_interval, "No configuration acquired; cannot run graphitelog thread");
         time(&buffer.now);
 
-        if (graphitelog_fd >= 0) {
+        if (graphitelog_fd >= 0 && graphitelog_format == KIT_GRAPHITELOG_FORMAT_BINARY)
+            kit_graphitelog_binary_write(&binary, buffer.now);
+        else if (graphitelog_fd >= 0) {
+            binary.count   = 0;    /* If switched back to binary, start with a dictionary */
             buffer.counter = 0;
             kit_counters_mib_text("", &buffer, kit_graphitelog_counter_callback, -1, COUNTER_FLAG_NONE);
             kit_graphitelog_complete(&buffer);
@@ -126,6 +323,7 @@ kit_graphitelog_start_routine(void *arg)
         }
     }
 
+    kit_free(binary.buf);
     return NULL;
 }
 
@@ -1,11 +1,44 @@
 #ifndef GRAPHITELOG_H
 #define GRAPHITELOG_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kit-counters.h"
+
+#define KIT_GRAPHITELOG_FORMAT_JSON   0    // One line of JSON per json_limit counters per interval (the default)
+#define KIT_GRAPHITELOG_FORMAT_BINARY 1    // Counter name dictionary, then delta encoded values per interval
+
+/* Binary format: a stream of records, each a one byte type and a four byte little endian payload length followed by the
+ * payload. Readers skip record types they don't know.
+ *
+ *   'D' dictionary: varint counter count, then that many NUL terminated counter names. Written by the first interval and
+ *                   whenever counters are added; values records that follow are in dictionary order.
+ *   'V' values:     varint timestamp, varint counter count, then that many zigzag varint differences from the previous
+ *                   values record (from zero for the first values record after a dictionary).
+ *
+ * Varints are little endian base 128, 7 bits per byte, with the high bit set on all but the last byte.
+ */
+#define KIT_GRAPHITELOG_RECORD_DICTIONARY 'D'
+#define KIT_GRAPHITELOG_RECORD_VALUES     'V'
+#define KIT_GRAPHITELOG_RECORD_HEADER     5
+
 struct kit_graphitelog_thread {
     unsigned counter_slot;
     int fd;
 };
 
+/* State kept by kit_graphitelog_binary_read() while decoding a binary stream
+ */
+struct kit_graphitelog_reader {
+    const char        *names[MAXCOUNTERS];     // Counter names; they point into the data passed to kit_graphitelog_binary_read
+    unsigned long long values[MAXCOUNTERS];    // Values as of the last values record
+    unsigned           count;                  // Number of counters in the dictionary
+    uint64_t           timestamp;              // Time of the last values record
+};
+
+typedef void (*kit_graphitelog_reader_cb_t)(struct kit_graphitelog_reader *reader, void *v);
+
 #include "kit-graphitelog-proto.h"
 
 #endif
@@ -3,18 +3,43 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/syscall.h>     /* for syscall(), SYS_gettid */
 
 #if __FreeBSD__
 #include <sys/socket.h>
 #endif
 
+#include "kit-counters.h"
 #include "kit-infolog.h"
 
 #define DELAY_BETWEEN_IDENTICAL_LOG_ENTRIES     1
 #define ALLOWED_BURST_FOR_IDENTICAL_LOG_ENTRIES 10U
 
-unsigned kit_infolog_flags;
+unsigned      kit_infolog_flags;
+kit_counter_t kit_infolog_counter_dropped = INVALID_COUNTER;    // Lines dropped because a thread's log ring was full
+
+static unsigned long long
+kit_infolog_dropped_combine_handler(int threadnum)
+{
+    return threadnum <= 0 ? sxe_log_async_get_dropped() : 0;
+}
+
+/**
+ * Write infolog and sxe-log lines to stderr from a background thread, so that logging threads don't block in write()
+ *
+ * @param ring_size Bytes buffered per logging thread, or 0 for the default; see sxe_log_async_start()
+ *
+ * @return true on success, false if the writer thread couldn't be started
+ *
+ * @note Lines logged when a thread's ring is full are dropped and counted in the "log.dropped" counter
+ */
+bool
+kit_infolog_async_initialize(unsigned ring_size)
+{
+    if (kit_infolog_counter_dropped == INVALID_COUNTER)
+        kit_infolog_counter_dropped = kit_counter_new_with_combine_handler("log.dropped", kit_infolog_dropped_combine_handler);
+
+    return sxe_log_async_start(ring_size, STDERR_FILENO) != SXE_RETURN_ERROR_INTERNAL;
+}
 
 __printflike(1, 2) int
 kit_infolog_printf(const char *format, ...)
@@ -27,15 +52,7 @@ kit_infolog_printf(const char *format, ...)
     int i, len;
     va_list ap;
 
-#ifdef __APPLE__
-    pid_t thread_id = syscall(SYS_thread_selfid);
-#elif defined(__FreeBSD__)
-    pthread_t thread_id = pthread_self();
-#else /* __linux__ */
-    pid_t thread_id = syscall(SYS_gettid);
-#endif
-
-    len = snprintf(buf, sizeof(buf), "%ld ", (long)thread_id);
+    len = snprintf(buf, sizeof(buf), "%ld ", sxe_log_get_tid());    /* Cached per thread */
     SXEA6((size_t)len < sizeof(buf), "An unsigned hex value doesn't fit in %zu bytes", sizeof(buf));
 
     va_start(ap, format);
@@ -64,6 +81,9 @@ kit_infolog_printf(const char *format, ...)
 
     last_log_ts = now;
     memcpy(previous_buf, buf, len);
-    kit_safe_write(STDERR_FILENO, buf, len, -1);
+
+    if (!sxe_log_async_append(buf, len))
+        kit_safe_write(STDERR_FILENO, buf, len, -1);
+
     return len;
 }
@@ -1,6 +1,7 @@
 #ifndef KIT_INFOLOG_H
 #define KIT_INFOLOG_H
 
+#include "kit-counters.h"
 #include "kit-spinlocks.h"
 
 #include <sxe-log.h>      // For __printflike
@@ -13,7 +14,8 @@
             kit_infolog_printf(format, ## __VA_ARGS__); }           \
     } while (0)
 
-extern unsigned kit_infolog_flags;
+extern unsigned      kit_infolog_flags;
+extern kit_counter_t kit_infolog_counter_dropped;
 
 #include "kit-infolog-proto.h"
 
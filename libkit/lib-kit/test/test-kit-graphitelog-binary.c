@@ -0,0 +1,107 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <tap.h>
+
+#include "kit.h"
+#include "kit-alloc.h"
+#include "kit-counters.h"
+#include "kit-graphitelog.h"
+
+#define INTERVAL 1
+
+const char *graphite_log_file = "graphite_log_file_binary";
+
+struct test_values {
+    unsigned           records;
+    unsigned long long first_a, first_b;
+    unsigned long long last_a, last_b;
+};
+
+static unsigned long long
+test_value(struct kit_graphitelog_reader *reader, const char *name)
+{
+    unsigned i;
+
+    for (i = 0; i < reader->count; i++)
+        if (strcmp(reader->names[i], name) == 0)
+            return reader->values[i];
+
+    return ~0ULL;
+}
+
+static void
+test_values_cb(struct kit_graphitelog_reader *reader, void *v)
+{
+    struct test_values *values = v;
+
+    if (values->records++ == 0) {
+        values->first_a = test_value(reader, "counter.a");
+        values->first_b = test_value(reader, "counter.b");
+    }
+
+    values->last_a = test_value(reader, "counter.a");
+    values->last_b = test_value(reader, "counter.b");
+}
+
+int
+main(void)
+{
+    struct kit_graphitelog_thread gthr;
+    struct kit_graphitelog_reader reader;
+    struct test_values values;
+    kit_counter_t counter_a, counter_b;
+    struct stat st;
+    pthread_t thread;
+    uint8_t *buf;
+
+    plan_tests(11);
+
+    kit_counters_initialize(MAXCOUNTERS, 2, false);
+    counter_a = kit_counter_new("counter.a");
+    counter_b = kit_counter_new("counter.b");
+    ok(kit_counter_isvalid(counter_a) && kit_counter_isvalid(counter_b), "Created counters");
+
+    kit_graphitelog_update_set_options(25, INTERVAL);
+    kit_graphitelog_set_format(KIT_GRAPHITELOG_FORMAT_BINARY);
+    unlink(graphite_log_file);
+    gthr.fd = open(graphite_log_file, O_CREAT | O_NONBLOCK | O_RDWR, 0644);
+    ok(gthr.fd >= 0, "Successfully created %s", graphite_log_file);
+
+    // The first interval is written as soon as the thread starts; the last one when it's told to terminate
+    kit_counter_add(counter_a, 5);
+    kit_counter_add(counter_b, 7);
+    gthr.counter_slot = 1;
+    is(pthread_create(&thread, NULL, kit_graphitelog_start_routine, &gthr), 0, "Successfully created graphitelog thread");
+    usleep(1000000 * INTERVAL + 200000);
+    kit_counter_add(counter_a, 1000000);
+    kit_counter_zero(counter_b);    // Values can go down too
+    usleep(1000000 * INTERVAL + 200000);
+    kit_graphitelog_terminate();
+    pthread_join(thread, NULL);
+
+    SXEA1(fstat(gthr.fd, &st) == 0 && (buf = kit_malloc(st.st_size)), "Failed to allocate a buffer for the graphitelog");
+    lseek(gthr.fd, 0, SEEK_SET);
+    is(read(gthr.fd, buf, st.st_size), st.st_size, "Read binary graphitelog output");
+    is(buf[0], KIT_GRAPHITELOG_RECORD_DICTIONARY,  "The output starts with a dictionary");
+
+    memset(&reader, '\0', sizeof(reader));
+    memset(&values, '\0', sizeof(values));
+    is(kit_graphitelog_binary_read(&reader, buf, st.st_size, test_values_cb, &values), (size_t)st.st_size, "Decoded all records");
+    is(reader.count, kit_num_counters(), "The dictionary names all %u counters", kit_num_counters());
+    ok(values.records >= 2, "Decoded %u values records", values.records);
+    ok(values.first_a == 5 && values.first_b == 7, "First values are as expected (a=%llu, b=%llu)", values.first_a, values.first_b);
+    ok(values.last_a == 1000005 && values.last_b == 0, "Last values are as expected (a=%llu, b=%llu)", values.last_a, values.last_b);
+
+    memset(&reader, '\0', sizeof(reader));
+    ok(kit_graphitelog_binary_read(&reader, buf, st.st_size - 1, NULL, NULL) < (size_t)st.st_size - 1,
+       "A partial record at the end is not consumed");
+
+    kit_free(buf);
+    close(gthr.fd);
+    unlink(graphite_log_file);
+    return exit_status();
+}
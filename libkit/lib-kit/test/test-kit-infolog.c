@@ -1,6 +1,7 @@
 #include <string.h>
 #include <tap.h>
 
+#include "kit-counters.h"
 #include "kit-infolog.h"
 
 int
@@ -13,7 +14,7 @@ main(void)
     char *bufptr;
     int count;
 
-    plan_tests(4);
+    plan_tests(8);
 
     SXEA1(output = mkstemp(temp),                   "Failed to create temporary output file");
     SXEA1((stderr_saved = dup(STDERR_FILENO)) >= 0, "Failed to saved STDERR_FILENO");
@@ -44,6 +45,24 @@ main(void)
     is(count, 11, "kit_infolog burst was limited");
     diag("Data2:\n%s", buf);
 
+    /* With asynchronous logging, lines are written by the log thread and lines that don't fit in the ring are counted
+     */
+    kit_counters_initialize(MAXCOUNTERS, 1, true);
+    ok(kit_infolog_async_initialize(256), "Started asynchronous logging with a 256 byte ring");
+    SXEA1(ftruncate(output, 0) == 0 && lseek(output, 0, SEEK_SET) == 0, "Failed to truncate output file");
+    dup2(output, STDERR_FILENO);
+    kit_infolog_printf("This line is written by the log thread");
+    kit_infolog_printf("%512s", "this line doesn't fit in the ring");
+    sxe_log_async_flush();
+    dup2(stderr_saved, STDERR_FILENO);
+    SXEA1(lseek(output, 0, SEEK_SET) == 0, "Failed to rewind output file");
+    memset(buf, 0, sizeof(buf));
+
+    ok(read(output, buf, sizeof(buf) - 1) > 0,                       "Read the data written by the log thread");
+    ok(strstr(buf, "written by the log thread") != NULL,             "The line that fit was written");
+    is(kit_counter_get(kit_infolog_counter_dropped), 1,              "The line that didn't fit was counted as dropped");
+    sxe_log_async_stop();
+
     unlink(temp);
     return exit_status();
 }
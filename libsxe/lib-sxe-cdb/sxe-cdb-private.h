@@ -165,6 +165,7 @@ struct SXE_CDB_INSTANCE {
     uint32_t        kvdata_used                        ; /* bytes allocated & used        to store key,value pairs */
     uint32_t        kvdata_maximum                     ; /* bytes allocated max threshold to store key,value pairs */
     uint32_t        sheets_size                        ; /* bytes allocated : sheets_size * SXE_CDB_SHEET_BYTES */
+    uint32_t        sheets_mapped                      ; /* sheets in ->sheets mapping; more than ->sheets_size when growing for epoch readers */
     uint32_t        sheets_cells_size                  ; /* cells allocated & used or not to index a key */
     uint32_t        sheets_cells_used                  ; /* cells allocated & used        to index a key */
     uint32_t        sheets_split                       ; /* times 1 sheet split into 2 sheets */
@@ -172,6 +173,8 @@ struct SXE_CDB_INSTANCE {
     uint64_t        keylen_misses                      ; /* times hash   matched but keylen didn't match */
     uint64_t        memcmp_misses                      ; /* times keylen matched but key    didn't match */
     uint32_t        keys_at_start                      ; /* sxe_cdb_instance_new() copy for sxe_cdb_instance_reboot() */
+    uint32_t        is_epoch                           ; /* 1 means grow into new mappings & unmap old ones after epoch readers are done */
+    uint32_t        file_mapped                        ; /* SXE_CDB_FILE_MAPPED_* bits for memory still mapped from a snapshot file */
     uint32_t        counts_pages                       ; /* kernel pages @ counts */ //todo: add _pages to sheets & kvdata
     uint32_t        counts_size                        ; /* bytes allocated : counts_size * SXE_CDB_COUNT_BYTES */
     uint32_t        counts_next_free                   ; /* unused   next in generic    double linked *counts* list */
@@ -182,11 +185,38 @@ struct SXE_CDB_INSTANCE {
     uint16_t        sheets_index[SXE_CDB_SHEETS_MAX]   ;
 } __attribute__((packed));
 
+#define SXE_CDB_FILE_MAPPED_SHEETS 1 /* mremap() can't grow file mappings (the tail isn't zero, or is past EOF), so these */
+#define SXE_CDB_FILE_MAPPED_KVDATA 2 /* grow once by copying into anonymous memory                                          */
+#define SXE_CDB_FILE_MAPPED_COUNTS 4
+
+#define SXE_CDB_SNAPSHOT_MAGIC   "sxe-cdb" /* 8 bytes including the terminating NUL */
+#define SXE_CDB_SNAPSHOT_VERSION 1         /* bump whenever SXE_CDB_SNAPSHOT or SXE_CDB_INSTANCE changes */
+
+typedef struct SXE_CDB_SNAPSHOT {
+    char                    magic[8]        ; /* SXE_CDB_SNAPSHOT_MAGIC */
+    uint32_t                version         ; /* SXE_CDB_SNAPSHOT_VERSION */
+    uint32_t                instance_bytes  ; /* sizeof(struct SXE_CDB_INSTANCE) when saved */
+    uint32_t                sheet_bytes     ; /* SXE_CDB_SHEET_BYTES when saved */
+    uint32_t                page_bytes      ; /* SXE_CDB_KERNEL_PAGE_BYTES when saved; all offsets & sizes are multiples */
+    uint64_t                sheets_offset   ; /* file offset of ->sheets_size sheets */
+    uint64_t                sheets_bytes    ;
+    uint64_t                sheets_checksum ;
+    uint64_t                kvdata_offset   ; /* file offset of ->kvdata_used bytes rounded up to a page */
+    uint64_t                kvdata_bytes    ;
+    uint64_t                kvdata_checksum ;
+    uint64_t                counts_offset   ; /* file offset of ->counts_pages pages */
+    uint64_t                counts_bytes    ;
+    uint64_t                counts_checksum ;
+    uint64_t                header_checksum ; /* of this header, including instance, with ->header_checksum zero */
+    struct SXE_CDB_INSTANCE instance        ; /* copy of instance with pointers zeroed */
+} __attribute__((packed)) SXE_CDB_SNAPSHOT;
+
 struct SXE_CDB_ENSEMBLE {
            uint32_t            cdb_count         ; /* instances of   SXE_CDB_INSTANCE; max 4GB kvdata per instance */
     struct SXE_CDB_INSTANCE ** cdb_instances     ; /* pointers  to   SXE_CDB_INSTANCE */
            SXE_SPINLOCK      * cdb_instance_locks; /* locks for each SXE_CDB_INSTANCE */
            uint32_t            cdb_is_locked : 1 ; /* use locks for  SXE_CDB_ENSEMBLE? */
+           uint32_t            cdb_is_epoch  : 1 ; /* allow lock free sxe_cdb_ensemble_read_*() in read sections? */
 } __attribute__((packed));
 
 #include "sxe-cdb.h"
@@ -21,11 +21,18 @@
 
 #define _GNU_SOURCE
 #include <sys/mman.h> /* for mremap() */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>   /* for PATH_MAX */
+#include <sched.h>    /* for sched_yield() */
+#include <stdio.h>
 #include <string.h> /* for memset() */
+#include <unistd.h>
 
 #include "murmurhash3.h"
 
 #include "sxe-log.h"
+#include "sxe-mmap.h"
 #include "sxe-util.h"
 #include "sxe-spinlock.h"
 #include "sxe-cdb-private.h"
@@ -42,6 +49,126 @@ static                SXE_SPINLOCK       sxe_cdb_ensemble_lock = { 0 }; /* usid
 static __thread const uint8_t          * sxe_cdb_key                  ; /* used by sxe_cdb_prepare() */
 static __thread       uint32_t           sxe_cdb_key_len              ; /* used by sxe_cdb_prepare() */
 
+#define SXE_CDB_READERS_MAX      256 /* threads which have ever called sxe_cdb_read_begin() and not sxe_cdb_read_thread_exit() */
+#define SXE_CDB_READER_FREE      0   /* reader slot not claimed by any thread */
+#define SXE_CDB_READER_QUIESCENT 1   /* reader slot claimed but its thread is not in a read section */
+#define SXE_CDB_READER_EPOCH_MIN 2   /* reader slot claimed and its thread entered a read section during this or a later epoch */
+
+#define SXE_CDB_READ_BARRIER()  __atomic_thread_fence(__ATOMIC_ACQUIRE) /* order pointer loads before loads through them    */
+#define SXE_CDB_WRITE_BARRIER() __atomic_thread_fence(__ATOMIC_RELEASE) /* order stores before the store which publishes them */
+
+typedef struct SXE_CDB_READER {
+    volatile uint64_t epoch; /* SXE_CDB_READER_FREE, SXE_CDB_READER_QUIESCENT, or epoch at sxe_cdb_read_begin() */
+} __attribute__((aligned(SXE_CDB_CACHE_LINE_BYTES))) SXE_CDB_READER; /* one per cache line so readers don't contend */
+
+static                SXE_CDB_READER     sxe_cdb_readers[SXE_CDB_READERS_MAX];
+static volatile       uint64_t           sxe_cdb_epoch = SXE_CDB_READER_EPOCH_MIN; /* bumped by writers waiting for readers */
+static __thread       uint32_t           sxe_cdb_reader_slot          ; /* 1 + index into sxe_cdb_readers[] or 0 if not claimed yet */
+static __thread       uint32_t           sxe_cdb_reader_depth         ; /* nested sxe_cdb_read_begin() calls */
+
+static void
+sxe_cdb_read_claim_slot(void)
+{
+    uint32_t slot;
+
+    for (slot = 0; slot < SXE_CDB_READERS_MAX; slot++) {
+        if (__sync_bool_compare_and_swap(&sxe_cdb_readers[slot].epoch, SXE_CDB_READER_FREE, SXE_CDB_READER_QUIESCENT)) {
+            sxe_cdb_reader_slot = slot + 1;
+            SXEL6("%s(){} // claimed reader slot %u", __FUNCTION__, slot);
+            return;
+        }
+    }
+
+    SXEA1(0, "ERROR: FATAL: more than %u threads reading sxe cdb ensembles // %s(){}", SXE_CDB_READERS_MAX, __FUNCTION__); /* COVERAGE EXCLUSION: todo: test with too many threads */
+} /* sxe_cdb_read_claim_slot() */
+
+/**
+ * Enter a read section; hkv pointers returned by sxe_cdb_ensemble_read_*() stay valid until the matching sxe_cdb_read_end().
+ * Read sections may be nested.
+ */
+void
+sxe_cdb_read_begin(void)
+{
+    if (sxe_cdb_reader_depth++ > 0) {
+        return;
+    }
+
+    if (0 == sxe_cdb_reader_slot) {
+        sxe_cdb_read_claim_slot();
+    }
+
+    sxe_cdb_readers[sxe_cdb_reader_slot - 1].epoch = __atomic_load_n(&sxe_cdb_epoch, __ATOMIC_ACQUIRE);
+    __sync_synchronize(); /* publish our epoch before loading any instance, sheets or kvdata pointers */
+} /* sxe_cdb_read_begin() */
+
+void
+sxe_cdb_read_end(void)
+{
+    SXEA6(sxe_cdb_reader_depth > 0, "ERROR: sxe_cdb_read_end() called outside of a read section");
+
+    if (--sxe_cdb_reader_depth > 0) {
+        return;
+    }
+
+    __atomic_store_n(&sxe_cdb_readers[sxe_cdb_reader_slot - 1].epoch, SXE_CDB_READER_QUIESCENT, __ATOMIC_RELEASE);
+} /* sxe_cdb_read_end() */
+
+void /* call before a reading thread exits so that its reader slot can be reused */
+sxe_cdb_read_thread_exit(void)
+{
+    SXEA1(0 == sxe_cdb_reader_depth, "ERROR: sxe_cdb_read_thread_exit() called inside a read section");
+
+    if (sxe_cdb_reader_slot) {
+        __atomic_store_n(&sxe_cdb_readers[sxe_cdb_reader_slot - 1].epoch, SXE_CDB_READER_FREE, __ATOMIC_RELEASE);
+        sxe_cdb_reader_slot = 0;
+    }
+} /* sxe_cdb_read_thread_exit() */
+
+/**
+ * Wait until every reader which might have loaded a pointer before this call has left its read section.
+ * Called by writers after publishing a new pointer and before freeing whatever the old pointer referenced.
+ */
+void
+sxe_cdb_read_synchronize(void)
+{
+    uint32_t slot;
+    uint64_t epoch;
+
+    SXEA1(0 == sxe_cdb_reader_depth, "ERROR: cannot wait for sxe cdb readers from inside a read section");
+
+    epoch = __sync_fetch_and_add(&sxe_cdb_epoch, 1); /* full barrier; readers entering after this see the new pointers */
+    SXEL6("%s(){} // waiting for readers in epoch %lu or older", __FUNCTION__, epoch);
+
+    for (slot = 0; slot < SXE_CDB_READERS_MAX; slot++) {
+        uint64_t reader_epoch;
+
+        while (((reader_epoch = __atomic_load_n(&sxe_cdb_readers[slot].epoch, __ATOMIC_ACQUIRE)) >= SXE_CDB_READER_EPOCH_MIN)
+        &&     ( reader_epoch <= epoch)) {
+            sched_yield(); /* reader is still in a read section it entered before the new pointers were published */
+        }
+    }
+} /* sxe_cdb_read_synchronize() */
+
+static void * /* copy of the old mapping in a new, larger mapping; caller publishes it and then calls sxe_cdb_instance_unmap_old() */
+sxe_cdb_map_copy(const void * old_base, size_t copy_bytes, size_t new_size)
+{
+    void * new_base = mmap(NULL /* kernel chooses addr */, new_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    SXEA1(MAP_FAILED != new_base, "ERROR: FATAL: expected mmap() not to fail // %s(){}", __FUNCTION__);
+    memcpy(new_base, old_base, copy_bytes);
+    return new_base;
+} /* sxe_cdb_map_copy() */
+
+static void
+sxe_cdb_instance_unmap_old(SXE_CDB_INSTANCE * cdb_instance, void * old_base, size_t old_size)
+{
+    if (cdb_instance->is_epoch) {
+        sxe_cdb_read_synchronize(); /* grace period; no reader can still be looking at the old mapping after this */
+    }
+
+    SXEA1(0 == munmap(old_base, old_size), "ERROR: INTERNAL: munmap() failed for retired mapping");
+} /* sxe_cdb_instance_unmap_old() */
+
 SXE_CDB_HKV *
 sxe_cdb_copy_hkv_to_tls(SXE_CDB_INSTANCE * cdb_instance, uint32_t hkv_pos)
 {
@@ -107,6 +234,7 @@ sxe_cdb_instance_new_init(
     }
 
     cdb_instance->sheets_size       = sheet_index_max ? sheet_index_max : 1; /* always create at least one sheet */
+    cdb_instance->sheets_mapped     = cdb_instance->sheets_size;
     cdb_instance->kvdata_size       = SXE_CDB_KERNEL_PAGE_BYTES;
     cdb_instance->kvdata_used       = 1; /* 0 means cell is unused in table; yeah, we're 'wasting' 1 byte here :-) */
     cdb_instance->sheets_cells_size = SXE_CDB_KEYS_PER_SHEET;
@@ -123,13 +251,14 @@ sxe_cdb_instance_new_init(
     cdb_instance->memcmp_misses     = 0;
     cdb_instance->kvdata_maximum    = kvdata_maximum;
     cdb_instance->keys_at_start     = keys_at_start;
+    cdb_instance->file_mapped       = 0; /* anonymous mmaps below; sxe_cdb_instance_load() maps a snapshot file instead */
 
     for (cl = 0; cl < SXE_CDB_COUNTS_LISTS_MAX; cl ++) {
         cdb_instance->counts_hi[cl] = SXE_CDB_COUNT_NONE;
         cdb_instance->counts_lo[cl] = SXE_CDB_COUNT_NONE;
     }
 
-    cdb_instance->sheets = mmap(NULL /* kernel chooses addr */, SXE_CDB_SHEET_BYTES       * cdb_instance->sheets_size , PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    cdb_instance->sheets = mmap(NULL /* kernel chooses addr */, SXE_CDB_SHEET_BYTES       * cdb_instance->sheets_mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
     cdb_instance->kvdata = mmap(NULL /* kernel chooses addr */,                             cdb_instance->kvdata_size , PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
     SXEL7("cdb_instance->sheets             : %p // 4k kernel pages: %u", cdb_instance->sheets, SXE_CDB_SHEET_BYTES * cdb_instance->sheets_size / 4096);
     SXEL7("cdb_instance->kvdata             : %p // 4k kernel pages: %u", cdb_instance->kvdata,                       cdb_instance->kvdata_size / 4096);
@@ -184,6 +313,7 @@ sxe_cdb_instance_new(
     SXEL7("SXE_CDB_KERNEL_PAGE_BYTES: %u" , SXE_CDB_KERNEL_PAGE_BYTES);
     SXEL7("SXE_CDB_COUNT_BYTES      : %zu", SXE_CDB_COUNT_BYTES      );
 
+    cdb_instance->is_epoch = 0; /* set by sxe_cdb_ensemble_new() & sxe_cdb_ensemble_swap_instances() for epoch reader ensembles */
     sxe_cdb_instance_new_init(cdb_instance, keys_at_start, kvdata_maximum);
 
     SXER6("return %p=cdb_instance", cdb_instance);
@@ -194,7 +324,7 @@ static void
 sxe_cdb_instance_destroy_mmaps(SXE_CDB_INSTANCE * cdb_instance)
 {
     SXEL6("%s(cdb_instance=?){}", __FUNCTION__);
-                                SXEA1(0 == munmap(cdb_instance->sheets, SXE_CDB_SHEET_BYTES       * cdb_instance->sheets_size ), "ERROR: INTERNAL: munmap() failed for sheets");
+                                SXEA1(0 == munmap(cdb_instance->sheets, SXE_CDB_SHEET_BYTES       * cdb_instance->sheets_mapped), "ERROR: INTERNAL: munmap() failed for sheets");
                                 SXEA1(0 == munmap(cdb_instance->kvdata,                             cdb_instance->kvdata_size ), "ERROR: INTERNAL: munmap() failed for kvdata");
     if (cdb_instance->counts) { SXEA1(0 == munmap(cdb_instance->counts, SXE_CDB_KERNEL_PAGE_BYTES * cdb_instance->counts_pages), "ERROR: INTERNAL: munmap() failed for counts"); }
 } /* sxe_cdb_instance_destroy_mmaps() */
@@ -216,6 +346,219 @@ sxe_cdb_instance_reboot(SXE_CDB_INSTANCE * cdb_instance)
     sxe_cdb_instance_new_init     (cdb_instance, cdb_instance->keys_at_start, cdb_instance->kvdata_maximum); /*   hello mmaps */
 } /* sxe_cdb_instance_reboot() */
 
+#define SXE_CDB_PAGE_ROUND(BYTES) (((uint64_t)(BYTES) + SXE_CDB_KERNEL_PAGE_BYTES - 1) / SXE_CDB_KERNEL_PAGE_BYTES * SXE_CDB_KERNEL_PAGE_BYTES)
+
+static uint64_t
+sxe_cdb_snapshot_checksum(const void * bytes, uint64_t length)
+{
+    uint64_t hash[2] = { 0, 0 };
+    uint64_t offset;
+    uint64_t chunk;
+
+    for (offset = 0; offset < length; offset += chunk) { /* MurmurHash3 takes an int length, so hash 1GB at a time */
+        chunk = length - offset < (1 << 30) ? length - offset : (1 << 30);
+        MurmurHash3_xnn_128((const uint8_t *) bytes + offset, (int) chunk, (uint32_t) hash[0] ^ (uint32_t) hash[1], &hash[0]);
+    }
+
+    return hash[0];
+} /* sxe_cdb_snapshot_checksum() */
+
+static int /* 0 or -1 with errno set */
+sxe_cdb_snapshot_write(int fd, const void * bytes, uint64_t length)
+{
+    uint64_t written;
+    ssize_t  result;
+
+    for (written = 0; written < length; written += result) {
+        if ((result = write(fd, (const uint8_t *) bytes + written, length - written)) <= 0) {
+            if (result < 0 && errno == EINTR) {
+                result = 0; /* COVERAGE EXCLUSION: interrupted write */
+                continue;   /* COVERAGE EXCLUSION: interrupted write */
+            }
+
+            return -1;
+        }
+    }
+
+    return 0;
+} /* sxe_cdb_snapshot_write() */
+
+/**
+ * Save an instance to a snapshot file that sxe_cdb_instance_load() can map back in without inserting any keys.
+ *
+ * The file is written to <path>.tmp and renamed over <path>, so a crash never leaves a partial snapshot at <path>. The
+ * layout is a page aligned SXE_CDB_SNAPSHOT header (including a copy of the instance) followed by the sheets, kvdata and
+ * counts memory, each page aligned and checksummed.
+ */
+SXE_RETURN
+sxe_cdb_instance_save(SXE_CDB_INSTANCE * cdb_instance, const char * path)
+{
+    SXE_RETURN         result = SXE_RETURN_ERROR_WRITE_FAILED;
+    SXE_CDB_SNAPSHOT * snapshot;
+    uint64_t           header_bytes = SXE_CDB_PAGE_ROUND(sizeof(*snapshot));
+    char               path_tmp[PATH_MAX];
+    int                fd = -1;
+
+    SXEE6("(cdb_instance=?, path=%s)", path);
+
+    if ((unsigned) snprintf(path_tmp, sizeof(path_tmp), "%s.tmp", path) >= sizeof(path_tmp)) {
+        SXEL3("WARNING: %s(): path too long: %s", __FUNCTION__, path);
+        goto SXE_EARLY_OUT;
+    }
+
+    snapshot = calloc(1, header_bytes); /* zero padding up to the first page boundary */
+    SXEA1(snapshot, "ERROR: INTERNAL: calloc() failed for %lu bytes // %s(){}", header_bytes, __FUNCTION__);
+
+    memcpy(snapshot->magic, SXE_CDB_SNAPSHOT_MAGIC, sizeof(snapshot->magic));
+    snapshot->version         = SXE_CDB_SNAPSHOT_VERSION;
+    snapshot->instance_bytes  = sizeof(struct SXE_CDB_INSTANCE);
+    snapshot->sheet_bytes     = SXE_CDB_SHEET_BYTES;
+    snapshot->page_bytes      = SXE_CDB_KERNEL_PAGE_BYTES;
+    snapshot->sheets_offset   = header_bytes;
+    snapshot->sheets_bytes    = (uint64_t) SXE_CDB_SHEET_BYTES * cdb_instance->sheets_size;
+    snapshot->kvdata_offset   = snapshot->sheets_offset + snapshot->sheets_bytes;
+    snapshot->kvdata_bytes    = SXE_CDB_PAGE_ROUND(cdb_instance->kvdata_used);
+    snapshot->counts_offset   = snapshot->kvdata_offset + snapshot->kvdata_bytes;
+    snapshot->counts_bytes    = cdb_instance->counts ? (uint64_t) SXE_CDB_KERNEL_PAGE_BYTES * cdb_instance->counts_pages : 0;
+    snapshot->sheets_checksum = sxe_cdb_snapshot_checksum(cdb_instance->sheets, snapshot->sheets_bytes);
+    snapshot->kvdata_checksum = sxe_cdb_snapshot_checksum(cdb_instance->kvdata, cdb_instance->kvdata_used);
+    snapshot->counts_checksum = sxe_cdb_snapshot_checksum(cdb_instance->counts, snapshot->counts_bytes);
+
+    memcpy(&snapshot->instance, cdb_instance, sizeof(snapshot->instance));
+    snapshot->instance.counts        = NULL;
+    snapshot->instance.sheets        = NULL;
+    snapshot->instance.kvdata        = NULL;
+    snapshot->instance.kvdata_size   = snapshot->kvdata_bytes;
+    snapshot->instance.sheets_mapped = cdb_instance->sheets_size;
+    snapshot->instance.is_epoch      = 0;
+    snapshot->instance.file_mapped   = 0;
+    snapshot->header_checksum        = sxe_cdb_snapshot_checksum(snapshot, sizeof(*snapshot));
+
+    if ((fd = open(path_tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+        SXEL3("WARNING: %s(): can't create %s: %s", __FUNCTION__, path_tmp, strerror(errno));
+        goto SXE_ERROR_OUT;
+    }
+
+    if ((sxe_cdb_snapshot_write(fd, snapshot,             header_bytes                                                 ) < 0)
+    ||  (sxe_cdb_snapshot_write(fd, cdb_instance->sheets, snapshot->sheets_bytes                                       ) < 0)
+    ||  (sxe_cdb_snapshot_write(fd, cdb_instance->kvdata, cdb_instance->kvdata_used                                    ) < 0)
+    ||  (ftruncate(fd, snapshot->counts_offset) < 0 || lseek(fd, snapshot->counts_offset, SEEK_SET) < 0                     )
+    ||  (sxe_cdb_snapshot_write(fd, cdb_instance->counts, snapshot->counts_bytes                                       ) < 0)
+    ||  (fsync(fd) < 0)) {
+        SXEL3("WARNING: %s(): can't write %s: %s", __FUNCTION__, path_tmp, strerror(errno)); /* COVERAGE EXCLUSION: todo: test a full disk */
+        goto SXE_ERROR_OUT;                                                                    /* COVERAGE EXCLUSION: todo: test a full disk */
+    }
+
+    if (rename(path_tmp, path) < 0) {
+        SXEL3("WARNING: %s(): can't rename %s to %s: %s", __FUNCTION__, path_tmp, path, strerror(errno)); /* COVERAGE EXCLUSION: todo: test a failed rename */
+        goto SXE_ERROR_OUT;                                                                                  /* COVERAGE EXCLUSION: todo: test a failed rename */
+    }
+
+    result = SXE_RETURN_OK;
+
+SXE_ERROR_OUT:
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    if (result != SXE_RETURN_OK) {
+        unlink(path_tmp);
+    }
+
+    free(snapshot);
+
+SXE_EARLY_OUT:
+    SXER6("return %s", sxe_return_to_string(result));
+    return result;
+} /* sxe_cdb_instance_save() */
+
+/**
+ * Map an instance saved by sxe_cdb_instance_save() back in, copy on write. Nothing is read until it is used, so loading
+ * is O(1) in the number of keys; memory grows by copying into anonymous memory the first time a put needs more room.
+ *
+ * @param verify 0 to only check the header, or 1 to also checksum all of the sheets, kvdata and counts (O(n))
+ *
+ * @return The instance, or NULL if the file is missing, truncated, corrupt or from an incompatible version (logged)
+ */
+SXE_CDB_INSTANCE *
+sxe_cdb_instance_load(const char * path, uint32_t verify)
+{
+    SXE_CDB_INSTANCE * cdb_instance = NULL;
+    SXE_CDB_SNAPSHOT * snapshot;
+    SXE_MMAP           memmap;
+    uint64_t           header_bytes = SXE_CDB_PAGE_ROUND(sizeof(*snapshot));
+    uint64_t           header_checksum;
+    uint8_t          * base;
+
+    SXEE6("(path=%s, verify=%u)", path, verify);
+
+    if (!sxe_mmap_try_open(&memmap, path, SXE_MMAP_FLAG_PRIVATE)) {
+        goto SXE_EARLY_OUT;
+    }
+
+    base     = memmap.addr;
+    snapshot = memmap.addr;
+
+    if (memmap.size < header_bytes || 0 != memcmp(snapshot->magic, SXE_CDB_SNAPSHOT_MAGIC, sizeof(snapshot->magic))) {
+        SXEL3("WARNING: %s(): %s is not an sxe-cdb snapshot", __FUNCTION__, path);
+        goto SXE_ERROR_OUT;
+    }
+
+    if (snapshot->version        != SXE_CDB_SNAPSHOT_VERSION
+     || snapshot->instance_bytes != sizeof(struct SXE_CDB_INSTANCE)
+     || snapshot->sheet_bytes    != SXE_CDB_SHEET_BYTES
+     || snapshot->page_bytes     != SXE_CDB_KERNEL_PAGE_BYTES) {
+        SXEL3("WARNING: %s(): %s is sxe-cdb snapshot version %u; expected version %u", __FUNCTION__, path, snapshot->version, SXE_CDB_SNAPSHOT_VERSION);
+        goto SXE_ERROR_OUT;
+    }
+
+    header_checksum           = snapshot->header_checksum;
+    snapshot->header_checksum = 0; /* private mapping; the file is not changed */
+
+    if (header_checksum != sxe_cdb_snapshot_checksum(snapshot, sizeof(*snapshot))) {
+        SXEL3("WARNING: %s(): %s has a bad header checksum", __FUNCTION__, path);
+        goto SXE_ERROR_OUT;
+    }
+
+    if (snapshot->sheets_offset != header_bytes
+     || snapshot->sheets_bytes  != (uint64_t) SXE_CDB_SHEET_BYTES * snapshot->instance.sheets_size || 0 == snapshot->sheets_bytes
+     || snapshot->kvdata_offset != snapshot->sheets_offset + snapshot->sheets_bytes
+     || snapshot->kvdata_bytes  != SXE_CDB_PAGE_ROUND(snapshot->instance.kvdata_used)              || 0 == snapshot->kvdata_bytes
+     || snapshot->counts_offset != snapshot->kvdata_offset + snapshot->kvdata_bytes
+     || snapshot->counts_bytes  != (uint64_t) SXE_CDB_KERNEL_PAGE_BYTES * snapshot->instance.counts_pages
+     || memmap.size             != snapshot->counts_offset + snapshot->counts_bytes) {
+        SXEL3("WARNING: %s(): %s is truncated or has an inconsistent layout", __FUNCTION__, path);
+        goto SXE_ERROR_OUT;
+    }
+
+    if (verify
+     && (snapshot->sheets_checksum != sxe_cdb_snapshot_checksum(base + snapshot->sheets_offset, snapshot->sheets_bytes            )
+      || snapshot->kvdata_checksum != sxe_cdb_snapshot_checksum(base + snapshot->kvdata_offset, snapshot->instance.kvdata_used    )
+      || snapshot->counts_checksum != sxe_cdb_snapshot_checksum(base + snapshot->counts_offset, snapshot->counts_bytes            ))) {
+        SXEL3("WARNING: %s(): %s has a bad data checksum", __FUNCTION__, path);
+        goto SXE_ERROR_OUT;
+    }
+
+    cdb_instance = malloc(sizeof(*cdb_instance));
+    SXEA1(cdb_instance, "ERROR: INTERNAL: malloc() failed for %zu bytes // %s(){}", sizeof(*cdb_instance), __FUNCTION__);
+    memcpy(cdb_instance, &snapshot->instance, sizeof(*cdb_instance));
+    cdb_instance->sheets      = (SXE_CDB_SHEET *) (base + snapshot->sheets_offset);
+    cdb_instance->kvdata      =                    base + snapshot->kvdata_offset ;
+    cdb_instance->counts      = snapshot->counts_bytes ? (SXE_CDB_COUNT *) (base + snapshot->counts_offset) : NULL;
+    cdb_instance->file_mapped = SXE_CDB_FILE_MAPPED_SHEETS | SXE_CDB_FILE_MAPPED_KVDATA | (snapshot->counts_bytes ? SXE_CDB_FILE_MAPPED_COUNTS : 0);
+
+    SXEA1(0 == munmap(base, header_bytes), "ERROR: INTERNAL: munmap() failed for snapshot header"); /* the regions stay mapped */
+    close(memmap.fd);
+    goto SXE_EARLY_OUT;
+
+SXE_ERROR_OUT:
+    sxe_mmap_close(&memmap);
+
+SXE_EARLY_OUT:
+    SXER6("return %p=cdb_instance", cdb_instance);
+    return cdb_instance;
+} /* sxe_cdb_instance_load() */
+
 #if SXE_DEBUG
 void
 sxe_cdb_instance_debug_validate(SXE_CDB_INSTANCE * cdb_instance, const char * debug)
@@ -254,6 +597,7 @@ sxe_cdb_instance_split_sheet(SXE_CDB_INSTANCE * cdb_instance, uint16_t sheet)
 {
     uint16_t this_sheet =               sheet      ;
     uint16_t that_sheet = cdb_instance->sheets_size;
+    uint8_t  moves[SXE_CDB_SHEETS_MAX / 8]; /* bit per sheet index; set if sheet index moves from this to that sheet */
     unsigned row;
     unsigned cell;
 
@@ -261,28 +605,47 @@ sxe_cdb_instance_split_sheet(SXE_CDB_INSTANCE * cdb_instance, uint16_t sheet)
 
     //debug sxe_cdb_debug_validate(cdb, "a");
 
-    SXEL7("cdb_instance->sheets             : %p // old base", cdb_instance->sheets);
-           cdb_instance->sheets = mremap(cdb_instance->sheets, SXE_CDB_SHEET_BYTES * cdb_instance->sheets_size, SXE_CDB_SHEET_BYTES * (1 + cdb_instance->sheets_size), MREMAP_MAYMOVE);
-    SXEL7("cdb_instance->sheets             : %p // new base after mremap()", cdb_instance->sheets);
+    if (! cdb_instance->is_epoch && ! (cdb_instance->file_mapped & SXE_CDB_FILE_MAPPED_SHEETS)) {
+        SXEL7("cdb_instance->sheets             : %p // old base", cdb_instance->sheets);
+               cdb_instance->sheets = mremap(cdb_instance->sheets, SXE_CDB_SHEET_BYTES * cdb_instance->sheets_size, SXE_CDB_SHEET_BYTES * (1 + cdb_instance->sheets_size), MREMAP_MAYMOVE);
+        SXEL7("cdb_instance->sheets             : %p // new base after mremap()", cdb_instance->sheets);
+               cdb_instance->sheets_mapped = 1 + cdb_instance->sheets_size;
+        SXEA1(MAP_FAILED != cdb_instance->sheets, "ERROR: FATAL: expected mremap() not to fail // %s(){}", __FUNCTION__);
+    }
+    else if (cdb_instance->sheets_size == cdb_instance->sheets_mapped) { /* epoch readers or a snapshot file may be using the old sheets; copy & double */
+        SXE_CDB_SHEET * sheets_old        = cdb_instance->sheets;
+        uint32_t        sheets_mapped_old = cdb_instance->sheets_mapped;
+        uint32_t        sheets_mapped_new = 2 * sheets_mapped_old < SXE_CDB_SHEETS_MAX ? 2 * sheets_mapped_old : SXE_CDB_SHEETS_MAX;
+        SXE_CDB_SHEET * sheets_new        = sxe_cdb_map_copy(sheets_old, SXE_CDB_SHEET_BYTES * cdb_instance->sheets_size, SXE_CDB_SHEET_BYTES * sheets_mapped_new);
+        SXE_CDB_WRITE_BARRIER();
+        cdb_instance->sheets        = sheets_new;
+        cdb_instance->sheets_mapped = sheets_mapped_new;
+        cdb_instance->file_mapped  &= ~SXE_CDB_FILE_MAPPED_SHEETS;
+        SXEL7("cdb_instance->sheets             : %p // new base after copy; %u sheets mapped", cdb_instance->sheets, sheets_mapped_new);
+        sxe_cdb_instance_unmap_old(cdb_instance, sheets_old, SXE_CDB_SHEET_BYTES * sheets_mapped_old);
+    }
+
            cdb_instance->sheets_size       ++; /* count extra sheet */
            cdb_instance->sheets_cells_size += SXE_CDB_KEYS_PER_SHEET;
 
-    SXEA1(MAP_FAILED != cdb_instance->sheets, "ERROR: FATAL: expected mremap() not to fail // %s(){}", __FUNCTION__);
-
     SXEL7("split sheet indexes into roughly two");
     unsigned si;
     unsigned sheet_toggle  = 0;
     unsigned sheet_toggles = 0;
+    memset(moves, 0, sizeof(moves));
     for (si = 0; si < SXE_CDB_SHEETS_MAX; si++) { /* loop over all sheet indexes */
-        SXEA6(cdb_instance->sheets_index[si] <= that_sheet, "ERROR: INTERNAL: expected ->sheets_index[%u] <= %u=that_sheet but found %u", si, that_sheet, cdb_instance->sheets_index[si]);
+        SXEA6(cdb_instance->sheets_index[si] < that_sheet, "ERROR: INTERNAL: expected ->sheets_index[%u] < %u=that_sheet but found %u", si, that_sheet, cdb_instance->sheets_index[si]);
         if (this_sheet == cdb_instance->sheets_index[si]) { /* if this is the full sheet? */
-            cdb_instance->sheets_index[si] = sheet_toggle ? that_sheet : this_sheet; /* split */
+            moves[si / 8] |= sheet_toggle ? 1 << (si % 8) : 0; /* split */
             sheet_toggle = sheet_toggle ? 0 : 1;
             sheet_toggles ++;
         }
     }
     SXEA6(sheet_toggles > 1, "ERROR: INTERNAL: too many keys? need at least two toggles to grow cdb!");
 
+#define SXE_CDB_CELL_MOVES(ROW,CELL) (moves[(cdb_instance->sheets[this_sheet].row[ROW].hash_hi.u16[CELL] % SXE_CDB_SHEETS_MAX) / 8] \
+                                       & (1 << ((cdb_instance->sheets[this_sheet].row[ROW].hash_hi.u16[CELL] % SXE_CDB_SHEETS_MAX) % 8)))
+
 #if SXE_DEBUG
     unsigned keys_total = 0;
     unsigned keys_moved = 0;
@@ -295,15 +658,11 @@ sxe_cdb_instance_split_sheet(SXE_CDB_INSTANCE * cdb_instance, uint16_t sheet)
 #if SXE_DEBUG
                 keys_total ++;
 #endif
-                uint16_t hash_hi = cdb_instance->sheets[this_sheet].row[row].hash_hi.u16[cell];
-                uint16_t mysheet = cdb_instance->sheets_index[hash_hi % SXE_CDB_SHEETS_MAX];
-                SXEA6((mysheet == this_sheet) || (mysheet == that_sheet), "ERROR: INTERNAL: expecting sheet %u or %u but got %u (while splitting cell %u in row %u with hash_hi %u)", this_sheet, that_sheet, mysheet, cell, row, hash_hi);
-                if    (mysheet == that_sheet) { /* cell should split to that other sheet? */
+                SXEA6(this_sheet == cdb_instance->sheets_index[cdb_instance->sheets[this_sheet].row[row].hash_hi.u16[cell] % SXE_CDB_SHEETS_MAX], "ERROR: INTERNAL: expecting sheet %u while splitting cell %u in row %u", this_sheet, cell, row);
+                if (SXE_CDB_CELL_MOVES(row, cell)) { /* cell should split to that other sheet? */
                     cdb_instance->sheets[that_sheet].row[row].hash_lo.u16[cell] = cdb_instance->sheets[this_sheet].row[row].hash_lo.u16[cell]; /* copy cell    */
                     cdb_instance->sheets[that_sheet].row[row].hash_hi.u16[cell] = cdb_instance->sheets[this_sheet].row[row].hash_hi.u16[cell]; /* from old     */
                     cdb_instance->sheets[that_sheet].row[row].hkv_pos.u32[cell] = cdb_instance->sheets[this_sheet].row[row].hkv_pos.u32[cell]; /* to new sheet */
-
-                    cdb_instance->sheets[this_sheet].row[row].hkv_pos.u32[cell] = 0; /* mark cell as unused */
 #if SXE_DEBUG
                     keys_moved ++;
 #endif
@@ -313,6 +672,25 @@ sxe_cdb_instance_split_sheet(SXE_CDB_INSTANCE * cdb_instance, uint16_t sheet)
     } // for (row
     SXEL6("split %u from %u sheet %5u keys to sheet %5u; now %u from %u keys total", keys_moved, keys_total, this_sheet, that_sheet, cdb_instance->sheets_cells_used, cdb_instance->sheets_cells_size);
 
+    SXE_CDB_WRITE_BARRIER(); /* moved cells are in that sheet before any sheet index points at it */
+    for (si = 0; si < SXE_CDB_SHEETS_MAX; si++) {
+        if (moves[si / 8] & (1 << (si % 8))) {
+            cdb_instance->sheets_index[si] = that_sheet;
+        }
+    }
+
+    if (cdb_instance->is_epoch) {
+        sxe_cdb_read_synchronize(); /* epoch readers may still be looking for the moved keys in this sheet */
+    }
+
+    for (row = 0; row < SXE_CDB_ROWS_PER_SHEET; row ++) {
+        for (cell = 0; cell < SXE_CDB_KEYS_PER_ROW; cell ++) {
+            if (cdb_instance->sheets[this_sheet].row[row].hkv_pos.u32[cell] && SXE_CDB_CELL_MOVES(row, cell)) {
+                cdb_instance->sheets[this_sheet].row[row].hkv_pos.u32[cell] = 0; /* mark cell as unused */
+            }
+        }
+    }
+
     //debug sxe_cdb_debug_validate(cdb, "b");
 
     cdb_instance->sheets_split ++;
@@ -373,22 +751,41 @@ SXE_CDB_ADD_RETRY_ROW_SCAN:;
 
     if (key_bytes_want > key_bytes_free) { /* come here to mremap() more key space! */
         uint32_t want_size_rounded_to_kernel_pages = (((key_bytes_want + (SXE_CDB_KERNEL_PAGE_BYTES - 1)) / SXE_CDB_KERNEL_PAGE_BYTES) * SXE_CDB_KERNEL_PAGE_BYTES) + SXE_CDB_KERNEL_PAGE_BYTES;
+        uint32_t kvdata_is_copied = cdb_instance->is_epoch || (cdb_instance->file_mapped & SXE_CDB_FILE_MAPPED_KVDATA);
+        if (kvdata_is_copied
+        &&  (cdb_instance->kvdata_size + cdb_instance->kvdata_size > cdb_instance->kvdata_size)
+        &&  (cdb_instance->kvdata_size                            > want_size_rounded_to_kernel_pages)) {
+            want_size_rounded_to_kernel_pages = cdb_instance->kvdata_size; /* double; each copying growth copies all of kvdata */
+        }
         if (cdb_instance->kvdata_size + want_size_rounded_to_kernel_pages < cdb_instance->kvdata_size) { SXEL3("WARNING: %s(): avoiding 4GB kvdata wrap; early out with no append for key #%u", __FUNCTION__, cdb_instance->sheets_cells_used); goto SXE_EARLY_OUT; }
+        if (! kvdata_is_copied) {
             cdb_instance->kvdata       = mremap(cdb_instance->kvdata, cdb_instance->kvdata_size, cdb_instance->kvdata_size + want_size_rounded_to_kernel_pages, MREMAP_MAYMOVE);
             cdb_instance->kvdata_size += want_size_rounded_to_kernel_pages;
             SXEA1(MAP_FAILED != cdb_instance->kvdata, "ERROR: FATAL: expected mremap() not to fail // %s(){}", __FUNCTION__);
+        }
+        else { /* epoch readers or a snapshot file may be using the old kvdata */
+            uint8_t  * kvdata_old      = cdb_instance->kvdata;
+            uint32_t   kvdata_size_old = cdb_instance->kvdata_size;
+            uint8_t  * kvdata_new      = sxe_cdb_map_copy(kvdata_old, cdb_instance->kvdata_used, kvdata_size_old + want_size_rounded_to_kernel_pages);
+            SXE_CDB_WRITE_BARRIER();
+            cdb_instance->kvdata       = kvdata_new;
+            cdb_instance->kvdata_size += want_size_rounded_to_kernel_pages;
+            cdb_instance->file_mapped &= ~SXE_CDB_FILE_MAPPED_KVDATA;
+            sxe_cdb_instance_unmap_old(cdb_instance, kvdata_old, kvdata_size_old);
+        }
     }
 
-    cdb_instance->sheets[sheet].row[row].hash_lo.u16[cell] = sxe_cdb_hash.u16[1];
-    cdb_instance->sheets[sheet].row[row].hash_hi.u16[cell] = sxe_cdb_hash.u16[0];
-    cdb_instance->sheets[sheet].row[row].hkv_pos.u32[cell] = k;
-
     SXE_CDB_HKV * hkv = (SXE_CDB_HKV *) &cdb_instance->kvdata[k];
     if      (1 == header_len) { hkv->header_len_1.flag = 0;                                                               hkv->header_len_1.key_len = sxe_cdb_key_len; hkv->header_len_1.val_len = val_len; memcpy(&hkv->header_len_1.content[0], sxe_cdb_key, sxe_cdb_key_len); memcpy(&hkv->header_len_1.content[sxe_cdb_key_len], val, val_len); }
     else if (3 == header_len) { hkv->header_len_3.flag = 1;                                                               hkv->header_len_3.key_len = sxe_cdb_key_len; hkv->header_len_3.val_len = val_len; memcpy(&hkv->header_len_3.content[0], sxe_cdb_key, sxe_cdb_key_len); memcpy(&hkv->header_len_3.content[sxe_cdb_key_len], val, val_len); }
     else if (5 == header_len) { hkv->header_len_5.flag = 0; hkv->header_len_5.xxx_len = 0; hkv->header_len_5.yyy_len = 0; hkv->header_len_5.key_len = sxe_cdb_key_len; hkv->header_len_5.val_len = val_len; memcpy(&hkv->header_len_5.content[0], sxe_cdb_key, sxe_cdb_key_len); memcpy(&hkv->header_len_5.content[sxe_cdb_key_len], val, val_len); }
     else if (8 == header_len) { hkv->header_len_8.flag = 0; hkv->header_len_8.xxx_len = 0; hkv->header_len_8.yyy_len = 1; hkv->header_len_8.key_len = sxe_cdb_key_len; hkv->header_len_8.val_len = val_len; memcpy(&hkv->header_len_8.content[0], sxe_cdb_key, sxe_cdb_key_len); memcpy(&hkv->header_len_8.content[sxe_cdb_key_len], val, val_len); }
 
+    cdb_instance->sheets[sheet].row[row].hash_lo.u16[cell] = sxe_cdb_hash.u16[1];
+    cdb_instance->sheets[sheet].row[row].hash_hi.u16[cell] = sxe_cdb_hash.u16[0];
+    SXE_CDB_WRITE_BARRIER(); /* readers finding hkv_pos see the hkv bytes & hashes */
+    cdb_instance->sheets[sheet].row[row].hkv_pos.u32[cell] = k;
+
     cdb_instance->kvdata_used       += key_bytes_want;
     cdb_instance->sheets_cells_used ++;
 
@@ -551,6 +948,78 @@ sxe_cdb_instance_get_uid_hkv_raw(SXE_CDB_INSTANCE * cdb_instance, SXE_CDB_UID ui
     return tls_hkv;
 } /* sxe_cdb_instance_get_uid_hkv_raw() */
 
+#define SXE_CDB_READ_HKV_IN_CELL_IN(ROW) \
+    hkv_pos = sheets[sheet].row[ROW].hkv_pos.u32[cell];                                            \
+    if ((hkv_pos)                                                                                  \
+    &&  (sxe_cdb_hash.u16[1] == sheets[sheet].row[ROW].hash_lo.u16[cell])                          \
+    &&  (sxe_cdb_hash.u16[0] == sheets[sheet].row[ROW].hash_hi.u16[cell])) {                       \
+        SXE_CDB_READ_BARRIER(); /* kvdata loaded after hkv_pos covers hkv_pos */                   \
+        tmp_hkv = (SXE_CDB_HKV *) &cdb_instance->kvdata[hkv_pos];                                  \
+        sxe_cdb_hkv_unpack(tmp_hkv, &sxe_cdb_tls_hkv_part);                                        \
+        if ((sxe_cdb_key_len ==        sxe_cdb_tls_hkv_part.key_len)                               \
+        &&  (0               == memcmp(sxe_cdb_tls_hkv_part.key, sxe_cdb_key, sxe_cdb_key_len))) { \
+            hkv = tmp_hkv; /* key exists! */                                                       \
+            goto SXE_EARLY_OUT;                                                                    \
+        }                                                                                          \
+    }
+
+/**
+ * Epoch reader version of sxe_cdb_instance_get_hkv_raw(); only call inside sxe_cdb_read_begin() & sxe_cdb_read_end().
+ * Does not count misses, so that concurrent readers don't write to the shared instance.
+ */
+SXE_CDB_HKV * /* NULL or direct pointer to SXE_CDB_HKV; valid until sxe_cdb_read_end() */
+sxe_cdb_instance_read_hkv(SXE_CDB_INSTANCE * cdb_instance)
+{
+    SXE_CDB_HKV * hkv = NULL; /* result */
+
+    SXEA6(sxe_cdb_reader_depth > 0, "ERROR: %s() called outside of a read section", __FUNCTION__);
+
+    uint16_t        sheet  = cdb_instance->sheets_index[sxe_cdb_hash.u16[0] % SXE_CDB_SHEETS_MAX];
+    SXE_CDB_READ_BARRIER(); /* sheets loaded after sheet index covers sheet */
+    SXE_CDB_SHEET * sheets = cdb_instance->sheets;
+    SXE_CDB_READ_BARRIER();
+
+    uint32_t      hkv_pos;
+    SXE_CDB_HKV * tmp_hkv;
+    uint32_t      cell   ;
+    uint32_t      row_1 = sxe_cdb_hash.u16[1] & (SXE_CDB_ROWS_PER_SHEET - 1);
+    uint32_t      row_2 = sxe_cdb_hash.u16[2] & (SXE_CDB_ROWS_PER_SHEET - 1);
+    for (cell = 0; cell < SXE_CDB_KEYS_PER_ROW; cell ++) {
+        SXE_CDB_READ_HKV_IN_CELL_IN(row_1);
+        SXE_CDB_READ_HKV_IN_CELL_IN(row_2);
+    }
+
+SXE_EARLY_OUT:;
+    SXEL6("%s(cdb_instance=?){} // return %p (%s)", __FUNCTION__, hkv, hkv ? "key exists" : "key doesn't exist");
+    return hkv;
+} /* sxe_cdb_instance_read_hkv() */
+
+SXE_CDB_HKV * /* NULL or direct pointer to SXE_CDB_HKV; valid until sxe_cdb_read_end() */
+sxe_cdb_instance_read_uid_hkv(SXE_CDB_INSTANCE * cdb_instance, SXE_CDB_UID uid)
+{
+    SXE_CDB_HKV * hkv = NULL; /* result */
+
+    SXEA6(sxe_cdb_reader_depth > 0, "ERROR: %s() called outside of a read section", __FUNCTION__);
+
+    uint32_t        cell        = uid.as_part.cell                       ; SXEA1(cell        < SXE_CDB_KEYS_PER_ROW  , "ERROR: INTERNAL: %u=cell        < %lu=SXE_CDB_KEYS_PER_ROW"  , cell       , SXE_CDB_KEYS_PER_ROW  );
+    uint32_t        row         = uid.as_part.row                        ; SXEA1(row         < SXE_CDB_ROWS_PER_SHEET, "ERROR: INTERNAL: %u=row         < %lu=SXE_CDB_ROWS_PER_SHEET", row        , SXE_CDB_ROWS_PER_SHEET);
+    uint16_t        sheet_index = uid.as_part.sheets_index_index         ; SXEA1(sheet_index < SXE_CDB_SHEETS_MAX    , "ERROR: INTERNAL: %u=sheet_index < %lu=SXE_CDB_SHEETS_MAX"    , sheet_index, SXE_CDB_SHEETS_MAX    );
+    uint16_t        sheet       = cdb_instance->sheets_index[sheet_index];
+    SXE_CDB_READ_BARRIER();
+    SXE_CDB_SHEET * sheets      = cdb_instance->sheets;
+    SXE_CDB_READ_BARRIER();
+    uint32_t        hkv_pos     = sheets[sheet].row[row].hkv_pos.u32[cell];
+
+    if (hkv_pos) {
+        SXE_CDB_READ_BARRIER();
+        hkv = (SXE_CDB_HKV *) &cdb_instance->kvdata[hkv_pos];
+        sxe_cdb_hkv_unpack(hkv, &sxe_cdb_tls_hkv_part);
+    }
+
+    SXEL6("%s(cdb_instance=?, uid=%010lx=ii[%04x]%03x-%01x){} // return %p", __FUNCTION__, uid.as_u64.u, uid.as_part.sheets_index_index, uid.as_part.row, uid.as_part.cell, hkv);
+    return hkv;
+} /* sxe_cdb_instance_read_uid_hkv() */
+
 SXE_CDB_HKV * /* NULL or tls SXE_CDB_HKV copy */
 sxe_cdb_instance_get_uid_hkv(SXE_CDB_INSTANCE * cdb_instance, SXE_CDB_UID uid)
 {
@@ -608,7 +1077,13 @@ sxe_cdb_instance_free_count_pop(SXE_CDB_INSTANCE * cdb_instance)
 
     if (0 == cdb_instance->counts_free) {
         cdb_instance->counts_pages ++; /* count extra page */
-        if (cdb_instance->counts) { cdb_instance->counts = mremap(cdb_instance->counts          , SXE_CDB_KERNEL_PAGE_BYTES * (cdb_instance->counts_pages - 1), SXE_CDB_KERNEL_PAGE_BYTES * cdb_instance->counts_pages, MREMAP_MAYMOVE                    ); }
+        if (cdb_instance->file_mapped & SXE_CDB_FILE_MAPPED_COUNTS) {
+            SXE_CDB_COUNT * counts_old = cdb_instance->counts;
+            cdb_instance->counts       = sxe_cdb_map_copy(counts_old, SXE_CDB_KERNEL_PAGE_BYTES * (cdb_instance->counts_pages - 1), SXE_CDB_KERNEL_PAGE_BYTES * cdb_instance->counts_pages);
+            cdb_instance->file_mapped &= ~SXE_CDB_FILE_MAPPED_COUNTS;
+            SXEA1(0 == munmap(counts_old, SXE_CDB_KERNEL_PAGE_BYTES * (cdb_instance->counts_pages - 1)), "ERROR: INTERNAL: munmap() failed for counts");
+        }
+        else if (cdb_instance->counts) { cdb_instance->counts = mremap(cdb_instance->counts          , SXE_CDB_KERNEL_PAGE_BYTES * (cdb_instance->counts_pages - 1), SXE_CDB_KERNEL_PAGE_BYTES * cdb_instance->counts_pages, MREMAP_MAYMOVE                    ); }
         else                      { cdb_instance->counts =   mmap(NULL /* kernel chooses addr */, SXE_CDB_KERNEL_PAGE_BYTES *  cdb_instance->counts_pages     , PROT_READ | PROT_WRITE                                , MAP_PRIVATE | MAP_ANONYMOUS, -1, 0); }
         SXEA1(MAP_FAILED != cdb_instance->counts, "ERROR: FATAL: expected m(re)map() not to fail // %s(){}", __FUNCTION__);
 
@@ -944,7 +1419,7 @@ sxe_cdb_ensemble_new(
     uint32_t keys_at_start ,
     uint64_t kvdata_maximum,
     uint32_t cdb_count     ,
-    uint32_t cdb_is_locked )
+    uint32_t cdb_is_locked ) /* SXE_CDB_ENSEMBLE_UNLOCKED, SXE_CDB_ENSEMBLE_LOCKED or SXE_CDB_ENSEMBLE_EPOCH_READERS */
 {
     SXE_CDB_ENSEMBLE * cdb_ensemble = NULL;
 
@@ -969,10 +1444,12 @@ sxe_cdb_ensemble_new(
         uint32_t i;
         for (i = 0; i < cdb_count; i++) {
             cdb_ensemble->cdb_instances[i] = sxe_cdb_instance_new(keys_at_start / cdb_count, kvdata_maximum / cdb_count);
+            cdb_ensemble->cdb_instances[i]->is_epoch = SXE_CDB_ENSEMBLE_EPOCH_READERS == cdb_is_locked ? 1 : 0;
             sxe_spinlock_construct(&cdb_ensemble->cdb_instance_locks[i]); /* in case we need locks */
         }
         cdb_ensemble->cdb_count     = cdb_count;
-        cdb_ensemble->cdb_is_locked = cdb_is_locked ? 1 : 0;
+        cdb_ensemble->cdb_is_locked = cdb_is_locked ? 1 : 0; /* epoch reader ensembles still lock writers */
+        cdb_ensemble->cdb_is_epoch  = SXE_CDB_ENSEMBLE_EPOCH_READERS == cdb_is_locked ? 1 : 0;
     }
 
     sxe_spinlock_give(&sxe_cdb_ensemble_lock);
@@ -991,6 +1468,10 @@ sxe_cdb_ensemble_destroy(SXE_CDB_ENSEMBLE * cdb_ensemble)
         SXEL5("%s() failed to acquire sxe_cdb_ensemble_lock; trying again", __FUNCTION__); /* COVERAGE EXCLUSION: todo: create multi-threaded test to show this informational lock message */
     }
 
+    if (cdb_ensemble->cdb_is_epoch) {
+        sxe_cdb_read_synchronize(); /* wait for any readers still looking at the instances */
+    }
+
     SXEL6("destroying array of cdb pointers:");
     for (i = 0; i < cdb_ensemble->cdb_count; i++) {
         sxe_cdb_instance_destroy(cdb_ensemble->cdb_instances[i]);
@@ -1035,8 +1516,28 @@ sxe_cdb_ensemble_reboot(SXE_CDB_ENSEMBLE * cdb_ensemble)
         SXE_CDB_ENSEMBLE_INSTANCE_LOCK_BEFORE(cdb_ensemble, sxe_cdb_ensemble_reboot);
     }
 
-    for (instance = 0; instance < cdb_ensemble->cdb_count; instance++) {
-        sxe_cdb_instance_reboot(cdb_ensemble->cdb_instances[instance]);
+    if (! cdb_ensemble->cdb_is_epoch) {
+        for (instance = 0; instance < cdb_ensemble->cdb_count; instance++) {
+            sxe_cdb_instance_reboot(cdb_ensemble->cdb_instances[instance]);
+        }
+    }
+    else { /* epoch readers may be using the instances; publish fresh instances and destroy the old ones after a grace period */
+        SXE_CDB_INSTANCE * cdb_instances_old[cdb_ensemble->cdb_count];
+
+        for (instance = 0; instance < cdb_ensemble->cdb_count; instance++) {
+            SXE_CDB_INSTANCE * cdb_instance = cdb_ensemble->cdb_instances[instance];
+            cdb_instances_old[instance]     = cdb_instance;
+            SXE_CDB_INSTANCE * cdb_instance_new = sxe_cdb_instance_new(cdb_instance->keys_at_start, cdb_instance->kvdata_maximum);
+            cdb_instance_new->is_epoch      = 1;
+            SXE_CDB_WRITE_BARRIER();
+            cdb_ensemble->cdb_instances[instance] = cdb_instance_new;
+        }
+
+        sxe_cdb_read_synchronize();
+
+        for (instance = 0; instance < cdb_ensemble->cdb_count; instance++) {
+            sxe_cdb_instance_destroy(cdb_instances_old[instance]);
+        }
     }
 
     for (instance = 0; instance < cdb_ensemble->cdb_count; instance++) {
@@ -1048,6 +1549,78 @@ sxe_cdb_ensemble_reboot(SXE_CDB_ENSEMBLE * cdb_ensemble)
     SXER6("return");
 } /* sxe_cdb_ensemble_reboot() */
 
+/**
+ * Save each instance of an ensemble with sxe_cdb_instance_save() to <path>.<instance>, locking each instance in turn if
+ * the ensemble is locked.
+ */
+SXE_RETURN
+sxe_cdb_ensemble_save(SXE_CDB_ENSEMBLE * cdb_ensemble, const char * path)
+{
+    SXE_RETURN result = SXE_RETURN_OK;
+    uint32_t   instance;
+    char       path_instance[PATH_MAX];
+
+    SXEE6("(cdb_ensemble=?, path=%s)", path);
+
+    for (instance = 0; instance < cdb_ensemble->cdb_count && result == SXE_RETURN_OK; instance++) {
+        if ((unsigned) snprintf(path_instance, sizeof(path_instance), "%s.%u", path, instance) >= sizeof(path_instance)) {
+            SXEL3("WARNING: %s(): path too long: %s", __FUNCTION__, path);
+            result = SXE_RETURN_ERROR_WRITE_FAILED;
+            break;
+        }
+
+        SXE_CDB_ENSEMBLE_INSTANCE_LOCK_BEFORE(cdb_ensemble, sxe_cdb_ensemble_save);
+        result =                                   sxe_cdb_instance_save(cdb_ensemble->cdb_instances[instance], path_instance);
+        SXE_CDB_ENSEMBLE_INSTANCE_UNLOCK(     cdb_ensemble);
+    }
+
+    SXER6("return %s", sxe_return_to_string(result));
+    return result;
+} /* sxe_cdb_ensemble_save() */
+
+/**
+ * Load an ensemble saved by sxe_cdb_ensemble_save(); the instance count must match the count it was saved with, because
+ * keys are spread over the instances by hash.
+ *
+ * @return The ensemble, or NULL if any instance can't be loaded (logged)
+ */
+SXE_CDB_ENSEMBLE *
+sxe_cdb_ensemble_load(
+    const char * path         ,
+    uint32_t     cdb_count    ,
+    uint32_t     cdb_is_locked, /* SXE_CDB_ENSEMBLE_UNLOCKED, SXE_CDB_ENSEMBLE_LOCKED or SXE_CDB_ENSEMBLE_EPOCH_READERS */
+    uint32_t     verify       ) /* 1 to checksum all memory; see sxe_cdb_instance_load() */
+{
+    SXE_CDB_ENSEMBLE * cdb_ensemble;
+    SXE_CDB_INSTANCE * cdb_instance;
+    uint32_t           instance;
+    char               path_instance[PATH_MAX];
+
+    SXEE6("(path=%s, cdb_count=%u, cdb_is_locked=%u, verify=%u)", path, cdb_count, cdb_is_locked, verify);
+
+    if (NULL == (cdb_ensemble = sxe_cdb_ensemble_new(0 /* minimum size; replaced below */, 0, cdb_count, cdb_is_locked))) {
+        goto SXE_EARLY_OUT;
+    }
+
+    for (instance = 0; instance < cdb_count; instance++) {
+        if ((unsigned) snprintf(path_instance, sizeof(path_instance), "%s.%u", path, instance) >= sizeof(path_instance)
+         || NULL == (cdb_instance = sxe_cdb_instance_load(path_instance, verify))) {
+            SXEL3("WARNING: %s(): can't load instance %u of %u from %s", __FUNCTION__, instance, cdb_count, path);
+            sxe_cdb_ensemble_destroy(cdb_ensemble);
+            cdb_ensemble = NULL;
+            goto SXE_EARLY_OUT;
+        }
+
+        cdb_instance->is_epoch = cdb_ensemble->cdb_is_epoch;
+        sxe_cdb_instance_destroy(cdb_ensemble->cdb_instances[instance]);
+        cdb_ensemble->cdb_instances[instance] = cdb_instance;
+    }
+
+SXE_EARLY_OUT:
+    SXER6("return %p=cdb_ensemble", cdb_ensemble);
+    return cdb_ensemble;
+} /* sxe_cdb_ensemble_load() */
+
 /**
  * USE WITH CAUTION: Caller responsible for unlock!
  *
@@ -1174,6 +1747,49 @@ sxe_cdb_ensemble_get_uid_hkv(SXE_CDB_ENSEMBLE * cdb_ensemble, SXE_CDB_UID uid)
     return tls_hkv;
 } /* sxe_cdb_ensemble_get_uid_hkv() */
 
+/**
+ * Lock free, copy free lookups for ensembles created with SXE_CDB_ENSEMBLE_EPOCH_READERS.
+ *
+ * Only call these inside sxe_cdb_read_begin() & sxe_cdb_read_end(). The returned hkv, and the key and value pointers in
+ * sxe_cdb_tls_hkv_part, point into the instance's kvdata and remain valid until sxe_cdb_read_end(), even if a writer
+ * grows the instance or the instances are swapped or rebooted in the meantime.
+ */
+
+SXE_CDB_HKV * /* NULL or direct pointer to SXE_CDB_HKV; valid until sxe_cdb_read_end() */
+sxe_cdb_ensemble_read_hkv(SXE_CDB_ENSEMBLE * cdb_ensemble)
+{
+    SXE_CDB_HKV * hkv;
+
+    SXEE6("(cdb_ensemble=?)");
+    SXEA6(cdb_ensemble->cdb_is_epoch, "ERROR: %s() needs an ensemble created with SXE_CDB_ENSEMBLE_EPOCH_READERS", __FUNCTION__);
+
+    uint32_t               instance = sxe_cdb_hash.u16[3] % cdb_ensemble->cdb_count;
+    SXE_CDB_INSTANCE * cdb_instance =                       cdb_ensemble->cdb_instances[instance];
+    SXE_CDB_READ_BARRIER(); /* instance loaded before its sheets & kvdata */
+
+    hkv = sxe_cdb_instance_read_hkv(cdb_instance);
+
+    SXER6("return hkv=%p (%s); sxe_cdb_tls_hkv_part: .key_len=%u  .val_len=%u", hkv, NULL == hkv ? "key doesn't exist" : "key exists", sxe_cdb_tls_hkv_part.key_len, sxe_cdb_tls_hkv_part.val_len);
+    return hkv;
+} /* sxe_cdb_ensemble_read_hkv() */
+
+SXE_CDB_HKV * /* NULL or direct pointer to SXE_CDB_HKV; valid until sxe_cdb_read_end() */
+sxe_cdb_ensemble_read_uid_hkv(SXE_CDB_ENSEMBLE * cdb_ensemble, SXE_CDB_UID uid)
+{
+    SXE_CDB_HKV * hkv;
+
+    SXEE6("(cdb_ensemble=?, uid=%010lx=%02x[%04x]%03x-%01x", uid.as_u64.u, uid.as_part.instance, uid.as_part.sheets_index_index, uid.as_part.row, uid.as_part.cell);
+    SXEA6(cdb_ensemble->cdb_is_epoch, "ERROR: %s() needs an ensemble created with SXE_CDB_ENSEMBLE_EPOCH_READERS", __FUNCTION__);
+
+    SXE_CDB_INSTANCE * cdb_instance = cdb_ensemble->cdb_instances[uid.as_part.instance];
+    SXE_CDB_READ_BARRIER();
+
+    hkv = sxe_cdb_instance_read_uid_hkv(cdb_instance, uid);
+
+    SXER6("return hkv=%p // sxe_cdb_tls_hkv_part.val_len=%u", hkv, sxe_cdb_tls_hkv_part.val_len);
+    return hkv;
+} /* sxe_cdb_ensemble_read_uid_hkv() */
+
 void /* only call this function directly *after* sxe_cdb_ensemble_set_uid_hkv() */
 sxe_cdb_ensemble_set_uid_hkv(SXE_CDB_ENSEMBLE * cdb_ensemble, SXE_CDB_UID uid)
 {
@@ -1278,7 +1894,9 @@ sxe_cdb_ensemble_kvdata_used(
  * another thread creates a brand new unlocked (read: faster
  * creation) sxe cdb ensemble that it wants the threads to start
  * using. This function can be used to swap in the underlying
- * instances in a locked way.
+ * instances in a locked way. If either ensemble has epoch
+ * readers then it returns once no reader can still be looking
+ * at a swapped out instance.
  */
 
 void
@@ -1293,10 +1911,17 @@ sxe_cdb_ensemble_swap_instances(
         SXE_CDB_ENSEMBLE_INSTANCE_LOCK_BEFORE(this_cdb_ensemble, this_cdb_ensemble);
         SXE_CDB_ENSEMBLE_INSTANCE_LOCK_BEFORE(that_cdb_ensemble, that_cdb_ensemble);
         struct SXE_CDB_INSTANCE * temp             = this_cdb_ensemble->cdb_instances[instance];
+        temp->is_epoch                             = that_cdb_ensemble->cdb_is_epoch; /* instances grow the way their new ensemble's readers need */
+        that_cdb_ensemble->cdb_instances[instance]->is_epoch = this_cdb_ensemble->cdb_is_epoch;
+        SXE_CDB_WRITE_BARRIER();
         this_cdb_ensemble->cdb_instances[instance] = that_cdb_ensemble->cdb_instances[instance];
         that_cdb_ensemble->cdb_instances[instance] = temp;
         SXE_CDB_ENSEMBLE_INSTANCE_UNLOCK(     that_cdb_ensemble);
         SXE_CDB_ENSEMBLE_INSTANCE_UNLOCK(     this_cdb_ensemble);
 
     }
+
+    if (this_cdb_ensemble->cdb_is_epoch || that_cdb_ensemble->cdb_is_epoch) {
+        sxe_cdb_read_synchronize(); /* no epoch reader is still looking at a swapped out instance once we return */
+    }
 } /* sxe_cdb_ensemble_swap_instances() */
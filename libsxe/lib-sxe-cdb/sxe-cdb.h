@@ -189,8 +189,35 @@ typedef union SXE_CDB_HASH {
 #define SXE_CDB_HKV_POS_NONE 0
 #define SXE_CDB_UID_NONE     UINT64_MAX
 
+#define SXE_CDB_ENSEMBLE_UNLOCKED      0 /* sxe_cdb_ensemble_new() cdb_is_locked: single-threaded use                                   */
+#define SXE_CDB_ENSEMBLE_LOCKED        1 /* sxe_cdb_ensemble_new() cdb_is_locked: per instance spinlocks                                */
+#define SXE_CDB_ENSEMBLE_EPOCH_READERS 2 /* sxe_cdb_ensemble_new() cdb_is_locked: per instance spinlocks for writers, epochs for readers */
+
+/**
+ * - Epoch readers:
+ *   - An ensemble created with SXE_CDB_ENSEMBLE_EPOCH_READERS
+ *     allows any thread to look up keys without locks and
+ *     without copying the hkv into tls:
+ *       sxe_cdb_read_begin();
+ *       sxe_cdb_prepare(key, key_len);
+ *       hkv = sxe_cdb_ensemble_read_hkv(cdb_ensemble);
+ *       ... use sxe_cdb_tls_hkv_part.key & .val directly ...
+ *       sxe_cdb_read_end();
+ *   - The hkv pointers stay valid until sxe_cdb_read_end().
+ *   - Writers still take the per instance spinlocks. Instead of
+ *     mremap()ing, growth copies into a new mapping, publishes
+ *     it, and unmaps the old mapping once all readers which may
+ *     be looking at it have left their read sections. Growth
+ *     is geometric to keep the copying cheap.
+ *   - Do not put keys, swap or reboot from inside a read
+ *     section; the writer would wait for itself.
+ *   - Values updated in place via sxe_cdb_*_set_uid_hkv() are
+ *     not updated atomically for readers.
+ */
+
 /**
- * - With the exception of sxe_cdb_instance_get_hkv() then all
+ * - With the exception of sxe_cdb_instance_get_hkv() and the
+ *   sxe_cdb_ensemble_read_*() functions then all
  *   functions returning an hkv pointer actually return a
  *   pointer to a tls copy of the hkv.
  *   - Why? Because if we returned an hkv pointer to the real
@@ -20,7 +20,11 @@
  */
 
 #include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "sxe-cdb-private.h"
 #include "sxe-log.h"
@@ -36,6 +40,126 @@
     is(                    sxe_cdb_tls_hkv_part.key_len, KEY_LEN , "%s: %s: hkv_part.key_len   is       as expected", VARIANT, SUB_VARIANT); \
     ok(0    == memcmp(KEY, sxe_cdb_tls_hkv_part.key    , KEY_LEN), "%s: %s: hkv_part.key bytes are      as expected", VARIANT, SUB_VARIANT);
 
+#define TEST_READERS_MAX 4
+
+typedef struct TEST_READER {
+    SXE_CDB_ENSEMBLE * cdb_ensemble;
+    uint32_t           keys        ; /* look up keys 0 to keys - 1                       */
+    uint32_t           is_locked   ; /* look up with spinlocks instead of in read sections */
+    uint64_t           lookups     ;
+    uint64_t           found       ; /* keys found with the expected value                */
+} TEST_READER;
+
+static volatile int test_reader_until_writer_done = 0; /* keep looking up keys until the writer clears this */
+
+static void *
+test_reader_thread(void * arg)
+{
+    TEST_READER * reader = arg;
+    SXE_CDB_HKV * hkv;
+    uint32_t      i;
+
+    do {
+        for (i = 0; i < reader->keys; i++) {
+            sxe_cdb_prepare((const uint8_t *) &i, sizeof(i));
+
+            if (reader->is_locked) {
+                hkv = sxe_cdb_ensemble_get_hkv_raw_locked(reader->cdb_ensemble);
+            }
+            else {
+                sxe_cdb_read_begin();
+                hkv = sxe_cdb_ensemble_read_hkv(reader->cdb_ensemble);
+            }
+
+            reader->lookups ++;
+            reader->found   += hkv && sizeof(i) == sxe_cdb_tls_hkv_part.val_len && i == *((uint32_t *) sxe_cdb_tls_hkv_part.val) ? 1 : 0;
+
+            if (reader->is_locked) {
+                sxe_cdb_ensemble_get_hkv_raw_unlock(reader->cdb_ensemble);
+            }
+            else {
+                sxe_cdb_read_end();
+            }
+        }
+    } while (test_reader_until_writer_done);
+
+    sxe_cdb_read_thread_exit();
+    return NULL;
+} /* test_reader_thread() */
+
+static uint64_t /* total keys found by all readers */
+test_readers_run(SXE_CDB_ENSEMBLE * cdb_ensemble, uint32_t keys, uint32_t readers, uint32_t is_locked)
+{
+    TEST_READER reader[TEST_READERS_MAX];
+    pthread_t   thread[TEST_READERS_MAX];
+    SXE_TIME    start_time = sxe_time_get();
+    uint64_t    found      = 0;
+    uint32_t    r;
+
+    for (r = 0; r < readers; r++) {
+        reader[r].cdb_ensemble = cdb_ensemble;
+        reader[r].keys         = keys        ;
+        reader[r].is_locked    = is_locked   ;
+        reader[r].lookups      = 0           ;
+        reader[r].found        = 0           ;
+        SXEA1(0 == pthread_create(&thread[r], NULL, test_reader_thread, &reader[r]), "ERROR: INTERNAL: pthread_create() failed");
+    }
+
+    for (r = 0; r < readers; r++) {
+        SXEA1(0 == pthread_join(thread[r], NULL), "ERROR: INTERNAL: pthread_join() failed");
+        found += reader[r].found;
+    }
+
+    SXEL5("test: ensemble: %s %u threads looked up %u keys each in %6.2f seconds or %8u keys per second", is_locked ? "locked" : "epoch ", readers, keys,
+          sxe_time_to_double_seconds(sxe_time_get() - start_time), (unsigned)(((uint64_t)keys * readers << 32) / (sxe_time_get() - start_time)));
+    return found;
+} /* test_readers_run() */
+
+#define TEST_SNAPSHOT         "test-sxe-cdb-snapshot"
+#define TEST_SNAPSHOT_COUNTED 0x80000000 /* key numbers from here on are only ever counted */
+#define TEST_SNAPSHOT_SHEETS  ((sizeof(SXE_CDB_SNAPSHOT) + SXE_CDB_KERNEL_PAGE_BYTES - 1) / SXE_CDB_KERNEL_PAGE_BYTES * SXE_CDB_KERNEL_PAGE_BYTES)
+
+static void
+test_snapshot_prepare(uint32_t i) /* random looking 16 byte key for key number i */
+{
+    static uint64_t key[2]; /* sxe_cdb_prepare() keeps a pointer to the key */
+
+    MurmurHash3_xnn_128((const uint8_t *) &i, sizeof(i), 12345, &key[0]);
+    sxe_cdb_prepare((const uint8_t *) &key[0], sizeof(key));
+}
+
+static uint32_t /* number of keys from first to first + keys - 1 found with their own key number as value */
+test_snapshot_found(SXE_CDB_INSTANCE * cdb_instance, uint32_t first, uint32_t keys)
+{
+    SXE_CDB_HKV_PART hkv_part;
+    SXE_CDB_HKV    * hkv;
+    uint32_t         found = 0;
+    uint32_t         i;
+
+    for (i = first; i < first + keys; i++) {
+        test_snapshot_prepare(i);
+
+        if (NULL != (hkv = sxe_cdb_instance_get_hkv_raw(cdb_instance))) {
+            sxe_cdb_hkv_unpack(hkv, &hkv_part);
+            found += hkv_part.val_len == sizeof(i) && 0 == memcmp(hkv_part.val, &i, sizeof(i));
+        }
+    }
+
+    return found;
+}
+
+static void
+test_snapshot_corrupt(const char * path, off_t offset) /* flip a byte in a snapshot file */
+{
+    uint8_t byte;
+    int     fd = open(path, O_RDWR);
+
+    SXEA1(fd >= 0 && 1 == pread(fd, &byte, 1, offset), "ERROR: INTERNAL: can't read %s", path);
+    byte ^= 0xff;
+    SXEA1(1 == pwrite(fd, &byte, 1, offset), "ERROR: INTERNAL: can't write %s", path);
+    close(fd);
+}
+
 static void
 test_runaway_variant(
     int variant,
@@ -139,7 +263,7 @@ main(void)
     uint8_t  header_len_5_key[KEY_HEADER_LEN_5_KEY_LEN_MAX]; /* 65535 bytes */
     uint8_t  header_len_8_key[KEY_HEADER_LEN_5_KEY_LEN_MAX + 1 /* 2^24 too big :-) */];
 
-    plan_tests(223);
+    plan_tests(256);
 
     /* tests for key count double double linked lists; different runaway variants test different linked list fine details :-) */
 
@@ -242,6 +366,121 @@ main(void)
         sxe_cdb_ensemble_destroy(this_cdb_ensemble);
     }
 
+    /* test sxe_cdb_instance_save() & sxe_cdb_instance_load() round trip a large random key set */
+
+    {
+        SXE_CDB_INSTANCE * cdb_instance = sxe_cdb_instance_new(0 /* grow from minimum size */, 0 /* grow to maximum allowed size */);
+        SXE_CDB_INSTANCE * cdb_loaded;
+        uint32_t           snapshot_keys = 200000;
+
+        for (i = 0; i < snapshot_keys; i++) {
+                  test_snapshot_prepare   (i);
+            SXEA1(sxe_cdb_instance_put_val(cdb_instance, (const uint8_t *) &i, sizeof(i)) != SXE_CDB_UID_NONE, "ERROR: INTERNAL: sxe_cdb_instance_put_val() unexpectedly failing");
+        }
+
+        for (i = TEST_SNAPSHOT_COUNTED; i < TEST_SNAPSHOT_COUNTED + 1000; i++) {
+                  test_snapshot_prepare(i);
+            SXEA1(sxe_cdb_instance_inc (cdb_instance, 0 /* counts_list */) == 1, "ERROR: INTERNAL: sxe_cdb_instance_inc() unexpectedly failing");
+        }
+
+        unlink(TEST_SNAPSHOT);
+        is(sxe_cdb_instance_load(TEST_SNAPSHOT, 0),                    NULL,          "snapshot: loading a missing snapshot fails");
+        start_time = sxe_time_get();
+        is(sxe_cdb_instance_save(cdb_instance, TEST_SNAPSHOT),         SXE_RETURN_OK, "snapshot: saved %u keys", snapshot_keys);
+        SXEL5("test: snapshot: saved %u keys in %6.3f seconds", snapshot_keys, sxe_time_to_double_seconds(sxe_time_get() - start_time));
+        ok(access(TEST_SNAPSHOT ".tmp", F_OK) != 0,                                   "snapshot: temporary file was renamed");
+        sxe_cdb_instance_destroy(cdb_instance);
+
+        start_time = sxe_time_get();
+        ok((cdb_loaded = sxe_cdb_instance_load(TEST_SNAPSHOT, 0))   != NULL,          "snapshot: loaded without verifying");
+        SXEL5("test: snapshot: loaded %u keys in %6.6f seconds", snapshot_keys, sxe_time_to_double_seconds(sxe_time_get() - start_time));
+        is(test_snapshot_found(cdb_loaded, 0, snapshot_keys),          snapshot_keys, "snapshot: found all %u keys with their values", snapshot_keys);
+        test_snapshot_prepare(TEST_SNAPSHOT_COUNTED);
+        is(sxe_cdb_instance_inc(cdb_loaded, 0 /* counts_list */),      2,             "snapshot: count survived the round trip");
+
+        for (i = snapshot_keys; i < 2 * snapshot_keys; i++) { /* grow the sheets, kvdata & counts out of the file mapping */
+                  test_snapshot_prepare   (i);
+            SXEA1(sxe_cdb_instance_put_val(cdb_loaded, (const uint8_t *) &i, sizeof(i)) != SXE_CDB_UID_NONE, "ERROR: INTERNAL: sxe_cdb_instance_put_val() unexpectedly failing after load");
+        }
+
+        for (i = 1; i <= 400; i++) { /* give keys distinct counts so that the counts need more pages */
+            uint32_t j;
+            for (j = 0; j < i; j++) {
+                      test_snapshot_prepare(TEST_SNAPSHOT_COUNTED + i);
+                SXEA1(sxe_cdb_instance_inc (cdb_loaded, 0 /* counts_list */) == 2 + j, "ERROR: INTERNAL: sxe_cdb_instance_inc() unexpectedly failing after load");
+            }
+        }
+
+        is(cdb_loaded->file_mapped,                                    0,             "snapshot: all memory was copied out of the file mapping when growing");
+        is(test_snapshot_found(cdb_loaded, 0, 2 * snapshot_keys),  2 * snapshot_keys, "snapshot: found all %u keys after growing", 2 * snapshot_keys);
+        sxe_cdb_instance_destroy(cdb_loaded);
+
+        ok((cdb_loaded = sxe_cdb_instance_load(TEST_SNAPSHOT, 1))   != NULL,          "snapshot: loaded again with verifying; puts didn't change the file");
+        is(test_snapshot_found(cdb_loaded, 0, 2 * snapshot_keys),      snapshot_keys, "snapshot: found only the %u saved keys", snapshot_keys);
+        sxe_cdb_instance_destroy(cdb_loaded);
+
+        SXEA1(chmod(TEST_SNAPSHOT, 0444) == 0, "ERROR: INTERNAL: can't make %s read-only", TEST_SNAPSHOT);
+        ok((cdb_loaded = sxe_cdb_instance_load(TEST_SNAPSHOT, 1))   != NULL,          "snapshot: a read-only snapshot can be loaded");
+        sxe_cdb_instance_destroy(cdb_loaded);
+        SXEA1(chmod(TEST_SNAPSHOT, 0644) == 0, "ERROR: INTERNAL: can't make %s writable", TEST_SNAPSHOT);
+
+        test_snapshot_corrupt(TEST_SNAPSHOT, TEST_SNAPSHOT_SHEETS + 1); /* first sheet */
+        ok((cdb_loaded = sxe_cdb_instance_load(TEST_SNAPSHOT, 0))   != NULL,          "snapshot: corrupt data isn't noticed without verifying");
+        sxe_cdb_instance_destroy(cdb_loaded);
+        is(sxe_cdb_instance_load(TEST_SNAPSHOT, 1),                    NULL,          "snapshot: corrupt data is noticed when verifying");
+        test_snapshot_corrupt(TEST_SNAPSHOT, TEST_SNAPSHOT_SHEETS + 1);
+        test_snapshot_corrupt(TEST_SNAPSHOT, offsetof(SXE_CDB_SNAPSHOT, instance) + offsetof(SXE_CDB_INSTANCE, kvdata_used));
+        is(sxe_cdb_instance_load(TEST_SNAPSHOT, 0),                    NULL,          "snapshot: corrupt header is always noticed");
+        test_snapshot_corrupt(TEST_SNAPSHOT, offsetof(SXE_CDB_SNAPSHOT, instance) + offsetof(SXE_CDB_INSTANCE, kvdata_used));
+        test_snapshot_corrupt(TEST_SNAPSHOT, 0);
+        is(sxe_cdb_instance_load(TEST_SNAPSHOT, 0),                    NULL,          "snapshot: bad magic is noticed");
+        test_snapshot_corrupt(TEST_SNAPSHOT, 0);
+        SXEA1(0 == truncate(TEST_SNAPSHOT, TEST_SNAPSHOT_SHEETS + SXE_CDB_KERNEL_PAGE_BYTES), "ERROR: INTERNAL: can't truncate %s", TEST_SNAPSHOT);
+        is(sxe_cdb_instance_load(TEST_SNAPSHOT, 0),                    NULL,          "snapshot: truncated snapshot is noticed");
+        unlink(TEST_SNAPSHOT);
+    }
+
+    /* test sxe_cdb_ensemble_save() & sxe_cdb_ensemble_load() */
+
+    {
+        uint32_t           instances    = 8;
+        uint32_t           ensemble_keys = 10000;
+        SXE_CDB_ENSEMBLE * cdb_ensemble = sxe_cdb_ensemble_new(0 /* grow from minimum size */, 0 /* grow to maximum allowed size */, instances /* number of cdb instances */, 1 /* locked */);
+        SXE_CDB_ENSEMBLE * cdb_loaded;
+        SXE_CDB_UID        uids[ensemble_keys];
+        SXE_CDB_HKV      * hkv;
+        uint32_t           found;
+
+        for (i = 0; i < ensemble_keys; i++) {
+                                         test_snapshot_prepare   (i);
+                        uids[i].as_u64.u = sxe_cdb_ensemble_put_val(cdb_ensemble, (const uint8_t *) &i, sizeof(i));
+            SXEA1(SXE_CDB_UID_NONE != uids[i].as_u64.u, "ERROR: INTERNAL: sxe_cdb_ensemble_put_val() unexpectedly failing");
+        }
+
+        is(sxe_cdb_ensemble_save(cdb_ensemble, TEST_SNAPSHOT),                               SXE_RETURN_OK, "snapshot: saved ensemble");
+        sxe_cdb_ensemble_destroy(cdb_ensemble);
+        ok((cdb_loaded = sxe_cdb_ensemble_load(TEST_SNAPSHOT, instances, SXE_CDB_ENSEMBLE_EPOCH_READERS, 1)) != NULL, "snapshot: loaded ensemble for epoch readers");
+
+        sxe_cdb_read_begin();
+        for (found = 0, i = 0; i < ensemble_keys; i++) {
+                             test_snapshot_prepare    (i);
+            found += NULL != (hkv = sxe_cdb_ensemble_read_hkv(cdb_loaded)) && sxe_cdb_ensemble_get_uid(cdb_loaded) == uids[i].as_u64.u;
+        }
+        sxe_cdb_read_end();
+
+        is(found,                                                                            ensemble_keys, "snapshot: found all %u ensemble keys with their uids", ensemble_keys);
+        sxe_cdb_ensemble_destroy(cdb_loaded);
+
+        unlink(TEST_SNAPSHOT ".7");
+        is(sxe_cdb_ensemble_load(TEST_SNAPSHOT, instances, SXE_CDB_ENSEMBLE_LOCKED, 0),     NULL,          "snapshot: loading an ensemble with a missing instance fails");
+
+        for (i = 0; i < instances; i++) {
+            char path_instance[64];
+            snprintf(path_instance, sizeof(path_instance), "%s.%u", TEST_SNAPSHOT, i);
+            unlink(path_instance);
+        }
+    }
+
     /* test sxe_cdb_ensemble_set_uid_hkv() & sxe_cdb_ensemble_get_hkv_locked() & sxe_cdb_ensemble_get_hkv_unlock() */
 
     {
@@ -501,6 +740,86 @@ main(void)
         sxe_cdb_ensemble_destroy(cdb_ensemble);
     }
 
+    /* tests for epoch readers; lock free lookups without tls copies, also while writers grow the instances */
+
+    {
+        uint32_t           instances    = 8;
+        SXE_CDB_ENSEMBLE * cdb_ensemble = sxe_cdb_ensemble_new(0 /* grow from minimum size */, 0 /* grow to maximum allowed size */, instances /* number of cdb instances */, SXE_CDB_ENSEMBLE_EPOCH_READERS);
+        SXE_CDB_UID        uid;
+        SXE_CDB_HKV      * hkv;
+        uint32_t           readers;
+        uint64_t           found;
+
+        for (i = 0; i < keys; i++) {
+                                                     sxe_cdb_prepare         ((const uint8_t *) &i, sizeof(i));
+            SXEA1(SXE_CDB_UID_NONE != sxe_cdb_ensemble_put_val(cdb_ensemble, (const uint8_t *) &i, sizeof(i)), "ERROR: INTERNAL: sxe_cdb_ensemble_put_val() unexpectedly failing");
+        }
+
+        i = 7;
+        sxe_cdb_prepare((const uint8_t *) &i, sizeof(i));
+        uid.as_u64.u = sxe_cdb_ensemble_get_uid(cdb_ensemble);
+        sxe_cdb_read_begin();
+        hkv          = sxe_cdb_ensemble_read_hkv(cdb_ensemble);
+        ok(NULL != hkv                                               , "epoch: read key in read section");
+        is(*((uint32_t *) sxe_cdb_tls_hkv_part.val), 7               , "epoch: value points at the expected bytes");
+        is(sxe_cdb_ensemble_read_uid_hkv(cdb_ensemble, uid), hkv     , "epoch: read by uid returns the same hkv; no copy");
+        i = keys;
+        sxe_cdb_prepare((const uint8_t *) &i, sizeof(i));
+        ok(NULL == sxe_cdb_ensemble_read_hkv(cdb_ensemble)           , "epoch: missing key not found");
+        sxe_cdb_read_end();
+
+        for (readers = 1; readers <= TEST_READERS_MAX; readers *= 2) {
+            is(test_readers_run(cdb_ensemble, keys, readers, 0 /* epoch  */), (uint64_t)keys * readers, "epoch: %u threads found all keys in read sections", readers);
+            is(test_readers_run(cdb_ensemble, keys, readers, 1 /* locked */), (uint64_t)keys * readers, "epoch: %u threads found all keys with locks"      , readers);
+        }
+
+        TEST_READER reader[2];
+        pthread_t   thread[2];
+
+        test_reader_until_writer_done = 1;
+        for (readers = 0; readers < 2; readers++) {
+            reader[readers].cdb_ensemble = cdb_ensemble;
+            reader[readers].keys         = keys        ;
+            reader[readers].is_locked    = 0           ;
+            reader[readers].lookups      = 0           ;
+            reader[readers].found        = 0           ;
+            SXEA1(0 == pthread_create(&thread[readers], NULL, test_reader_thread, &reader[readers]), "ERROR: INTERNAL: pthread_create() failed");
+        }
+
+        start_time = sxe_time_get();
+        for (i = keys; i < 2 * keys; i++) { /* grow every instance's sheets & kvdata under the readers */
+                                                     sxe_cdb_prepare         ((const uint8_t *) &i, sizeof(i));
+            SXEA1(SXE_CDB_UID_NONE != sxe_cdb_ensemble_put_val(cdb_ensemble, (const uint8_t *) &i, sizeof(i)), "ERROR: INTERNAL: sxe_cdb_ensemble_put_val() unexpectedly failing");
+        }
+        elapsed_time = sxe_time_to_double_seconds(sxe_time_get() - start_time);
+        SXEL5("test: ensemble: epoch put-val %u keys under 2 reader threads in %6.2f seconds", keys, elapsed_time);
+
+        test_reader_until_writer_done = 0;
+        for (readers = 0; readers < 2; readers++) {
+            SXEA1(0 == pthread_join(thread[readers], NULL), "ERROR: INTERNAL: pthread_join() failed");
+        }
+
+        is(reader[0].found + reader[1].found, reader[0].lookups + reader[1].lookups, "epoch: no existing key was missed while the writer grew the instances");
+
+        for (found = 0, i = 0; i < 2 * keys; i++) {
+            sxe_cdb_read_begin();
+            sxe_cdb_prepare((const uint8_t *) &i, sizeof(i));
+            hkv    = sxe_cdb_ensemble_read_hkv(cdb_ensemble);
+            found += hkv && i == *((uint32_t *) sxe_cdb_tls_hkv_part.val) ? 1 : 0;
+            sxe_cdb_read_end();
+        }
+        is(found, 2 * keys, "epoch: all keys found after growing");
+
+        sxe_cdb_ensemble_reboot(cdb_ensemble);
+        i = 7;
+        sxe_cdb_read_begin();
+        sxe_cdb_prepare((const uint8_t *) &i, sizeof(i));
+        ok(NULL == sxe_cdb_ensemble_read_hkv(cdb_ensemble), "epoch: key not found after reboot");
+        sxe_cdb_read_end();
+
+        sxe_cdb_ensemble_destroy(cdb_ensemble);
+    }
+
     /* stress test cdb ensemble inc */
 
     {
@@ -41,7 +41,7 @@
 #include "sxe-util.h"
 #include "sxe-dirwatch.h"
 
-extern struct ev_loop * sxe_private_main_loop;
+extern __thread struct ev_loop * sxe_private_main_loop;    /* The loop run by the calling thread */
 
 static ev_io            sxe_dirwatch_watcher;
 static int              sxe_dirwatch_inotify_fd = -1;
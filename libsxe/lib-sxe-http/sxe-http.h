@@ -143,6 +143,14 @@ sxe_http_message_set_ignore_line(SXE_HTTP_MESSAGE * message) {
     message->ignore_line   = 1;
 }
 
+/* Point a message at the buffer holding its unparsed data, which the reader may have moved (e.g. to grow it) since it was
+ * last parsed. Offsets into the message are relative to the start of the buffer, so they are unchanged.
+ */
+static inline void
+sxe_http_message_rebase(SXE_HTTP_MESSAGE * message, const char * buffer) {
+    message->buffer = buffer;
+}
+
 static inline void
 sxe_http_message_buffer_shift_ignore_length(SXE_HTTP_MESSAGE * message) {
     memmove(SXE_CAST_NOCONST(char *, message->buffer), message->buffer + message->ignore_length, message->buffer_length);
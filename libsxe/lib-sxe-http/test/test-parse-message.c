@@ -55,6 +55,14 @@
                                     "\r\nContent-Length: 10\r\n\r\n12345678\r\n"
 #define MESSAGE_MULTI_HEADER_OFFSET 29
 
+/* Elements longer than 16 bytes, so the delimiters and bad characters are found by the vectorized scan
+ */
+#define LONG_URL                    "/a/much/longer/path/to/some/resource.html"
+#define MESSAGE_LONG_TOKENS         "GET " LONG_URL " HTTP/1.1\r\nUser-Agent-Header-Name: a-value-longer-than-sixteen\r\n\r\n"
+#define MESSAGE_BAD_LONG_NAME       "\r\nAn-Unusually-Long-Header\001Name: 0\r\n"
+#define MESSAGE_BAD_HIGH_NAME       "\r\nAn-Unusually-Long-Header\200Name: 0\r\n"
+#define MESSAGE_BAD_LONG_VALUE      "\r\nContent-Type: text/html; charset=utf-8\nX: y\r\n\r\n"
+
 /* Long headers must be larger than TEST_MAX_BUF
  */
 static char message_long_headers[] = MESSAGE_LONG_HEADERS;
@@ -63,7 +71,9 @@ int
 main(void)
 {
     SXE_HTTP_MESSAGE message;
-    plan_tests(62);
+    unsigned         headers = 0;
+
+    plan_tests(71);
 
     tap_test_case_name("defragmentation");
     sxe_http_message_construct(&message, MESSAGE_HAPPY, 0);
@@ -201,6 +211,40 @@ main(void)
     is(sxe_http_message_parse_next_line_element(&message, SXE_HTTP_LINE_ELEMENT_TYPE_END_OF_LINE), SXE_RETURN_WARN_WOULD_BLOCK,
                                                                                       "Would block on rest of response line");
 
+    tap_test_case_name("long elements");
+    sxe_http_message_construct(&message, MESSAGE_LONG_TOKENS, strlen(MESSAGE_LONG_TOKENS));
+    sxe_http_message_parse_next_line_element(&message, SXE_HTTP_LINE_ELEMENT_TYPE_TOKEN);
+    is(sxe_http_message_parse_next_line_element(&message, SXE_HTTP_LINE_ELEMENT_TYPE_TOKEN), SXE_RETURN_OK, "Got the long URL");
+    is(sxe_http_message_get_line_element_length(&message), strlen(LONG_URL),       "Long URL has the right length");
+    is_strncmp(sxe_http_message_get_line_element(&message), LONG_URL, strlen(LONG_URL), "Long URL is '" LONG_URL "'");
+    sxe_http_message_parse_next_line_element(&message, SXE_HTTP_LINE_ELEMENT_TYPE_END_OF_LINE);
+    is(sxe_http_message_parse_next_header(&message), SXE_RETURN_OK,                   "Parsed the long header");
+    is(sxe_http_message_get_header_value_length(&message), strlen("a-value-longer-than-sixteen"), "Long value has the right length");
+
+    sxe_http_message_construct(&message, MESSAGE_BAD_LONG_NAME, strlen(MESSAGE_BAD_LONG_NAME));
+    sxe_http_message_parse_next_line_element(&message, SXE_HTTP_LINE_ELEMENT_TYPE_END_OF_LINE);
+    is(sxe_http_message_parse_next_header(&message), SXE_RETURN_ERROR_BAD_MESSAGE_RECEIVED,
+                                                                                      "Control character in a long header name");
+    sxe_http_message_construct(&message, MESSAGE_BAD_HIGH_NAME, strlen(MESSAGE_BAD_HIGH_NAME));
+    sxe_http_message_parse_next_line_element(&message, SXE_HTTP_LINE_ELEMENT_TYPE_END_OF_LINE);
+    is(sxe_http_message_parse_next_header(&message), SXE_RETURN_ERROR_BAD_MESSAGE_RECEIVED,
+                                                                                      "8 bit character in a long header name");
+    sxe_http_message_construct(&message, MESSAGE_BAD_LONG_VALUE, strlen(MESSAGE_BAD_LONG_VALUE));
+    sxe_http_message_parse_next_line_element(&message, SXE_HTTP_LINE_ELEMENT_TYPE_END_OF_LINE);
+    is(sxe_http_message_parse_next_header(&message), SXE_RETURN_ERROR_BAD_MESSAGE_RECEIVED,
+                                                                                      "Bare new line in a long header value");
+
+    sxe_http_message_construct(&message, MESSAGE_LONG_TOKENS, strlen(MESSAGE_LONG_TOKENS));
+    sxe_http_message_parse_next_line_element(&message, SXE_HTTP_LINE_ELEMENT_TYPE_TOKEN);
+    sxe_http_message_parse_next_line_element(&message, SXE_HTTP_LINE_ELEMENT_TYPE_TOKEN);
+    sxe_http_message_parse_next_line_element(&message, SXE_HTTP_LINE_ELEMENT_TYPE_END_OF_LINE);
+
+    while (sxe_http_message_parse_next_header(&message) == SXE_RETURN_OK) {
+        headers++;
+    }
+
+    is(headers, 1,                                                                    "Parsed the one header of the long token request");
+
     return exit_status();
 }
 
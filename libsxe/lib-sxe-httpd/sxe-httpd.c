@@ -35,6 +35,7 @@
 #define SXE_HTTPD_BUFFER_SIZE(s)     (sizeof(SXE_BUFFER) + (s)->buffer_size)
 #define SXE_HTTPD_BUFFER(s, idx)     (SXE_BUFFER *)(((char *)(s)->buffers) + (idx * SXE_HTTPD_BUFFER_SIZE(s)))
 #define SXE_HTTPD_BUFFER_INDEX(s, b) ((SXE_CAST(uintptr_t, (b)) - SXE_CAST(uintptr_t, (s)->buffers)) / SXE_HTTPD_BUFFER_SIZE((s)))
+#define SXE_HTTPD_PIPELINE_MAXIMUM   16    /* Maximum pipelined requests parsed per read event before yielding to the loop */
 
 typedef enum {
     SXE_HTTPD_BUFFER_FREE,
@@ -220,6 +221,24 @@ sxe_httpd_set_body_handler(SXE_HTTPD *self, sxe_httpd_body_handler new_handler)
     return old_handler;
 }
 
+/**
+ * Pass request bodies to the on_body handler in slices of a minimum size
+ *
+ * @param self HTTPD server
+ * @param size Size of the slices, or 0 (the default) to pass each part of the body as soon as it's read
+ *
+ * @note Each slice but the last is at least size bytes, in one contiguous buffer, so there are fewer on_body calls for large
+ *       uploads. Connections accepted after this is called are allowed to buffer up to size bytes, which also raises their
+ *       limit on the length of the request line and headers.
+ */
+void
+sxe_httpd_set_body_slice_size(SXE_HTTPD * self, unsigned size)
+{
+    SXEA1(size <= SXE_BUF_SIZE_MAXIMUM, "Body slice size %u is larger than the maximum SXE buffer size %u", size,
+          SXE_BUF_SIZE_MAXIMUM);
+    self->body_slice_size = size;
+}
+
 sxe_httpd_respond_handler
 sxe_httpd_set_respond_handler(SXE_HTTPD *self, sxe_httpd_respond_handler new_handler)
 {
@@ -402,6 +421,10 @@ sxe_httpd_event_connect(SXE * this)
     request->server = self;
     sxe_buffer_list_construct(&request->out_buffer_list);
 
+    if (self->body_slice_size > SXE_BUF_SIZE) {
+        sxe_set_buf_size(this, self->body_slice_size);
+    }
+
     (*self->on_connect)(request);
 
     /* reap the oldest connection if we have no free connections */
@@ -614,6 +637,7 @@ sxe_httpd_event_read(SXE * this, int additional_length)
     unsigned            value_length;
     unsigned            i;
     unsigned            request_id;
+    unsigned            pipelined            = 0;
 
     SXEE6I("sxe_httpd_event_read(request=%p,additional_length=%d)", request, additional_length);
     SXE_UNUSED_PARAMETER(additional_length);
@@ -633,9 +657,15 @@ sxe_httpd_event_read(SXE * this, int additional_length)
         goto SXE_EARLY_OUT; /* coverage exclusion: spurious - see block comment for details. */
     }
 
+SXE_HTTPD_NEXT_REQUEST:
     state = sxe_pool_index_to_state(request_pool, request_id);
     switch (state) {
     case SXE_HTTPD_CONN_IDLE:
+        if (SXE_BUF_USED(this) == 0) {
+            SXEL7I("No data for a new request; staying IDLE");    /* E.g. a deferred resume after a pipelined request */
+            goto SXE_EARLY_OUT;
+        }
+
         SXEL7I("state IDLE -> LINE");
         sxe_http_message_construct(message, SXE_BUF(this), SXE_BUF_USED(this));
         sxe_pool_set_indexed_element_state(request_pool, request_id, state, SXE_HTTPD_CONN_REQ_LINE);
@@ -643,13 +673,14 @@ sxe_httpd_event_read(SXE * this, int additional_length)
         /* FALLTHRU */
 
     case SXE_HTTPD_CONN_REQ_LINE:
+        sxe_http_message_rebase(message, SXE_BUF(this));    /* The SXE may have grown its buffer, moving the data */
         sxe_http_message_increase_buffer_length(message, SXE_BUF_USED(this));
         start  = SXE_BUF(this);
         length = SXE_BUF_USED(this);
         end    = sxe_strncspn(start, "\n", length);    /* TODO: Be smarter about not rescanning */
 
         if (end == NULL) {
-            if (length == SXE_BUF_SIZE) {
+            if (length == SXE_BUF_MAXIMUM(this)) {
                 response_status_code = 414;
                 response_reason = "Request-URI too large";
                 goto SXE_ERROR_OUT;
@@ -672,6 +703,7 @@ sxe_httpd_event_read(SXE * this, int additional_length)
         /* FALLTHRU */
 
     case SXE_HTTPD_CONN_REQ_HEADERS:
+        sxe_http_message_rebase(message, SXE_BUF(this));
         sxe_http_message_increase_buffer_length(message, SXE_BUF_USED(this));
 
         /* While the end-of-headers has not yet been reached
@@ -684,8 +716,8 @@ sxe_httpd_event_read(SXE * this, int additional_length)
             if ((consumed = sxe_http_message_get_ignore_length(message))) {
                 sxe_buf_consume(this, consumed);
                 if ((buffer_left = sxe_http_message_get_buffer_length(message))) {
-                    SXEL7I("%u bytes ignored , move the remaining %u bytes to the beginning of buffer", consumed, buffer_left);
-                    sxe_http_message_buffer_shift_ignore_length(message);
+                    SXEL7I("%u bytes ignored, the remaining %u bytes follow them in the buffer", consumed, buffer_left);
+                    sxe_http_message_rebase(message, SXE_BUF(this));
                 }
                 goto SXE_EARLY_OUT;
             }
@@ -693,11 +725,11 @@ sxe_httpd_event_read(SXE * this, int additional_length)
             if (result == SXE_RETURN_WARN_WOULD_BLOCK) {
                 /* If the buffer is full
                  */
-                if (SXE_BUF_USED(this) == SXE_BUF_SIZE) {
+                if (SXE_BUF_USED(this) == SXE_BUF_MAXIMUM(this)) {
                     consumed = sxe_http_message_consume_parsed_headers(message); /* COVERAGE EXCLUSION - TODO: WIN32 COVERAGE */
 
                     if (consumed == 0) {
-                        SXEL3I("%s: Found a header which is too big(>=%u), ignore it", __func__, SXE_BUF_SIZE);
+                        SXEL3I("%s: Found a header which is too big(>=%u), ignore it", __func__, SXE_BUF_MAXIMUM(this));
                         sxe_buf_clear(this);
                         sxe_http_message_set_ignore_line(message);
                         goto SXE_EARLY_OUT;
@@ -769,6 +801,14 @@ sxe_httpd_event_read(SXE * this, int additional_length)
                 data_len = request->in_content_length - request->in_content_seen; /* Coverage Exclusion - todo: win32 coverage */
             }
 
+            /* In slice mode, wait until a whole slice (or the rest of the body) is buffered
+             */
+            else if (data_len < server->body_slice_size && data_len < request->in_content_length - request->in_content_seen
+                  && data_len < SXE_BUF_MAXIMUM(this)) {
+                SXEL7I("Have %u bytes of a %u byte body slice; waiting for more", data_len, server->body_slice_size);
+                goto SXE_EARLY_OUT;
+            }
+
             SXEL7I("c/l %u - body chunk %d:%.*s", request->in_content_length, data_len, data_len, chunk);
             consumed += data_len;
             sxe_buf_consume(this, data_len);
@@ -811,6 +851,18 @@ SXE_EARLY_OUT:
         sxe_buf_resume(this, SXE_BUF_RESUME_IMMEDIATE);    /* sxe_consume() pauses; unpause unless sxe_httpd_pause() was called. */
     }
 
+    /* If the response was sent synchronously and the client has pipelined another request behind it, parse that request now
+     * rather than waiting for the deferred resume on the next event loop iteration.
+     */
+    if (state == SXE_HTTPD_CONN_IDLE && SXE_BUF_USED(this) != 0 && !request->paused
+     && ++pipelined < SXE_HTTPD_PIPELINE_MAXIMUM) {
+        SXEL7I("Parsing a pipelined request from the %u bytes remaining in the buffer", SXE_BUF_USED(this));
+        consumed             = 0;
+        response_status_code = 400;
+        response_reason      = "Bad request";
+        goto SXE_HTTPD_NEXT_REQUEST;
+    }
+
     SXER6I("return");
 }
 
@@ -1211,6 +1263,7 @@ sxe_httpd_event_sendfile_done(SXE * this, SXE_RETURN final_result)
     SXE_BUFFER        * buffer;
 
     SXEE6I("(request=%p, final_result=%s)", request, sxe_return_to_string(final_result));
+    sxe_set_cork(this, false);    /* Flush the end of the file */
 
     if (request->on_sent_handler) {
         (*request->on_sent_handler)(request, final_result, request->on_sent_userdata);
@@ -1271,11 +1324,17 @@ sxe_httpd_response_sendfile(SXE_HTTPD_REQUEST *request, int fd, unsigned length,
         }
     }
 
+    /* Cork the connection so that the headers go out in the same packet as the start of the file
+     */
+    sxe_set_cork(this, true);
     result = sxe_send_buffers(this, &request->out_buffer_list, sxe_httpd_event_sendfile_ready);
 
     if (result == SXE_RETURN_OK) {
         sxe_httpd_event_sendfile_ready(this, result);
     }
+    else if (result != SXE_RETURN_IN_PROGRESS) {
+        sxe_set_cork(this, false);    /* The headers weren't sent and the file won't be, so don't leave the connection corked */
+    }
 
 SXE_EARLY_OUT:
     SXER6I("return %s", sxe_return_to_string(result));
@@ -1523,6 +1582,7 @@ sxe_httpd_construct(SXE_HTTPD * self, unsigned connections, unsigned buffer_coun
     self->on_body      = sxe_httpd_default_body_handler;
     self->on_respond   = sxe_httpd_default_respond_handler;
     self->on_close     = sxe_httpd_default_close_handler;
+    self->body_slice_size = 0;
 
     SXER6("return");
 }
@@ -102,6 +102,7 @@ typedef struct SXE_HTTPD {
     SXE_BUFFER              * buffers;
     unsigned                  buffer_size;
     unsigned                  buffer_count;
+    unsigned                  body_slice_size;    /* 0 to pass the body to on_body as it's read; see sxe_httpd_set_body_slice_size() */
     void                    * user_data;
     sxe_httpd_connect_handler on_connect;
     sxe_httpd_request_handler on_request;
@@ -0,0 +1,137 @@
+/* Copyright 2010 Sophos Limited. All rights reserved. Sophos is a registered
+ * trademark of Sophos Limited.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tap.h"
+#include "sxe-httpd.h"
+#include "sxe-test.h"
+#include "sxe-util.h"
+
+#include "common.h"
+
+#define TEST_WAIT       5.0
+#define TEST_SLICE      8192
+#define TEST_BODY       20000    /* Two whole slices and a partial one                                 */
+#define TEST_CHUNKS     40       /* Response body buffers; more than are gathered into a single write */
+#define TEST_CHUNK      "0123456789"
+#define TEST_HEADER     1000     /* Two headers of this size don't fit in the initial SXE_BUF_SIZE byte input buffer */
+
+static char test_request[TEST_BODY + 128];
+static char test_value[TEST_HEADER + 1];
+static char test_response[TEST_CHUNKS * SXE_LITERAL_LENGTH(TEST_CHUNK) + 128];
+
+int
+main(void)
+{
+    SXE_HTTPD           httpd;
+    SXE_HTTPD_REQUEST * request;
+    SXE               * listener;
+    SXE               * c;
+    tap_ev              ev;
+    unsigned            header_length;
+    unsigned            slices     = 0;
+    unsigned            short_ones = 0;
+    unsigned            received   = 0;
+    unsigned            used;
+    unsigned            i;
+
+    plan_tests(15);
+
+    test_sxe_register_and_init(12);
+
+    sxe_httpd_construct(&httpd, 3, TEST_CHUNKS + 10, 512, 0);
+    SXE_HTTPD_SET_HANDLER(&httpd, body,    h_body);
+    SXE_HTTPD_SET_HANDLER(&httpd, respond, h_respond);
+    sxe_httpd_set_body_slice_size(&httpd, TEST_SLICE);
+
+    listener = test_httpd_listen(&httpd, "0.0.0.0", 0);
+    c        = test_new_tcp(NULL, "0.0.0.0", 0, client_connect, client_read, NULL);
+    sxe_connect(c, "127.0.0.1", SXE_LOCAL_PORT(listener));
+    is_eq(test_tap_ev_queue_identifier_wait(q_client, TEST_WAIT, &ev), "client_connect", "Client connected to HTTPD");
+
+    /* The body is passed to on_body in slices of at least TEST_SLICE bytes, except for the last one
+     */
+    header_length = snprintf(test_request, sizeof(test_request), "POST /upload HTTP/1.1\r\nContent-Length: %u\r\n\r\n", TEST_BODY);
+    memset(&test_request[header_length], 'x', TEST_BODY);
+    test_sxe_send(c, test_request, header_length + TEST_BODY, client_sent, "client_sent", q_client, TEST_WAIT, &ev);
+
+    while (received < TEST_BODY && strcmp(test_tap_ev_queue_identifier_wait(q_httpd, TEST_WAIT, &ev), "h_body") == 0) {
+        used      = SXE_CAST(unsigned, tap_ev_arg(ev, "used"));
+        received += used;
+        slices++;
+
+        if (used < TEST_SLICE && received < TEST_BODY) {
+            short_ones++;
+        }
+    }
+
+    is(received, TEST_BODY,                                                       "Received the whole %u byte body", TEST_BODY);
+    is(short_ones, 0,                                                             "Only the last slice was shorter than %u bytes",
+       TEST_SLICE);
+    ok(slices <= TEST_BODY / TEST_SLICE + 1,                                      "Body was passed in %u slices", slices);
+    is_eq(test_tap_ev_queue_identifier_wait(q_httpd, TEST_WAIT, &ev), "h_respond", "HTTPD ready to respond");
+    request = SXE_CAST_NOCONST(SXE_HTTPD_REQUEST *, tap_ev_arg(ev, "request"));
+
+    /* A response made of many small buffers is gathered into a few writes and arrives intact
+     */
+    sxe_httpd_response_start(request, 200, "OK");
+    sxe_httpd_response_content_length(request, TEST_CHUNKS * SXE_LITERAL_LENGTH(TEST_CHUNK));
+
+    for (i = 0; i < TEST_CHUNKS; i++) {
+        sxe_httpd_response_add_body_data(request, TEST_CHUNK, SXE_LITERAL_LENGTH(TEST_CHUNK));
+    }
+
+    sxe_httpd_response_end(request, h_sent, NULL);
+    is_eq(test_tap_ev_queue_identifier_wait(q_httpd, TEST_WAIT, &ev), "h_sent",   "HTTPD finished the response");
+    is(sxe_httpd_diag_get_free_buffers(&httpd), TEST_CHUNKS + 10,                 "All response buffers were returned");
+
+    header_length = SXE_LITERAL_LENGTH("HTTP/1.1 200 OK\r\nContent-Length: 400\r\n\r\n");
+    test_ev_queue_wait_read(q_client, TEST_WAIT, &ev, c, "client_read", test_response,
+                            header_length + TEST_CHUNKS * SXE_LITERAL_LENGTH(TEST_CHUNK), "client");
+
+    for (i = 0; i < TEST_CHUNKS; i++) {
+        if (memcmp(&test_response[header_length + i * SXE_LITERAL_LENGTH(TEST_CHUNK)], TEST_CHUNK,
+                   SXE_LITERAL_LENGTH(TEST_CHUNK)) != 0) {
+            break;
+        }
+    }
+
+    is(i, TEST_CHUNKS,                                                            "Response body arrived in order");
+
+    /* Headers that don't fit in the initial input buffer are parsed from the grown buffer that they are moved to
+     */
+    SXE_HTTPD_SET_HANDLER(&httpd, header, h_header);
+    memset(test_value, 'v', TEST_HEADER);
+    header_length = snprintf(test_request, sizeof(test_request), "GET /big HTTP/1.1\r\nX-One: %s\r\nX-Two: %s\r\n\r\n",
+                             test_value, test_value);
+    SXEA1(header_length > SXE_BUF_SIZE, "Test request headers are only %u bytes", header_length);
+    test_sxe_send(c, test_request, header_length, client_sent, "client_sent", q_client, TEST_WAIT, &ev);
+
+    is_eq(test_tap_ev_queue_identifier_wait(q_httpd, TEST_WAIT, &ev), "h_header", "HTTPD got the first big header");
+    is_eq(tap_ev_arg(ev, "key"), "X-One",                                         "It's X-One");
+    is_eq(test_tap_ev_queue_identifier_wait(q_httpd, TEST_WAIT, &ev), "h_header", "HTTPD got the second big header");
+    ok(strcmp(tap_ev_arg(ev, "key"), "X-Two") == 0 && strcmp(tap_ev_arg(ev, "value"), test_value) == 0,
+       "It's X-Two, with its whole value");
+    return exit_status();
+}
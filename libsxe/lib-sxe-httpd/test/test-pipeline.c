@@ -0,0 +1,127 @@
+/* Copyright 2010 Sophos Limited. All rights reserved. Sophos is a registered
+ * trademark of Sophos Limited.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tap.h"
+#include "sxe-httpd.h"
+#include "sxe-test.h"
+#include "sxe-util.h"
+
+#include "common.h"
+
+#define TEST_WAIT       5.0
+#define TEST_REQUESTS   5
+#define TEST_REQUEST    "GET /%u HTTP/1.1\r\nHost: localhost\r\n\r\n"
+#define TEST_RESPONSE   "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\n/%u"
+
+static char test_requests[TEST_REQUESTS * sizeof(TEST_REQUEST)];
+static char test_expected[TEST_REQUESTS * sizeof(TEST_RESPONSE)];
+static char test_response[TEST_REQUESTS * sizeof(TEST_RESPONSE)];
+
+static char      test_url[16];
+static uintptr_t test_iteration;
+
+/* Remember the URL and the event loop iteration the request was parsed on
+ */
+static void
+test_request(SXE_HTTPD_REQUEST * request, const char * method, unsigned method_length, const char * url, unsigned url_length,
+             const char * version, unsigned version_length)
+{
+    SXE * this = sxe_httpd_request_get_sxe(request);
+
+    SXE_UNUSED_PARAMETER(this);
+    SXEE6I("%s(url=[%.*s])", __func__, url_length, url);
+    SXE_UNUSED_PARAMETER(method);
+    SXE_UNUSED_PARAMETER(method_length);
+    SXE_UNUSED_PARAMETER(version);
+    SXE_UNUSED_PARAMETER(version_length);
+    snprintf(test_url, sizeof(test_url), "%.*s", url_length, url);
+    test_iteration = ev_loop_count(ev_default_loop(0));
+    SXER6I("return");
+}
+
+/* Respond synchronously with the URL as the body
+ */
+static void
+test_respond(SXE_HTTPD_REQUEST * request)
+{
+    sxe_httpd_response_simple(request, NULL, NULL, 200, "OK", test_url, NULL);
+    tap_ev_queue_push(q_httpd, __func__, 1, "iteration", (void *)test_iteration);
+}
+
+int
+main(void)
+{
+    SXE_HTTPD httpd;
+    SXE     * listener;
+    SXE     * c;
+    tap_ev    ev;
+    unsigned  requests_length = 0;
+    unsigned  expected_length = 0;
+    uintptr_t first_iteration = 0;
+    unsigned  same_iteration  = 0;
+    unsigned  i;
+
+    plan_tests(7);
+
+    test_sxe_register_and_init(12);
+
+    sxe_httpd_construct(&httpd, 3, 10, 512, 0);
+    SXE_HTTPD_SET_HANDLER(&httpd, request, test_request);
+    SXE_HTTPD_SET_HANDLER(&httpd, respond, test_respond);
+
+    listener = test_httpd_listen(&httpd, "0.0.0.0", 0);
+    c        = test_new_tcp(NULL, "0.0.0.0", 0, client_connect, client_read, NULL);
+    sxe_connect(c, "127.0.0.1", SXE_LOCAL_PORT(listener));
+    is_eq(test_tap_ev_queue_identifier_wait(q_client, TEST_WAIT, &ev), "client_connect", "Client connected to HTTPD");
+
+    /* All of the requests are written at once, so they arrive in the server's buffer together
+     */
+    for (i = 0; i < TEST_REQUESTS; i++) {
+        requests_length += snprintf(&test_requests[requests_length], sizeof(test_requests) - requests_length, TEST_REQUEST, i);
+        expected_length += snprintf(&test_expected[expected_length], sizeof(test_expected) - expected_length, TEST_RESPONSE, i);
+    }
+
+    test_sxe_send(c, test_requests, requests_length, client_sent, "client_sent", q_client, TEST_WAIT, &ev);
+
+    for (i = 0; i < TEST_REQUESTS; i++) {
+        if (strcmp(test_tap_ev_queue_identifier_wait(q_httpd, TEST_WAIT, &ev), "test_respond") != 0) {
+            break;
+        }
+
+        if (i == 0) {
+            first_iteration = (uintptr_t)tap_ev_arg(ev, "iteration");
+        }
+
+        same_iteration += (uintptr_t)tap_ev_arg(ev, "iteration") == first_iteration;
+    }
+
+    is(i, TEST_REQUESTS,                           "Responded to all %u pipelined requests", TEST_REQUESTS);
+    is(same_iteration, TEST_REQUESTS,              "All of the pipelined requests were handled by a single read event");
+    test_ev_queue_wait_read(q_client, TEST_WAIT, &ev, c, "client_read", test_response, expected_length, "client");
+    ok(memcmp(test_response, test_expected, expected_length) == 0, "Responses arrived in the order of the requests");
+    test_process_all_libev_events();
+    is(tap_ev_queue_length(q_httpd), 0,            "No more HTTPD events once the buffered requests are handled");
+    return exit_status();
+}
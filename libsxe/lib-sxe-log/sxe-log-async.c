@@ -0,0 +1,357 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * Asynchronous log output: each thread appends its formatted log lines to its own single producer/single consumer ring
+ * buffer, and one writer thread drains all of the rings to a file descriptor with writev(). Logging threads never make a
+ * system call or take a lock. If a ring is full, the line is dropped and counted (see sxe_log_async_get_dropped()).
+ *
+ * Lines are still formatted by the logging thread, because the level, indent and transaction id all depend on its state.
+ * Fatal lines (e.g. from SXEA1) flush all rings and are written synchronously, so that nothing is lost by abort().
+ */
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <limits.h>          /* for IOV_MAX                          */
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>         /* for writev()                         */
+#include <time.h>            /* for nanosleep()                      */
+
+#include "sxe-log.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+#define SXE_LOG_ASYNC_RING_SIZE_DEFAULT (64 * 1024)
+#define SXE_LOG_ASYNC_IDLE_NANOSECONDS  1000000          /* Writer thread sleeps for 1ms when all rings are empty */
+#define SXE_LOG_ASYNC_RECORD_SKIP       UINT32_MAX       /* Record length meaning "continue at the start of the ring" */
+#define SXE_LOG_ASYNC_RECORD_ALIGN(len) (((len) + sizeof(uint32_t) + 7) & ~(uint64_t)7)
+
+typedef struct SXE_LOG_RING {
+    struct SXE_LOG_RING * next;              /* Rings are never freed; a ring whose thread exits is reused by a new one */
+    volatile unsigned     orphaned;          /* 1 if the ring's thread has exited                                      */
+    char                * buffer;
+    uint64_t              size;              /* Power of two                                                           */
+    volatile uint64_t     head;              /* Bytes ever appended; only written by the owning thread                 */
+    volatile uint64_t     dropped;           /* Lines dropped because the ring was full; only written by the owner     */
+    char                  padding[64];       /* Keep the writer's tail off the owner's cache line                      */
+    volatile uint64_t     tail;              /* Bytes ever written out; only written by the writer thread              */
+} SXE_LOG_RING;
+
+static SXE_LOG_RING * volatile sxe_log_async_rings    = NULL;
+static volatile bool           sxe_log_async_running  = false;
+static volatile bool           sxe_log_async_stopping = false;
+static uint64_t                sxe_log_async_size     = SXE_LOG_ASYNC_RING_SIZE_DEFAULT;
+static int                     sxe_log_async_fd       = -1;
+static pthread_t               sxe_log_async_writer;
+static pthread_key_t           sxe_log_async_key;
+static pthread_once_t          sxe_log_async_key_once = PTHREAD_ONCE_INIT;
+static SXE_LOG_LINE_OUT_PTR    sxe_log_async_line_out_previous;
+static __thread SXE_LOG_RING * sxe_log_async_ring     = NULL;
+
+static void
+sxe_log_async_thread_exit(void * ring)
+{
+    ((SXE_LOG_RING *)ring)->orphaned = 1;    /* The writer still drains it; the next new thread adopts it */
+}
+
+static void
+sxe_log_async_key_create(void)
+{
+    pthread_key_create(&sxe_log_async_key, sxe_log_async_thread_exit);
+}
+
+static SXE_LOG_RING *
+sxe_log_async_ring_get(void)
+{
+    SXE_LOG_RING * ring;
+
+    if (sxe_log_async_ring != NULL) {
+        return sxe_log_async_ring;
+    }
+
+    for (ring = sxe_log_async_rings; ring != NULL; ring = ring->next) {    /* Adopt the ring of a thread that has exited */
+        if (ring->orphaned && __sync_bool_compare_and_swap(&ring->orphaned, 1, 0)) {
+            goto SXE_EARLY_OUT;
+        }
+    }
+
+    if ((ring = calloc(1, sizeof(*ring))) == NULL || (ring->buffer = malloc(sxe_log_async_size)) == NULL) {
+        free(ring);              /* COVERAGE EXCLUSION: Out of memory */
+        return NULL;             /* COVERAGE EXCLUSION: Out of memory */
+    }
+
+    ring->size = sxe_log_async_size;
+
+    do {
+        ring->next = sxe_log_async_rings;
+    } while (!__sync_bool_compare_and_swap(&sxe_log_async_rings, ring->next, ring));
+
+SXE_EARLY_OUT:
+    pthread_once(&sxe_log_async_key_once, sxe_log_async_key_create);
+    pthread_setspecific(sxe_log_async_key, ring);
+    sxe_log_async_ring = ring;
+    return ring;
+}
+
+/**
+ * Append a line to the calling thread's log ring
+ *
+ * @param line   Line to append; normally newline terminated
+ * @param length Length of the line in bytes
+ *
+ * @return true if the line was appended or dropped because the ring was full, false if asynchronous logging is not running,
+ *         in which case the caller should write the line itself
+ */
+bool
+sxe_log_async_append(const char * line, unsigned length)
+{
+    SXE_LOG_RING * ring;
+    uint64_t       head;
+    uint64_t       record;
+    uint64_t       offset;
+    uint64_t       contiguous;
+
+    if (!sxe_log_async_running || (ring = sxe_log_async_ring_get()) == NULL) {
+        return false;
+    }
+
+    head       = ring->head;
+    record     = SXE_LOG_ASYNC_RECORD_ALIGN(length);
+    offset     = head & (ring->size - 1);
+    contiguous = ring->size - offset;
+
+    if (head + record + (contiguous < record ? contiguous : 0) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->size) {
+        ring->dropped++;
+        return true;
+    }
+
+    if (contiguous < record) {    /* Records are never split, so skip to the start of the ring */
+        *(uint32_t *)(void *)&ring->buffer[offset] = SXE_LOG_ASYNC_RECORD_SKIP;
+        head  += contiguous;
+        offset = 0;
+    }
+
+    *(uint32_t *)(void *)&ring->buffer[offset] = length;
+    memcpy(&ring->buffer[offset + sizeof(uint32_t)], line, length);
+    __atomic_store_n(&ring->head, head + record, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* Write out everything that is in a ring; returns false if nothing was there
+ */
+static bool
+sxe_log_async_drain(SXE_LOG_RING * ring)
+{
+    struct iovec iov[IOV_MAX < 64 ? IOV_MAX : 64];
+    uint64_t     head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t     tail = ring->tail;
+    uint64_t     offset;
+    uint32_t     length;
+    unsigned     count;
+    size_t       total;
+    ssize_t      written;
+
+    if (tail == head) {
+        return false;
+    }
+
+    while (tail != head) {
+        for (count = 0, total = 0; tail != head && count < sizeof(iov) / sizeof(iov[0]); ) {
+            offset = tail & (ring->size - 1);
+            length = *(uint32_t *)(void *)&ring->buffer[offset];
+
+            if (length == SXE_LOG_ASYNC_RECORD_SKIP) {
+                tail += ring->size - offset;
+                continue;
+            }
+
+            iov[count].iov_base = &ring->buffer[offset + sizeof(uint32_t)];
+            iov[count].iov_len  = length;
+            total              += length;
+            tail               += SXE_LOG_ASYNC_RECORD_ALIGN(length);
+            count++;
+        }
+
+        /* Partial writes are finished one record at a time; if the descriptor fails, the lines are lost
+         */
+        while (total > 0 && (written = writev(sxe_log_async_fd, iov, count)) != (ssize_t)total) {
+            if (written < 0) {
+                if (errno == EINTR || errno == EAGAIN) {
+                    continue;                                    /* COVERAGE EXCLUSION: Interrupted write */
+                }
+
+                break;                                           /* COVERAGE EXCLUSION: Log descriptor failed */
+            }
+
+            for (total -= written; (size_t)written >= iov[0].iov_len; count--) {    /* COVERAGE EXCLUSION: Partial write */
+                written -= iov[0].iov_len;                       /* COVERAGE EXCLUSION: Partial write */
+                memmove(&iov[0], &iov[1], (count - 1) * sizeof(iov[0]));    /* COVERAGE EXCLUSION: Partial write */
+            }
+
+            iov[0].iov_base  = (char *)iov[0].iov_base + written; /* COVERAGE EXCLUSION: Partial write */
+            iov[0].iov_len  -= written;                          /* COVERAGE EXCLUSION: Partial write */
+        }
+
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    return true;
+}
+
+static void *
+sxe_log_async_writer_main(void * arg)
+{
+    struct timespec idle = { 0, SXE_LOG_ASYNC_IDLE_NANOSECONDS };
+    SXE_LOG_RING *  ring;
+    bool            busy;
+
+    SXE_UNUSED_PARAMETER(arg);
+
+    for (;;) {
+        bool stopping = sxe_log_async_stopping;    /* Read before draining, so the last drain follows the last append */
+
+        for (busy = false, ring = sxe_log_async_rings; ring != NULL; ring = ring->next) {
+            busy = sxe_log_async_drain(ring) || busy;
+        }
+
+        if (stopping) {
+            break;
+        }
+
+        if (!busy) {
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Wait for the writer thread to write out every line appended before this call
+ */
+void
+sxe_log_async_flush(void)
+{
+    struct timespec wait = { 0, SXE_LOG_ASYNC_IDLE_NANOSECONDS / 10 };
+    SXE_LOG_RING *  ring;
+
+    if (!sxe_log_async_running || pthread_equal(pthread_self(), sxe_log_async_writer)) {
+        return;
+    }
+
+    for (ring = sxe_log_async_rings; ring != NULL; ring = ring->next) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+        while (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) < head && sxe_log_async_running) {
+            nanosleep(&wait, NULL);
+        }
+    }
+}
+
+static void
+sxe_log_async_line_out(SXE_LOG_LEVEL level, const char * line)
+{
+    if (level == SXE_LOG_LEVEL_FATAL) {    /* Assertions abort; flush everything before them and write them synchronously */
+        sxe_log_async_flush();
+    }
+    else if (sxe_log_async_append(line, strlen(line))) {
+        return;
+    }
+
+    (*sxe_log_async_line_out_previous)(level, line);
+}
+
+/**
+ * Start logging asynchronously
+ *
+ * @param ring_size Bytes in each thread's ring buffer, rounded up to a power of two, or 0 for the default of 64KB. Only used
+ *                  the first time asynchronous logging is started.
+ * @param fd        File descriptor the writer thread writes log lines to (e.g. STDERR_FILENO)
+ *
+ * @return SXE_RETURN_OK, SXE_RETURN_WARN_ALREADY_INITIALIZED if already started, or SXE_RETURN_ERROR_INTERNAL if the writer
+ *         thread could not be created
+ *
+ * @note Lines logged with sxe_log() go to fd instead of the current line out function; fatal lines still go to it as well.
+ */
+SXE_RETURN
+sxe_log_async_start(unsigned ring_size, int fd)
+{
+    if (sxe_log_async_running) {
+        return SXE_RETURN_WARN_ALREADY_INITIALIZED;
+    }
+
+    if (sxe_log_async_rings == NULL && ring_size != 0) {    /* Existing rings can't be resized */
+        for (sxe_log_async_size = 256; sxe_log_async_size < ring_size; sxe_log_async_size *= 2) {
+        }
+    }
+
+    sxe_log_async_fd       = fd;
+    sxe_log_async_stopping = false;
+
+    if (pthread_create(&sxe_log_async_writer, NULL, sxe_log_async_writer_main, NULL) != 0) {
+        return SXE_RETURN_ERROR_INTERNAL;    /* COVERAGE EXCLUSION: Out of threads */
+    }
+
+    sxe_log_async_running           = true;
+    sxe_log_async_line_out_previous = sxe_log_hook_line_out(sxe_log_async_line_out);
+    return SXE_RETURN_OK;
+}
+
+/**
+ * Stop logging asynchronously, after writing out everything logged so far
+ *
+ * @note Lines that other threads append while this function runs may be left in their rings until the next start
+ */
+void
+sxe_log_async_stop(void)
+{
+    if (!sxe_log_async_running) {
+        return;
+    }
+
+    sxe_log_hook_line_out(sxe_log_async_line_out_previous);
+    sxe_log_async_running  = false;
+    sxe_log_async_stopping = true;
+    pthread_join(sxe_log_async_writer, NULL);
+}
+
+/**
+ * Get the total number of lines dropped because a thread's log ring was full
+ */
+uint64_t
+sxe_log_async_get_dropped(void)
+{
+    SXE_LOG_RING * ring;
+    uint64_t       dropped = 0;
+
+    for (ring = sxe_log_async_rings; ring != NULL; ring = ring->next) {
+        dropped += ring->dropped;
+    }
+
+    return dropped;
+}
+
+#endif /* !_WIN32 */
@@ -38,6 +38,7 @@
 #ifdef __FreeBSD__
 #   include <sys/thr.h>
 #endif
+#include <pthread.h>         /* for pthread_atfork(), pthread_once() */
 #include <unistd.h>          /* for getpid()                         */
 #include "mock.h"            /* allow mocking openlog() and syslog() */
 #endif
@@ -83,6 +84,11 @@ __thread unsigned      sxe_log_transaction_id = SXE_LOG_NO_ID;    // Value displ
 
 /* Local variables */
 
+#if !defined(_WIN32) && !defined(__APPLE__)
+static __thread long              sxe_log_tid          = 0;    // Cached kernel thread id; 0 until first looked up
+static pthread_once_t             sxe_log_tid_once     = PTHREAD_ONCE_INIT;
+#endif
+
 static volatile SXE_LOG_LEVEL     sxe_log_level        = SXE_LOG_LEVEL_OVER_MAXIMUM;
 static volatile SXE_LOG_CONTROL * sxe_log_control_list = NULL;
 static volatile unsigned          sxe_log_setting_era  = 0;
@@ -153,6 +159,46 @@ sxe_return_to_string(SXE_RETURN ret)
     return NULL;
 }
 
+#ifndef _WIN32
+#ifndef __APPLE__
+static void
+sxe_log_tid_forget(void)    /* In a forked child, the only thread has a new thread id */
+{
+    sxe_log_tid = 0;
+}
+
+static void
+sxe_log_tid_register_atfork(void)
+{
+    pthread_atfork(NULL, NULL, sxe_log_tid_forget);
+}
+#endif
+
+/**
+ * Get the kernel's id for the calling thread, as shown in log lines
+ *
+ * @note The id is looked up with a system call the first time a thread calls this function and cached after that
+ */
+long
+sxe_log_get_tid(void)
+{
+#if defined(__APPLE__)
+    return syscall(SYS_thread_selfid);    /* No __thread on Apple; see sxe_log_transaction_id */
+#else
+    if (sxe_log_tid == 0) {
+        pthread_once(&sxe_log_tid_once, sxe_log_tid_register_atfork);
+#   if defined(__FreeBSD__)
+        thr_self(&sxe_log_tid);
+#   else
+        sxe_log_tid = syscall(SYS_gettid);
+#   endif
+    }
+
+    return sxe_log_tid;
+#endif
+}
+#endif
+
 static bool
 sxe_log_safe_append(char * log_buffer, unsigned * index_ptr, int appended)
 {
@@ -216,19 +262,19 @@ sxe_log_prefix_default(char * log_buffer, unsigned id, SXE_LOG_LEVEL level)
     gettimeofday(&mytv, NULL);
     gmtime_r((time_t *)&mytv.tv_sec, &mytm);
 #   if defined(__APPLE__)
-    ThreadId = syscall(SYS_thread_selfid);
+    ThreadId = sxe_log_get_tid();
     ProcessId = getpid();
     ret = snprintf(log_buffer, SXE_LOG_BUFFER_SIZE, "%04d%02d%02d %02d%02d%02d.%03ld P% 10d T% 10d ", mytm.tm_year + 1900,
                    mytm. tm_mon + 1, mytm.tm_mday, mytm.tm_hour, mytm.tm_min, mytm.tm_sec, (long)mytv.tv_usec / 1000,
                    ProcessId, ThreadId);
 #   elif defined(__FreeBSD__)
-    thr_self(&ThreadId);
+    ThreadId = sxe_log_get_tid();
     ProcessId = getpid();
     ret = snprintf(log_buffer, SXE_LOG_BUFFER_SIZE, "%04d%02d%02d %02d%02d%02d.%03ld P% 10d T% 10ld ", mytm.tm_year + 1900,
                    mytm. tm_mon + 1, mytm.tm_mday, mytm.tm_hour, mytm.tm_min, mytm.tm_sec, (long)mytv.tv_usec / 1000,
                    ProcessId, ThreadId);
 #else
-    ThreadId = syscall(SYS_gettid);
+    ThreadId = sxe_log_get_tid();
     ret = snprintf(log_buffer, SXE_LOG_BUFFER_SIZE, "%04d%02d%02d %02d%02d%02d.%03ld T% 10d ", mytm.tm_year + 1900,
                    mytm. tm_mon + 1, mytm.tm_mday, mytm.tm_hour, mytm.tm_min, mytm.tm_sec, mytv.tv_usec / 1000, ThreadId);
 #endif /* !__APPLE__ */
@@ -923,16 +969,15 @@ sxe_log_buffer_prefix_syslog(char * log_buffer, unsigned id, SXE_LOG_LEVEL level
 {
     unsigned length;
 #if defined(__APPLE__)
-    pid_t    ThreadId = syscall(SYS_thread_selfid);
+    pid_t    ThreadId = sxe_log_get_tid();
 
     snprintf(log_buffer, SXE_LOG_BUFFER_SIZE, "T=%d ", ThreadId);
 #elif defined(__FreeBSD__)
-    long     ThreadId;
-    thr_self(&ThreadId);
+    long     ThreadId = sxe_log_get_tid();
 
     snprintf(log_buffer, SXE_LOG_BUFFER_SIZE, "T=%ld ", ThreadId);
 #else
-    pid_t ThreadId = syscall(SYS_gettid);
+    pid_t ThreadId = sxe_log_get_tid();
 
     snprintf(log_buffer, SXE_LOG_BUFFER_SIZE, "T=%d ", ThreadId);
 #endif
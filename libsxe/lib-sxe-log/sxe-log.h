@@ -26,6 +26,7 @@
 #define __SXE_LOG_H__
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>    /* For __thread on Windows */
 
@@ -396,6 +397,7 @@ static volatile SXE_LOG_CONTROL sxe_log_control = {SXE_LOG_LEVEL_OVER_MAXIMUM, N
 #endif
 
 #include "sxe-log-proto.h"
+#include "sxe-log-async-proto.h"
 #include "sxe-log-legacy.h"
 #include "sxe-strlcpy-proto.h"
 #include "sxe-str-encode-proto.h"
@@ -0,0 +1,118 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "sxe-log.h"
+#include "tap.h"
+
+#define TEST_THREADS 4
+#define TEST_LINES   2000
+#define TEST_RING    (1 << 20)
+
+static void *
+test_thread_log(void * arg)
+{
+    unsigned thread = (unsigned)(uintptr_t)arg;
+    unsigned line;
+
+    for (line = 0; line < TEST_LINES; line++) {
+        SXEL3("async thread %u line %u", thread, line);
+    }
+
+    return NULL;
+}
+
+int
+main(void)
+{
+    pthread_t   threads[TEST_THREADS];
+    unsigned    next_line[TEST_THREADS];
+    char        temp[] = "test-sxe-log-async.temp.XXXXXX";
+    char      * big;
+    char      * contents;
+    char      * line;
+    struct stat status;
+    unsigned    thread;
+    unsigned    number;
+    unsigned    found      = 0;
+    unsigned    disordered = 0;
+    int         fd;
+    FILE      * file;
+
+    plan_tests(11);
+
+    is(sxe_log_get_tid(), syscall(SYS_gettid),                      "sxe_log_get_tid() returns the kernel thread id");
+    is(sxe_log_get_tid(), syscall(SYS_gettid),                      "sxe_log_get_tid() returns the kernel thread id when cached");
+    ok(!sxe_log_async_append("not started\n", 12),                  "Can't append before asynchronous logging is started");
+
+    SXEA1((fd = mkstemp(temp)) >= 0, "Failed to create temporary output file");
+    is(sxe_log_async_start(TEST_RING, fd), SXE_RETURN_OK,           "Started asynchronous logging");
+    is(sxe_log_async_start(0, fd), SXE_RETURN_WARN_ALREADY_INITIALIZED, "Starting again warns");
+
+    for (thread = 0; thread < TEST_THREADS; thread++) {
+        SXEA1(pthread_create(&threads[thread], NULL, test_thread_log, (void *)(uintptr_t)thread) == 0, "Can't create thread");
+    }
+
+    for (thread = 0; thread < TEST_THREADS; thread++) {
+        pthread_join(threads[thread], NULL);
+    }
+
+    SXEA1(big = malloc(TEST_RING), "Can't allocate a line bigger than the ring");
+    memset(big, 'x', TEST_RING);
+    ok(sxe_log_async_append(big, TEST_RING),                        "A line bigger than the ring is accepted...");
+    is(sxe_log_async_get_dropped(), 1,                              "...and dropped");
+
+    sxe_log_async_flush();
+    sxe_log_async_stop();
+    ok(!sxe_log_async_append("stopped\n", 8),                       "Can't append after asynchronous logging is stopped");
+
+    /* Every line from every thread was written, in order per thread
+     */
+    SXEA1(fstat(fd, &status) == 0 && (contents = malloc(status.st_size + 1)), "Can't allocate a buffer for the log");
+    SXEA1(lseek(fd, 0, SEEK_SET) == 0 && (file = fdopen(fd, "r")), "Can't reopen the log");
+    contents[fread(contents, 1, status.st_size, file)] = '\0';
+    memset(next_line, 0, sizeof(next_line));
+
+    for (line = strtok(contents, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        if ((line = strstr(line, "async thread ")) == NULL || sscanf(line, "async thread %u line %u", &thread, &number) != 2) {
+            continue;
+        }
+
+        found++;
+        disordered += thread >= TEST_THREADS || number != next_line[thread];
+        next_line[thread % TEST_THREADS] = number + 1;
+    }
+
+    is(found, TEST_THREADS * TEST_LINES,                            "Found all %u lines", TEST_THREADS * TEST_LINES);
+    is(disordered, 0,                                               "Each thread's lines were written in order");
+    ok(strchr(contents, 'x') == NULL,                               "The dropped line was not written");
+
+    free(contents);
+    free(big);
+    fclose(file);
+    unlink(temp);
+    return exit_status();
+}
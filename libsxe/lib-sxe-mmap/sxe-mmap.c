@@ -53,6 +53,53 @@ sxe_mmap_open(SXE_MMAP * memmap, const char * file) {
     SXER6( "return // sxe_mmap_open()" );
 }
 
+/**
+ * Map a file without asserting if it can't be opened or mapped
+ *
+ * @param memmap Memory map to fill in
+ * @param file   File to map
+ * @param flags  0 for a shared mapping or SXE_MMAP_FLAG_PRIVATE for a copy on write mapping
+ *
+ * @return true on success or false on failure (logged)
+ */
+bool
+sxe_mmap_try_open(SXE_MMAP * memmap, const char * file, int flags)
+{
+    struct stat st;
+    bool        result = false;
+
+    SXEE6("sxe_mmap_try_open(memmap=%p, file=%s, flags=%d)", memmap, file, flags);
+    memmap->flags = flags;
+
+    /* A copy on write mapping never writes the file, so it only needs to be readable (e.g. a snapshot on a read-only mount)
+     */
+    if ((memmap->fd = open(file, flags & SXE_MMAP_FLAG_PRIVATE ? O_RDONLY : O_RDWR, 0666)) < 0) {
+        SXEL3("sxe_mmap_try_open: Failed to open file %s: %s", file, strerror(errno));
+        goto SXE_EARLY_OUT;
+    }
+
+    if (fstat(memmap->fd, &st) < 0 || st.st_size == 0) {
+        SXEL3("sxe_mmap_try_open: Cannot map empty or unstatable file %s", file);
+        close(memmap->fd);
+        goto SXE_EARLY_OUT;
+    }
+
+    memmap->size = st.st_size;
+
+    if ((memmap->addr = mmap(NULL, memmap->size, PROT_READ | PROT_WRITE, flags & SXE_MMAP_FLAG_PRIVATE ? MAP_PRIVATE : MAP_SHARED,
+                             memmap->fd, 0)) == MAP_FAILED) {
+        SXEL3("sxe_mmap_try_open: Failed to mmap file %s: %s", file, strerror(errno));
+        close(memmap->fd);
+        goto SXE_EARLY_OUT;
+    }
+
+    result = true;
+
+SXE_EARLY_OUT:
+    SXER6("return %s", result ? "true" : "false");
+    return result;
+}
+
 void
 sxe_mmap_close(SXE_MMAP* memmap) {
     SXEE6("sxe_mmap_close(memmap=%p)", memmap);
@@ -98,6 +145,57 @@ sxe_mmap_open(SXE_MMAP * memmap, const char * file)
     SXER6("return // sxe_mmap_open()" );
 }
 
+bool
+sxe_mmap_try_open(SXE_MMAP * memmap, const char * file, int flags)
+{
+    HANDLE      fh;
+    HANDLE      view;
+    struct stat st;
+    bool        result = false;
+
+    SXEE6("sxe_mmap_try_open(memmap=%p, file=%s, flags=%d)", memmap, file, flags);
+    memmap->flags = flags;
+
+    if (0 != stat(file, &st) || st.st_size == 0) {
+        SXEL3("sxe_mmap_try_open: Cannot map missing or empty file %s", file);
+        goto SXE_EARLY_OUT;
+    }
+
+    memmap->size = st.st_size;
+    fh = CreateFile(file, flags & SXE_MMAP_FLAG_PRIVATE ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE,
+                    NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL|FILE_FLAG_RANDOM_ACCESS, NULL);
+
+    if (fh == INVALID_HANDLE_VALUE) {
+        SXEL3("sxe_mmap_try_open: fail to open file %s", file);
+        goto SXE_EARLY_OUT;
+    }
+
+    view = CreateFileMapping(fh, NULL, flags & SXE_MMAP_FLAG_PRIVATE ? PAGE_WRITECOPY : PAGE_READWRITE, 0, 0, 0);
+
+    if (view == NULL) {
+        SXEL3("sxe_mmap_try_open: fail to create file mapping for file %s", file);
+        CloseHandle(fh);
+        goto SXE_EARLY_OUT;
+    }
+
+    memmap->addr = MapViewOfFile(view, flags & SXE_MMAP_FLAG_PRIVATE ? FILE_MAP_COPY : FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, memmap->size);
+
+    if (memmap->addr == NULL) {
+        SXEL3("sxe_mmap_try_open: fail to map view of file for file %s", file);
+        CloseHandle(view);
+        CloseHandle(fh);
+        goto SXE_EARLY_OUT;
+    }
+
+    memmap->win32_fh   = fh  ;
+    memmap->win32_view = view;
+    result             = true;
+
+SXE_EARLY_OUT:
+    SXER6("return %s", result ? "true" : "false");
+    return result;
+}
+
 void
 sxe_mmap_close(SXE_MMAP * memmap)
 {
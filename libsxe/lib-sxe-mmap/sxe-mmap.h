@@ -27,6 +27,8 @@
 #ifndef __SXE_MMAP__
 #define __SXE_MMAP__
 
+#include <stdbool.h>
+
 #ifdef _WIN32
     #include <winsock2.h>
     #include <windows.h>
@@ -45,6 +47,8 @@ typedef struct {
 
 #define SXE_MMAP_ADDR(memmap) ((volatile void *)(memmap)->addr)
 
+#define SXE_MMAP_FLAG_PRIVATE 1    /* sxe_mmap_try_open(): copy on write mapping; changes are never written to the file */
+
 #include "sxe-mmap-proto.h"
 
 #endif
@@ -37,6 +37,7 @@ typedef struct SXE_POOL_NODE {
     union {
         SXE_TIME time;
         uint64_t count;
+        unsigned next_free;    /* Lock-free pools: index + 1 of the next element on the free stack, or 0 */
     } last;
 } SXE_POOL_NODE;
 
@@ -55,6 +56,8 @@ typedef struct SXE_POOL_IMPL {
     SXE_LIST_NODE          timeout_node;
     uint64_t               next_count;
     const char *        (* state_to_string)(unsigned state);
+    volatile uint64_t      free_head;    /* Lock-free pools: tag << 32 | index + 1 of the top of the free stack      */
+    uint64_t               serial;       /* Lock-free pools: unique identifier used to match per-thread free caches */
 } SXE_POOL_IMPL;
 
 static inline SXE_POOL_NODE *
@@ -28,7 +28,7 @@
  * @param array  Pointer to the pool array
  * @param state  State to walk
  *
- * @exception If the pool is both locked and timed, it cannot be walked safely
+ * @exception If the pool is both locked and timed, it cannot be walked safely; lock-free pools cannot be walked at all
  */
 void
 sxe_pool_walker_construct(SXE_POOL_WALKER * walker, void * array, unsigned state)
@@ -38,6 +38,8 @@ sxe_pool_walker_construct(SXE_POOL_WALKER * walker, void * array, unsigned state
     SXEE6("sxe_pool_walker_construct(walker=%p,pool=%s,state=%s)", walker, pool->name, (*pool->state_to_string)(state));
     SXEA1(!((pool->options & SXE_POOL_OPTION_LOCKED) && (pool->options & SXE_POOL_OPTION_TIMED)),
            "sxe_pool_walker_construct: Can't walk thread safe timed pool %s safely", pool->name);
+    SXEA1(!(pool->options & SXE_POOL_OPTION_LOCK_FREE), "sxe_pool_walker_construct: Lock-free pool %s can't be walked",
+          pool->name);
     sxe_list_walker_construct(&walker->list_walker, &SXE_POOL_QUEUE(pool)[state]);
     walker->pool  = pool;
     walker->state = state;
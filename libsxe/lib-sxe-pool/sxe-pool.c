@@ -36,8 +36,23 @@
 #define SXE_POOL_ON_INCORRECT_STATE_ABORT        1
 #define SXE_POOL_ASSERT_ARRAY_INITIALIZED(array) SXEA6((array) != NULL, "%s(array=NULL): Uninitialized pool?", __func__)
 
-static SXE_LIST sxe_pool_timeout_list;
-static unsigned sxe_pool_timeout_count = 0;
+#define SXE_POOL_CACHE_SIZE                      16    /* Maximum free elements a thread keeps for each lock-free pool    */
+#define SXE_POOL_CACHE_DIVISOR                   64    /* A thread's cache holds at most this fraction of a lock-free pool */
+#define SXE_POOL_CACHES                          4     /* Number of lock-free pools a thread can keep free caches for     */
+#define SXE_POOL_FREE_TAG                        (1ULL << 32)
+#define SXE_POOL_FREE_TOP(head)                  ((unsigned)((head) & (SXE_POOL_FREE_TAG - 1)))
+
+typedef struct SXE_POOL_CACHE {
+    SXE_POOL_IMPL * pool;
+    uint64_t        serial;
+    unsigned        count;
+    unsigned        ids[SXE_POOL_CACHE_SIZE];
+} SXE_POOL_CACHE;
+
+static SXE_LIST                sxe_pool_timeout_list;
+static unsigned                sxe_pool_timeout_count = 0;
+static volatile uint64_t       sxe_pool_serial        = 0;
+static __thread SXE_POOL_CACHE sxe_pool_caches[SXE_POOL_CACHES];
 
 /* Diagnostic function to convert state to string if none is supplied by the user
  */
@@ -56,6 +71,150 @@ sxe_pool_state_to_string(unsigned state)                                /* Cover
     return result;                                                      /* Coverage Exclusion: Only called in debug mode */
 }
 
+/* Lock-free pools keep their free elements on a Treiber stack of indices. The head is tagged with a count of the operations
+ * on it, so that an element popped and pushed back by other threads between a read of the head and the compare and swap
+ * can't be mistaken for an unchanged stack (the ABA problem).
+ */
+static unsigned
+sxe_pool_free_pop(SXE_POOL_IMPL * pool)
+{
+    uint64_t head;
+    unsigned top;
+
+    do {
+        head = pool->free_head;
+
+        if ((top = SXE_POOL_FREE_TOP(head)) == 0) {
+            return SXE_POOL_NO_INDEX;
+        }
+    } while (!__sync_bool_compare_and_swap(&pool->free_head, head,
+                                           (head & ~(SXE_POOL_FREE_TAG - 1)) + SXE_POOL_FREE_TAG
+                                         + SXE_POOL_NODES(pool)[top - 1].last.next_free));
+
+    return top - 1;
+}
+
+static void
+sxe_pool_free_push(SXE_POOL_IMPL * pool, unsigned id)
+{
+    uint64_t head;
+
+    do {
+        head                                    = pool->free_head;
+        SXE_POOL_NODES(pool)[id].last.next_free = SXE_POOL_FREE_TOP(head);
+    } while (!__sync_bool_compare_and_swap(&pool->free_head, head, (head & ~(SXE_POOL_FREE_TAG - 1)) + SXE_POOL_FREE_TAG + id + 1));
+}
+
+/* Find this thread's free cache for a lock-free pool, claiming an empty one if there is none. A cache left by a destroyed pool at
+ * the same address is reclaimed. Returns NULL if the pool is too small to cache or if every cache holds elements of other pools.
+ */
+static SXE_POOL_CACHE *
+sxe_pool_cache_get(SXE_POOL_IMPL * pool)
+{
+    SXE_POOL_CACHE * empty = NULL;
+    unsigned         i;
+
+    if (pool->number < SXE_POOL_CACHE_DIVISOR) {
+        return NULL;
+    }
+
+    for (i = 0; i < SXE_POOL_CACHES; i++) {
+        if (sxe_pool_caches[i].pool == pool) {
+            /* A stale serial number means the cached elements belong to a destroyed pool that this one has replaced
+             */
+            if (sxe_pool_caches[i].serial != pool->serial) {
+                sxe_pool_caches[i].count  = 0;
+                sxe_pool_caches[i].serial = pool->serial;
+            }
+
+            return &sxe_pool_caches[i];
+        }
+
+        if (empty == NULL && sxe_pool_caches[i].count == 0) {
+            empty = &sxe_pool_caches[i];
+        }
+    }
+
+    if (empty != NULL) {
+        empty->pool   = pool;
+        empty->serial = pool->serial;
+    }
+
+    return empty;
+}
+
+static unsigned
+sxe_pool_cache_maximum(SXE_POOL_IMPL * pool)
+{
+    return pool->number / SXE_POOL_CACHE_DIVISOR < SXE_POOL_CACHE_SIZE ? pool->number / SXE_POOL_CACHE_DIVISOR
+                                                                        : SXE_POOL_CACHE_SIZE;
+}
+
+/* Take a free element from a lock-free pool, refilling this thread's cache with a batch from the free stack when it's empty
+ */
+static unsigned
+sxe_pool_lock_free_take(SXE_POOL_IMPL * pool)
+{
+    SXE_POOL_CACHE * cache = sxe_pool_cache_get(pool);
+    unsigned         id;
+
+    if (cache == NULL) {
+        return sxe_pool_free_pop(pool);
+    }
+
+    while (cache->count < (sxe_pool_cache_maximum(pool) + 1) / 2 && (id = sxe_pool_free_pop(pool)) != SXE_POOL_NO_INDEX) {
+        cache->ids[cache->count++] = id;
+    }
+
+    return cache->count == 0 ? SXE_POOL_NO_INDEX : cache->ids[--cache->count];
+}
+
+/* Give a free element back to a lock-free pool, spilling half of this thread's cache to the free stack when it's full
+ */
+static void
+sxe_pool_lock_free_give(SXE_POOL_IMPL * pool, unsigned id)
+{
+    SXE_POOL_CACHE * cache = sxe_pool_cache_get(pool);
+    unsigned         maximum;
+
+    if (cache == NULL) {
+        sxe_pool_free_push(pool, id);
+        return;
+    }
+
+    if (cache->count == (maximum = sxe_pool_cache_maximum(pool))) {
+        while (cache->count > maximum / 2) {
+            sxe_pool_free_push(pool, cache->ids[--cache->count]);
+        }
+    }
+
+    cache->ids[cache->count++] = id;
+}
+
+/* Move an element of a lock-free pool between states, returning it to the free stack if the new state is 0
+ */
+static bool
+sxe_pool_lock_free_set_state(SXE_POOL_IMPL * pool, unsigned id, unsigned old_state, unsigned new_state)
+{
+    SXEA1(old_state != 0 || new_state == 0, "Lock-free pool %s: only the oldest free element can be taken, not element %u",
+          pool->name, id);
+
+    if (!__sync_bool_compare_and_swap(&SXE_POOL_NODES(pool)[id].list_node.id, old_state, new_state)) {
+        return false;
+    }
+
+    if (old_state != new_state) {
+        __sync_fetch_and_sub(&SXE_POOL_QUEUE(pool)[old_state].length, 1);
+        __sync_fetch_and_add(&SXE_POOL_QUEUE(pool)[new_state].length, 1);
+
+        if (new_state == 0) {
+            sxe_pool_lock_free_give(pool, id);
+        }
+    }
+
+    return true;
+}
+
 const char *
 sxe_pool_get_name(void * array)
 {
@@ -114,8 +273,11 @@ sxe_pool_size(unsigned number, size_t size, unsigned states)
 /**
  * Construct a new pool of <number> objects of size <size> with <states> states
  *
- * @param options = SXE_POOL_OPTION_LOCKED for thread safety
- *                  SXE_POOL_OPTION_TIMED  to keep the time of last insertion for each node
+ * @param options = SXE_POOL_OPTION_LOCKED    for thread safety
+ *                  SXE_POOL_OPTION_TIMED     to keep the time of last insertion for each node
+ *                  SXE_POOL_OPTION_LOCK_FREE for thread safety without a lock; elements in states other than 0 (free) are not
+ *                                            queued, so they can't be walked or taken oldest first, and each thread may cache
+ *                                            a few free elements
  *
  * @return A pointer to the array of objects
  *
@@ -151,6 +313,9 @@ sxe_pool_construct(void * base, const char * name, unsigned number, size_t size,
         sxe_spinlock_construct(&pool->spinlock);
     }
 
+    SXEA1(!(options & SXE_POOL_OPTION_LOCK_FREE) || !(options & (SXE_POOL_OPTION_LOCKED | SXE_POOL_OPTION_TIMED)),
+          "Pool %s: a lock-free pool can't also be locked or timed", name);
+
     strncpy(pool->name, name, sizeof(pool->name));
     pool->name[sizeof(pool->name) - 1] = '\0';
     pool->event_timeout                = NULL;
@@ -163,6 +328,20 @@ sxe_pool_construct(void * base, const char * name, unsigned number, size_t size,
         SXE_LIST_CONSTRUCT(&SXE_POOL_QUEUE(pool)[i], i, SXE_POOL_NODE, list_node);
     }
 
+    if (options & SXE_POOL_OPTION_LOCK_FREE) {
+        SXEL6("Construct the free stack");
+        pool->serial    = __sync_add_and_fetch(&sxe_pool_serial, 1);
+        pool->free_head = number == 0 ? 0 : 1;
+
+        for (i = 0; i < number; i++) {
+            SXE_POOL_NODES(pool)[i].list_node.id    = 0;
+            SXE_POOL_NODES(pool)[i].last.next_free = i + 1 < number ? i + 2 : 0;
+        }
+
+        SXE_POOL_QUEUE(pool)[0].length = number;
+        goto SXE_EARLY_OUT;
+    }
+
     SXEL6("Construct the free list");
 
     log_level_saved = sxe_log_decrease_level(SXE_LOG_LEVEL_DEBUG);    /* Shut up logging on every node */
@@ -186,6 +365,8 @@ sxe_pool_construct(void * base, const char * name, unsigned number, size_t size,
     }
 
     sxe_log_set_level(log_level_saved);
+
+SXE_EARLY_OUT:
     SXER6("return array=%p // pool=%p, pool->nodes=%p, pool->name=%s", pool + 1, pool, SXE_POOL_NODES(pool), pool->name);
     return pool + 1;
 }
@@ -230,7 +411,8 @@ sxe_pool_to_base(void * array)
  * @param size    Size of each element in the pool
  * @param states  Number of states each element can be in
  * @param options SXE_POOL_OPTION_UNLOCKED for speed or SXE_POOL_OPTION_LOCKED for thread safety, and SXE_POOL_OPTION_TIMED to
- *                support timed operations; bit mask, combined with | operator
+ *                support timed operations; bit mask, combined with | operator. SXE_POOL_OPTION_LOCK_FREE is thread safe without
+ *                a lock, but can't be combined with either (see sxe_pool_construct())
  *
  * @return A pointer to the array of objects
  *
@@ -439,6 +621,14 @@ sxe_pool_set_indexed_element_state(void * array, unsigned id, unsigned old_state
     SXEA6(old_state <= pool->states, "state %u is greater than maximum state %u for pool %s", old_state, pool->states, pool->name);
     SXEA6(new_state <= pool->states, "state %u is greater than maximum state %u for pool %s", new_state, pool->states, pool->name);
 
+    if (pool->options & SXE_POOL_OPTION_LOCK_FREE) {
+        SXEA1(sxe_pool_lock_free_set_state(pool, id, old_state, new_state),
+              "sxe_pool_set_indexed_element_state(pool=%s,id=%u,old_state=%s,new_state=%s): Object is in state %s", pool->name,
+              id, (*pool->state_to_string)(old_state), (*pool->state_to_string)(new_state),
+              (*pool->state_to_string)(sxe_pool_index_to_state(array, id)));
+        goto SXE_ERROR_OUT;
+    }
+
     if ((result = sxe_pool_lock(pool)) == SXE_POOL_LOCK_NOT_TAKEN) {
         goto SXE_ERROR_OUT;
     }
@@ -479,6 +669,17 @@ sxe_pool_try_to_set_indexed_element_state(void * array, unsigned id, unsigned ol
     SXEA6(old_state <= pool->states, "state %u is greater than maximum state %u for pool %s", old_state, pool->states, pool->name);
     SXEA6(*new_state_inout <= pool->states, "state %u is greater than maximum state %u for pool %s", *new_state_inout, pool->states, pool->name);
 
+    if (pool->options & SXE_POOL_OPTION_LOCK_FREE) {
+        if (sxe_pool_lock_free_set_state(pool, id, old_state, *new_state_inout)) {
+            result = id;
+        }
+        else {
+            *new_state_inout = sxe_pool_index_to_state(array, id);
+        }
+
+        goto SXE_ERROR_OUT;
+    }
+
     if (sxe_pool_lock(pool) == SXE_POOL_LOCK_NOT_TAKEN) {
         result = SXE_POOL_LOCK_NOT_TAKEN;    /* Coverage exclusion: Add tests before using in multiprocess code */
         goto SXE_ERROR_OUT;                  /* Coverage exclusion: Add tests before using in multiprocess code */
@@ -521,6 +722,29 @@ sxe_pool_set_oldest_element_state(void * array, unsigned old_state, unsigned new
     SXEA6(new_state <= pool->states, "new state %u is greater than maximum state %u for pool %s", new_state, pool->states,
            pool->name);
 
+    /* Lock-free pools only queue free elements, and hand out whichever one is cheapest to take
+     */
+    if (pool->options & SXE_POOL_OPTION_LOCK_FREE) {
+        SXEA1(old_state == 0, "Lock-free pool %s: elements can only be taken from state 0, not %s", pool->name,
+              (*pool->state_to_string)(old_state));
+
+        if ((result = sxe_pool_lock_free_take(pool)) == SXE_POOL_NO_INDEX) {
+            SXEL6("sxe_pool_set_oldest_element_state(pool=%s): No free objects; returning SXE_POOL_NO_INDEX", pool->name);
+            goto SXE_ERROR_OUT;
+        }
+
+        SXEA1(__sync_bool_compare_and_swap(&SXE_POOL_NODES(pool)[result].list_node.id, 0, new_state),
+              "Lock-free pool %s: free element %u is not in state 0", pool->name, result);
+        __sync_fetch_and_sub(&SXE_POOL_QUEUE(pool)[0].length, 1);
+        __sync_fetch_and_add(&SXE_POOL_QUEUE(pool)[new_state].length, 1);
+
+        if (new_state == 0) {
+            sxe_pool_lock_free_give(pool, result);
+        }
+
+        goto SXE_ERROR_OUT;
+    }
+
     if ((result = sxe_pool_lock(pool)) == SXE_POOL_LOCK_NOT_TAKEN) {
         goto SXE_ERROR_OUT;
     }
@@ -558,6 +782,11 @@ sxe_pool_touch_indexed_element(void * array, unsigned id)
     SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
     SXEE6("sxe_pool_touch_indexed_element(pool=%s,id=%u)", pool->name, id);
 
+    if (pool->options & SXE_POOL_OPTION_LOCK_FREE) {
+        SXEL6("Lock-free pool %s doesn't keep elements in order of use", pool->name);
+        goto SXE_ERROR_OUT;
+    }
+
     if ((result = sxe_pool_lock(pool)) == SXE_POOL_LOCK_NOT_TAKEN) {
         goto SXE_ERROR_OUT;
     }
@@ -586,6 +815,7 @@ sxe_pool_get_oldest_element_index(void * array, unsigned state)
     SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
     SXEE6("sxe_pool_get_oldest_element_index(pool=%s, state=%s)", pool->name, (*pool->state_to_string)(state));
     SXEA6(state <= pool->states, "state %u is greater than maximum state %u for pool %s", state, pool->states, pool->name);
+    SXEA1(!(pool->options & SXE_POOL_OPTION_LOCK_FREE), "Lock-free pool %s doesn't keep elements in order of use", pool->name);
 
     if (sxe_pool_lock(pool) == SXE_POOL_LOCK_NOT_TAKEN) {
         goto SXE_ERROR_OUT;  /* Coverage exclusion: Add tests before using in multiprocess code */
@@ -620,6 +850,7 @@ sxe_pool_impl_get_oldest_element_time_or_count(SXE_POOL_IMPL * pool, unsigned st
 
     SXEE6("sxe_pool_get_oldest_element_%s(pool=%s, state=%s)", pool->options & SXE_POOL_OPTION_TIMED ? "time" : "count",
            pool->name, (*pool->state_to_string)(state));
+    SXEA1(!(pool->options & SXE_POOL_OPTION_LOCK_FREE), "Lock-free pool %s doesn't keep elements in order of use", pool->name);
 
     if (sxe_pool_lock(pool) == SXE_POOL_LOCK_NOT_TAKEN) {
         goto SXE_ERROR_OUT;  /* Coverage exclusion: Add tests before using in multiprocess code */
@@ -714,10 +945,39 @@ sxe_pool_delete(void * array)
         SXEA1(sxe_list_remove(&sxe_pool_timeout_list, pool) == pool, "Remove always returns the object removed");
     }
 
+    if (pool->options & SXE_POOL_OPTION_LOCK_FREE) {
+        sxe_pool_lock_free_flush(array);    /* Other threads' caches can't match the pool's serial number again */
+    }
+
     free(pool);
     SXER6("return");
 }
 
+/**
+ * Return the free elements that the calling thread has cached for a lock-free pool to the pool
+ *
+ * @note Call this before a thread that has freed elements of a lock-free pool exits, or the elements remain in its cache
+ */
+void
+sxe_pool_lock_free_flush(void * array)
+{
+    SXE_POOL_IMPL * pool = SXE_POOL_ARRAY_TO_IMPL(array);
+    unsigned        i;
+
+    SXE_POOL_ASSERT_ARRAY_INITIALIZED(array);
+    SXEE6("(pool=%s)", pool->name);
+
+    for (i = 0; i < SXE_POOL_CACHES; i++) {
+        if (sxe_pool_caches[i].pool == pool && sxe_pool_caches[i].serial == pool->serial) {
+            while (sxe_pool_caches[i].count > 0) {
+                sxe_pool_free_push(pool, sxe_pool_caches[i].ids[--sxe_pool_caches[i].count]);
+            }
+        }
+    }
+
+    SXER6("return");
+}
+
 /**
  * Reset the lock on a pool
  *
@@ -35,6 +35,7 @@
 #define SXE_POOL_OPTION_UNLOCKED       0
 #define SXE_POOL_OPTION_LOCKED         SXE_BIT_OPTION(0)
 #define SXE_POOL_OPTION_TIMED          SXE_BIT_OPTION(1)
+#define SXE_POOL_OPTION_LOCK_FREE      SXE_BIT_OPTION(2)    /* Thread safe without a lock; state 0 must be the free state */
 
 typedef void (*SXE_POOL_EVENT_TIMEOUT)(    void * array, unsigned array_index, void * caller_info);
 
@@ -0,0 +1,242 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sxe-log.h"
+#include "sxe-pool.h"
+#include "sxe-thread.h"
+#include "sxe-time.h"
+#include "tap.h"
+
+#define TEST_ELEMENT_NUMBER 256
+#define TEST_THREADS        4
+#define TEST_ITERATIONS     200000
+#define TEST_HELD           8       /* Elements each thread holds at once, so allocations and frees interleave */
+
+typedef enum TEST_STATE {
+    TEST_STATE_FREE,
+    TEST_STATE_USED,
+    TEST_STATE_DONE,
+    TEST_STATE_NUMBER_OF_STATES    /* This is not a state and must be last */
+} TEST_STATE;
+
+typedef struct TEST_ELEMENT {
+    uintptr_t owner;
+} TEST_ELEMENT;
+
+static TEST_ELEMENT * test_array;
+static unsigned       test_options;
+static unsigned       test_collisions[TEST_THREADS];
+static unsigned       test_empties[TEST_THREADS];
+
+/* Take and give elements as fast as possible, checking that no other thread is handed an element while this one holds it
+ */
+static SXE_THREAD_RETURN SXE_STDCALL
+test_contender_thread(void * which_as_ptr)
+{
+    uintptr_t which = (uintptr_t)which_as_ptr;
+    unsigned  held[TEST_HELD];
+    unsigned  i;
+    unsigned  j;
+
+    for (j = 0; j < TEST_HELD; j++) {
+        held[j] = SXE_POOL_NO_INDEX;
+    }
+
+    for (i = 0; i < TEST_ITERATIONS; i++) {
+        j = i % TEST_HELD;
+
+        if (held[j] != SXE_POOL_NO_INDEX) {
+            test_collisions[which] += test_array[held[j]].owner != which + 1;
+            test_array[held[j]].owner = 0;
+            while (sxe_pool_set_indexed_element_state(test_array, held[j], TEST_STATE_USED, TEST_STATE_FREE)
+                == SXE_POOL_LOCK_NOT_TAKEN) {
+            }
+        }
+
+        if ((held[j] = sxe_pool_set_oldest_element_state(test_array, TEST_STATE_FREE, TEST_STATE_USED)) >= TEST_ELEMENT_NUMBER) {
+            held[j] = SXE_POOL_NO_INDEX;    /* Empty, or the lock wasn't taken */
+            test_empties[which]++;
+            continue;
+        }
+
+        test_collisions[which]   += test_array[held[j]].owner != 0;
+        test_array[held[j]].owner = which + 1;
+    }
+
+    for (j = 0; j < TEST_HELD; j++) {
+        if (held[j] != SXE_POOL_NO_INDEX) {
+            test_array[held[j]].owner = 0;
+
+            while (sxe_pool_set_indexed_element_state(test_array, held[j], TEST_STATE_USED, TEST_STATE_FREE)
+                == SXE_POOL_LOCK_NOT_TAKEN) {
+            }
+        }
+    }
+
+    if (test_options & SXE_POOL_OPTION_LOCK_FREE) {
+        sxe_pool_lock_free_flush(test_array);
+    }
+
+    return 0;
+}
+
+static double
+test_contention(unsigned options, unsigned * collisions_out)
+{
+    SXE_THREAD thread[TEST_THREADS];
+    SXE_TIME   start_time;
+    uintptr_t  i;
+
+    test_options    = options;
+    test_array      = sxe_pool_new(options & SXE_POOL_OPTION_LOCK_FREE ? "lock-free" : "locked", TEST_ELEMENT_NUMBER,
+                                   sizeof(TEST_ELEMENT), TEST_STATE_NUMBER_OF_STATES, options);
+    memset(test_array, 0, TEST_ELEMENT_NUMBER * sizeof(TEST_ELEMENT));
+    memset(test_collisions, 0, sizeof(test_collisions));
+    start_time      = sxe_time_get();
+    *collisions_out = 0;
+
+    for (i = 0; i < TEST_THREADS; i++) {
+        SXEA1(sxe_thread_create(&thread[i], test_contender_thread, (void *)i, SXE_THREAD_OPTION_DEFAULTS) == SXE_RETURN_OK,
+              "Unable to create thread");
+    }
+
+    for (i = 0; i < TEST_THREADS; i++) {
+        sxe_thread_join(thread[i]);
+        *collisions_out += test_collisions[i];
+    }
+
+    return sxe_time_to_double_seconds(sxe_time_get() - start_time);
+}
+
+int
+main(void)
+{
+    unsigned char taken[TEST_ELEMENT_NUMBER];
+    unsigned      duplicates = 0;
+    unsigned      collisions;
+    unsigned      new_state;
+    unsigned      id;
+    unsigned      i;
+    double        locked_seconds;
+    double        lock_free_seconds;
+    void        * base;
+    unsigned      first = 0;
+    unsigned      reused;
+
+    plan_tests(16);
+
+    /* Single threaded semantics
+     */
+    test_array = sxe_pool_new("lock-free", TEST_ELEMENT_NUMBER, sizeof(TEST_ELEMENT), TEST_STATE_NUMBER_OF_STATES,
+                              SXE_POOL_OPTION_LOCK_FREE);
+    memset(taken, 0, sizeof(taken));
+
+    for (i = 0; i < TEST_ELEMENT_NUMBER; i++) {
+        if ((id = sxe_pool_set_oldest_element_state(test_array, TEST_STATE_FREE, TEST_STATE_USED)) == SXE_POOL_NO_INDEX) {
+            break;
+        }
+
+        duplicates += taken[id]++;
+    }
+
+    is(i, TEST_ELEMENT_NUMBER,                                                  "Took all %u elements", TEST_ELEMENT_NUMBER);
+    is(duplicates, 0,                                                           "No element was taken twice");
+    is(sxe_pool_get_number_in_state(test_array, TEST_STATE_USED), TEST_ELEMENT_NUMBER, "All elements are used");
+    is(sxe_pool_set_oldest_element_state(test_array, TEST_STATE_FREE, TEST_STATE_USED), SXE_POOL_NO_INDEX,
+                                                                                "No more elements can be taken");
+
+    sxe_pool_set_indexed_element_state(test_array, 7, TEST_STATE_USED, TEST_STATE_DONE);
+    is(sxe_pool_index_to_state(test_array, 7), TEST_STATE_DONE,                 "Element 7 was moved to DONE");
+    new_state = TEST_STATE_FREE;
+    is(sxe_pool_try_to_set_indexed_element_state(test_array, 7, TEST_STATE_USED, &new_state), SXE_POOL_INCORRECT_STATE,
+                                                                                "Element 7 can't be freed from USED");
+    is(new_state, TEST_STATE_DONE,                                              "...because it is DONE");
+    new_state = TEST_STATE_FREE;
+    is(sxe_pool_try_to_set_indexed_element_state(test_array, 7, TEST_STATE_DONE, &new_state), 7,
+                                                                                "Element 7 can be freed from DONE");
+
+    for (i = 0; i < TEST_ELEMENT_NUMBER; i++) {
+        if (i != 7) {
+            sxe_pool_set_indexed_element_state(test_array, i, TEST_STATE_USED, TEST_STATE_FREE);
+        }
+    }
+
+    is(sxe_pool_get_number_in_state(test_array, TEST_STATE_FREE), TEST_ELEMENT_NUMBER, "All elements were freed");
+    sxe_pool_delete(test_array);
+
+    /* Contention: the same work on a locked pool and a lock-free one
+     */
+    locked_seconds = test_contention(SXE_POOL_OPTION_LOCKED, &collisions);
+    is(collisions, 0,                                                           "Locked pool never handed out a held element");
+    sxe_pool_delete(test_array);
+
+    lock_free_seconds = test_contention(SXE_POOL_OPTION_LOCK_FREE, &collisions);
+    is(collisions, 0,                                                           "Lock-free pool never handed out a held element");
+    is(sxe_pool_get_number_in_state(test_array, TEST_STATE_FREE), TEST_ELEMENT_NUMBER, "All elements are free again");
+    is(sxe_pool_get_number_in_state(test_array, TEST_STATE_USED), 0,            "No elements are used");
+
+    /* Once the threads have flushed their caches, every element can be taken again
+     */
+    memset(taken, 0, sizeof(taken));
+    duplicates = 0;
+
+    for (i = 0; i < TEST_ELEMENT_NUMBER; i++) {
+        if ((id = sxe_pool_set_oldest_element_state(test_array, TEST_STATE_FREE, TEST_STATE_USED)) == SXE_POOL_NO_INDEX) {
+            break;
+        }
+
+        duplicates += taken[id]++;
+    }
+
+    is(i, TEST_ELEMENT_NUMBER,                                                  "All elements can be taken after contention");
+    is(duplicates, 0,                                                           "No element was taken twice");
+    sxe_pool_delete(test_array);
+
+    /* A pool constructed where a destroyed one was reuses the thread's cache that was left behind, rather than leaking it. The
+     * first take refills the cache from the free stack, so it returns the same element each time the same cache is used.
+     */
+    SXEA1(base = malloc(sxe_pool_size(TEST_ELEMENT_NUMBER, sizeof(TEST_ELEMENT), TEST_STATE_NUMBER_OF_STATES)),
+          "Couldn't allocate a pool");
+
+    for (i = 0, reused = 0; i < 8; i++) {    /* More pools than a thread keeps caches for */
+        test_array = sxe_pool_construct(base, "reused", TEST_ELEMENT_NUMBER, sizeof(TEST_ELEMENT), TEST_STATE_NUMBER_OF_STATES,
+                                        SXE_POOL_OPTION_LOCK_FREE);
+        id = sxe_pool_set_oldest_element_state(test_array, TEST_STATE_FREE, TEST_STATE_USED);
+        sxe_pool_set_indexed_element_state(test_array, id, TEST_STATE_USED, TEST_STATE_FREE);    /* Left in this thread's cache */
+
+        if (i == 0) {
+            first = id;
+        }
+
+        reused += id == first;
+    }
+
+    is(reused, i,                                                               "Every pool at the same address reused its cache");
+    free(base);
+
+    diag("%u threads x %u take/give pairs: locked %.3f seconds, lock-free %.3f seconds", TEST_THREADS, TEST_ITERATIONS,
+         locked_seconds, lock_free_seconds);
+    return exit_status();
+}
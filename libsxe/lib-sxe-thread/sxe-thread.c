@@ -23,6 +23,7 @@
 #include <string.h>
 
 #include "sxe-thread.h"
+#include "sxe-util.h"
 
 SXE_RETURN
 sxe_thread_create(SXE_THREAD * thread, SXE_THREAD_RETURN (SXE_STDCALL * thread_main)(void *), void * user_data, unsigned options)
@@ -65,3 +66,35 @@ SXE_EARLY_OUT:
     SXER6("return %s", sxe_return_to_string(result));
     return result;
 }
+
+SXE_RETURN
+sxe_thread_join(SXE_THREAD thread)
+{
+    SXE_RETURN result = SXE_RETURN_ERROR_INTERNAL;
+    int        error;
+
+    SXEE6("sxe_thread_join(thread=%p)", SXE_CAST(void *, thread));
+
+#ifdef _WIN32
+    if (WaitForSingleObject(thread, INFINITE) == WAIT_OBJECT_0) {    /* Coverage Exclusion - todo: win32 coverage */
+        CloseHandle(thread);                                          /* Coverage Exclusion - todo: win32 coverage */
+        result = SXE_RETURN_OK;                                       /* Coverage Exclusion - todo: win32 coverage */
+        goto SXE_EARLY_OUT;                                           /* Coverage Exclusion - todo: win32 coverage */
+    }
+
+    error = sxe_socket_get_last_error();                                                         /* Coverage Exclusion - todo: win32 coverage */
+    SXEL2("sxe_thread_join: Failed to join a thread: %s", sxe_socket_error_as_str(error));      /* Coverage Exclusion - todo: win32 coverage */
+
+#else /* POSIX */
+    if ((error = pthread_join(thread, NULL)) == 0) {
+        result = SXE_RETURN_OK;
+        goto SXE_EARLY_OUT;
+    }
+
+    SXEL2("sxe_thread_join: Unexpected error joining a thread: %s", strerror(error));    /* Coverage Exclusion - Failure case */
+#endif
+
+SXE_EARLY_OUT:
+    SXER6("return %s", sxe_return_to_string(result));
+    return result;
+}
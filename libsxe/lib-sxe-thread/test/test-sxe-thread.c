@@ -32,6 +32,7 @@
 
 #include "sxe-spinlock.h"
 #include "sxe-thread.h"
+#include "sxe-util.h"
 #include "tap.h"
 
 #define TEST_YIELD_MAX 1000000
@@ -81,14 +82,24 @@ test_thread_main(void * lock)
     return (SXE_THREAD_RETURN)0;
 }
 
+static SXE_THREAD_RETURN SXE_STDCALL
+test_thread_exit(void * done)
+{
+    SXEE6("test_thread_exit(done=%p)", done);
+    *(volatile unsigned *)done = 1;
+    SXER6("return NULL");
+    return (SXE_THREAD_RETURN)0;
+}
+
 int
 main(void)
 {
-    SXE_THREAD thread;
-    SXE_RETURN result;
-    unsigned   i;
+    SXE_THREAD        thread;
+    SXE_RETURN        result;
+    unsigned          i;
+    volatile unsigned done = 0;
 
-    plan_tests(6);
+    plan_tests(8);
     sxe_log_hook_line_out(test_log_line);
     test_log_level = sxe_log_set_level(SXE_LOG_LEVEL_TRACE);    /* Required to do indentation test */
     sxe_spinlock_construct(&ping);
@@ -110,5 +121,9 @@ main(void)
     is(sxe_spinlock_take(&pong), SXE_SPINLOCK_STATUS_TAKEN, "Pong lock taken by main");
     ok(main_indent > 0,                                     "Main log indent set to %u", main_indent);
     ok(thread_indent > main_indent,                         "Thread indent is greater than main indent");
+
+    sxe_thread_create(&thread, test_thread_exit, SXE_CAST_NOCONST(void *, &done), SXE_THREAD_OPTION_DEFAULTS);
+    is(sxe_thread_join(thread), SXE_RETURN_OK,              "Joined a thread that exited");
+    is(done, 1,                                             "The joined thread ran to completion");
     return exit_status();
 }
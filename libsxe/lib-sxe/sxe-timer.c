@@ -23,7 +23,7 @@
 #include "sxe.h"
 #include "sxe-log.h"
 
-extern struct ev_loop * sxe_private_main_loop;
+extern __thread struct ev_loop * sxe_private_main_loop;    /* The loop run by the calling thread */
 
 void
 sxe_timer_init(ev_timer* timer, void(*cb)(EV_P_ ev_timer *w, int revents), double after, double repeat)
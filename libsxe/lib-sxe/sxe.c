@@ -50,6 +50,7 @@
 #else
 # include <linux/sockios.h>    /* For SIOCINQ: This appears to be Linux specific; under FreeBSD, use MSG_PEEK */
 # include <sys/sendfile.h>
+# define SXE_HAVE_MMSG 1       /* recvmmsg() and sendmmsg() are Linux specific                                */
 #endif
 
 #include <netdb.h>
@@ -64,6 +65,8 @@
 #include "sxe-log.h"
 #include "sxe-pool.h"
 #include "sxe-socket.h"
+#include "sxe-spinlock.h"
+#include "sxe-thread.h"
 #include "sxe-util.h"
 #include "sxe-test.h"         /* for test_tap_ev_queue_shift_wait_get_deferred_count */
 
@@ -81,6 +84,39 @@ typedef union SXE_CONTROL_MESSAGE_FD {
 
 #define SXE_WANT_CALLER_READS_UDP 0
 
+#if defined(TCP_CORK)
+#define SXE_TCP_CORK TCP_CORK      /* Linux         */
+#elif defined(TCP_NOPUSH)
+#define SXE_TCP_CORK TCP_NOPUSH    /* BSD and MacOS */
+#endif
+
+#if SXE_HAVE_MMSG
+/* Datagrams received by one recvmmsg() call on a batched UDP SXE. They are delivered to the read callback one at a time; any
+ * that don't fit in the input buffer are held here until the caller drains it.
+ */
+struct SXE_UDP_BATCH {
+    unsigned             size;        /* Maximum number of datagrams per recvmmsg()     */
+    unsigned             next;        /* Index of the next datagram to deliver           */
+    unsigned             received;    /* Number of datagrams returned by recvmmsg()      */
+    struct mmsghdr     * headers;
+    struct iovec       * vectors;
+    struct sockaddr_in * addrs;
+    char               * bufs;        /* 'size' buffers of SXE_BUF_SIZE bytes           */
+};
+#endif
+
+/* Input buffers are only attached to a SXE while it has data pending. Detached buffers are kept for reuse in per loop free
+ * lists, one for each power of two size class, so that idle connections don't hold any buffer memory. The free list links
+ * are kept in a trailer after each buffer, so a detached buffer's data is left intact until the buffer is reused.
+ */
+#define SXE_BUF_CLASS_MINIMUM 10    /* Smallest buffer allocated is 1KB                         */
+#define SXE_BUF_CLASS_MAXIMUM 24    /* Largest buffer allocated is 16MB (SXE_BUF_SIZE_MAXIMUM)  */
+#define SXE_BUF_CACHE_MAXIMUM 64    /* Free buffers kept per size class; any more are freed     */
+
+typedef struct SXE_BUF_FREE {
+    struct SXE_BUF_FREE * next;
+} SXE_BUF_FREE;
+
 typedef enum SXE_STATE {
     SXE_STATE_FREE,
     SXE_STATE_USED,
@@ -99,19 +135,165 @@ sxe_state_to_string(unsigned state)                         /* coverage exclusio
     }                                                       /* coverage exclusion: state to string */
 }                                                           /* coverage exclusion: state to string */
 
-int                     sxe_caller_read_udp_length;      /* If is_caller_reads_udp caller returns length read here */
-struct ev_loop        * sxe_private_main_loop = NULL;    /* Private to this package; do not export via sxe.h       */
-
-static unsigned         sxe_extra_size        = 0;
-static unsigned         sxe_array_total       = 0;
-static SXE            * sxe_array             = NULL;
-static unsigned         sxe_stat_total_accept = 0;
-static unsigned         sxe_stat_total_read   = 0;
-static unsigned         sxe_has_been_inited   = 0;
-static int              sxe_listen_backlog    = SOMAXCONN;
+/* A call queued by sxe_loop_post() to be made on another loop's thread
+ */
+typedef struct SXE_LOOP_CALL_NODE {
+    struct SXE_LOOP_CALL_NODE * next;
+    SXE_LOOP_CALL               call;
+    void                      * arg;
+} SXE_LOOP_CALL_NODE;
+
+/* A libev loop and the thread that runs it. Loop 0 is the default loop, run by the thread that called sxe_init(); the others
+ * are created by sxe_init() when sxe_register_loops() asks for more than one, and each has its own SXE pool.
+ */
+typedef struct SXE_LOOP {
+    struct ev_loop     * ev_loop;
+    SXE_THREAD           thread;
+    struct ev_async      wakeup;      /* Sent by sxe_loop_post() and sxe_fini()  */
+    SXE_SPINLOCK         lock;        /* Protects calls and stopping             */
+    SXE_LOOP_CALL_NODE * calls;       /* Calls posted to this loop, newest first */
+    bool                 stopping;
+    unsigned             index;
+} SXE_LOOP;
+
+         int              sxe_caller_read_udp_length;      /* If is_caller_reads_udp caller returns length read here */
+__thread struct ev_loop * sxe_private_main_loop = NULL;    /* Private to this package; do not export via sxe.h       */
+
+static          unsigned         sxe_extra_size           = 0;
+static          unsigned         sxe_array_total          = 0;    /* Number of SXEs in each loop's pool             */
+static __thread SXE            * sxe_array                = NULL;
+static __thread unsigned         sxe_stat_total_accept    = 0;
+static __thread unsigned         sxe_stat_total_read      = 0;
+static          unsigned         sxe_has_been_inited      = 0;
+static          int              sxe_listen_backlog       = SOMAXCONN;
+static          unsigned         sxe_loop_total           = 1;
+static          SXE_LOOP       * sxe_loops                = NULL; /* sxe_loop_total loops if sxe_register_loops() was called */
+static          SXE_LOOP_START   sxe_loop_start           = NULL;
+static          void           * sxe_loop_start_user_data = NULL;
+static __thread unsigned         sxe_loop_index           = 0;
+static __thread SXE_BUF_FREE   * sxe_buf_cache[SXE_BUF_CLASS_MAXIMUM + 1];
+static __thread unsigned         sxe_buf_cache_count[SXE_BUF_CLASS_MAXIMUM + 1];
 
 static inline bool sxe_is_free(SXE * this) {return sxe_pool_index_to_state(sxe_array, this->id) == SXE_STATE_FREE;}
 
+static unsigned
+sxe_buf_class(unsigned size)
+{
+    unsigned class = SXE_BUF_CLASS_MINIMUM;
+
+    while ((1U << class) < size) {
+        class++;
+    }
+
+    return class;
+}
+
+/* Return a detached buffer of 'size' bytes to this loop's cache
+ */
+static void
+sxe_buf_cache_put(char * buf, unsigned size)
+{
+    unsigned       class = sxe_buf_class(size);
+    SXE_BUF_FREE * node  = (SXE_BUF_FREE *)(void *)(buf + (1U << class));
+
+    if (sxe_buf_cache_count[class] >= SXE_BUF_CACHE_MAXIMUM) {
+        free(buf);
+        return;
+    }
+
+    node->next           = sxe_buf_cache[class];
+    sxe_buf_cache[class] = node;
+    sxe_buf_cache_count[class]++;
+}
+
+/* Free all of the buffers in this loop's cache, including any still attached to its SXEs
+ */
+static void
+sxe_buf_cache_free(void)
+{
+    SXE_BUF_FREE * node;
+    unsigned       class;
+    unsigned       id;
+
+    for (id = 0; id < sxe_array_total; id++) {
+        free(sxe_array[id].in_buf);
+        sxe_array[id].in_buf  = NULL;
+        sxe_array[id].in_size = 0;
+    }
+
+    for (class = SXE_BUF_CLASS_MINIMUM; class <= SXE_BUF_CLASS_MAXIMUM; class++) {
+        while ((node = sxe_buf_cache[class]) != NULL) {
+            sxe_buf_cache[class] = node->next;
+            free((char *)node - (1U << class));
+        }
+
+        sxe_buf_cache_count[class] = 0;
+    }
+}
+
+/* Attach a buffer of 'size' bytes to a SXE, moving any unconsumed data from its current buffer to the start of the new one.
+ * Returns false if the buffer can't be allocated, leaving the SXE unchanged.
+ */
+static bool
+sxe_buf_attach(SXE * this, unsigned size)
+{
+    unsigned class = sxe_buf_class(size);
+    char   * buf;
+
+    SXEA6I(size >= SXE_BUF_USED(this), "Can't attach a %u byte buffer to a SXE with %u bytes pending", size, SXE_BUF_USED(this));
+
+    if (sxe_buf_cache[class] != NULL) {
+        buf                  = (char *)sxe_buf_cache[class] - (1U << class);
+        sxe_buf_cache[class] = sxe_buf_cache[class]->next;
+        sxe_buf_cache_count[class]--;
+    }
+    else if ((buf = malloc((1U << class) + sizeof(SXE_BUF_FREE))) == NULL) {
+        SXEL2I("Couldn't allocate a %u byte input buffer", 1U << class);
+        return false;
+    }
+
+    if (this->in_buf != NULL) {
+        memcpy(buf, SXE_BUF(this), SXE_BUF_USED(this));
+        sxe_buf_cache_put(this->in_buf, this->in_size);
+        this->in_total   -= this->in_consumed;
+        this->in_consumed = 0;
+    }
+
+    SXEL6I("Attached a %u byte input buffer", size);
+    this->in_buf  = buf;
+    this->in_size = size;
+    return true;
+}
+
+/* Make sure the SXE has a buffer to read into; it starts at SXE_BUF_SIZE bytes (or less, if that's its maximum)
+ */
+static bool
+sxe_buf_reserve(SXE * this)
+{
+    return this->in_buf != NULL || sxe_buf_attach(this, this->in_maximum < SXE_BUF_SIZE ? this->in_maximum : SXE_BUF_SIZE);
+}
+
+static void
+sxe_buf_detach(SXE * this)
+{
+    if (this->in_buf != NULL) {
+        sxe_buf_cache_put(this->in_buf, this->in_size);
+        this->in_buf  = NULL;
+        this->in_size = 0;
+    }
+}
+
+/* Detach an open SXE's buffer once there is no data pending in it. A closed SXE keeps its buffer until it is reused, so that
+ * the last data read can still be inspected after the close.
+ */
+static void
+sxe_buf_detach_if_empty(SXE * this)
+{
+    if (this->in_total == 0 && this->socket != SXE_SOCKET_INVALID) {
+        sxe_buf_detach(this);
+    }
+}
+
 static unsigned
 get_deferred_count(void)
 {
@@ -170,6 +352,7 @@ deferred_resume_invoke(SXE * this)
     SXEE6I("()");
     SXEL6I("Invoking read event for %u bytes of cached data", SXE_BUF_USED(this));
     (*this->in_event_read)(this, SXE_BUF_USED(this));
+    sxe_buf_detach_if_empty(this);
     SXER6I("return");
 }
 
@@ -274,6 +457,178 @@ sxe_register(unsigned number_of_connections, unsigned extra_size)
     SXER6("return");
 }
 
+/**
+ * Ask sxe_init() to run more than one libev loop
+ *
+ * @param loops     Number of loops; loop 0 is the default loop, run by the caller; the others each get their own thread
+ * @param start     Function called on each loop's thread once its SXE pool is ready, to create that loop's SXEs
+ * @param user_data Passed to start
+ *
+ * @note Each loop has its own pool of the number of SXEs registered with sxe_register(), its own deferred events and its own
+ *       statistics. A SXE must only be used on the thread of the loop that allocated it. Use sxe_listen_shared() to have the
+ *       kernel spread connections across a listener on each loop, and sxe_loop_post() to hand work between loops.
+ */
+void
+sxe_register_loops(unsigned loops, SXE_LOOP_START start, void * user_data)
+{
+    SXEE6("sxe_register_loops(loops=%u,start=%p,user_data=%p)", loops, start, user_data);
+    SXEA1(sxe_has_been_inited == 0, "SXE has already been init()'d");
+    SXEA1(loops > 0,                "sxe_register_loops: at least one loop is required");
+    SXEA1(start != NULL,            "sxe_register_loops: a start function is required");
+    sxe_loop_total           = loops;
+    sxe_loop_start           = start;
+    sxe_loop_start_user_data = user_data;
+    SXER6("return");
+}
+
+/**
+ * Get the index of the loop run by the calling thread; 0 unless called on a thread created for sxe_register_loops()
+ */
+unsigned
+sxe_loop_get_index(void)
+{
+    return sxe_loop_index;
+}
+
+/**
+ * Get the number of loops; 1 unless sxe_register_loops() asked for more
+ */
+unsigned
+sxe_loop_get_count(void)
+{
+    return sxe_loop_total;
+}
+
+/* Make the calls posted to a loop, oldest first, on the loop's own thread; stop the loop if sxe_fini() has asked it to.
+ */
+static void
+sxe_loop_wakeup(EV_P_ struct ev_async * wakeup, int revents)
+{
+    SXE_LOOP           * sxe_loop = (SXE_LOOP *)wakeup->data;
+    SXE_LOOP_CALL_NODE * calls;
+    SXE_LOOP_CALL_NODE * oldest   = NULL;
+    SXE_LOOP_CALL_NODE * node;
+    bool                 stopping;
+
+    SXE_UNUSED_PARAMETER(revents);
+    SXEE6("sxe_loop_wakeup(loop=%u)", sxe_loop->index);
+
+    SXEA1(sxe_spinlock_take(&sxe_loop->lock) == SXE_SPINLOCK_STATUS_TAKEN, "Couldn't lock loop %u", sxe_loop->index);
+    calls           = sxe_loop->calls;
+    stopping        = sxe_loop->stopping;
+    sxe_loop->calls = NULL;
+    sxe_spinlock_give(&sxe_loop->lock);
+
+    while ((node = calls) != NULL) {    /* Reverse the calls so that they're made in the order they were posted */
+        calls      = node->next;
+        node->next = oldest;
+        oldest     = node;
+    }
+
+    while ((node = oldest) != NULL) {
+        oldest = node->next;
+        (*node->call)(node->arg);
+        free(node);
+    }
+
+    if (stopping) {
+        SXEL6("Stopping loop %u", sxe_loop->index);
+        ev_unloop(EV_A, EVUNLOOP_ALL);
+    }
+
+    SXER6("return");
+}
+
+/**
+ * Call a function on the thread that runs a loop
+ *
+ * @param loop The index of the loop; may be the caller's own loop
+ * @param call The function to call from the loop
+ * @param arg  Passed to call
+ *
+ * @return SXE_RETURN_OK or SXE_RETURN_ERROR_ALLOC if the call couldn't be queued
+ *
+ * @note Calls posted to a loop by one thread are made in the order they were posted. Any calls that haven't been made when
+ *       sxe_fini() is called are discarded.
+ */
+SXE_RETURN
+sxe_loop_post(unsigned loop, SXE_LOOP_CALL call, void * arg)
+{
+    SXE_RETURN           result = SXE_RETURN_ERROR_ALLOC;
+    SXE_LOOP           * sxe_loop;
+    SXE_LOOP_CALL_NODE * node;
+
+    SXEE6("sxe_loop_post(loop=%u,call=%p,arg=%p)", loop, call, arg);
+    SXEA1(sxe_loops != NULL,      "sxe_loop_post: sxe_register_loops() was not called before sxe_init()");
+    SXEA1(loop < sxe_loop_total,  "sxe_loop_post: loop %u is not less than the number of loops (%u)", loop, sxe_loop_total);
+
+    if ((node = malloc(sizeof(*node))) == NULL) {
+        SXEL2("sxe_loop_post: Couldn't allocate a call to loop %u", loop);
+        goto SXE_ERROR_OUT;
+    }
+
+    sxe_loop   = &sxe_loops[loop];
+    node->call = call;
+    node->arg  = arg;
+    SXEA1(sxe_spinlock_take(&sxe_loop->lock) == SXE_SPINLOCK_STATUS_TAKEN, "Couldn't lock loop %u", loop);
+    node->next      = sxe_loop->calls;
+    sxe_loop->calls = node;
+    sxe_spinlock_give(&sxe_loop->lock);
+    ev_async_send(sxe_loop->ev_loop, &sxe_loop->wakeup);
+    result = SXE_RETURN_OK;
+
+SXE_EARLY_OR_ERROR_OUT:
+    SXER6("return %s", sxe_return_to_string(result));
+    return result;
+}
+
+/* Give the calling thread its SXE pool and make loop the one it runs.
+ */
+static void
+sxe_init_loop(struct ev_loop * loop)
+{
+    unsigned id;
+
+    SXEL6("Allocating %u SXEs of %zu bytes each for loop %u", sxe_array_total, sizeof(SXE) + sxe_extra_size, sxe_loop_index);
+    sxe_array = sxe_pool_new("sxe_pool", sxe_array_total, sizeof(SXE) + sxe_extra_size, SXE_STATE_NUMBER_OF_STATES,
+                             SXE_POOL_OPTION_TIMED);
+    sxe_pool_set_state_to_string(sxe_array, sxe_state_to_string);
+
+    for (id = 0; id < sxe_array_total; id++) {
+        sxe_array[id].in_buf  = NULL;
+        sxe_array[id].in_size = 0;
+    }
+
+    sxe_private_main_loop = loop;
+    ev_set_loop_release_cb(sxe_private_main_loop, deferred_generic_invoke, NULL); /* set release callback, NULL for acquire callback */
+}
+
+static SXE_THREAD_RETURN SXE_STDCALL
+sxe_loop_thread(void * user_data)
+{
+    SXE_LOOP * sxe_loop = (SXE_LOOP *)user_data;
+    unsigned   id;
+
+    sxe_loop_index = sxe_loop->index;
+    SXEE6("sxe_loop_thread(loop=%u)", sxe_loop_index);
+    sxe_init_loop(sxe_loop->ev_loop);
+    (*sxe_loop_start)(sxe_loop_index, sxe_loop_start_user_data);
+    ev_loop(sxe_private_main_loop, 0);
+
+    for (id = 0; id < sxe_array_total; id++) {    /* Close this loop's SXEs; no other thread can */
+        if (sxe_pool_index_to_state(sxe_array, id) != SXE_STATE_FREE) {
+            sxe_close(&sxe_array[id]);
+        }
+    }
+
+    sxe_buf_cache_free();
+    sxe_pool_delete(sxe_array);
+    sxe_array             = NULL;
+    sxe_private_main_loop = NULL;
+    SXER6("return NULL");
+    return (SXE_THREAD_RETURN)0;
+}
+
 /* Under Windows, stub out signal handling; libev doesn't grab the SIGCHLD signal in Windows
  * TODO: Make an abstract function for starting libev that hides this.
  */
@@ -308,6 +663,7 @@ sxe_init(void)
 {
     SXE_RETURN       result = SXE_RETURN_ERROR_INTERNAL;
     struct sigaction sigaction_saved;
+    unsigned         i;
 
     SXEE6("sxe_init()");
     SXEA1(!sxe_has_been_inited, "sxe_init: SXE is already initialized");
@@ -318,11 +674,6 @@ sxe_init(void)
 
     /* TODO: Check that sxe_array_total is smaller than system ulimit -n */
 
-    SXEL6("Allocating %u SXEs of %zu bytes each", sxe_array_total, sizeof(SXE) + sxe_extra_size);
-    sxe_array = sxe_pool_new("sxe_pool", sxe_array_total, sizeof(SXE) + sxe_extra_size, SXE_STATE_NUMBER_OF_STATES,
-                             SXE_POOL_OPTION_TIMED);
-    sxe_pool_set_state_to_string(sxe_array, sxe_state_to_string);
-
     if (!sxe_private_main_loop) {
         /* Initialize libev, but don't let it take over the SIGCHLD signal.
          */
@@ -338,8 +689,29 @@ sxe_init(void)
             ev_backend(sxe_private_main_loop) == EVBACKEND_PORT    ? "EVBACKEND_PORT"    : "Unknown backend!" );
     }
 
-    ev_set_loop_release_cb (sxe_private_main_loop, deferred_generic_invoke, NULL); /* set release callback, NULL for acquire callback */
+    sxe_init_loop(sxe_private_main_loop);
 
+    if (sxe_loop_start != NULL) {
+        SXEA1((sxe_loops = calloc(sxe_loop_total, sizeof(*sxe_loops))) != NULL, "sxe_init: Couldn't allocate %u loops",
+              sxe_loop_total);
+
+        for (i = 0; i < sxe_loop_total; i++) {
+            sxe_loops[i].index = i;
+            sxe_loops[i].ev_loop = i == 0 ? sxe_private_main_loop : ev_loop_new(EVFLAG_AUTO);
+            SXEA1(sxe_loops[i].ev_loop != NULL, "sxe_init: Couldn't create libev loop %u", i);
+            sxe_spinlock_construct(&sxe_loops[i].lock);
+            ev_async_init(&sxe_loops[i].wakeup, sxe_loop_wakeup);
+            sxe_loops[i].wakeup.data = &sxe_loops[i];
+            ev_async_start(sxe_loops[i].ev_loop, &sxe_loops[i].wakeup);
+        }
+
+        for (i = 1; i < sxe_loop_total; i++) {
+            SXEA1(sxe_thread_create(&sxe_loops[i].thread, sxe_loop_thread, &sxe_loops[i], SXE_THREAD_OPTION_DEFAULTS)
+                  == SXE_RETURN_OK, "sxe_init: Couldn't create a thread for loop %u", i);
+        }
+
+        (*sxe_loop_start)(0, sxe_loop_start_user_data);
+    }
 
     sxe_has_been_inited = 1;
     result = SXE_RETURN_OK;
@@ -347,10 +719,30 @@ sxe_init(void)
     return result;
 }
 
+/* Discard any calls that were posted to a loop but never made
+ */
+static void
+sxe_loop_discard_calls(SXE_LOOP * sxe_loop)
+{
+    SXE_LOOP_CALL_NODE * node;
+
+    while ((node = sxe_loop->calls) != NULL) {
+        sxe_loop->calls = node->next;
+        free(node);
+    }
+}
+
+/**
+ * Finalize SXE objects, stopping and joining the threads of any extra loops
+ *
+ * @note Must be called by the thread that called sxe_init()
+ */
 SXE_RETURN
 sxe_fini(void)
 {
     SXE_RETURN result = SXE_RETURN_ERROR_INTERNAL;
+    unsigned   i;
+
     SXEE6("sxe_fini()");
 
     if (sxe_array == NULL) {
@@ -358,6 +750,29 @@ sxe_fini(void)
         goto SXE_ERROR_OUT;
     }
 
+    SXEA1(sxe_loop_index == 0, "sxe_fini: must be called from loop 0, not loop %u", sxe_loop_index);
+
+    if (sxe_loops != NULL) {
+        for (i = 1; i < sxe_loop_total; i++) {
+            SXEA1(sxe_spinlock_take(&sxe_loops[i].lock) == SXE_SPINLOCK_STATUS_TAKEN, "Couldn't lock loop %u", i);
+            sxe_loops[i].stopping = true;
+            sxe_spinlock_give(&sxe_loops[i].lock);
+            ev_async_send(sxe_loops[i].ev_loop, &sxe_loops[i].wakeup);
+        }
+
+        for (i = 1; i < sxe_loop_total; i++) {
+            SXEA1(sxe_thread_join(sxe_loops[i].thread) == SXE_RETURN_OK, "sxe_fini: Couldn't join the thread for loop %u", i);
+            ev_loop_destroy(sxe_loops[i].ev_loop);
+            sxe_loop_discard_calls(&sxe_loops[i]);
+        }
+
+        ev_async_stop(sxe_private_main_loop, &sxe_loops[0].wakeup);
+        sxe_loop_discard_calls(&sxe_loops[0]);
+        free(sxe_loops);
+        sxe_loops = NULL;
+    }
+
+    sxe_buf_cache_free();
     sxe_pool_delete(sxe_array);
     sxe_extra_size        = 0;
     sxe_array_total       = 0;
@@ -365,6 +780,8 @@ sxe_fini(void)
     sxe_stat_total_accept = 0;
     sxe_stat_total_read   = 0;
     sxe_has_been_inited   = 0;
+    sxe_loop_total        = 1;
+    sxe_loop_start        = NULL;
     result                = SXE_RETURN_OK;
 
 SXE_EARLY_OR_ERROR_OUT:
@@ -398,11 +815,27 @@ stop_reading_buffer_full(SXE * this)
 #endif
 }
 
+/* If datagrams are being held in a UDP batch, the socket may have no more data to wake the watcher; kick it instead
+ */
+static void
+sxe_udp_batch_kick(SXE * this)
+{
+#if SXE_HAVE_MMSG
+    if (this->udp_batch != NULL && this->udp_batch->next < this->udp_batch->received) {
+        SXEL6I("Kicking read events to deliver %u held datagrams", this->udp_batch->received - this->udp_batch->next);
+        ev_feed_event(sxe_private_main_loop, &this->io, EV_READ);
+    }
+#else
+    SXE_UNUSED_PARAMETER(this);
+#endif
+}
+
 static void
 restart_reading_buffer_drained(SXE * this)
 {
     SXEL6I("Buffer was paused: restarting read events");
     ev_io_start(sxe_private_main_loop, &this->io);
+    sxe_udp_batch_kick(this);
 
 #ifndef SXE_DISABLE_OPENSSL
     if (this->ssl_id != SXE_POOL_NO_INDEX) {
@@ -446,6 +879,9 @@ sxe_new_internal(SXE                    * this              ,
     that->next_socket         = SXE_SOCKET_INVALID;
     that->in_total            = 0;
     that->in_consumed         = 0;
+    that->in_maximum          = SXE_BUF_SIZE;
+    sxe_buf_detach(that);
+    that->udp_batch           = NULL;
     memcpy(&that->local_addr, local_addr, sizeof(that->local_addr));
 
 SXE_EARLY_OR_ERROR_OUT:
@@ -536,6 +972,88 @@ sxe_new_udp(SXE               * this         ,
     return sxe_new(this, local_ip, local_port, NULL, in_event_read, NULL, SXE_FALSE, NULL);
 }
 
+/**
+ * Set the size that a SXE's input buffer can grow to
+ *
+ * @param this Pointer to the SXE; connections accepted by a listening SXE inherit its size
+ * @param size Maximum number of bytes of unconsumed data to buffer; 1 to SXE_BUF_SIZE_MAXIMUM (default SXE_BUF_SIZE)
+ *
+ * @note A buffer is only attached to the SXE while data is pending. It starts at SXE_BUF_SIZE bytes (or size, if smaller),
+ *       and doubles each time it fills without any data being consumed, until it reaches size. A smaller buffer that is
+ *       already attached is grown the next time it fills.
+ */
+void
+sxe_set_buf_size(SXE * this, unsigned size)
+{
+    SXEE6I("sxe_set_buf_size(this=%p,size=%u)", this, size);
+    SXEA1I(size > 0 && size <= SXE_BUF_SIZE_MAXIMUM, "sxe_set_buf_size(): size %u is not 1 to %u", size, SXE_BUF_SIZE_MAXIMUM);
+    this->in_maximum = size;
+    SXER6I("return");
+}
+
+/**
+ * Read datagrams on a UDP SXE in batches, using one recvmmsg() call per batch
+ *
+ * @param this A UDP SXE returned by sxe_new_udp()
+ * @param size Maximum number of datagrams per batch; 1 to SXE_UDP_BATCH_MAXIMUM
+ *
+ * @return SXE_RETURN_OK, SXE_RETURN_ERROR_ALLOC if the batch buffers can't be allocated, or SXE_RETURN_ERROR_INTERNAL if
+ *         batching is not supported on this platform
+ *
+ * @note Only the system calls are batched: each datagram is still passed to the read event separately, with SXE_PEER_ADDR()
+ *       set to its sender. The batch buffers are freed by sxe_close().
+ */
+SXE_RETURN
+sxe_set_udp_batch(SXE * this, unsigned size)
+{
+    SXE_RETURN result = SXE_RETURN_ERROR_INTERNAL;
+#if SXE_HAVE_MMSG
+    struct SXE_UDP_BATCH * batch;
+    unsigned               i;
+#endif
+
+    SXEE6I("sxe_set_udp_batch(this=%p,size=%u)", this, size);
+    SXEA1I(!(this->flags & SXE_FLAG_IS_STREAM),                "sxe_set_udp_batch(): SXE is not a UDP SXE");
+    SXEA1I(this->udp_batch == NULL,                            "sxe_set_udp_batch(): SXE is already batched");
+    SXEA1I(size > 0 && size <= SXE_UDP_BATCH_MAXIMUM,          "sxe_set_udp_batch(): size %u is not 1 to %u", size,
+           SXE_UDP_BATCH_MAXIMUM);
+
+#if SXE_HAVE_MMSG
+    if ((batch = malloc(sizeof(*batch) + size * (sizeof(*batch->headers) + sizeof(*batch->vectors) + sizeof(*batch->addrs)
+                                               + SXE_BUF_SIZE))) == NULL) {
+        SXEL2I("sxe_set_udp_batch(): Couldn't allocate %u datagram buffers", size);
+        result = SXE_RETURN_ERROR_ALLOC;
+        goto SXE_ERROR_OUT;
+    }
+
+    batch->size     = size;
+    batch->next     = 0;
+    batch->received = 0;
+    batch->headers  = (struct mmsghdr *)(batch + 1);
+    batch->vectors  = (struct iovec *)(batch->headers + size);
+    batch->addrs    = (struct sockaddr_in *)(batch->vectors + size);
+    batch->bufs     = (char *)(batch->addrs + size);
+    memset(batch->headers, 0, size * sizeof(*batch->headers));
+
+    for (i = 0; i < size; i++) {
+        batch->vectors[i].iov_base             = batch->bufs + i * SXE_BUF_SIZE;
+        batch->vectors[i].iov_len              = SXE_BUF_SIZE;
+        batch->headers[i].msg_hdr.msg_name     = &batch->addrs[i];
+        batch->headers[i].msg_hdr.msg_iov      = &batch->vectors[i];
+        batch->headers[i].msg_hdr.msg_iovlen   = 1;
+    }
+
+    this->udp_batch = batch;
+    result          = SXE_RETURN_OK;
+#else
+    SXEL2I("sxe_set_udp_batch(): Batched UDP reads are not supported on this platform");
+#endif
+
+SXE_EARLY_OR_ERROR_OUT:
+    SXER6I("return %s", sxe_return_to_string(result));
+    return result;
+}
+
 #ifdef WINDOWS_NT
 #define SXE_WINAPI_CAST_CHAR_STAR (char *)
 #else
@@ -650,13 +1168,20 @@ sxe_private_handle_read_data(SXE * this, int length, int *reads_remaining)
 
     /* If the buffer is full, SXE must wait for the caller to clear it before asking ev for more EVREAD events.
      */
-    if (this->in_total == SXE_BUF_SIZE) {
+    if (this->in_size != 0 && this->in_total == this->in_size) {
         if (this->in_consumed) {
             SXEL6I("Shuffling the buffer to make room for more data");
             memmove(this->in_buf, SXE_BUF(this), SXE_BUF_USED(this));
             this->in_total -= this->in_consumed;
             this->in_consumed = 0;
         }
+        else if (this->in_size < this->in_maximum) {
+            SXEL6I("Growing the %u byte buffer to make room for more data", this->in_size);
+
+            if (!sxe_buf_attach(this, this->in_size < this->in_maximum / 2 ? 2 * this->in_size : this->in_maximum)) {
+                stop_reading_buffer_full(this);    /* COVERAGE EXCLUSION: Out of memory */
+            }
+        }
         else {
             stop_reading_buffer_full(this);
         }
@@ -665,7 +1190,87 @@ sxe_private_handle_read_data(SXE * this, int length, int *reads_remaining)
     SXER6I("return");
 }
 
-#define SXE_IO_CB_READ_MAXIMUM 64
+#define SXE_IO_CB_READ_MAXIMUM         64
+#define SXE_SEND_BUFFERS_IOVEC_MAXIMUM 32    /* Buffers gathered into each write by sxe_send_buffers() */
+
+#if SXE_HAVE_MMSG
+/* Deliver any datagrams held in the batch, then refill it with recvmmsg() until the socket is drained or the per event limit
+ * is reached.
+ */
+static void
+sxe_io_cb_read_udp_batch(SXE * this, int reads_remaining)
+{
+    struct SXE_UDP_BATCH * batch = this->udp_batch;
+    unsigned               count;
+    unsigned               i;
+    unsigned               length;
+    int                    received;
+
+    SXEE6I("sxe_io_cb_read_udp_batch(reads_remaining=%d) // socket=%d", reads_remaining, this->socket);
+
+    for (;;) {
+        while (batch->next < batch->received) {
+            if (!sxe_buf_reserve(this)) {
+                goto SXE_EARLY_OUT;
+            }
+
+            if (this->in_total == this->in_size) {
+                SXEL6I("Buffer is full: holding %u datagrams", batch->received - batch->next);
+                goto SXE_EARLY_OUT;
+            }
+
+            i      = batch->next++;
+            length = batch->headers[i].msg_len;
+            length = length < this->in_size - this->in_total ? length : this->in_size - this->in_total;
+            memcpy(&this->peer_addr, &batch->addrs[i], sizeof(this->peer_addr));
+            memcpy(this->in_buf + this->in_total, batch->vectors[i].iov_base, length);
+            SXEL6I("Read %u bytes from peer IP %s:%hu", length, inet_ntoa(this->peer_addr.sin_addr),
+                    ntohs(this->peer_addr.sin_port));
+            sxe_private_handle_read_data(this, length, NULL);
+
+            if (this->udp_batch != batch) {
+                SXEL6I("SXE was closed by the read event: dropping the rest of the batch");
+                goto SXE_EARLY_OUT;
+            }
+        }
+
+        if (reads_remaining <= 0) {
+            SXEL6I("Read the maximum number of datagrams for this event");
+            goto SXE_EARLY_OUT;
+        }
+
+        count = (unsigned)reads_remaining < batch->size ? (unsigned)reads_remaining : batch->size;
+
+        for (i = 0; i < count; i++) {
+            batch->headers[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i]);
+        }
+
+        if ((received = recvmmsg(this->socket, batch->headers, count, 0, NULL)) <= 0) {
+            if (received < 0 && sxe_socket_get_last_error() == SXE_SOCKET_ERROR(EWOULDBLOCK)) {
+                SXEL6I("socket=%d is not ready", this->socket);
+            }
+            else {
+                SXEL2I("Failed to read from socket=%d: (%d) %s", this->socket, sxe_socket_get_last_error(),
+                       sxe_socket_get_last_error_as_str());
+            }
+
+            goto SXE_EARLY_OUT;
+        }
+
+        SXEL6I("Read %d datagrams in a batch of %u", received, count);
+        batch->next      = 0;
+        batch->received  = received;
+        reads_remaining -= received;
+
+        if ((unsigned)received < count) {    /* A short batch means the socket has been drained */
+            reads_remaining = 0;
+        }
+    }
+
+SXE_EARLY_OR_ERROR_OUT:
+    SXER6I("return");
+}
+#endif
 
 static void
 sxe_io_cb_read(EV_P_ ev_io * io, int revents)
@@ -697,12 +1302,16 @@ sxe_io_cb_read(EV_P_ ev_io * io, int revents)
 
     if (revents == EV_READ) {
 SXE_TRY_AND_READ_AGAIN:
+        if (!sxe_buf_reserve(this)) {
+            goto SXE_EARLY_OUT;    /* The watcher is still active, so the read will be retried */
+        }
+
         if (this->path) {
 #ifndef _WIN32
             memset(&message_header, 0, sizeof message_header);
 
-            io_vector[0].iov_base =        this->in_buf  + this->in_total;
-            io_vector[0].iov_len  = sizeof(this->in_buf) - this->in_total;
+            io_vector[0].iov_base = this->in_buf  + this->in_total;
+            io_vector[0].iov_len  = this->in_size - this->in_total;
             message_header.msg_control    = &control_message_buf;
             message_header.msg_controllen = CMSG_LEN(sizeof(fd_from_recvmsg));
             message_header.msg_name       = 0;
@@ -766,7 +1375,7 @@ SXE_TRY_AND_READ_AGAIN:
         else if (this->flags & SXE_FLAG_IS_STREAM) {
             /* Use recv(), not read() for Windows Sockets API compatibility
              */
-            length = recv(this->socket, this->in_buf + this->in_total, sizeof(this->in_buf) - this->in_total, 0);
+            length = recv(this->socket, this->in_buf + this->in_total, this->in_size - this->in_total, 0);
         }
 #if SXE_WANT_CALLER_READS_UDP
         else if (this->flags & SXE_FLAG_IS_CALLER_READS) {
@@ -776,9 +1385,15 @@ SXE_TRY_AND_READ_AGAIN:
 
             length = sxe_caller_read_udp_length; /* COVERAGE EXCLUSION: TODO */
         }
+#endif
+#if SXE_HAVE_MMSG
+        else if (this->udp_batch != NULL) {
+            sxe_io_cb_read_udp_batch(this, reads_remaining_this_event);
+            goto SXE_EARLY_OUT;
+        }
 #endif
         else {
-            length = recvfrom(this->socket, this->in_buf + this->in_total, sizeof(this->in_buf) - this->in_total, 0,
+            length = recvfrom(this->socket, this->in_buf + this->in_total, this->in_size - this->in_total, 0,
                               (struct sockaddr *)&this->peer_addr, &peer_addr_size);
             last_socket_error = sxe_socket_get_last_error();
             SXEA6I(peer_addr_size == sizeof(this->peer_addr), "Peer address is not an IPV4 address (peer_addr_size=%d)",
@@ -838,6 +1453,7 @@ SXE_TRY_AND_READ_AGAIN:
     }
 
 SXE_EARLY_OR_ERROR_OUT:
+    sxe_buf_detach_if_empty(this);
     SXER6I("return");
 }
 
@@ -870,7 +1486,7 @@ void
 sxe_buf_consume(SXE * this, unsigned bytes)
 {
     SXEE6I("sxe_buf_consume(bytes=%u)", bytes);
-    SXEA6I(bytes <= SXE_BUF_SIZE,       "attempt to consume %u bytes, which is more than SXE_BUF_SIZE (%u)", bytes, SXE_BUF_SIZE);
+    SXEA6I(bytes <= this->in_size,      "attempt to consume %u bytes, which is more than the buffer size (%u)", bytes, this->in_size);
     SXEA6I(bytes <= SXE_BUF_USED(this), "attempt to consume %u bytes, which is more than SXE_BUF_USED (%u)", bytes, SXE_BUF_USED(this));
     this->in_consumed += bytes;
     sxe_pause(this);
@@ -903,12 +1519,13 @@ sxe_buf_resume(SXE * this, SXE_BUF_RESUME invoke_callback)
     /* If we've filled the buffer and stopped reading, we need to ensure there
      * is room for more data to read, otherwise we won't ever actually get
      * more data! */
-    if (this->in_consumed && this->in_total == SXE_BUF_SIZE) {
+    if (this->in_consumed && this->in_total == this->in_size) {
         SXEL6I("Watcher was paused: making room for more data, and restarting read events");
         memmove(this->in_buf, SXE_BUF(this), SXE_BUF_USED(this));
         this->in_total -= this->in_consumed;
         this->in_consumed = 0;
         ev_io_start(sxe_private_main_loop, &this->io);
+        sxe_udp_batch_kick(this);
     }
 
     if (invoke_callback == SXE_BUF_RESUME_IMMEDIATE && SXE_BUF_USED(this) != 0) {
@@ -1008,6 +1625,8 @@ sxe_io_cb_accept(EV_P_ ev_io * io, int revents)
                 SXEL3I("Warning: failed to allocate a connection from socket=%d: out of connections", this->socket);
                 goto SXE_ERROR_OUT;
             }
+
+            that->in_maximum = this->in_maximum;
         }
 
         that->socket               = that_socket;
@@ -1155,8 +1774,9 @@ sxe_listen_plus(SXE * this, unsigned flags)
     SXEE6I("sxe_listen(this=%p, flags=%u)", this, flags);
     SXEA1I(this  != NULL,                   "sxe_listen: object pointer is NULL");
     SXEA1I(!sxe_is_free(this),              "sxe_listen: connection has not been allocated (state=FREE)");
-    SXEA1I(!(flags & ~SXE_FLAG_IS_ONESHOT), "sxe_listen: a flag other than SXE_FLAG_IS_ONESHOT was given: 0x%08x",
-            flags & ~SXE_FLAG_IS_ONESHOT);
+    SXEA1I(!(flags & ~(SXE_FLAG_IS_ONESHOT | SXE_FLAG_IS_REUSEPORT)),
+           "sxe_listen: a flag other than SXE_FLAG_IS_ONESHOT or SXE_FLAG_IS_REUSEPORT was given: 0x%08x",
+           flags & ~(SXE_FLAG_IS_ONESHOT | SXE_FLAG_IS_REUSEPORT));
 
     if (this->socket != SXE_SOCKET_INVALID) {
         SXEL2I("Listener is already in use (socket=%d)", this->socket);
@@ -1191,6 +1811,21 @@ sxe_listen_plus(SXE * this, unsigned flags)
 
     sxe_set_socket_options(this, socket_listen);
 
+    if (flags & SXE_FLAG_IS_REUSEPORT) {
+#ifdef SO_REUSEPORT
+        int reuse_port = 1;
+
+        if (setsockopt(socket_listen, SOL_SOCKET, SO_REUSEPORT, SXE_WINAPI_CAST_CHAR_STAR &reuse_port, sizeof(reuse_port)) < 0) {
+            SXEL2I("Error setting SO_REUSEPORT on listening socket: (%d) %s", sxe_socket_get_last_error(),    /* COVERAGE EXCLUSION: Can't fail */
+                   sxe_socket_get_last_error_as_str());                                                       /* COVERAGE EXCLUSION: Can't fail */
+            goto SXE_EARLY_OUT;                                                                               /* COVERAGE EXCLUSION: Can't fail */
+        }
+#else
+        SXEL2I("Shared listening sockets (SO_REUSEPORT) are not supported on this platform");
+        goto SXE_EARLY_OUT;
+#endif
+    }
+
     if (bind(socket_listen, address, address_length) < 0) {
         int error = sxe_socket_get_last_error();    /* Save due to Windows resetting it in inet_ntoa */
 
@@ -1210,7 +1845,7 @@ sxe_listen_plus(SXE * this, unsigned flags)
         goto SXE_EARLY_OUT;
     }
 
-    this->flags       |= flags;            /* Set one-shot, if specified by the caller */
+    this->flags       |= flags;            /* Set one-shot and/or reuse-port, if specified by the caller */
     this->socket       = socket_listen;
     this->socket_as_fd = _open_osfhandle(socket_listen, 0);
     socket_listen      = SXE_SOCKET_INVALID;
@@ -1514,6 +2149,82 @@ SXE_EARLY_OR_ERROR_OUT:
     return result;
 }
 
+/**
+ * Write a batch of datagrams to a UDP SXE, using one sendmmsg() call per SXE_UDP_BATCH_MAXIMUM datagrams
+ *
+ * @param this      A UDP SXE
+ * @param datagrams Array of datagrams, each with its own destination address
+ * @param count     Number of datagrams
+ * @param written   NULL or pointer to a count of the datagrams written, set even on failure
+ *
+ * @return SXE_RETURN_OK if all datagrams were written in full, or SXE_RETURN_ERROR_INTERNAL on the first one that wasn't
+ */
+SXE_RETURN
+sxe_write_to_batch(SXE * this, const SXE_DATAGRAM * datagrams, unsigned count, unsigned * written)
+{
+    SXE_RETURN     result = SXE_RETURN_ERROR_INTERNAL;
+    unsigned       done   = 0;
+#if SXE_HAVE_MMSG
+    struct mmsghdr headers[SXE_UDP_BATCH_MAXIMUM];
+    struct iovec   vectors[SXE_UDP_BATCH_MAXIMUM];
+    unsigned       batch;
+    unsigned       i;
+    int            ret;
+#endif
+
+    SXEA6I(this != NULL,                        "sxe_write_to_batch(): connection pointer is NULL");
+    SXEA6I(!(this->flags & SXE_FLAG_IS_STREAM), "sxe_write_to_batch(): SXE is not a UDP SXE");
+    SXEE6I("sxe_write_to_batch(this=%p,datagrams=%p,count=%u) // socket=%d", this, datagrams, count, this->socket);
+
+#if SXE_HAVE_MMSG
+    memset(headers, 0, sizeof(headers));
+
+    while (done < count) {
+        batch = count - done < SXE_UDP_BATCH_MAXIMUM ? count - done : SXE_UDP_BATCH_MAXIMUM;
+
+        for (i = 0; i < batch; i++) {
+            SXED7I(datagrams[done + i].data, datagrams[done + i].size);
+            vectors[i].iov_base                = SXE_CAST_NOCONST(void *, datagrams[done + i].data);
+            vectors[i].iov_len                 = datagrams[done + i].size;
+            headers[i].msg_hdr.msg_name        = SXE_CAST_NOCONST(void *, datagrams[done + i].dest_addr);
+            headers[i].msg_hdr.msg_namelen     = sizeof(*datagrams[done + i].dest_addr);
+            headers[i].msg_hdr.msg_iov         = &vectors[i];
+            headers[i].msg_hdr.msg_iovlen      = 1;
+        }
+
+        if ((ret = sendmmsg(this->socket, headers, batch, 0)) <= 0) {
+            SXEL2I("sxe_write_to_batch(): Error writing to socket=%d: (%d) %s", this->socket, sxe_socket_get_last_error(),
+                   sxe_socket_get_last_error_as_str());
+            goto SXE_ERROR_OUT;
+        }
+
+        for (i = 0; i < (unsigned)ret; i++, done++) {
+            if (headers[i].msg_len != datagrams[done].size) {
+                SXEL2I("sxe_write_to_batch(): Only %u of %u bytes written to socket=%d", headers[i].msg_len,  /* COVERAGE EXCLUSION: Logging for UDP truncation on sendmmsg */
+                       datagrams[done].size, this->socket);                                                 /* COVERAGE EXCLUSION: Logging for UDP truncation on sendmmsg */
+                goto SXE_ERROR_OUT;                                                                         /* COVERAGE EXCLUSION: Logging for UDP truncation on sendmmsg */
+            }
+        }
+    }
+#else
+    for (; done < count; done++) {
+        if (sxe_write_to(this, datagrams[done].data, datagrams[done].size, datagrams[done].dest_addr) != SXE_RETURN_OK) {
+            goto SXE_ERROR_OUT;
+        }
+    }
+#endif
+
+    result = SXE_RETURN_OK;
+
+SXE_EARLY_OR_ERROR_OUT:
+    if (written != NULL) {
+        *written = done;
+    }
+
+    SXER6I("return %s // written=%u", sxe_return_to_string(result), done);
+    return result;
+}
+
 /* TODO: Implement in terms of a helper that takes a pointer to bytes written as a parameter */
 
 SXE_RETURN
@@ -1574,18 +2285,177 @@ SXE_EARLY_OR_ERROR_OUT:
     return result;
 }
 
+#ifndef _WIN32
+/**
+ * Write a vector of data to a stream SXE with a single system call
+ *
+ * @param this    Pointer to a connected stream SXE
+ * @param vectors Data to write, in order
+ * @param count   Number of vectors; at most IOV_MAX
+ *
+ * @return SXE_RETURN_OK if all the data was written, SXE_RETURN_WARN_WOULD_BLOCK if only some of it was (the number of bytes
+ *         written is SXE_LAST_WRITE_LENGTH()), or an error
+ */
+SXE_RETURN
+sxe_writev(SXE * this, const struct iovec * vectors, unsigned count)
+{
+    SXE_RETURN    result = SXE_RETURN_ERROR_INTERNAL;
+    struct msghdr message_header;
+    unsigned      size   = 0;
+    unsigned      i;
+    int           ret;
+    int           socket_error;
+
+    SXEA6I(this != NULL,                       "SXE pointer is NULL");
+    SXEA6I((this->flags & SXE_FLAG_IS_STREAM), "SXE is not a stream SXE");
+    SXEA6I(this->ssl_id == SXE_POOL_NO_INDEX,  "sxe_writev() on an SSL socket: use sxe_send_buffers()");
+    SXEE6I("sxe_writev(vectors=%p, count=%u)", vectors, count);
+
+    if (this->socket == SXE_SOCKET_INVALID) {
+        SXEL2I("Send on a disconnected socket");
+        result = SXE_RETURN_ERROR_NO_CONNECTION;
+        goto SXE_ERROR_OUT;
+    }
+
+    for (i = 0; i < count; i++) {
+        size += vectors[i].iov_len;
+    }
+
+    /* Use sendmsg(), not writev(), so that SXE_SOCKET_MSG_NOSIGNAL can be passed
+     */
+    memset(&message_header, 0, sizeof(message_header));
+    message_header.msg_iov    = SXE_CAST_NOCONST(struct iovec *, vectors);
+    message_header.msg_iovlen = count;
+
+    if ((ret = sendmsg(this->socket, &message_header, SXE_SOCKET_MSG_NOSIGNAL)) != (int)size) {
+        if (ret >= 0) {
+            SXEL6I("sxe_writev(): Only %d of %u bytes written to socket=%d", ret, size, this->socket);
+            this->last_write = ret;
+            result = SXE_RETURN_WARN_WOULD_BLOCK;
+        }
+        else {
+            socket_error = sxe_socket_get_last_error();
+            SXEL2I("sxe_writev(): Error writing to socket=%d: (%d) %s", this->socket, socket_error, sxe_socket_get_last_error_as_str());
+            this->last_write = 0;
+
+            if ((socket_error == SXE_SOCKET_ERROR(ECONNRESET  ))
+             || (socket_error == SXE_SOCKET_ERROR(ECONNREFUSED))
+             || (socket_error == SXE_SOCKET_ERROR(ENOTCONN    )))
+            {
+                result = SXE_RETURN_ERROR_NO_CONNECTION;
+            }
+            else if (socket_error == SXE_SOCKET_ERROR(EWOULDBLOCK)) {
+                result = SXE_RETURN_WARN_WOULD_BLOCK;
+            }
+        }
+
+        goto SXE_ERROR_OUT;
+    }
+
+    this->last_write = size;
+    SXEL6I("Wrote %u bytes from %u vectors to socket=%d", size, count, this->socket);
+    result = SXE_RETURN_OK;
+
+SXE_EARLY_OR_ERROR_OUT:
+    SXER6I("return %s", sxe_return_to_string(result));
+    return result;
+}
+#endif
+
+/**
+ * Hold back partial segments on a TCP SXE until uncorked, so that separately written headers and bodies share packets
+ *
+ * @param this Pointer to a connected TCP SXE
+ * @param cork true to cork, false to uncork and flush anything held back
+ *
+ * @return SXE_RETURN_OK, or SXE_RETURN_ERROR_INTERNAL if the socket option couldn't be set
+ *
+ * @note This is a hint: where neither TCP_CORK nor TCP_NOPUSH is available, or on pipes, it does nothing
+ */
+SXE_RETURN
+sxe_set_cork(SXE * this, bool cork)
+{
+    SXE_RETURN result = SXE_RETURN_OK;
+#ifdef SXE_TCP_CORK
+    int        flag   = cork ? 1 : 0;
+#endif
+
+    SXEE6I("sxe_set_cork(cork=%s)", SXE_BOOL_TO_STR(cork));
+
+    if (this->path != NULL || this->socket == SXE_SOCKET_INVALID) {
+        goto SXE_EARLY_OUT;
+    }
+
+#ifdef SXE_TCP_CORK
+    if (setsockopt(this->socket, IPPROTO_TCP, SXE_TCP_CORK, SXE_WINAPI_CAST_CHAR_STAR &flag, sizeof(flag)) < 0) {
+        SXEL2I("sxe_set_cork(): Couldn't %s socket=%d: %s", cork ? "cork" : "uncork", this->socket,    /* COVERAGE EXCLUSION: Can't happen */
+               sxe_socket_get_last_error_as_str());                                                     /* COVERAGE EXCLUSION: Can't happen */
+        result = SXE_RETURN_ERROR_INTERNAL;                                                             /* COVERAGE EXCLUSION: Can't happen */
+    }
+#endif
+
+SXE_EARLY_OR_ERROR_OUT:
+    SXER6I("return %s", sxe_return_to_string(result));
+    return result;
+}
+
 /* Shared between sxe_io_cb_send_buffers and sxe_send_buffers
  */
 static SXE_RETURN
 sxe_send_buffers_again(SXE * this)
 {
-    SXE_RETURN   result = SXE_RETURN_OK;
-    SXE_BUFFER * buffer;
+    SXE_RETURN      result = SXE_RETURN_OK;
+    SXE_BUFFER    * buffer;
+#ifndef _WIN32
+    SXE_LIST_WALKER gather;
+    struct iovec    vectors[SXE_SEND_BUFFERS_IOVEC_MAXIMUM];
+    unsigned        count;
+    unsigned        written;
+#endif
 
     SXEE6I("sxe_send_buffers_again(this=%p) // socket=%d", this, this->socket);
     buffer = sxe_list_walker_find(&this->send_list_walk);
 
     while (buffer != NULL) {
+#ifndef _WIN32
+        /* Gather the buffers into a vector, so that many small buffers are written with one system call
+         */
+        gather = this->send_list_walk;
+
+        for (count = 0; buffer != NULL && count < SXE_SEND_BUFFERS_IOVEC_MAXIMUM; buffer = sxe_list_walker_step(&gather)) {
+            if (sxe_buffer_length(buffer) != 0) {
+                vectors[count].iov_base = SXE_CAST_NOCONST(char *, sxe_buffer_get_data(buffer));
+                vectors[count].iov_len  = sxe_buffer_length(buffer);
+                count++;
+            }
+        }
+
+        this->last_write = 0;
+
+        if (count > 0) {
+            result = sxe_writev(this, vectors, count);
+
+            if (result != SXE_RETURN_OK && result != SXE_RETURN_WARN_WOULD_BLOCK) {
+                break;
+            }
+        }
+
+        /* Consume what was written, stepping over the buffers that were completely sent
+         */
+        written = this->last_write;
+
+        for (buffer = sxe_list_walker_find(&this->send_list_walk);
+             buffer != NULL && written >= sxe_buffer_length(buffer);
+             buffer = sxe_list_walker_step(&this->send_list_walk))
+        {
+            written -= sxe_buffer_length(buffer);
+            sxe_buffer_consume(buffer, sxe_buffer_length(buffer));
+        }
+
+        if (written > 0) {
+            sxe_buffer_consume(buffer, written);
+        }
+#else
         result = sxe_write(this, sxe_buffer_get_data(buffer), sxe_buffer_length(buffer));
 
         if (result != SXE_RETURN_OK && result != SXE_RETURN_WARN_WOULD_BLOCK) {
@@ -1597,6 +2467,7 @@ sxe_send_buffers_again(SXE * this)
         if (sxe_buffer_length(buffer) == 0) {
             buffer = sxe_list_walker_step(&this->send_list_walk);
         }
+#endif
 
         if (result == SXE_RETURN_WARN_WOULD_BLOCK) {                                                                               /* COVERAGE EXCLUSION: Debian 8 */
             result = SXE_RETURN_IN_PROGRESS;                                                                                       /* COVERAGE EXCLUSION: Debian 8 */
@@ -1927,6 +2798,8 @@ sxe_close(SXE * this)
     this->out_event_written  = NULL;
     this->in_total    = 0;
     this->in_consumed = 0;
+    free(this->udp_batch);
+    this->udp_batch   = NULL;
     sxe_pool_set_indexed_element_state(sxe_array, this->id, state, SXE_STATE_FREE);
 
 SXE_EARLY_OUT:
@@ -30,8 +30,10 @@
 #include "sxe-socket.h"
 #include "sxe-util.h"
 
-#define SXE_BUF_SIZE    1500
-#define SXE_IP_ADDR_ANY "INADDR_ANY"
+#define SXE_BUF_SIZE          1500    /* Default size of a SXE's input buffer; see sxe_set_buf_size()       */
+#define SXE_BUF_SIZE_MAXIMUM  (1U << 24)
+#define SXE_IP_ADDR_ANY       "INADDR_ANY"
+#define SXE_UDP_BATCH_MAXIMUM 64      /* Maximum number of datagrams per sxe_set_udp_batch() batch */
 
 /* Flags. Currently, only SXE_FLAG_IS_ONESHOT is required in the SXE interface
  */
@@ -40,18 +42,23 @@
 #define SXE_FLAG_IS_CALLER_READS  0x00000004
 #define SXE_FLAG_IS_PAUSED        0x00000008
 #define SXE_FLAG_IS_SSL           0x00000010
+#define SXE_FLAG_IS_REUSEPORT     0x00000020    /* Listener shares its port with other loops' listeners (SO_REUSEPORT) */
 
 typedef enum SXE_BUF_RESUME {
     SXE_BUF_RESUME_IMMEDIATE,
     SXE_BUF_RESUME_WHEN_MORE_DATA
 } SXE_BUF_RESUME;
 
-struct SXE; /* Forward Declaration */
+struct SXE;           /* Forward Declaration */
+struct SXE_UDP_BATCH; /* Forward Declaration */
+struct iovec;         /* Forward Declaration */
 typedef void (*SXE_IN_EVENT_READ )(    struct SXE *, int length);
 typedef void (*SXE_IN_EVENT_CLOSE)(    struct SXE *            );
 typedef void (*SXE_IN_EVENT_CONNECTED)(struct SXE *            );
 typedef void (*SXE_OUT_EVENT_WRITTEN )(struct SXE *, SXE_RETURN);
 typedef void (*SXE_DEFERRED_EVENT)(    struct SXE *            );
+typedef void (*SXE_LOOP_START)(        unsigned loop, void * user_data);
+typedef void (*SXE_LOOP_CALL )(        void * arg              );
 
 /* SXE object. Used for "Accept Sockets", "Connection Sockets", and UDP ports.
  */
@@ -70,7 +77,9 @@ typedef struct SXE {
     int                    last_write;           /* number of bytes written by the last sxe_write() call                  */
     unsigned               in_total;
     unsigned               in_consumed;          /* number of bytes already "consumed" by the callback                    */
-    char                   in_buf[SXE_BUF_SIZE];
+    unsigned               in_size;              /* size of in_buf, or 0 if no buffer is attached (nothing to read)       */
+    unsigned               in_maximum;           /* size in_buf may grow to; SXE_BUF_SIZE unless set by sxe_set_buf_size  */
+    char                 * in_buf;               /* taken from the loop's buffer cache only while there is data pending   */
     SXE_IN_EVENT_CONNECTED in_event_connected;   /* NULL or function to call when peer accepts connection                 */
     SXE_IN_EVENT_READ      in_event_read ;       /*         function to call when peer writes data                        */
     SXE_IN_EVENT_CLOSE     in_event_close;       /* NULL or function to call when peer disconnects                        */
@@ -87,12 +96,22 @@ typedef struct SXE {
        intptr_t            as_int;
     }                      user_data;            /* Not used by sxe                                                       */
     int                    next_socket;          /* Socket to switch to from pipe when all data has been read and cleared */
+    struct SXE_UDP_BATCH * udp_batch;            /* NULL unless UDP reads are batched by sxe_set_udp_batch()              */
 } SXE;
 
+/* One datagram to be sent by sxe_write_to_batch()
+ */
+typedef struct SXE_DATAGRAM {
+    const void               * data;
+    unsigned                   size;
+    const struct sockaddr_in * dest_addr;
+} SXE_DATAGRAM;
+
 #define SXE_BUF_STRNSTR(this,str)        sxe_strnstr    (SXE_BUF(this), str, SXE_BUF_USED(this))
 #define SXE_BUF_STRNCASESTR(this,str)    sxe_strncasestr(SXE_BUF(this), str, SXE_BUF_USED(this))
-#define SXE_BUF(this)                    (     &(this)->in_buf[0] + (this)->in_consumed)
+#define SXE_BUF(this)                    (      (this)->in_buf + (this)->in_consumed)
 #define SXE_BUF_USED(this)               (      (this)->in_total - (this)->in_consumed)
+#define SXE_BUF_MAXIMUM(this)            (      (this)->in_maximum)
 #define SXE_PEER_ADDR(this)              (     &(this)->peer_addr)
 #define SXE_PEER_PORT(this)              (ntohs((this)->peer_addr.sin_port))
 #define SXE_LOCAL_PORT(this)             (ntohs(sxe_get_local_addr(this)->sin_port))
@@ -112,6 +131,7 @@ typedef struct SXE {
 
 static inline SXE_RETURN sxe_listen(        SXE * this) {return sxe_listen_plus(this, 0);                   }
 static inline SXE_RETURN sxe_listen_oneshot(SXE * this) {return sxe_listen_plus(this, SXE_FLAG_IS_ONESHOT); }
+static inline SXE_RETURN sxe_listen_shared( SXE * this) {return sxe_listen_plus(this, SXE_FLAG_IS_REUSEPORT);}
 static inline void       sxe_pause(         SXE * this) {this->flags |= SXE_FLAG_IS_PAUSED;                 }
 
 #endif /* __SXE_H__ */
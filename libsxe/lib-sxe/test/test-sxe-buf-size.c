@@ -0,0 +1,148 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "sxe.h"
+#include "sxe-log.h"
+#include "sxe-socket.h"
+#include "sxe-test.h"
+#include "sxe-util.h"
+#include "tap.h"
+
+#define TEST_WAIT     5.0
+#define TEST_PORT     9254
+#define TEST_MAXIMUM  8192
+#define TEST_GROWN    6000     /* More than SXE_BUF_SIZE, less than TEST_MAXIMUM */
+#define TEST_OVERFLOW 10000    /* More than TEST_MAXIMUM                         */
+
+static bool test_clear = false;    /* If true, clear the buffer in the read event */
+static char test_data[TEST_OVERFLOW];
+
+static void
+test_event_connected(SXE * this)
+{
+    SXEE6I("%s()", __func__);
+    tap_ev_push(__func__, 1, "this", this);
+    SXER6I("return");
+}
+
+static void
+test_event_read(SXE * this, int length)
+{
+    SXEE6I("%s(length=%d)", __func__, length);
+    tap_ev_push(__func__, 4, "this", this, "length", length, "used", (void *)(uintptr_t)SXE_BUF_USED(this),
+                "size", (void *)(uintptr_t)this->in_size);
+
+    if (test_clear) {
+        sxe_buf_clear(this);
+    }
+
+    SXER6I("return");
+}
+
+/* Wait for read events on a SXE until its buffer holds 'used' bytes; returns the size of its buffer at that point
+ */
+static unsigned
+test_wait_for_used(SXE * this, unsigned used)
+{
+    tap_ev   ev;
+    unsigned size = 0;
+
+    while (SXE_BUF_USED(this) < used && strcmp(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "test_event_read") == 0) {
+        size = (uintptr_t)tap_ev_arg(ev, "size");
+    }
+
+    return size;
+}
+
+int
+main(void)
+{
+    SXE    * listener;
+    SXE    * connector;
+    SXE    * connectee;
+    tap_ev   ev;
+    unsigned i;
+
+    plan_tests(16);
+
+    for (i = 0; i < sizeof(test_data); i++) {
+        test_data[i] = 'a' + i % 26;
+    }
+
+    sxe_register(3, 0);
+    is(sxe_init(), SXE_RETURN_OK,                                    "init succeeded");
+
+    listener  = sxe_new_tcp(NULL, "127.0.0.1", TEST_PORT, test_event_connected, test_event_read, NULL);
+    connector = sxe_new_tcp(NULL, "127.0.0.1", 0,         test_event_connected, test_event_read, NULL);
+    sxe_set_buf_size(listener, TEST_MAXIMUM);
+    is(sxe_listen(listener), SXE_RETURN_OK,                          "Listening on port %u", TEST_PORT);
+    is(sxe_connect(connector, "127.0.0.1", TEST_PORT), SXE_RETURN_OK, "Connecting to the listener");
+    test_tap_ev_identifier_wait(TEST_WAIT, &ev);
+    connectee = SXE_CAST_NOCONST(SXE *, tap_ev_arg(ev, "this"));
+
+    if (connectee == connector) {
+        test_tap_ev_identifier_wait(TEST_WAIT, &ev);
+        connectee = SXE_CAST_NOCONST(SXE *, tap_ev_arg(ev, "this"));
+    }
+    else {
+        test_tap_ev_identifier_wait(TEST_WAIT, &ev);
+    }
+
+    is(SXE_BUF_MAXIMUM(connector), SXE_BUF_SIZE,                     "Connector has the default maximum buffer size");
+    is(SXE_BUF_MAXIMUM(connectee), TEST_MAXIMUM,                     "Connectee inherited the listener's maximum buffer size");
+    ok(connectee->in_buf == NULL && connectee->in_size == 0,         "Idle connectee holds no input buffer");
+
+    /* A buffer that fills without any data being consumed grows
+     */
+    is(sxe_write(connector, test_data, TEST_GROWN), SXE_RETURN_OK,   "Wrote %u bytes", TEST_GROWN);
+    ok(test_wait_for_used(connectee, TEST_GROWN) >= TEST_GROWN,      "Buffer grew to hold them");
+    is(SXE_BUF_USED(connectee), TEST_GROWN,                          "All %u bytes are in the buffer", TEST_GROWN);
+    ok(memcmp(SXE_BUF(connectee), test_data, TEST_GROWN) == 0,       "They were read in order");
+
+    /* A buffer that is drained by the read event is returned to the cache
+     */
+    test_clear = true;
+    sxe_buf_clear(connectee);
+    is(sxe_write(connector, "HELO", 4), SXE_RETURN_OK,               "Wrote 'HELO'");
+    is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "test_event_read", "Got a read event");
+    ok(connectee->in_buf == NULL && connectee->in_size == 0,         "Drained connectee holds no input buffer");
+
+    /* A buffer stops growing at the maximum, and reading stops until it's cleared
+     */
+    test_clear = false;
+    is(sxe_write(connector, test_data, TEST_OVERFLOW), SXE_RETURN_OK, "Wrote %u bytes", TEST_OVERFLOW);
+    test_wait_for_used(connectee, TEST_MAXIMUM);
+    test_process_all_libev_events();
+    is(SXE_BUF_USED(connectee), TEST_MAXIMUM,                        "Read stopped when the buffer reached %u bytes", TEST_MAXIMUM);
+    tap_ev_flush();
+    test_clear = true;
+    sxe_buf_clear(connectee);
+    test_tap_ev_identifier_wait(TEST_WAIT, &ev);
+    is(tap_ev_arg(ev, "used"), TEST_OVERFLOW - TEST_MAXIMUM,         "The rest was read once the buffer was cleared");
+
+    sxe_close(connector);
+    sxe_close(connectee);
+    sxe_close(listener);
+    sxe_fini();
+    return exit_status();
+}
@@ -0,0 +1,162 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "sxe.h"
+#include "sxe-socket.h"
+#include "sxe-test.h"
+#include "sxe-util.h"
+#include "tap.h"
+
+#define TEST_WAIT        5.0
+#define TEST_LOOPS       3
+#define TEST_PORT        9253
+#define TEST_CONNECTIONS 30
+
+static SXE            * test_listener[TEST_LOOPS];
+static SXE_RETURN       test_listen_result[TEST_LOOPS];
+static volatile bool    test_wrong_loop;    /* Set if a callback runs on a loop other than the one that owns its SXE */
+static volatile long    test_loops_started;
+
+static void
+test_loop_called(void * arg)
+{
+    SXEE6("%s(arg=%p)", __func__, arg);
+    tap_ev_push(__func__, 2, "loop", arg, "on", (void *)(uintptr_t)sxe_loop_get_index());
+    SXER6("return");
+}
+
+static void
+test_event_connected(SXE * this)
+{
+    unsigned loop = sxe_loop_get_index();
+
+    SXEE6I("%s()", __func__);
+
+    if (SXE_USER_DATA_AS_INT(test_listener[loop]) != (intptr_t)loop) {
+        test_wrong_loop = true;
+    }
+
+    sxe_close(this);
+    sxe_loop_post(0, test_loop_called, (void *)(uintptr_t)loop);    /* Hand the accept over to the main loop */
+    SXER6I("return");
+}
+
+static void
+test_event_read(SXE * this, int length)
+{
+    SXE_UNUSED_PARAMETER(this);
+    SXE_UNUSED_PARAMETER(length);
+}
+
+static void
+test_loop_start(unsigned loop, void * user_data)
+{
+    SXEE6("%s(loop=%u,user_data=%p)", __func__, loop, user_data);
+
+    if (loop != sxe_loop_get_index() || user_data != test_listener) {
+        test_wrong_loop = true;
+    }
+
+    test_listener[loop] = sxe_new_tcp(NULL, "127.0.0.1", TEST_PORT, test_event_connected, test_event_read, NULL);
+    SXE_USER_DATA_AS_INT(test_listener[loop]) = loop;
+    test_listen_result[loop] = sxe_listen_shared(test_listener[loop]);
+    __sync_add_and_fetch(&test_loops_started, 1);
+    SXER6("return");
+}
+
+int
+main(void)
+{
+    struct sockaddr_in addr;
+    unsigned           accepted[TEST_LOOPS];
+    unsigned           loops_used = 0;
+    unsigned           connected  = 0;
+    unsigned           i;
+    int                client[TEST_CONNECTIONS];
+    tap_ev             ev;
+
+    plan_tests(11);
+
+    for (i = 0; i < TEST_LOOPS; i++) {
+        test_listen_result[i] = SXE_RETURN_ERROR_NOT_INITIALIZED;
+    }
+
+    sxe_register(4, 0);
+    sxe_register_loops(TEST_LOOPS, test_loop_start, test_listener);
+    is(sxe_init(), SXE_RETURN_OK,                         "init succeeded");
+    is(sxe_loop_get_count(), TEST_LOOPS,                  "There are %u loops", TEST_LOOPS);
+    is(sxe_loop_get_index(), 0,                           "The main thread runs loop 0");
+
+    /* Posting to our own loop is made from the next event loop iteration
+     */
+    is(sxe_loop_post(0, test_loop_called, (void *)(uintptr_t)666), SXE_RETURN_OK, "Posted a call to loop 0");
+    is_eq(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "test_loop_called", "The call was made");
+    is(tap_ev_arg(ev, "loop"), 666,                       "...with its argument");
+    is(tap_ev_arg(ev, "on"),   0,                         "...on loop 0");
+
+    for (i = 0; test_loops_started < TEST_LOOPS && i < 5000; i++) {    /* Wait up to 5 seconds for the loops to start */
+        usleep(1000);
+    }
+
+    for (i = 0; i < TEST_LOOPS && test_listen_result[i] == SXE_RETURN_OK; i++) {
+    }
+
+    is(i, TEST_LOOPS,                                     "Every loop is listening on port %u", TEST_PORT);
+
+    /* The kernel spreads connections to the shared port across the loops' listeners
+     */
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(TEST_PORT);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    memset(accepted, 0, sizeof(accepted));
+
+    for (i = 0; i < TEST_CONNECTIONS; i++) {
+        client[i] = socket(AF_INET, SOCK_STREAM, 0);
+
+        if (connect(client[i], (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            connected++;
+        }
+    }
+
+    for (i = 0; i < connected; i++) {
+        test_tap_ev_identifier_wait(TEST_WAIT, &ev);
+        accepted[(uintptr_t)tap_ev_arg(ev, "loop")]++;
+    }
+
+    for (i = 0; i < TEST_LOOPS; i++) {
+        loops_used += accepted[i] > 0;
+    }
+
+    is(connected, TEST_CONNECTIONS,                       "Connected %u clients", TEST_CONNECTIONS);
+    ok(loops_used > 1,                                    "Connections were accepted by %u of %u loops (%u/%u/%u)", loops_used,
+       TEST_LOOPS, accepted[0], accepted[1], accepted[2]);
+    ok(!test_wrong_loop,                                  "Every SXE was only used on its own loop");
+
+    for (i = 0; i < TEST_CONNECTIONS; i++) {
+        CLOSESOCKET(client[i]);
+    }
+
+    sxe_fini();
+    return exit_status();
+}
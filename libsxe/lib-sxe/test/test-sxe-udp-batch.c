@@ -0,0 +1,170 @@
+/* Copyright (c) 2010 Sophos Group.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sxe.h"
+#include "sxe-socket.h"
+#include "sxe-test.h"
+#include "sxe-util.h"
+#include "tap.h"
+
+#define TEST_WAIT        5.0
+#define TEST_BATCH       32      /* Datagrams per sxe_write_to_batch() call                                  */
+#define TEST_ROUNDS      500     /* Number of batches sent in the throughput test                             */
+#define TEST_HOLD_SIZE   100     /* Size of the datagrams in the held datagram test                           */
+#define TEST_HOLD_COUNT  20      /* More than SXE_BUF_SIZE / TEST_HOLD_SIZE, so some are held in the batch    */
+
+static bool           test_hold;             /* If true, don't clear the buffer; push a tap event per datagram */
+static unsigned       test_received;
+static unsigned       test_mismatched;
+static unsigned short test_client_port;
+
+static void
+test_event_read(SXE * this, int length)
+{
+    char expected[16];
+
+    SXEE6I("%s(length=%d)", __func__, length);
+
+    if (test_hold) {
+        tap_ev_push(__func__, 2, "length", length, "used", SXE_BUF_USED(this));
+        goto SXE_EARLY_OUT;
+    }
+
+    snprintf(expected, sizeof(expected), "%08u", test_received);
+
+    if (SXE_BUF_USED(this) != 8 || memcmp(SXE_BUF(this), expected, 8) != 0 || SXE_PEER_PORT(this) != test_client_port) {
+        test_mismatched++;
+    }
+
+    sxe_buf_clear(this);
+
+    if (++test_received % TEST_BATCH == 0) {
+        tap_ev_push("test_event_read_batch", 1, "received", test_received);
+    }
+
+SXE_EARLY_OR_ERROR_OUT:
+    SXER6I("return");
+}
+
+int
+main(void)
+{
+    SXE_DATAGRAM       datagrams[TEST_HOLD_COUNT > TEST_BATCH ? TEST_HOLD_COUNT : TEST_BATCH];
+    char               payload[TEST_BATCH][16];
+    char               hold_payload[TEST_HOLD_SIZE];
+    struct sockaddr_in addr;
+    SXE              * server;
+    SXE              * client;
+    tap_ev             ev;
+    ev_tstamp          start_time;
+    ev_tstamp          elapsed_time;
+    unsigned           written;
+    unsigned           failed_writes = 0;
+    unsigned           round;
+    unsigned           i;
+
+    plan_tests(13);
+
+    sxe_register(2, 0);
+    ok(sxe_init() == SXE_RETURN_OK, "init succeeded");
+
+    server = sxe_new_udp(NULL, "127.0.0.1", 0, test_event_read);
+    is(sxe_set_udp_batch(server, TEST_BATCH), SXE_RETURN_OK, "Batched reads on the UDP server");
+    ok(sxe_listen(server) == SXE_RETURN_OK,                  "listen on UDP server succeeded");
+
+    client = sxe_new_udp(NULL, "127.0.0.1", 0, test_event_read);
+    ok(sxe_listen(client) == SXE_RETURN_OK,                  "listen on UDP client succeeded");
+    test_client_port = SXE_LOCAL_PORT(client);
+
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port        = SXE_LOCAL_PORT(server);
+    addr.sin_port        = htons(addr.sin_port);      /* Must be a separate step: htons can't wrap ntohs */
+
+    /* Throughput: send batches of sequence numbers over loopback and check that each arrives, in order, from the client
+     */
+    start_time = ev_time();
+
+    for (round = 0; round < TEST_ROUNDS; round++) {
+        for (i = 0; i < TEST_BATCH; i++) {
+            snprintf(payload[i], sizeof(payload[i]), "%08u", round * TEST_BATCH + i);
+            datagrams[i].data      = payload[i];
+            datagrams[i].size      = 8;
+            datagrams[i].dest_addr = &addr;
+        }
+
+        if (sxe_write_to_batch(client, datagrams, TEST_BATCH, &written) != SXE_RETURN_OK || written != TEST_BATCH) {
+            failed_writes++;
+            break;
+        }
+
+        if (strcmp(test_tap_ev_identifier_wait(TEST_WAIT, &ev), "test_event_read_batch") != 0) {
+            break;
+        }
+    }
+
+    elapsed_time = ev_time() - start_time;
+    is(failed_writes, 0,                               "All batched writes succeeded");
+    is(test_received, TEST_ROUNDS * TEST_BATCH,        "Received all %u datagrams", TEST_ROUNDS * TEST_BATCH);
+    is(test_mismatched, 0,                             "All datagrams arrived in order from the client");
+    diag("Sent and received %u datagrams in batches of %u in %.3f seconds (%.0f datagrams per second)",
+         test_received, TEST_BATCH, elapsed_time, elapsed_time > 0 ? test_received / elapsed_time : 0.0);
+
+    /* Datagrams that don't fit in the input buffer are held in the batch until the buffer is cleared
+     */
+    test_hold = true;
+    memset(hold_payload, 'x', sizeof(hold_payload));
+
+    for (i = 0; i < TEST_HOLD_COUNT; i++) {
+        datagrams[i].data      = hold_payload;
+        datagrams[i].size      = sizeof(hold_payload);
+        datagrams[i].dest_addr = &addr;
+    }
+
+    is(sxe_write_to_batch(client, datagrams, TEST_HOLD_COUNT, &written), SXE_RETURN_OK, "Wrote %u datagrams", TEST_HOLD_COUNT);
+
+    for (i = 0; i < SXE_BUF_SIZE / TEST_HOLD_SIZE; i++) {
+        test_tap_ev_identifier_wait(TEST_WAIT, &ev);
+    }
+
+    is(tap_ev_arg(ev, "used"), SXE_BUF_SIZE,           "Buffer is full after %u datagrams", SXE_BUF_SIZE / TEST_HOLD_SIZE);
+    test_process_all_libev_events();
+    is(tap_ev_length(), 0,                             "No more datagrams are delivered while the buffer is full");
+
+    sxe_buf_clear(server);
+
+    for (; i < TEST_HOLD_COUNT; i++) {
+        test_tap_ev_identifier_wait(TEST_WAIT, &ev);
+    }
+
+    is(tap_ev_arg(ev, "used"), (TEST_HOLD_COUNT - SXE_BUF_SIZE / TEST_HOLD_SIZE) * TEST_HOLD_SIZE,
+                                                       "Held datagrams were delivered once the buffer was cleared");
+    test_process_all_libev_events();
+    is(tap_ev_length(), 0,                             "No more events in the queue");
+
+    sxe_close(client);
+    is(sxe_close(server), SXE_RETURN_OK,               "Closed the batched UDP server");
+    sxe_fini();
+    return exit_status();
+}
@@ -37,6 +37,9 @@ static const struct key_value_entry options_config[] = {
     KEY_VALUE_ENTRY_UNSIGNED(struct example_options, infolog_flags,           0, 65535),
     KEY_VALUE_ENTRY_UNSIGNED(struct example_options, graphitelog_interval,    1, 60 * 60),
     KEY_VALUE_ENTRY_UNSIGNED(struct example_options, graphitelog_json_limit,  1, 65535),
+    KEY_VALUE_ENTRY_UNSIGNED(struct example_options, graphitelog_binary,      0, 1),
+    KEY_VALUE_ENTRY_UNSIGNED(struct example_options, conf_publish_interval,   0, 60 * 60 * 1000),
+    KEY_VALUE_ENTRY_STRING(  struct example_options, conf_publish_priority,   NULL),
     KEY_VALUE_ENTRY_UNSIGNED(struct example_options, example_option,          1, 1234),
 };
 
@@ -144,6 +147,8 @@ uup_example_update_config(struct confset *nconf)
 
     digest_store_set_options(options->digest_store_dir, options->digest_store_freq, options->digest_store_period);
     kit_graphitelog_update_set_options(options->graphitelog_json_limit, options->graphitelog_interval);
+    kit_graphitelog_set_format(options->graphitelog_binary ? KIT_GRAPHITELOG_FORMAT_BINARY : KIT_GRAPHITELOG_FORMAT_JSON);
+    conf_set_publish_options(options->conf_publish_interval, options->conf_publish_priority);
 
     kit_infolog_printf("Example option has been set to %u", options->example_option);
 
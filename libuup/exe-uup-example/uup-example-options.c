@@ -101,6 +101,7 @@ options_free(struct conf *base)
         struct example_options *me = CONF2OPT(base);
         SXEA6(base->type == &optct, ": unexpected conf_type %s", base->type->name);
         kit_free(me->digest_store_dir);
+        kit_free(me->conf_publish_priority);
         kit_free(me);
     }
 }
@@ -19,6 +19,11 @@ struct example_options {
     unsigned infolog_flags;
     unsigned graphitelog_interval;      /* The interval for logging counters for graphite */
     unsigned graphitelog_json_limit;    /* The max number of counters per JSON object in the graphite log */
+    unsigned graphitelog_binary;        /* 1 to write the graphite log in the binary format instead of JSON */
+
+    /* Options for the conf thread */
+    unsigned conf_publish_interval;     /* Minimum milliseconds between new conf generations, 0 to publish every change */
+    char    *conf_publish_priority;     /* Comma separated conf type names that are published immediately */
 
     /* Example application options */
     unsigned example_option;            /* An example option */
@@ -25,14 +25,9 @@ static void
 policy_free(struct conf *base)
 {
     struct policy *me = CONF2POLICY(base);
-    unsigned i;
 
     SXEA6(base->type == &policy_conf_type, "policy_free() with unexpected conf_type %s", base->type->name);
-
-    for (i = 0; i < me->count; i++)
-        policy_org_refcount_dec(me->orgs[i]);
-
-    kit_free(me->orgs);
+    conf_segment_table_fini(&me->orgs);
     kit_free(me);
 }
 
@@ -40,36 +35,21 @@ static struct conf *
 policy_clone(struct conf *obase)
 {
     struct policy *me, *ome;
-    unsigned i;
 
     if ((me = MOCKFAIL(POLICY_CLONE, NULL, kit_malloc(sizeof(*me)))) == NULL)
         SXEL2("Couldn't allocate a policy structure");
     else {
         conf_setup(&me->conf, &policy_conf_type);
-        me->count = 0;
         me->mtime = 0;
-        me->orgs  = NULL;
-        ome       = CONF2POLICY(obase);
-
-        if (ome && ome->count) {
-            me->count = (ome->count + 9) / 10 * 10;
-
-            if ((me->orgs = MOCKFAIL(POLICY_CLONE_POLICY_ORGS, NULL, kit_malloc(me->count * sizeof(*me->orgs)))) == NULL) {
-                SXEL2("Couldn't allocate %u new policy org slots", me->count);
-                kit_free(me);
-                me = NULL;
-            }
-            else {
-                me->count = ome->count;
-
-                for (i = 0; i < me->count; i++) {
-                    policy_org_refcount_inc(me->orgs[i] = ome->orgs[i]);
-
-                    if (me->mtime < me->orgs[i]->cs.mtime)
-                        me->mtime = me->orgs[i]->cs.mtime;
-                }
-            }
+
+        if ((ome = CONF2POLICY(obase)) == NULL)
+            conf_segment_table_init(&me->orgs, offsetof(struct policy_org, cs), policy_org_refcount_inc, policy_org_refcount_dec);
+        else if (!conf_segment_table_clone(&me->orgs, &ome->orgs)) {
+            kit_free(me);
+            me = NULL;
         }
+        else
+            me->mtime = conf_segment_table_mtime(&me->orgs);
     }
 
     return me ? &me->conf : NULL;
@@ -86,54 +66,49 @@ policy_settimeatleast(struct conf *base, time_t t)
     return me->mtime;
 }
 
-static unsigned
-policy_org_slot(struct policy_org *const *const me, uint32_t orgid, unsigned count)
-{
-    return conf_segment_slot((void *const *const)me, orgid, count, offsetof(struct policy_org, cs));
-}
-
 static unsigned
 policy_orgid2slot(const struct conf *base, uint32_t orgid)
 {
     const struct policy *me = CONSTCONF2POLICY(base);
 
-    return policy_org_slot(me->orgs, orgid, me->count);
+    return conf_segment_table_slot(&me->orgs, orgid);
 }
 
 static const struct conf_segment *
 policy_slot2segment(const struct conf *base, unsigned slot)
 {
-    const struct policy *me = CONSTCONF2POLICY(base);
+    const struct policy     *me  = CONSTCONF2POLICY(base);
+    const struct policy_org *org = conf_segment_table_get(&me->orgs, slot);
 
-    return slot < me->count ? &me->orgs[slot]->cs : NULL;
+    return org ? &org->cs : NULL;
 }
 
 static void
 policy_slotfailedload(struct conf *base, unsigned slot, bool value)
 {
-    struct policy *me = CONF2POLICY(base);
+    struct policy     *me = CONF2POLICY(base);
+    struct policy_org *org;
 
-    if (slot < me->count)
-        me->orgs[slot]->cs.failed_load = value;
+    if ((org = conf_segment_table_get(&me->orgs, slot)) != NULL)
+        org->cs.failed_load = value;
 }
 
 static bool
 policy_slotisempty(const struct conf *base, unsigned slot)
 {
-    const struct policy *me = CONSTCONF2POLICY(base);
+    const struct policy     *me  = CONSTCONF2POLICY(base);
+    const struct policy_org *org = conf_segment_table_get(&me->orgs, slot);
 
-    return slot >= me->count || (me->orgs[slot]->rules == NULL);
+    return org == NULL || (org->rules == NULL);
 }
 
-static void
+static bool
 policy_freeslot(struct conf *base, unsigned slot)
 {
     struct policy *me = CONF2POLICY(base);
 
-    SXEA1(slot < me->count, "Cannot free policy org slot %u (count %u)", slot, me->count);
-    policy_org_refcount_dec(me->orgs[slot]);
-    memmove(me->orgs + slot, me->orgs + slot + 1, (me->count - slot - 1) * sizeof(*me->orgs));
-    me->count--;
+    SXEA1(slot < me->orgs.count, "Cannot free policy org slot %u (count %u)", slot, me->orgs.count);
+    return conf_segment_table_remove(&me->orgs, slot);
 }
 
 static bool
@@ -141,50 +116,38 @@ policy_useorg(struct conf *base, void *vorg, unsigned slot, uint64_t *alloc)
 {
     struct policy     *me  = CONF2POLICY(base);
     struct policy_org *org = vorg;
-    struct policy_org **alp;
+    struct policy_org *oorg;
+    uint64_t          oalloc = 0;
+
+    SXEA6(slot <= me->orgs.count, "Oops, Insertion point is at pos %u of %u", slot, me->orgs.count);
 
-    SXEA6(slot <= me->count, "Oops, Insertion point is at pos %u of %u", slot, me->count);
+    if ((oorg = conf_segment_table_get(&me->orgs, slot)) != NULL && oorg->cs.id == org->cs.id) {
+        SXEL7("Existing policy slot %u already contains org id %" PRIu32, slot, org->cs.id);
+        oalloc = oorg->cs.alloc;
 
-    if (!(me->count % 10)) {
-        if ((alp = MOCKFAIL(POLICY_MORE_POLICY_ORGS, NULL, kit_realloc(me->orgs, (me->count + 10) * sizeof(*me->orgs)))) == NULL) {
-            SXEL2("Couldn't reallocate %u policy org slots", me->count + 10);
+        if (!conf_segment_table_replace(&me->orgs, slot, org))
             return false;
-        }
+    } else {
+        SXEA6(oorg == NULL || oorg->cs.id > org->cs.id, "Landed on unexpected orgid %" PRIu32 " when looking for org %" PRIu32,
+              oorg->cs.id, org->cs.id);
 
-        me->orgs = alp;
+        if (!conf_segment_table_insert(&me->orgs, slot, org))
+            return false;
     }
 
     policy_settimeatleast(base, org->cs.mtime);
-    *alloc += org->cs.alloc;
-
-    if (slot < me->count) {
-        SXEA6(me->orgs[slot]->cs.id >= org->cs.id, "Landed on unexpected orgid %" PRIu32 " when looking for org %" PRIu32,
-              me->orgs[slot]->cs.id, org->cs.id);
-
-        if (me->orgs[slot]->cs.id > org->cs.id) {
-            SXEL7("Existing slot %u orgid %" PRIu32 " exceeds policy id %" PRIu32, slot, me->orgs[slot]->cs.id,
-                  org->cs.id);
-            memmove(me->orgs + slot + 1, me->orgs + slot, (me->count - slot) * sizeof(*me->orgs));
-            me->count++;
-        } else {
-            SXEL7("Existing policy slot %u already contains org id %" PRIu32, slot, org->cs.id);
-            *alloc -= me->orgs[slot]->cs.alloc;
-            policy_org_refcount_dec(me->orgs[slot]);
-        }
-    } else
-        me->count++;
-
-    me->orgs[slot] = org;
+    *alloc += org->cs.alloc - oalloc;
     return true;
 }
 
 static void
 policy_loaded(struct conf *base)
 {
-    struct policy *me = CONF2POLICY(base);
+    struct policy     *me = CONF2POLICY(base);
+    struct policy_org *org;
 
-    if (me && me->count)
-        conf_report_load("rules", me->orgs[0]->version);
+    if (me && (org = conf_segment_table_get(&me->orgs, 0)) != NULL)
+        conf_report_load("rules", org->version);
 }
 
 static const struct conf_segment_ops policy_segment_ops = {
@@ -232,7 +195,5 @@ policy_conf_get(const struct confset *set, module_conf_t m)
 struct policy_org *
 policy_find_org(const struct policy *me, uint32_t orgid)
 {
-    unsigned slot = policy_org_slot(me->orgs, orgid, me->count);
-
-    return slot >= me->count || me->orgs[slot]->cs.id != orgid ? NULL : me->orgs[slot];
+    return conf_segment_table_find(&me->orgs, orgid);
 }
@@ -310,11 +310,11 @@ main(void)
             ok(policy, "Constructed policy from empty V%u data", POLICY_VERSION);
 
             skip_if(policy == NULL, 5, "Cannot check content of NULL policy") {
-                is(policy->count, 1, "V%u data has a count of 1 list", POLICY_VERSION);
+                is(policy->orgs.count, 1, "V%u data has a count of 1 list", POLICY_VERSION);
                 is(policy->conf.refcount, 2, "V%u data has a refcount of 2", POLICY_VERSION);
 
-                skip_if(!policy->count, 1, "Cannot verify org count")
-                    ok(policy->orgs[0]->rules == NULL, "V%u data has NULL rules", POLICY_VERSION);
+                skip_if(!policy->orgs.count, 1, "Cannot verify org count")
+                    ok(((struct policy_org *)conf_segment_table_get(&policy->orgs, 0))->rules == NULL, "V%u data has NULL rules", POLICY_VERSION);
 
                 ok(org = policy_find_org(policy, 1), "Found org 1 in the list");
                 is(org->count, 0,                    "No rules: kick 'em where it counts!");
@@ -370,17 +370,17 @@ main(void)
         OK_SXEL_ERROR("Couldn't clone a policy conf object");
         MOCKFAIL_END_TESTS();
 
-        MOCKFAIL_START_TESTS(3, POLICY_CLONE_POLICY_ORGS);
+        MOCKFAIL_START_TESTS(3, CONF_SEGMENT_TABLE_CLONE);
         create_atomic_file("test-policy-1", "%s", content[0]);
         ok(!confset_load(NULL), "Noted no update");
-        OK_SXEL_ERROR("Couldn't allocate 10 new policy org slots");
+        OK_SXEL_ERROR("Couldn't allocate 16 segment table chunk references");
         OK_SXEL_ERROR("Couldn't clone a policy conf object");
         MOCKFAIL_END_TESTS();
 
         MOCKFAIL_START_TESTS(2, POLICY_ORG_NEW);
         create_atomic_file("test-policy-1", "%s", content[0]);
         ok(!confset_load(NULL), "Noted no update");
-        OK_SXEL_ERROR("Cannot allocate 96 bytes for a policy_org object");
+        OK_SXEL_ERROR("Cannot allocate 104 bytes for a policy_org object");
         MOCKFAIL_END_TESTS();
 
         MOCKFAIL_START_TESTS(2, POLICY_DUP_GLOBALLINE);
@@ -389,7 +389,6 @@ main(void)
         OK_SXEL_ERROR("Failed to allocate memory to duplicate the global attribute line");
         MOCKFAIL_END_TESTS();
 
-        MOCKFAIL_START_TESTS(4, POLICY_MORE_POLICY_ORGS);
         char filename[32];
 
         for (i = 1; i <= 10; i++) {
@@ -399,9 +398,11 @@ main(void)
 
         ok(confset_load(NULL), "Noted an update");
         OK_SXEL_ERROR(NULL);
+
+        MOCKFAIL_START_TESTS(2, CONF_SEGMENT_TABLE_CHUNK);
         create_atomic_file("test-policy-0", "%s", content[0]);
         ok(!confset_load(NULL), "Noted no update");
-        OK_SXEL_ERROR("Couldn't reallocate 20 policy org slots");
+        OK_SXEL_ERROR("Couldn't allocate a segment table chunk");
         MOCKFAIL_END_TESTS();
 
         create_atomic_file("test-policy-0", "%s", content[0]);    // Actually insert out of order to cover this case
@@ -3,27 +3,30 @@
 
 #include "application.h"
 
+struct application_key {
+    uint32_t key;                         /* Offset of a lower cased, reversed domain in application::keys */
+    uint32_t slot;                        /* The 'al' slot of the application_lists that the domain came from */
+};
+
 struct application_index {
-    unsigned slot;
-    unsigned offset;
+    struct application_key *ref;          /* A block of 'count' entries sorted by key */
+    unsigned count;
 };
 
 struct application {
     struct conf conf;
-    unsigned count;                       /* # allocated application_lists entries */
     time_t mtime;                         /* last modification */
-    struct application_lists **al;        /* a block of 'count' pointers */
+    struct conf_segment_table lists;      /* application_lists segments in application id order */
+    unsigned count;                       /* # entries in 'al' */
+    struct application_lists **al;        /* a flat copy of 'lists' made by application_loaded(), indexed by the super-indices */
 
-    struct {
-        struct application_index *ref;    /* A block of *index.count entries */
-        unsigned count;
-    } dindex, pindex;                     /* dindex is the super-domain-index, pindex is the super-proxy-index */
+    struct application_index dindex;      /* The super-domain-index */
+    struct application_index pindex;      /* The super-proxy-index */
+    char *keys;                           /* Keys for both super-indices, stored contiguously in index order */
 };
 
 #if defined(SXE_DEBUG) || defined(SXE_COVERAGE)    // Define unique tags for mockfails
 #   define APPLICATION_CLONE             ((const char *)application_register_resolver + 0)
-#   define APPLICATION_CLONE_DOMAINLISTS ((const char *)application_register_resolver + 1)
-#   define APPLICATION_MOREDOMAINLISTS   ((const char *)application_register_resolver + 2)
 #endif
 
 #endif
@@ -1,22 +1,18 @@
 #include <kit-alloc.h>
 #include <mockfail.h>
+#include <string.h>
 
 #include "application-private.h"
 #include "conf-meta.h"
 #include "dns-name.h"
-#include "domainlist-private.h"       /* We point our super indices inside our application-lists' domainlists */
+#include "domainlist-private.h"       /* We copy our super index keys out of our application-lists' domainlists */
 #include "urllist.h"
 #include "xray.h"
 
 #define CONSTCONF2APPLICATION(confp)  (const struct application *)((confp) ? (const char *)(confp) - offsetof(struct application, conf) : NULL)
 #define CONF2APPLICATION(confp)       (struct application *)((confp) ? (char *)(confp) - offsetof(struct application, conf) : NULL)
 
-static __thread struct {
-    struct application_lists **al;
-    unsigned lookup : 1;              /* This is a lookup - 'a' is a reversed domain */
-    unsigned subdomain : 1;           /* subdomain matches ('a' is a subdomain of 'b') return 0 */
-    unsigned proxy : 1;               /* This is proxy (pdl) data, not domain (dl) data */
-} compar_data;
+static __thread const char *compar_keys;    /* The key store that compar_key() entries refer to */
 
 static void application_free(struct conf *base);
 
@@ -30,14 +26,13 @@ static void
 application_free(struct conf *base)
 {
     struct application *me = CONF2APPLICATION(base);
-    unsigned i;
 
     SXEA6(base->type == &appct, "application_free() with unexpected conf_type %s", base->type->name);
     kit_free(me->dindex.ref);
     kit_free(me->pindex.ref);
-    for (i = 0; i < me->count; i++)
-        application_lists_refcount_dec(me->al[i]);
+    kit_free(me->keys);
     kit_free(me->al);
+    conf_segment_table_fini(&me->lists);
     kit_free(me);
 }
 
@@ -45,36 +40,28 @@ static struct conf *
 application_clone(struct conf *obase)
 {
     struct application *me, *ome;
-    unsigned i;
 
     if ((me = MOCKFAIL(APPLICATION_CLONE, NULL, kit_malloc(sizeof(*me)))) == NULL)
         SXEL2("Couldn't allocate an application structure");
     else {
         conf_setup(&me->conf, &appct);
-        me->count = 0;
         me->mtime = 0;
-        me->al = NULL;
 
-        /* We don't copy the super-indices.  They'll be setup in application_loaded() */
+        /* We don't copy the super-indices or the flat application_lists array.  They'll be setup in application_loaded() */
+        me->count = 0;
+        me->al = NULL;
         me->dindex.ref = me->pindex.ref = NULL;
         me->dindex.count = me->pindex.count = 0;
-
-        ome = CONF2APPLICATION(obase);
-        if (ome && ome->count) {
-            me->count = (ome->count + 9) / 10 * 10;
-            if ((me->al = MOCKFAIL(APPLICATION_CLONE_DOMAINLISTS, NULL, kit_malloc(me->count * sizeof(*me->al)))) == NULL) {
-                SXEL2("Couldn't allocate %u new application domainlist slots", me->count);
-                kit_free(me);
-                me = NULL;
-            } else {
-                me->count = ome->count;
-                for (i = 0; i < me->count; i++) {
-                    application_lists_refcount_inc(me->al[i] = ome->al[i]);
-                    if (me->mtime < me->al[i]->cs.mtime)
-                        me->mtime = me->al[i]->cs.mtime;
-                }
-            }
-        }
+        me->keys = NULL;
+
+        if ((ome = CONF2APPLICATION(obase)) == NULL)
+            conf_segment_table_init(&me->lists, offsetof(struct application_lists, cs), application_lists_refcount_inc,
+                                    application_lists_refcount_dec);
+        else if (!conf_segment_table_clone(&me->lists, &ome->lists)) {
+            kit_free(me);
+            me = NULL;
+        } else
+            me->mtime = conf_segment_table_mtime(&me->lists);
     }
 
     return me ? &me->conf : NULL;
@@ -91,34 +78,31 @@ application_settimeatleast(struct conf *base, time_t t)
     return me->mtime;
 }
 
-static unsigned
-application_lists_slot(struct application_lists *const *const me, uint32_t appid, unsigned count)
-{
-    return conf_segment_slot((void *const *const)me, appid, count, offsetof(struct application_lists, cs));
-}
-
 static unsigned
 application_appid2slot(const struct conf *base, uint32_t appid)
 {
     const struct application *me = CONSTCONF2APPLICATION(base);
 
-    return application_lists_slot(me->al, appid, me->count);
+    return conf_segment_table_slot(&me->lists, appid);
 }
 
 static const struct conf_segment *
 application_slot2segment(const struct conf *base, unsigned slot)
 {
     const struct application *me = CONSTCONF2APPLICATION(base);
+    const struct application_lists *al = conf_segment_table_get(&me->lists, slot);
 
-    return slot < me->count ? &me->al[slot]->cs : NULL;
+    return al ? &al->cs : NULL;
 }
 
 static void
 application_slotfailedload(struct conf *base, unsigned slot, bool value)
 {
     struct application *me = CONF2APPLICATION(base);
-    if (slot < me->count) {
-        me->al[slot]->cs.failed_load = value;
+    struct application_lists *al;
+
+    if ((al = conf_segment_table_get(&me->lists, slot)) != NULL) {
+        al->cs.failed_load = value;
     }
 }
 
@@ -126,19 +110,18 @@ static bool
 application_slotisempty(const struct conf *base, unsigned slot)
 {
     const struct application *me = CONSTCONF2APPLICATION(base);
+    const struct application_lists *al = conf_segment_table_get(&me->lists, slot);
 
-    return slot >= me->count || (me->al[slot]->dl == NULL && me->al[slot]->pdl == NULL);
+    return al == NULL || (al->dl == NULL && al->pdl == NULL);
 }
 
-static void
+static bool
 application_freeslot(struct conf *base, unsigned slot)
 {
     struct application *me = CONF2APPLICATION(base);
 
-    SXEA1(slot < me->count, "Cannot free application domainlist slot %u (count %u)", slot, me->count);
-    application_lists_refcount_dec(me->al[slot]);
-    memmove(me->al + slot, me->al + slot + 1, (me->count - slot - 1) * sizeof(*me->al));
-    me->count--;
+    SXEA1(slot < me->lists.count, "Cannot free application domainlist slot %u (count %u)", slot, me->lists.count);
+    return conf_segment_table_remove(&me->lists, slot);
 }
 
 static bool
@@ -146,122 +129,133 @@ application_usedomainlist(struct conf *base, void *val, unsigned slot, uint64_t
 {
     struct application *me = CONF2APPLICATION(base);
     struct application_lists *al = val;
-    struct application_lists **alp;
+    struct application_lists *oal;
+    uint64_t oalloc = 0;
 
-    SXEA6(slot <= me->count, "Oops, Insertion point is at pos %u of %u", slot, me->count);
-    if (!(me->count % 10)) {
-        if ((alp = MOCKFAIL(APPLICATION_MOREDOMAINLISTS, NULL, kit_realloc(me->al, (me->count + 10) * sizeof(*me->al)))) == NULL) {
-            SXEL2("Couldn't reallocate %u application domainlist slots", me->count + 10);
+    SXEA6(slot <= me->lists.count, "Oops, Insertion point is at pos %u of %u", slot, me->lists.count);
+
+    if ((oal = conf_segment_table_get(&me->lists, slot)) != NULL && oal->cs.id == al->cs.id) {
+        SXEL7("Existing application-lists slot %u already contains application id %" PRIu32, slot, al->cs.id);
+        oalloc = oal->cs.alloc;
+        if (!conf_segment_table_replace(&me->lists, slot, al))
+            return false;
+    } else {
+        SXEA6(oal == NULL || oal->cs.id > al->cs.id, "Landed on unexpected appid %" PRIu32 " when looking for app %" PRIu32, oal->cs.id, al->cs.id);
+        if (!conf_segment_table_insert(&me->lists, slot, al))
             return false;
-        }
-        me->al = alp;
     }
 
     application_settimeatleast(base, al->cs.mtime);
-    *alloc += al->cs.alloc;
-    if (slot < me->count) {
-        SXEA6(me->al[slot]->cs.id >= al->cs.id, "Landed on unexpected appid %" PRIu32 " when looking for app %" PRIu32, me->al[slot]->cs.id, al->cs.id);
-        if (me->al[slot]->cs.id > al->cs.id) {
-            SXEL7("Existing domainlist slot %u appid %" PRIu32 " exceeds application id %" PRIu32, slot, me->al[slot]->cs.id, al->cs.id);
-            memmove(me->al + slot + 1, me->al + slot, (me->count - slot) * sizeof(*me->al));
-            me->count++;
-        } else {
-            SXEL7("Existing application-lists slot %u already contains application id %" PRIu32, slot, al->cs.id);
-            *alloc -= me->al[slot]->cs.alloc;
-            application_lists_refcount_dec(me->al[slot]);
-        }
-    } else
-        me->count++;
-    me->al[slot] = al;
-
+    *alloc += al->cs.alloc - oalloc;
     return true;
 }
 
-static int
-compar_index(const void *va, const void *vb)
+/*
+ * Compare a lower cased, reversed domain with a key.  If 'subdomain' is set and 'a' is a subdomain of 'b', they're equal.
+ */
+static inline int
+application_key_cmp(const char *a, const char *b, bool subdomain)
 {
-    const struct application_index *ai;
-    struct domainlist *dl;
-    const uint8_t *a, *b;
+    for (; *b && *a == *b; a++, b++)
+        ;
 
-    if (compar_data.lookup)
-        a = va;     /* We're doing a lookup - va points to a (reversed) domain string */
-    else {
-        ai = va;    /* We're sorting, va points to an application index entry */
-        dl = compar_data.proxy ? compar_data.al[ai->slot]->pdl : compar_data.al[ai->slot]->dl;
-        SXEA6(dl, "Cannot reference through NULL for lhs");
-        a = (const uint8_t *)dl->name_bundle + ai->offset;
-    }
-    ai = vb;
-    dl = compar_data.proxy ? compar_data.al[ai->slot]->pdl : compar_data.al[ai->slot]->dl;
-    SXEA6(dl, "Cannot reference through NULL for rhs");
-    b = (const uint8_t *)dl->name_bundle + ai->offset;
+    if (subdomain && *a == '.' && !*b)
+        return 0;
 
-    for (; *b && dns_tolower[*a] == dns_tolower[*b]; a++, b++)
-        ;
+    return (uint8_t)*a - (uint8_t)*b;
+}
 
-    if (compar_data.subdomain && *a == '.' && !*b)
-        return 0;    /* If this is a lookup, and 'a' is a subdomain of 'b', then it's a match! */
+static int
+compar_key(const void *va, const void *vb)
+{
+    const struct application_key *a = va, *b = vb;
 
-    return dns_tolower[*a] - dns_tolower[*b];
+    return strcmp(compar_keys + a->key, compar_keys + b->key);
 }
 
 static void
 application_loaded(struct conf *base)
 {
     struct application *me = CONF2APPLICATION(base);
-    struct application_index *tgt, *src;
-    unsigned *count, i, n, proxy, slot;
-    struct application_index **ref;
+    struct application_key *tgt, *src;
+    unsigned i, n, proxy, slot;
+    struct application_index *index;
+    char *keys[2], *key;
+    size_t len[2], pos;
     struct domainlist *dl;
+    const char *name;
 
-    if (me && me->count)
+    if (me && me->lists.count)
         conf_report_load("application", APPLICATION_VERSION);
 
-    /* Now create our super-indices */
+    /* The super-indices refer to application_lists by slot, so take a flat copy of the table */
+    me->count = me->lists.count;
+    SXEA1(me->al = kit_malloc(me->count * sizeof(*me->al)), "Cannot allocate %u application_lists pointers", me->count);
+    for (slot = 0; slot < me->count; slot++)
+        me->al[slot] = conf_segment_table_get(&me->lists, slot);
+
+    /*
+     * Now create our super-indices.  Each domain is copied (lower cased) into a temporary key store so that sorting and
+     * lookups never have to go back through the application_lists and their domainlists.
+     */
     for (proxy = 0; proxy < 2; proxy++) {
-        count = proxy ? &me->pindex.count : &me->dindex.count;
-        ref = proxy ? &me->pindex.ref : &me->dindex.ref;
+        index = proxy ? &me->pindex : &me->dindex;
 
-        for (*count = slot = 0; slot < me->count; slot++)
+        for (index->count = slot = 0, len[proxy] = 0; slot < me->count; slot++)
             if ((dl = proxy ? me->al[slot]->pdl : me->al[slot]->dl)) {
-                SXEA6(dl, "Cannot reference through NULL");
-                *count += dl->name_amount;
+                index->count += dl->name_amount;
+                for (n = 0; n < (unsigned)dl->name_amount; n++)
+                    len[proxy] += strlen(dl->name_bundle + DOMAINLIST_NAME_OFFSET(dl, n)) + 1;
             }
 
-        SXEA1(*ref = kit_malloc(*count * sizeof(**ref)), "Cannot allocate a super-index of %u entries", *count);
+        SXEA1(len[proxy] <= UINT32_MAX, "A super-index key store of %zu bytes is too big", len[proxy]);
+        SXEA1(index->ref = kit_malloc(index->count * sizeof(*index->ref)), "Cannot allocate a super-index of %u entries", index->count);
+        SXEA1(keys[proxy] = kit_malloc(len[proxy] + 1), "Cannot allocate a super-index key store of %zu bytes", len[proxy]);
 
-        for (i = slot = 0; slot < me->count; slot++)
-            if ((dl = proxy ? me->al[slot]->pdl : me->al[slot]->dl)) {
-                SXEA6(dl, "Cannot reference through NULL");
+        for (i = slot = 0, pos = 0; slot < me->count; slot++)
+            if ((dl = proxy ? me->al[slot]->pdl : me->al[slot]->dl))
                 for (n = 0; n < (unsigned)dl->name_amount; n++, i++) {
-                    ref[0][i].slot = slot;
-                    ref[0][i].offset = DOMAINLIST_NAME_OFFSET(dl, n);
+                    index->ref[i].key = pos;
+                    index->ref[i].slot = slot;
+                    for (name = dl->name_bundle + DOMAINLIST_NAME_OFFSET(dl, n); *name; name++)
+                        keys[proxy][pos++] = dns_tolower[(uint8_t)*name];
+                    keys[proxy][pos++] = '\0';
                 }
-            }
-        SXEA6(i == *count, "Oops, i=%u, not %u", i, *count);
+        SXEA6(i == index->count, "Oops, i=%u, not %u", i, index->count);
 
         if (i > 1) {
             /* Sort the super-index */
-            compar_data.al = me->al;
-            compar_data.lookup = 0;
-            compar_data.subdomain = 0;
-            compar_data.proxy = proxy;
-            qsort(*ref, *count, sizeof(**ref), compar_index);
+            compar_keys = keys[proxy];
+            qsort(index->ref, index->count, sizeof(*index->ref), compar_key);
 
             if (!proxy) {
                 /* Remove super-domain-index subdomains */
-                compar_data.al = me->al;
-                compar_data.lookup = 0;
-                compar_data.subdomain = !proxy;
-                compar_data.proxy = proxy;
-                for (tgt = *ref, src = *ref + 1; src < *ref + *count; src++)
-                    if (compar_index(src, tgt))
+                for (tgt = index->ref, src = index->ref + 1; src < index->ref + index->count; src++)
+                    if (application_key_cmp(keys[proxy] + src->key, keys[proxy] + tgt->key, true))
                         *++tgt = *src;
-                *count = tgt - *ref + 1;
+                index->count = tgt - index->ref + 1;
             }
         }
     }
+
+    /* Pack the surviving keys into a single store in index order, so that a binary search walks forward through memory */
+    for (pos = 0, proxy = 0; proxy < 2; proxy++)
+        for (index = proxy ? &me->pindex : &me->dindex, i = 0; i < index->count; i++)
+            pos += strlen(keys[proxy] + index->ref[i].key) + 1;
+
+    SXEA1(me->keys = kit_malloc(pos + 1), "Cannot allocate a super-index key store of %zu bytes", pos);
+
+    for (pos = 0, proxy = 0; proxy < 2; proxy++) {
+        for (index = proxy ? &me->pindex : &me->dindex, i = 0; i < index->count; i++) {
+            key = keys[proxy] + index->ref[i].key;
+            n = strlen(key) + 1;
+            memcpy(me->keys + pos, key, n);
+            index->ref[i].key = pos;
+            pos += n;
+        }
+
+        kit_free(keys[proxy]);
+    }
 }
 
 static const struct conf_segment_ops application_segment_ops = {
@@ -310,33 +304,43 @@ application_conf_get(const struct confset *set, module_conf_t m)
     return CONSTCONF2APPLICATION(base);
 }
 
+static const struct application_key *
+application_index_find(const struct application *me, const struct application_index *index, const char *domain, bool subdomain)
+{
+    unsigned lo, hi, mid;
+    int cmp;
+
+    for (lo = 0, hi = index->count; lo < hi;) {
+        mid = lo + (hi - lo) / 2;
+
+        if ((cmp = application_key_cmp(domain, me->keys + index->ref[mid].key, subdomain)) == 0)
+            return index->ref + mid;
+
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return NULL;
+}
+
 static bool
 application_lookup_domainlist(const struct application *me, const uint8_t *name, bool proxy, struct xray *x, const char *listname)
 {
     char domain[DNS_MAXLEN_STRING + 1];
-    struct application_index *result;
-    struct application_index *ref;
+    const struct application_key *result;
     const uint8_t *suffix;
-    struct domainlist *dl;
     const char *match;
-    unsigned count;
-    size_t   dlen;
+    size_t   dlen, i;
 
     if (me && dns_name_to_buf(name, domain, sizeof(domain), &dlen, DNS_NAME_DEFAULT)) {
         mem_reverse(domain, dlen);
+        for (i = 0; i < dlen; i++)
+            domain[i] = dns_tolower[(uint8_t)domain[i]];
 
-        compar_data.al = me->al;
-        compar_data.lookup = 1;
-        compar_data.subdomain = !proxy;
-        compar_data.proxy = proxy;
-
-        count = proxy ? me->pindex.count : me->dindex.count;
-        ref = proxy ? me->pindex.ref : me->dindex.ref;
-
-        if ((result = bsearch(domain, ref, count, sizeof(*ref), compar_index)) != NULL) {
-            dl = proxy ? me->al[result->slot]->pdl : me->al[result->slot]->dl;
-            SXEA6(dl, "Cannot reference through NULL");
-            match = dl->name_bundle + result->offset;
+        if ((result = application_index_find(me, proxy ? &me->pindex : &me->dindex, domain, !proxy)) != NULL) {
+            match = me->keys + result->key;
             suffix = name + dlen + !*match - !*name - strlen(match);
 
             XRAY6(x, "%s %s match: found %s", listname, proxy ? "exact" : "subdomain", dns_name_to_str1(suffix));
@@ -366,14 +370,14 @@ application_lookup_domainlist_byid(const struct application *me, uint32_t appid,
     struct domainlist *dl;
     const uint8_t *ret;
     char appname[50];
-    unsigned slot;
 
     ret = NULL;
     if (me) {
-        slot = application_appid2slot(&me->conf, appid);
-        al = slot < me->count ? me->al[slot] : NULL;
-        if (al && al->cs.id == appid && (dl = proxy ? al->pdl : al->dl)) {
-            if (al->cm && al->cm->name)
+        al = conf_segment_table_find(&me->lists, appid);
+        if (al && (dl = proxy ? al->pdl : al->dl)) {
+            if (!XRAY_WANTED(x, 6))
+                *appname = '\0';    /* The name is only used for tracing */
+            else if (al->cm && al->cm->name)
                 snprintf(appname, sizeof(appname), "%s %s", al->cm->name, proxy ? "proxy" : "domain");
             else
                 snprintf(appname, sizeof(appname), "application-%u %s", appid, proxy ? "proxy" : "domain");
@@ -400,14 +404,12 @@ bool
 application_match_url_byid(const struct application *me, uint32_t appid, const char *url, unsigned urllen)
 {
     struct application_lists *al;
-    unsigned slot;
     bool ret;
 
     ret = false;
     if (me) {
-        slot = application_appid2slot(&me->conf, appid);
-        al = slot < me->count ? me->al[slot] : NULL;
-        if (al && al->cs.id == appid && al->ul)
+        al = conf_segment_table_find(&me->lists, appid);
+        if (al && al->ul)
             ret = urllist_match(al->ul, url, urllen);
     }
 
@@ -12,6 +12,7 @@
 #include "conf-loader.h"
 #include "dns-name.h"
 #include "domaintagging.h"
+#include "xray.h"
 
 #define CONSTCONF2CAT(confp) (const struct categorization *)((confp) ? (const char *)(confp) - offsetof(struct categorization, conf) : NULL)
 #define CONF2CAT(confp)      (struct categorization *)((confp) ? (char *)(confp) - offsetof(struct categorization, conf) : NULL)
@@ -340,14 +341,16 @@ categorization_by_domain(const struct categorization *me, const struct confset *
                 case CATTYPE_EXACT_DOMAINLIST:
                     mtype = me->item[i].type == CATTYPE_DOMAINLIST ? DOMAINLIST_MATCH_SUBDOMAIN : DOMAINLIST_MATCH_EXACT;
 
-                    if (domainlist_match(domainlist_conf_get(conf, me->module[i]), name, mtype, x, conf_name(conf, me->module[i])))
+                    if (domainlist_match(domainlist_conf_get(conf, me->module[i]), name, mtype,
+                        x, XRAY_WANTED(x, 6) ? conf_name(conf, me->module[i]) : NULL))
                         pref_categories_setbit(match, me->item[i].catbit);
 
                     SXEL7("After looking for %s in %s, categories are %s",
                           dns_name_to_str1(name), conf_name(conf, me->module[i]) ?: "<not-loaded>", pref_categories_idstr(match));
                     break;
                 case CATTYPE_APPLICATION:
-                    if (application_match_domain(application_conf_get(conf, me->module[i]), name, x, conf_name(conf, me->module[i])))
+                    if (application_match_domain(application_conf_get(conf, me->module[i]), name,
+                        x, XRAY_WANTED(x, 6) ? conf_name(conf, me->module[i]) : NULL))
                         pref_categories_setbit(match, me->item[i].catbit);
 
                     SXEL7("After looking for %s in %s, categories are %s",
@@ -370,7 +373,8 @@ categorization_by_address(const struct categorization *me, const struct confset
                 switch (me->item[i].type) {
                 case CATTYPE_CIDRLIST:
                 case CATTYPE_IPLIST:
-                    if (cidrlist_search(cidrlist_conf_get(conf, me->module[i]), addr, x, conf_name(conf, me->module[i])))
+                    if (cidrlist_search(cidrlist_conf_get(conf, me->module[i]), addr,
+                        x, XRAY_WANTED(x, 6) ? conf_name(conf, me->module[i]) : NULL))
                         pref_categories_setbit(match, me->item[i].catbit);
 
                     SXEL7("After looking for %s in %s, categories are %s",
@@ -391,7 +395,8 @@ categorization_might_proxy(const struct categorization *me, const struct confset
         for (i = 0; i < me->count; i++)
             if (me->item[i].type == CATTYPE_APPLICATION)
                 if ((!me->item[i].polmask || me->item[i].polmask & polbits) && (!me->item[i].orgmask || me->item[i].orgmask & orgbits))
-                    if (application_proxy(application_conf_get(conf, me->module[i]), name, x, conf_name(conf, me->module[i])))
+                    if (application_proxy(application_conf_get(conf, me->module[i]), name,
+                        x, XRAY_WANTED(x, 6) ? conf_name(conf, me->module[i]) : NULL))
                         return true;
 
     return false;
@@ -24,12 +24,9 @@ static void
 cidrprefs_free(struct conf *base)
 {
     struct cidrprefs *me = CONF2CIDRPREFS(base);
-    unsigned i;
 
     SXEA6(base->type == &cidrprefsct, "cidrprefs_free() with unexpected conf_type %s", base->type->name);
-    for (i = 0; i < me->count; i++)
-        prefs_org_refcount_dec(me->org[i]);
-    kit_free(me->org);
+    conf_segment_table_fini(&me->org);
     kit_free(me);
 }
 
@@ -37,32 +34,20 @@ static struct conf *
 cidrprefs_clone(struct conf *obase)
 {
     struct cidrprefs *me, *ome;
-    unsigned i;
 
     if ((me = MOCKFAIL(CIDRPREFS_CLONE, NULL, kit_malloc(sizeof(*me)))) == NULL)
         SXEL2("Couldn't allocate a cidrprefs structure");
     else {
         conf_setup(&me->conf, &cidrprefsct);
-        me->count = 0;
         me->mtime = 0;
-        me->org = NULL;
-
-        ome = CONF2CIDRPREFS(obase);
-        if (ome && ome->count) {
-            me->count = (ome->count + 9) / 10 * 10;
-            if ((me->org = MOCKFAIL(CIDRPREFS_CLONE_ORGS, NULL, kit_malloc(me->count * sizeof(*me->org)))) == NULL) {
-                SXEL2("Couldn't allocate %u new cidrprefs org slots", me->count);
-                kit_free(me);
-                me = NULL;
-            } else {
-                me->count = ome->count;
-                for (i = 0; i < me->count; i++) {
-                    prefs_org_refcount_inc(me->org[i] = ome->org[i]);
-                    if (me->mtime < me->org[i]->cs.mtime)
-                        me->mtime = me->org[i]->cs.mtime;
-                }
-            }
-        }
+
+        if ((ome = CONF2CIDRPREFS(obase)) == NULL)
+            prefs_org_table_init(&me->org);
+        else if (!conf_segment_table_clone(&me->org, &ome->org)) {
+            kit_free(me);
+            me = NULL;
+        } else
+            me->mtime = conf_segment_table_mtime(&me->org);
     }
 
     return me ? &me->conf : NULL;
@@ -83,23 +68,26 @@ cidrprefs_orgid2slot(const struct conf *base, uint32_t orgid)
 {
     const struct cidrprefs *me = CONSTCONF2CIDRPREFS(base);
 
-    return prefs_org_slot(me->org, orgid, me->count);
+    return prefs_org_slot(&me->org, orgid);
 }
 
 static const struct conf_segment *
 cidrprefs_slot2segment(const struct conf *base, unsigned slot)
 {
     const struct cidrprefs *me = CONSTCONF2CIDRPREFS(base);
+    const struct prefs_org *po = conf_segment_table_get(&me->org, slot);
 
-    return slot < me->count ? &me->org[slot]->cs : NULL;
+    return po ? &po->cs : NULL;
 }
 
 static void
 cidrprefs_slotfailedload(struct conf *base, unsigned slot, bool value)
 {
     struct cidrprefs *me = CONF2CIDRPREFS(base);
-    if (slot < me->count) {
-        me->org[slot]->cs.failed_load = value;
+    struct prefs_org *po;
+
+    if ((po = conf_segment_table_get(&me->org, slot)) != NULL) {
+        po->cs.failed_load = value;
     }
 }
 
@@ -107,19 +95,18 @@ bool
 cidrprefs_slotisempty(const struct conf *base, unsigned slot)
 {
     const struct cidrprefs *me = CONSTCONF2CIDRPREFS(base);
+    const struct prefs_org *po = conf_segment_table_get(&me->org, slot);
 
-    return slot >= me->count || &me->org[slot]->fp.total == 0;
+    return po == NULL || &po->fp.total == 0;
 }
 
-static void
+static bool
 cidrprefs_freeslot(struct conf *base, unsigned slot)
 {
     struct cidrprefs *me = CONF2CIDRPREFS(base);
 
-    SXEA1(slot < me->count, "Cannot free cidrprefs org slot %u (count %u)", slot, me->count);
-    prefs_org_refcount_dec(me->org[slot]);
-    memmove(me->org + slot, me->org + slot + 1, (me->count - slot - 1) * sizeof(*me->org));
-    me->count--;
+    SXEA1(slot < me->org.count, "Cannot free cidrprefs org slot %u (count %u)", slot, me->org.count);
+    return conf_segment_table_remove(&me->org, slot);
 }
 
 static bool
@@ -127,30 +114,22 @@ cidrprefs_useorg(struct conf *base, void *vcpo, unsigned slot, uint64_t *alloc)
 {
     struct cidrprefs *me = CONF2CIDRPREFS(base);
     struct prefs_org *cpo = vcpo;
-    struct prefs_org **cpop;
-
-    SXEA6(slot <= me->count, "Oops, Insertion point is at pos %u of %u", slot, me->count);
-    if (!(me->count % 10)) {
-        if ((cpop = MOCKFAIL(CIDRPREFS_MOREORGS, NULL, kit_realloc(me->org, (me->count + 10) * sizeof(*me->org)))) == NULL) {
-            SXEL2("Couldn't reallocate %u cidrprefs org slots", me->count + 10);
-            return false;
-        }
-        me->org = cpop;
-    }
 
+    SXEA6(slot <= me->org.count, "Oops, Insertion point is at pos %u of %u", slot, me->org.count);
     if (!(cpo->fp.loadflags & LOADFLAGS_FP_FAILED)) {
         cidrprefs_settimeatleast(base, cpo->cs.mtime);
     }
-    return prefs_org_fill_slot(cpo, me->org, &me->count, slot, alloc);
+    return prefs_org_fill_slot(cpo, &me->org, slot, alloc);
 }
 
 static void
 cidrprefs_loaded(struct conf *base)
 {
     struct cidrprefs *me = CONF2CIDRPREFS(base);
+    const struct prefs_org *po;
 
-    if (me && me->count)
-        conf_report_load(me->org[0]->fp.ops->type, me->org[0]->fp.version);
+    if (me && (po = conf_segment_table_get(&me->org, 0)) != NULL)
+        conf_report_load(po->fp.ops->type, po->fp.version);
 }
 
 static const struct conf_segment_ops cidrprefs_segment_ops = {
@@ -188,12 +167,12 @@ cidrprefs_conf_get(const struct confset *set, module_conf_t m)
 const struct prefblock *
 cidrprefs_get_prefblock(const struct cidrprefs *me, uint32_t orgid)
 {
-    unsigned i;
+    const struct prefs_org *po;
 
-    if (me == NULL || (i = prefs_org_slot(me->org, orgid, me->count)) == me->count || me->org[i]->cs.id != orgid)
+    if (me == NULL || (po = conf_segment_table_find(&me->org, orgid)) == NULL)
         return NULL;
 
-    return me->org[i]->fp.values;
+    return po->fp.values;
 }
 
 /* Lookup cidrprefs by its org and bundle id */
@@ -212,7 +191,7 @@ cidrprefs_get_policy(const struct cidrprefs *me, pref_t *pref, uint32_t orgid, u
         goto DONE;
     }
 
-    if (!(bundle = prefbundle_get(blk->resource.bundle, blk->count.bundles, AT_BUNDLE, bundleid))) {
+    if (!(bundle = prefblock_bundle(blk, AT_BUNDLE, bundleid))) {
         SXEL6("Unable to find bundleid %u for orgid %u in cidrprefs", bundleid, orgid);
         goto DONE;
     }
@@ -2,6 +2,7 @@
 #include <stdio.h>
 
 #include "cloudprefs-org.h"
+#include "parseline.h"
 #include "xray.h"
 
 struct cloudprefs_org_key {
@@ -25,14 +26,15 @@ static int    /* returns # bytes consumed */
 cloudprefs_org_parsekey(struct fileprefs *fp, int item, const struct conf_loader *cl, const char *line)
 {
     struct cloudprefs_org_key *k = CLOUDPREFS_ORG_KEY(fp, item);
-    uint32_t orgid, originid;
-    int cmp, consumed;
-    char colon;
+    uint64_t orgid, originid;
+    const char *p;
+    int cmp;
 
     SXEA6(fp->version == CLOUDPREFS_VERSION, "Trying to parse cloudprefs-origin key for version %u", fp->version);
 
-    if (sscanf(line, "%" PRIu32 ":%" PRIu32 "%c%n", &orgid, &originid, &colon, &consumed) == 3 && colon == ':')
-        k->originid =  originid;
+    if ((p = parse_uint(line, &orgid)) != NULL && *p == ':' && (p = parse_uint(p + 1, &originid)) != NULL && *p++ == ':'
+     && orgid == (uint32_t)orgid && originid == (uint32_t)originid)
+        k->originid = originid;
     else {
         SXEL2("%s(): cloudprefs v%u: %s: %u: Unrecognised line (invalid key format)", __FUNCTION__, fp->version, conf_loader_path(cl), conf_loader_line(cl));
         return 0;
@@ -46,7 +48,7 @@ cloudprefs_org_parsekey(struct fileprefs *fp, int item, const struct conf_loader
         return 0;
     }
 
-    return consumed;
+    return p - line;
 }
 
 const char *
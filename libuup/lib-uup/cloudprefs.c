@@ -31,12 +31,9 @@ static void
 cloudprefs_free(struct conf *base)
 {
     struct cloudprefs *me = CONF2CLOUDPREFS(base);
-    unsigned i;
 
     SXEA6(base->type == &cloudprefsct, "cloudprefs_free() with unexpected conf_type %s", base->type->name);
-    for (i = 0; i < me->count; i++)
-        prefs_org_refcount_dec(me->org[i]);
-    kit_free(me->org);
+    conf_segment_table_fini(&me->org);
     kit_free(me);
 }
 
@@ -44,32 +41,20 @@ static struct conf *
 cloudprefs_clone(struct conf *obase)
 {
     struct cloudprefs *me, *ome;
-    unsigned i;
 
     if ((me = MOCKFAIL(CLOUDPREFS_CLONE, NULL, kit_malloc(sizeof(*me)))) == NULL)
         SXEL2("Couldn't allocate a cloudprefs structure");
     else {
         conf_setup(&me->conf, &cloudprefsct);
-        me->count = 0;
         me->mtime = 0;
-        me->org = NULL;
-
-        ome = CONF2CLOUDPREFS(obase);
-        if (ome && ome->count) {
-            me->count = (ome->count + 9) / 10 * 10;
-            if ((me->org = MOCKFAIL(CLOUDPREFS_CLONE_ORGS, NULL, kit_malloc(me->count * sizeof(*me->org)))) == NULL) {
-                SXEL2("Couldn't allocate %u new cloudprefs org slots", me->count);
-                kit_free(me);
-                me = NULL;
-            } else {
-                me->count = ome->count;
-                for (i = 0; i < me->count; i++) {
-                    prefs_org_refcount_inc(me->org[i] = ome->org[i]);
-                    if (me->mtime < me->org[i]->cs.mtime)
-                        me->mtime = me->org[i]->cs.mtime;
-                }
-            }
-        }
+
+        if ((ome = CONF2CLOUDPREFS(obase)) == NULL)
+            prefs_org_table_init(&me->org);
+        else if (!conf_segment_table_clone(&me->org, &ome->org)) {
+            kit_free(me);
+            me = NULL;
+        } else
+            me->mtime = conf_segment_table_mtime(&me->org);
     }
 
     return me ? &me->conf : NULL;
@@ -91,23 +76,26 @@ cloudprefs_orgid2slot(const struct conf *base, uint32_t orgid)
 {
     const struct cloudprefs *me = CONSTCONF2CLOUDPREFS(base);
 
-    return prefs_org_slot(me->org, orgid, me->count);
+    return prefs_org_slot(&me->org, orgid);
 }
 
 static const struct conf_segment *
 cloudprefs_slot2segment(const struct conf *base, unsigned slot)
 {
     const struct cloudprefs *me = CONSTCONF2CLOUDPREFS(base);
+    const struct prefs_org *po = conf_segment_table_get(&me->org, slot);
 
-    return slot < me->count ? &me->org[slot]->cs : NULL;
+    return po ? &po->cs : NULL;
 }
 
 static void
 cloudprefs_slotfailedload(struct conf *base, unsigned slot, bool value)
 {
     struct cloudprefs *me = CONF2CLOUDPREFS(base);
-    if (slot < me->count) {
-        me->org[slot]->cs.failed_load = value;
+    struct prefs_org *po;
+
+    if ((po = conf_segment_table_get(&me->org, slot)) != NULL) {
+        po->cs.failed_load = value;
     }
 }
 
@@ -115,19 +103,18 @@ bool
 cloudprefs_slotisempty(const struct conf *base, unsigned slot)
 {
     const struct cloudprefs *me = CONSTCONF2CLOUDPREFS(base);
+    const struct prefs_org *po = conf_segment_table_get(&me->org, slot);
 
-    return slot >= me->count || me->org[slot]->fp.total == 0;
+    return po == NULL || po->fp.total == 0;
 }
 
-static void
+static bool
 cloudprefs_freeslot(struct conf *base, unsigned slot)
 {
     struct cloudprefs *me = CONF2CLOUDPREFS(base);
 
-    SXEA1(slot < me->count, "Cannot free cloudprefs org slot %u (count %u)", slot, me->count);
-    prefs_org_refcount_dec(me->org[slot]);
-    memmove(me->org + slot, me->org + slot + 1, (me->count - slot - 1) * sizeof(*me->org));
-    me->count--;
+    SXEA1(slot < me->org.count, "Cannot free cloudprefs org slot %u (count %u)", slot, me->org.count);
+    return conf_segment_table_remove(&me->org, slot);
 }
 
 static bool
@@ -135,31 +122,22 @@ cloudprefs_useorg(struct conf *base, void *vcpo, unsigned slot, uint64_t *alloc)
 {
     struct cloudprefs *me = CONF2CLOUDPREFS(base);
     struct prefs_org *cpo = vcpo;
-    struct prefs_org **cpop;
-
-    SXEA6(slot <= me->count, "Oops, Insertion point is at pos %u of %u", slot, me->count);
-
-    if (!(me->count % 10)) {
-        if ((cpop = MOCKFAIL(CLOUDPREFS_MOREORGS, NULL, kit_realloc(me->org, (me->count + 10) * sizeof(*me->org)))) == NULL) {
-            SXEL2("Couldn't reallocate %u cloudprefs org slots", me->count + 10);
-            return false;
-        }
-        me->org = cpop;
-    }
 
+    SXEA6(slot <= me->org.count, "Oops, Insertion point is at pos %u of %u", slot, me->org.count);
     if (!(cpo->fp.loadflags & LOADFLAGS_FP_FAILED)) {
         cloudprefs_settimeatleast(base, cpo->cs.mtime);
     }
-    return prefs_org_fill_slot(cpo, me->org, &me->count, slot, alloc);
+    return prefs_org_fill_slot(cpo, &me->org, slot, alloc);
 }
 
 static void
 cloudprefs_loaded(struct conf *base)
 {
     struct cloudprefs *me = CONF2CLOUDPREFS(base);
+    const struct prefs_org *po;
 
-    if (me && me->count)
-        conf_report_load(me->org[0]->fp.ops->type, me->org[0]->fp.version);
+    if (me && (po = conf_segment_table_get(&me->org, 0)) != NULL)
+        conf_report_load(po->fp.ops->type, po->fp.version);
 }
 
 static const struct conf_segment_ops cloudprefs_segment_ops = {
@@ -209,12 +187,12 @@ cloudprefs_conf_get(const struct confset *set, module_conf_t m)
 const struct prefblock *
 cloudprefs_get_prefblock(const struct cloudprefs *me, uint32_t orgid)
 {
-    unsigned i;
+    const struct prefs_org *po;
 
-    if (me == NULL || (i = prefs_org_slot(me->org, orgid, me->count)) == me->count || me->org[i]->cs.id != orgid)
+    if (me == NULL || (po = conf_segment_table_find(&me->org, orgid)) == NULL)
         return NULL;
 
-    return me->org[i]->fp.values;
+    return po->fp.values;
 }
 
 /*
@@ -226,9 +204,9 @@ cloudprefs_get(pref_t *pref, const struct cloudprefs *me, const char *name, uint
 {
     uint32_t global_parent_org = pref_get_globalorg();
     const struct prefblock *pblk, *gblk;
+    const struct prefs_org *po;
     const struct preforg *org;
     const char *what;
-    unsigned i;
 
     SXEE7("(me=%p, name=%s, org_id=%u, origin_id=%u, other_origins=%p, x=%p)", me, name, org_id, origin_id, *other_origins, x);
     pref_fini(pref);
@@ -236,12 +214,12 @@ cloudprefs_get(pref_t *pref, const struct cloudprefs *me, const char *name, uint
     if (me == NULL)
         goto MATCH_DONE;
 
-    if ((i = prefs_org_slot(me->org, org_id, me->count)) == me->count || me->org[i]->cs.id != org_id) {
+    if ((po = conf_segment_table_find(&me->org, org_id)) == NULL) {
         XRAY6(x, "%s match: no such org", name);
         goto MATCH_DONE;
     }
 
-    if ((what = cloudprefs_org_get(pref, me->org[i], name, origin_id, other_origins, x)) != NULL) {
+    if ((what = cloudprefs_org_get(pref, po, name, origin_id, other_origins, x)) != NULL) {
         pblk = gblk = NULL;
         if ((org = PREF_ORG(pref)) != NULL && org->parentid && !PREF_PARENTORG(pref))
             pblk = cloudprefs_get_prefblock(me, org->parentid);     /* We couldn't find the parent org in the prefblock, find it in its own block */
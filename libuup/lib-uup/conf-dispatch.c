@@ -1,12 +1,19 @@
 #include <kit.h>
 #include <kit-alloc.h>
 #include <kit-queue.h>
+#include <sys/stat.h>
 
 #include "conf-dispatch.h"
 #include "conf.h"
+#include "conf-info.h"
+#include "pref-segments.h"
+#include "uup-counters.h"
 
 struct loadjob {
     struct conf_dispatch cd;
+    enum conf_dispatch_priority priority;    /* Which todo queue we go on */
+    off_t size;                              /* File size, used to start the largest whole file loads first */
+    uint64_t todo_ns;                        /* When this job was put on a todo queue */
     TAILQ_ENTRY(loadjob) q;    /* Our loadjobq TAILQ membership (queue.*) */
 };
 
@@ -23,16 +30,24 @@ struct blockable_queue {
     pthread_cond_t block;
 };
 
+struct priority_queue {
+    struct loadjobq queue[CONF_DISPATCH_PRIORITIES];
+    pthread_mutex_t lock;
+    pthread_cond_t block;
+};
+
 static struct {
     struct lockable_queue dead;     /* Jobs that aren't loadable any more (free-list) */
     struct lockable_queue wait;     /* Jobs that have just been loaded and aren't ready to be loaded again yet */
-    struct blockable_queue todo;    /* Jobs that need to be done */
+    struct priority_queue todo;     /* Jobs that need to be done, one queue per priority */
     struct lockable_queue live;     /* Jobs that are in progress */
     struct blockable_queue done;    /* Jobs that are complete */
 } dispatch = {
     .dead = { TAILQ_HEAD_INITIALIZER(dispatch.dead.queue), PTHREAD_MUTEX_INITIALIZER },
     .wait = { TAILQ_HEAD_INITIALIZER(dispatch.wait.queue), PTHREAD_MUTEX_INITIALIZER },
-    .todo = { TAILQ_HEAD_INITIALIZER(dispatch.todo.queue), PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER },
+    .todo = { { TAILQ_HEAD_INITIALIZER(dispatch.todo.queue[CONF_DISPATCH_PRIORITY_SEGMENT]),
+                TAILQ_HEAD_INITIALIZER(dispatch.todo.queue[CONF_DISPATCH_PRIORITY_FILE]) },
+              PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER },
     .live = { TAILQ_HEAD_INITIALIZER(dispatch.live.queue), PTHREAD_MUTEX_INITIALIZER },
     .done = { TAILQ_HEAD_INITIALIZER(dispatch.done.queue), PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER }
 };
@@ -43,8 +58,104 @@ static struct {
  *   - todo -> live -> done
  *                  -> dead (done and dead are currently never mutually held)
  *   - wait (wait currently never held with others)
+ *
+ * Todo jobs are handed out by priority.  Segment loads (and the segment
+ * managers that queue them) are small and frequent, so they overtake whole
+ * file loads, which may take minutes.  Whole file loads are ordered largest
+ * first so that the longest load isn't the last one started.
  */
 
+enum conf_dispatch_priority
+conf_dispatch_priority(const struct conf_dispatch *cd)
+{
+    if (CONF_DISPATCH_ISLOAD(*cd) && (cd->segment || cd->info->manager))
+        return CONF_DISPATCH_PRIORITY_SEGMENT;
+
+    return CONF_DISPATCH_PRIORITY_FILE;
+}
+
+/* Work out where a job goes on the todo queues; called without any dispatch locks held */
+static void
+loadjob_prioritize(struct loadjob *job)
+{
+    struct stat st;
+
+    job->priority = conf_dispatch_priority(&job->cd);
+    job->size = 0;
+
+    if (job->priority == CONF_DISPATCH_PRIORITY_FILE && CONF_DISPATCH_ISLOAD(job->cd))
+        job->size = stat(job->cd.info->path, &st) == 0 ? st.st_size : job->cd.info->st.size;
+
+    kit_time_cached_update();
+    job->todo_ns = kit_time_cached_nsec();
+}
+
+/* Insert a job into its todo queue; dispatch.todo.lock must be held */
+static void
+loadjob_todo_insert(struct loadjob *job)
+{
+    struct loadjobq *tq = &dispatch.todo.queue[job->priority];
+    struct loadjob *smaller;
+
+    if (job->size)
+        TAILQ_FOREACH(smaller, tq, q)
+            if (smaller->size < job->size) {
+                TAILQ_INSERT_BEFORE(smaller, job, q);
+                return;
+            }
+
+    TAILQ_INSERT_TAIL(tq, job, q);
+}
+
+/*
+ * A requeued segment manager that already has all the segments it is allowed
+ * pending has nothing to do until one of them completes.
+ */
+static bool
+loadjob_is_idle_manager(const struct loadjob *job)
+{
+    const struct pref_segments *manager;
+
+    if (job->cd.segment || !CONF_DISPATCH_ISLOAD(job->cd) || (manager = job->cd.info->manager) == NULL)
+        return false;
+
+    return manager->state == SEGMENT_STATE_REQUEUED && manager->pending >= manager->parallel;
+}
+
+/*
+ * Get the next todo job; dispatch.todo.lock must be held.  Idle segment
+ * managers are passed over in favour of real work, but are returned if there
+ * is nothing else to do.
+ */
+static struct loadjob *
+loadjob_todo_next(void)
+{
+    struct loadjob *job, *idle = NULL;
+    unsigned p;
+
+    for (p = 0; p < CONF_DISPATCH_PRIORITIES; p++)
+        TAILQ_FOREACH(job, &dispatch.todo.queue[p], q) {
+            if (!loadjob_is_idle_manager(job))
+                return job;
+            if (idle == NULL)
+                idle = job;
+        }
+
+    return idle;
+}
+
+static bool
+loadjob_todo_pending(void)
+{
+    unsigned p;
+
+    for (p = 0; p < CONF_DISPATCH_PRIORITIES; p++)
+        if (TAILQ_FIRST(&dispatch.todo.queue[p]))
+            return true;
+
+    return false;
+}
+
 void
 conf_dispatch_put(struct conf_dispatch *cd, enum conf_dispatch_queue queue)
 {
@@ -61,7 +172,7 @@ conf_dispatch_put(struct conf_dispatch *cd, enum conf_dispatch_queue queue)
         block = NULL;
         break;
     case CONF_DISPATCH_TODO:
-        wq = &dispatch.todo.queue;
+        wq = NULL;
         lock = &dispatch.todo.lock;
         block = &dispatch.todo.block;
         break;
@@ -86,8 +197,13 @@ conf_dispatch_put(struct conf_dispatch *cd, enum conf_dispatch_queue queue)
         job->cd = *cd;
     else
         SXEA6(CONF_DISPATCH_ISEXIT(job->cd), "Failed to create an EXIT job");
+    if (queue == CONF_DISPATCH_TODO)
+        loadjob_prioritize(job);
     pthread_mutex_lock(lock);
-    TAILQ_INSERT_TAIL(wq, job, q);
+    if (wq)
+        TAILQ_INSERT_TAIL(wq, job, q);
+    else
+        loadjob_todo_insert(job);
     if (block)
         pthread_cond_broadcast(block);
     pthread_mutex_unlock(lock);
@@ -102,7 +218,7 @@ conf_dispatch_getresult(struct conf_dispatch *cd, bool (*block_check_under_spinl
 
     while ((job = TAILQ_FIRST(&dispatch.done.queue)) == NULL
         && block_check_under_spinlock && block_check_under_spinlock()
-        && (TAILQ_FIRST(&dispatch.todo.queue) || TAILQ_FIRST(&dispatch.live.queue)))
+        && (loadjob_todo_pending() || TAILQ_FIRST(&dispatch.live.queue)))
         pthread_cond_wait(&dispatch.done.block, &dispatch.done.lock);
 
     if (job)
@@ -160,10 +276,11 @@ conf_dispatch_handle_t
 conf_dispatch_getwork(struct conf_dispatch *cd, bool block)
 {
     struct loadjob *job;
+    uint64_t wait_ms;
 
     pthread_mutex_lock(&dispatch.todo.lock);
 
-    while ((job = TAILQ_FIRST(&dispatch.todo.queue)) == NULL && block)
+    while ((job = loadjob_todo_next()) == NULL && block)
         pthread_cond_wait(&dispatch.todo.block, &dispatch.todo.lock);
 
     if (job) {
@@ -174,7 +291,7 @@ conf_dispatch_getwork(struct conf_dispatch *cd, bool block)
         pthread_mutex_lock(&dispatch.live.lock);
         pthread_mutex_lock(&dispatch.done.lock);
 
-        TAILQ_REMOVE(&dispatch.todo.queue, job, q);
+        TAILQ_REMOVE(&dispatch.todo.queue[job->priority], job, q);
         TAILQ_INSERT_TAIL(&dispatch.live.queue, job, q);
 
         pthread_mutex_unlock(&dispatch.done.lock);
@@ -184,6 +301,19 @@ conf_dispatch_getwork(struct conf_dispatch *cd, bool block)
 
     pthread_mutex_unlock(&dispatch.todo.lock);
 
+    if (job && CONF_DISPATCH_ISLOAD(*cd)) {
+        kit_time_cached_update();
+        wait_ms = (kit_time_cached_nsec() - job->todo_ns) / 1000000ULL;
+
+        if (job->priority == CONF_DISPATCH_PRIORITY_SEGMENT) {
+            kit_counter_incr(COUNTER_UUP_CONF_DISPATCH_SEGMENT_JOBS);
+            kit_counter_add(COUNTER_UUP_CONF_DISPATCH_SEGMENT_WAIT_MS, wait_ms);
+        } else {
+            kit_counter_incr(COUNTER_UUP_CONF_DISPATCH_FILE_JOBS);
+            kit_counter_add(COUNTER_UUP_CONF_DISPATCH_FILE_WAIT_MS, wait_ms);
+        }
+    }
+
     return job;
 }
 
@@ -211,6 +341,8 @@ void
 conf_dispatch_donework(struct conf_dispatch *cd, conf_dispatch_handle_t job)
 {
     job->cd = *cd;
+    kit_time_cached_update();
+    job->cd.done_ms = kit_time_cached_nsec() / 1000000U;
 
     pthread_mutex_lock(&dispatch.live.lock);
     pthread_mutex_lock(&dispatch.done.lock);
@@ -221,17 +353,57 @@ conf_dispatch_donework(struct conf_dispatch *cd, conf_dispatch_handle_t job)
     pthread_mutex_unlock(&dispatch.live.lock);
 }
 
+/* Take the first result on the done queue that matches, without blocking */
+bool
+conf_dispatch_getmatch(struct conf_dispatch *cd, bool (*match)(const struct conf_dispatch *cd))
+{
+    struct loadjob *job;
+
+    pthread_mutex_lock(&dispatch.done.lock);
+    TAILQ_FOREACH(job, &dispatch.done.queue, q)
+        if (match(&job->cd)) {
+            TAILQ_REMOVE(&dispatch.done.queue, job, q);
+            break;
+        }
+    pthread_mutex_unlock(&dispatch.done.lock);
+
+    if (job) {
+        *cd = job->cd;
+        pthread_mutex_lock(&dispatch.dead.lock);
+        TAILQ_INSERT_TAIL(&dispatch.dead.queue, job, q);
+        pthread_mutex_unlock(&dispatch.dead.lock);
+    }
+
+    return !!job;
+}
+
+/* Count the results on the done queue that match, or all of them if match is NULL */
+unsigned
+conf_dispatch_done_count(bool (*match)(const struct conf_dispatch *cd))
+{
+    struct loadjob *job;
+    unsigned count = 0;
+
+    pthread_mutex_lock(&dispatch.done.lock);
+    TAILQ_FOREACH(job, &dispatch.done.queue, q)
+        count += !match || match(&job->cd);
+    pthread_mutex_unlock(&dispatch.done.lock);
+
+    return count;
+}
+
 /* Return an active job from the live queue to the todo queue */
 void
 conf_dispatch_requeue(struct conf_dispatch *cd, conf_dispatch_handle_t job)
 {
     job->cd = *cd;
+    loadjob_prioritize(job);
 
     pthread_mutex_lock(&dispatch.todo.lock);
     pthread_mutex_lock(&dispatch.live.lock);
 
     TAILQ_REMOVE(&dispatch.live.queue, job, q);
-    TAILQ_INSERT_TAIL(&dispatch.todo.queue, job, q);
+    loadjob_todo_insert(job);
     pthread_cond_broadcast(&dispatch.todo.block);
 
     pthread_mutex_unlock(&dispatch.live.lock);
@@ -247,7 +419,8 @@ conf_dispatch_purge(void (*cb)(struct conf_dispatch *cd))
         void (*cb)(struct conf_dispatch *);
     } purge[] = {
         { &dispatch.wait.queue, &dispatch.wait.lock, cb },
-        { &dispatch.todo.queue, &dispatch.todo.lock, cb },
+        { &dispatch.todo.queue[CONF_DISPATCH_PRIORITY_SEGMENT], &dispatch.todo.lock, cb },
+        { &dispatch.todo.queue[CONF_DISPATCH_PRIORITY_FILE], &dispatch.todo.lock, cb },
         { &dispatch.dead.queue, &dispatch.dead.lock, NULL },
     };
     struct loadjobq cbq;
@@ -10,6 +10,14 @@ enum conf_dispatch_queue {
     CONF_DISPATCH_DONE,     /* Jobs that are complete */
 };
 
+/* Todo jobs are handed out by priority; lower values go first */
+enum conf_dispatch_priority {
+    CONF_DISPATCH_PRIORITY_SEGMENT, /* Segment loads and their managers; small and high churn */
+    CONF_DISPATCH_PRIORITY_FILE,    /* Whole file loads (largest first), then FREE and EXIT jobs */
+};
+
+#define CONF_DISPATCH_PRIORITIES (CONF_DISPATCH_PRIORITY_FILE + 1)
+
 struct preffile;
 
 struct conf_dispatch {
@@ -22,6 +30,7 @@ struct conf_dispatch {
     const struct preffile *segment; /* Segment data for individual segment loading */
 
     uint64_t wait_ms;        /* When this job started waiting */
+    uint64_t done_ms;        /* When this job's result was put on the done queue */
 };
 
 #define CONF_DISPATCH_ISFREE(cd) ((cd).info == NULL && (cd).data != NULL)
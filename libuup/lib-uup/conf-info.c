@@ -86,6 +86,7 @@ conf_info_free(struct conf_info *info)
         if (info->manager)
             pref_segments_free(info->manager);
         kit_free(info->userdata);
+        kit_free(info->digests.text);
         kit_free(info);
     }
 }
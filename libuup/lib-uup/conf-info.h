@@ -13,6 +13,15 @@ struct conf_stat {
     off_t size;
     time_t mtime;                             /* file modification time */
     time_t ctime;                             /* inode change time (creation date) */
+    uint64_t hash;                            /* fast (non-cryptographic) hash of the raw file contents, or 0 */
+};
+
+struct conf_digest_cache {                    /* The digest store's formatted listing of an object */
+    const struct conf *base;                  /* The object that was listed */
+    uint32_t updates;                         /* conf_info::updates when it was listed */
+    bool failed_load;                         /* conf_info::failed_load when it was listed */
+    size_t len;
+    char *text;
 };
 
 struct conf_info {                            /* Persistent info about a registered file */
@@ -27,6 +36,7 @@ struct conf_info {                            /* Persistent info about a registe
     char *path;                               /* Registered path, relative to the /etc/opendnscache/root directory */
     struct pref_segments *manager;            /* Segment manager */
     const struct conf_segment_ops *seg;       /* Segment dispatch functions */
+    struct conf_digest_cache digests;         /* Written by digest-store.c (main config thread), freed with the info */
 
     /* refcount, registered and loadable are owned and locked by conf.c (current.lock) */
     unsigned refcount;                        /* number of confset objects using us */
@@ -1,8 +1,11 @@
 #include <errno.h>
 #include <kit-alloc.h>
 #include <kit.h>
+#include <limits.h>
 #include <mockfail.h>
+#include <murmurhash3.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include "conf-loader.h"
@@ -24,6 +27,9 @@ conf_loader_init(struct conf_loader *cl)
 {
     memset(&cl->st, '\0', sizeof(cl->st));
     cl->state.gz = NULL;
+    cl->state.map = NULL;
+    cl->state.rbuf = NULL;
+    cl->state.rbufpos = cl->state.rbuflen = 0;
     *cl->state.fn = '\0';
     cl->state.err = 0;
     cl->flags = CONF_LOADER_DEFAULT;
@@ -34,10 +40,16 @@ conf_loader_init(struct conf_loader *cl)
     *cl->backup = *cl->tempfn = '\0';
 }
 
+static bool
+conf_loader_isopen(const struct conf_loader *cl)
+{
+    return cl->state.gz || cl->state.map;
+}
+
 bool
 conf_loader_eof(const struct conf_loader *cl)
 {
-    return !cl->state.gz && (!cl->buf || !*cl->buf);
+    return !conf_loader_isopen(cl) && (!cl->buf || !*cl->buf);
 }
 
 int
@@ -47,13 +59,30 @@ conf_loader_err(const struct conf_loader *cl)
 }
 
 static void
-conf_loader_reset(struct conf_loader *cl)
+conf_loader_close_input(struct conf_loader *cl)
 {
     if (cl->state.gz) {
         gzclose(cl->state.gz);
         cl->state.gz = NULL;
     }
 
+    if (cl->state.map) {
+        munmap((void *)(uintptr_t)cl->state.map, cl->state.mapsz);
+        cl->state.map = NULL;
+    }
+
+    kit_free(cl->state.rbuf);
+    cl->state.rbuf = NULL;
+    cl->state.rbufpos = cl->state.rbuflen = 0;
+}
+
+/* Close the input without consuming the rest of the file, discarding any partially written backup
+ */
+void
+conf_loader_reset(struct conf_loader *cl)
+{
+    conf_loader_close_input(cl);
+
     if (cl->backupgz || cl->backupfp) {
         if (cl->backupgz)
             gzclose(cl->backupgz);
@@ -67,17 +96,49 @@ conf_loader_reset(struct conf_loader *cl)
     }
     memset(&cl->st, '\0', sizeof(cl->st));
     *cl->state.fn = '\0';
-    cl->state.rbuflen = 0;
     cl->state.err = 0;
     cl->flags = CONF_LOADER_DEFAULT;
 }
 
+/* Check for the gzip magic number without disturbing the file offset */
+static bool
+conf_loader_fd_iscompressed(int fd)
+{
+    unsigned char magic[2];
+
+    return pread(fd, magic, sizeof(magic), 0) == sizeof(magic) && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+/* Hash the raw file contents so that a reload of identical content can be detected without parsing it.  Returns 0 if the
+ * contents can't be hashed.
+ */
+static uint64_t
+conf_loader_fd_hash(int fd, off_t size, const char *map)
+{
+    uint64_t hash[2];
+    void *tmap = NULL;
+
+    if (size <= 0 || size > INT_MAX)
+        return 0;
+
+    if (map == NULL && (map = tmap = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+        return 0;    /* COVERAGE EXCLUSION: todo: Figure out how to make mmap fail */
+
+    MurmurHash3_xnn_128(map, size, 0, hash);
+
+    if (tmap)
+        munmap(tmap, size);
+
+    return hash[0] ?: 1;
+}
+
 bool
 conf_loader_open(struct conf_loader *cl, const char *fn, const char *backupdir, const char *backupsuffix, int clev, uint8_t flags)
 {
-    gzFile      gz;
     struct stat st;
     const char *base;
+    uint64_t    hash;
+    void       *map;
     int         cperrno, fd, flen;
     char        err[256], how[3];
 
@@ -102,28 +163,58 @@ conf_loader_open(struct conf_loader *cl, const char *fn, const char *backupdir,
         }
     }
 
-    if ((gz = gzdopen(fd, "r")) == NULL) {
-        cperrno = errno;
-        SXEL3("%s: gzdopen: %s", conf_loader_path(cl), SSTRERROR(errno, err, sizeof(err)));
-        close(fd);
-        memset(&cl->st, '\0', sizeof(cl->st));
-        errno = cl->state.err = cperrno;
-        return false;    /* COVERAGE EXCLUSION: todo: Figure out how to make gzdopen fail */
+    SXEA1(fstat(fd, &st) == 0, "fstat of descriptor for %s failed", conf_loader_path(cl));
+
+    /* Large uncompressed files are mapped and read in place; everything else goes through zlib */
+    if (st.st_size >= CONF_LOADER_MAP_MINSZ && !conf_loader_fd_iscompressed(fd)) {
+        if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            cl->state.map = map;
+            cl->state.mapsz = st.st_size;
+            cl->state.mappos = 0;
+            close(fd);
+        } else
+            SXEL6("%s(): %s: mmap: %s - falling back to gzread()", __FUNCTION__, conf_loader_path(cl), SSTRERROR(errno, err, sizeof(err)));    /* COVERAGE EXCLUSION: todo: Figure out how to make mmap fail */
+    }
+
+    hash = conf_loader_fd_hash(fd, st.st_size, cl->state.map);
+
+    if (!cl->state.map) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        if ((cl->state.gz = gzdopen(fd, "r")) == NULL) {
+            cperrno = errno;
+            SXEL3("%s: gzdopen: %s", conf_loader_path(cl), SSTRERROR(errno, err, sizeof(err)));
+            close(fd);
+            memset(&cl->st, '\0', sizeof(cl->st));
+            errno = cl->state.err = cperrno;
+            return false;    /* COVERAGE EXCLUSION: todo: Figure out how to make gzdopen fail */
+        }
+
+#ifdef GZBUFFERSZ
+        gzbuffer(cl->state.gz, GZBUFFERSZ);
+#endif
     }
 
-    SXEA1(fstat(fd, &st) == 0, "fstat of descriptor for %s failed", conf_loader_path(cl));
     cl->st.dev = st.st_dev;
     cl->st.ino = st.st_ino;
     cl->st.size = st.st_size;
     cl->st.mtime = st.st_mtime;
     cl->st.ctime = st.st_ctime;
+    cl->st.hash = hash;
 
-#ifdef GZBUFFERSZ
-    gzbuffer(gz, GZBUFFERSZ);
-#endif
     MD5_Init(&cl->md5);
     cl->base_alloc = kit_thread_allocated_bytes();
 
+    /* Allocated after base_alloc is taken so that the raw buffer doesn't count towards the conf's allocations */
+    if (cl->state.gz && (cl->state.rbuf = MOCKFAIL(CONF_LOADER_RBUF, NULL, kit_malloc(CONF_LOADER_RBUFSZ))) == NULL) {
+        SXEL2("Couldn't allocate %d bytes for the raw buffer", CONF_LOADER_RBUFSZ);
+        conf_loader_close_input(cl);
+        memset(&cl->st, '\0', sizeof(cl->st));
+        errno = cl->state.err = ENOMEM;
+        return false;
+    }
+
     if (backupdir || backupsuffix) {
         base = kit_basename(fn);
         snprintf(cl->tempfn, sizeof(cl->tempfn), "%s%s.%s%s",
@@ -155,89 +246,126 @@ conf_loader_open(struct conf_loader *cl, const char *fn, const char *backupdir,
         if (cperrno) {
             SXEL2("conf-loader: Cannot create/truncate %s: %s", cl->tempfn, SSTRERROR(cperrno, err, sizeof(err)));    /* COVERAGE EXCLUSION: Was covered by opendnscache tests */
             close(fd);                                /* COVERAGE EXCLUSION: Was covered by opendnscache tests */
-            gzclose(gz);                              /* COVERAGE EXCLUSION: Was covered by opendnscache tests */
+            conf_loader_close_input(cl);              /* COVERAGE EXCLUSION: Was covered by opendnscache tests */
             memset(&cl->st, '\0', sizeof(cl->st));    /* COVERAGE EXCLUSION: Was covered by opendnscache tests */
             errno = cl->state.err = cperrno;          /* COVERAGE EXCLUSION: Was covered by opendnscache tests */
             return false;                             /* COVERAGE EXCLUSION: Was covered by opendnscache tests */
         }
     }
 
-    cl->state.gz = gz;
     cl->state.line = 0;
-    cl->state.rbuflen = 0;
 
     return true;
 }
 
-static ssize_t
-conf_loader_raw_nextline(struct conf_loader *cl, size_t start)
+/* Return the unconsumed raw data, reading more if necessary.  At EOF (or on error) the input is closed and 0 is returned.
+ */
+static size_t
+conf_loader_fill(struct conf_loader *cl, const char **data)
 {
-    size_t  pos, rpos;
     ssize_t result;
-    char   *nbuf;
     int     errnum;
 
-    pos = start;
+    if (cl->state.map) {
+        if (cl->state.mappos < cl->state.mapsz) {
+            *data = cl->state.map + cl->state.mappos;
+            return cl->state.mapsz - cl->state.mappos;
+        }
 
-    do {
-        if (!cl->state.rbuflen && cl->state.gz) {
-            /* Try to get some more raw data */
-            result = MOCKFAIL(CONF_LOADER_GZREAD, -1, gzread(cl->state.gz, cl->state.rbuf + cl->state.rbuflen, sizeof(cl->state.rbuf) - cl->state.rbuflen));
-
-            if (result > 0)
-                cl->state.rbuflen += result;
-            else {
-                if (result == -1)
-                    SXEL2("%s: %u: %s", conf_loader_path(cl), conf_loader_line(cl),
-                          MOCKFAIL(CONF_LOADER_GZREAD, "Some gzerror() string", gzerror(cl->state.gz, &errnum)));
-                gzclose(cl->state.gz);
-                cl->state.gz = NULL;
-            }
+        conf_loader_close_input(cl);
+        return 0;
+    }
+
+    if (!cl->state.gz)
+        return 0;
+
+    if (cl->state.rbufpos == cl->state.rbuflen) {
+        /* Try to get some more raw data */
+        cl->state.rbufpos = cl->state.rbuflen = 0;
+        result = MOCKFAIL(CONF_LOADER_GZREAD, -1, gzread(cl->state.gz, cl->state.rbuf, CONF_LOADER_RBUFSZ));
+
+        if (result <= 0) {
+            if (result == -1)
+                SXEL2("%s: %u: %s", conf_loader_path(cl), conf_loader_line(cl),
+                      MOCKFAIL(CONF_LOADER_GZREAD, "Some gzerror() string", gzerror(cl->state.gz, &errnum)));
+            conf_loader_close_input(cl);
+            return 0;
         }
 
-        if (cl->state.rbuflen) {
-            /* Consume the raw data (populating the conf-loader) until we see a linefeed */
-            rpos = 0;
-            while (rpos < cl->state.rbuflen) {
-                if (pos + 1 >= cl->bufsz) {
-                    if ((nbuf = MOCKFAIL(CONF_LOADER_RAW_GETLINE, NULL, kit_realloc(cl->buf, cl->bufsz + GZLINEGROWTHSZ))) == NULL) {
-                        SXEL2("Couldn't realloc line buffer to %zu bytes", cl->bufsz);
-                        if (cl->state.gz) {
-                            gzclose(cl->state.gz);
-                            cl->state.gz = NULL;
-                        }
-                        break;
-                    }
-                    cl->bufsz += GZLINEGROWTHSZ;
-                    cl->buf = nbuf;
-                }
+        cl->state.rbuflen = result;
+    }
 
-                cl->buf[pos] = cl->state.rbuf[rpos++];
+    *data = cl->state.rbuf + cl->state.rbufpos;
+    return cl->state.rbuflen - cl->state.rbufpos;
+}
 
-                if (cl->buf[pos++] == '\n')
-                    break;
-                else if (!(cl->flags & CONF_LOADER_ALLOW_NUL) && cl->buf[pos - 1] == '\0') {
-                    SXEL3("%s: %u: Embedded NUL detected", conf_loader_path(cl), conf_loader_line(cl));
-                    return 0;
-                }
+static void
+conf_loader_consume(struct conf_loader *cl, size_t len)
+{
+    if (cl->state.map)
+        cl->state.mappos += len;
+    else
+        cl->state.rbufpos += len;
+}
+
+/* Return the number of bytes of the (uncompressed) file that have been consumed
+ */
+static size_t
+conf_loader_offset(struct conf_loader *cl)
+{
+    if (cl->state.map)
+        return cl->state.mappos;
+
+    return cl->state.gz ? gzseek(cl->state.gz, 0, SEEK_CUR) - (cl->state.rbuflen - cl->state.rbufpos) : 0;
+}
+
+static ssize_t
+conf_loader_raw_nextline(struct conf_loader *cl, size_t start)
+{
+    const char *data, *nl;
+    size_t      avail, len, nsz, pos;
+    char       *nbuf;
+
+    pos = start;
+
+    while ((avail = conf_loader_fill(cl, &data)) > 0) {
+        /* Consume the raw data (populating the conf-loader) up to and including the next linefeed */
+        nl  = memchr(data, '\n', avail);
+        len = nl ? (size_t)(nl - data) + 1 : avail;
+
+        if (!(cl->flags & CONF_LOADER_ALLOW_NUL) && memchr(data, '\0', len)) {
+            SXEL3("%s: %u: Embedded NUL detected", conf_loader_path(cl), conf_loader_line(cl));
+            return 0;
+        }
+
+        if (pos + len >= cl->bufsz) {
+            nsz = cl->bufsz + (pos + len - cl->bufsz) / GZLINEGROWTHSZ * GZLINEGROWTHSZ + GZLINEGROWTHSZ;
+
+            if ((nbuf = MOCKFAIL(CONF_LOADER_RAW_GETLINE, NULL, kit_realloc(cl->buf, nsz))) == NULL) {
+                SXEL2("Couldn't realloc line buffer to %zu bytes", nsz);
+                conf_loader_close_input(cl);
+                return -1;
             }
 
-            if (rpos == cl->state.rbuflen || (pos > start && cl->buf[pos - 1] == '\n')) {
-                result = pos - start;
-                memmove(cl->state.rbuf, cl->state.rbuf + rpos, cl->state.rbuflen -= rpos);
-            } else
-                result = -1;
-        } else
-            result = pos - start;
+            cl->bufsz = nsz;
+            cl->buf = nbuf;
+        }
+
+        memcpy(cl->buf + pos, data, len);
+        conf_loader_consume(cl, len);
+        pos += len;
+
+        if (nl)
+            break;
+    }
 
-        if (cl->buf)
-            cl->buf[pos] = '\0';
-    } while (cl->state.gz && result > 0 && cl->buf[result + start - 1] != '\n');
+    if (cl->buf)
+        cl->buf[pos] = '\0';
 
-    if (result > 0)
+    if (pos > start)
         cl->state.line++;
 
-    return result;
+    return pos - start;
 }
 
 static const char *
@@ -339,9 +467,9 @@ conf_loader_readfile(struct conf_loader *cl, size_t *len, unsigned maxlines)
     unsigned    gzadd, nlines;
 
     *len = 0;
-    csz = cl->st.size + 1 - gzseek(cl->state.gz, 0, SEEK_CUR) + cl->state.rbuflen;
-    SXEL6("%s: %u: Setting csz to %zu + 1 - %zu + %zu = %zu", conf_loader_path(cl), conf_loader_line(cl),
-          (size_t)cl->st.size, (size_t)cl->st.size + 1 - csz + cl->state.rbuflen, cl->state.rbuflen, csz);
+    csz = cl->st.size + 1 - conf_loader_offset(cl);
+    SXEL6("%s: %u: Setting csz to %zu + 1 - %zu = %zu", conf_loader_path(cl), conf_loader_line(cl),
+          (size_t)cl->st.size, (size_t)cl->st.size + 1 - csz, csz);
     if ((content = MOCKFAIL(CONF_LOADER_READFILE, NULL, kit_malloc(csz))) == NULL)
         SXEL2("Couldn't allocate %zu bytes for file data", csz);
     else {
@@ -412,7 +540,7 @@ conf_loader_done(struct conf_loader *cl, struct conf_info *info)
 {
     char err[256];
 
-    if (!cl->state.gz && !cl->state.err) {
+    if (!conf_loader_isopen(cl) && !cl->state.err) {
         if (info) {
             MD5_Final(info->digest, &cl->md5);
             info->alloc = kit_thread_allocated_bytes() - cl->base_alloc;
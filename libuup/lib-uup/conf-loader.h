@@ -11,10 +11,17 @@
 #include "conf.h"
 #include "pref-segments.h"
 
+#define CONF_LOADER_MAP_MINSZ (64 * 1024)    // Uncompressed files at least this big are mmap()ed rather than gzread()
+#define CONF_LOADER_RBUFSZ    (64 * 1024)    // Size of the raw buffer used for gzread()
+
 struct conf_loader_state {
-    gzFile gz;                              /* File reader */
-    char rbuf[8192];                        /* Raw buffer */
+    gzFile gz;                              /* File reader (compressed or small files) */
+    const char *map;                        /* Mapped file contents (large uncompressed files) */
+    size_t mapsz;                           /* Size of the mapping */
+    size_t mappos;                          /* Offset of the next unconsumed byte in the mapping */
+    char *rbuf;                             /* Raw buffer, allocated while gz is open */
     char fn[PATH_MAX];                      /* Path name of opened file */
+    size_t rbufpos;                         /* Offset of the next unconsumed byte in the raw buffer */
     size_t rbuflen;                         /* Raw buffer used */
     unsigned line;                          /* Last read line number */
     int err;                                /* CONF_LOADER_STATE_* flags */
@@ -42,7 +49,7 @@ struct conf_loader_state {
  */
 struct conf_loader {
     struct conf_stat st;                    /* The config file being loaded */
-    struct conf_loader_state state;         /* Currently open file details (if state.gz != NULL) */
+    struct conf_loader_state state;         /* Currently open file details (if state.gz or state.map != NULL) */
     uint8_t flags;                          /* CONF_LOADER_* flags used during loading */
     MD5_CTX md5;
     uint64_t base_alloc;                    /* Per-thread bytes allocated at open() time */
@@ -62,6 +69,7 @@ struct conf_loader {
 #   define CONF_LOADER_RAW_GETLINE ((const char *)conf_loader_readfile + 2)
 #   define CONF_LOADER_TOOMUCHDATA ((const char *)conf_loader_readfile + 3)
 #   define CONF_LOADER_REALLOC     ((const char *)conf_loader_readfile + 4)
+#   define CONF_LOADER_RBUF        ((const char *)conf_loader_readfile + 5)
 #endif
 
 #endif
@@ -1,10 +1,11 @@
 #include <inttypes.h>    /* Required by ubuntu */
+#include <kit-alloc.h>
+#include <mockfail.h>
 
+#include "atomic.h"
 #include "conf-loader.h"
 #include "conf-segment.h"
 
-#define CS(v, i) ((struct conf_segment *)((uint8_t *)(v)[i] + csoffset))
-
 void
 conf_segment_init(struct conf_segment *me, uint32_t id, struct conf_loader *cl, bool failed)
 {
@@ -22,35 +23,440 @@ conf_segment_init(struct conf_segment *me, uint32_t id, struct conf_loader *cl,
         me->alloc = info.alloc;
         me->mtime = info.st.mtime;
         me->ctime = info.st.ctime;
+        me->hash = info.st.hash;
         memcpy(me->digest, info.digest, sizeof(me->digest));
     }
 }
 
+/*
+ * Return the slot of id in ids, or the where-it-should-be position if it's not present.  This is a branchless lower bound
+ * search; the last few probes land in the same cache line.
+ */
 unsigned
-conf_segment_slot(void *const *const me, uint32_t id, unsigned count, unsigned csoffset)
+conf_segment_ids_slot(const uint32_t *ids, uint32_t id, unsigned count)
 {
-    unsigned i, lim, pos;
-    long long cmp;
+    const uint32_t *base = ids;
+    unsigned half, n, pos;
 
-    /* This is similar to bsearch(), but returns the where-it-should-be position if not found */
+    if (count == 0)
+        pos = 0;
+    else {
+        for (n = count; n > 1; n -= half) {
+            half = n / 2;
+            base = base[half] < id ? base + half : base;
+        }
 
-    for (pos = 0, lim = count; lim; lim >>= 1) {
-        i = pos + (lim >> 1);
-        if ((cmp = (long long)id - (long long)CS(me, i)->id) == 0) {
-            pos = i;
-            break;
-        } else if (cmp > 0) {
-            pos = i + 1;
-            lim--;
+        pos = base - ids + (*base < id);
+    }
+
+    SXEL7("%s(ids=?, id=%" PRIu32 ", count=%u) {} // return %u, val %lld", __FUNCTION__, id, count, pos,
+          pos < count ? (long long)ids[pos] : -1LL);
+
+    return pos;
+}
+
+#define CONF_SEGMENT_TABLE_REFS_INCREMENT 16
+#define CHUNK_CS(t, chunk, i) ((struct conf_segment *)((uint8_t *)(chunk)->segs[i] + (t)->csoffset))
+
+void
+conf_segment_table_init(struct conf_segment_table *me, unsigned csoffset, void (*refcount_inc)(void *), void (*refcount_dec)(void *))
+{
+    memset(me, '\0', sizeof(*me));
+    me->csoffset = csoffset;
+    me->refcount_inc = refcount_inc;
+    me->refcount_dec = refcount_dec;
+}
+
+static void
+conf_segment_chunk_release(struct conf_segment_table *me, struct conf_segment_chunk *chunk)
+{
+    unsigned i;
+
+    if (ATOMIC_DEC_INT_NV(&chunk->refcount) == 0) {
+        for (i = 0; i < chunk->count; i++)
+            me->refcount_dec(chunk->segs[i]);
+        kit_free(chunk);
+    }
+}
+
+static void
+conf_segment_chunk_settime(struct conf_segment_table *me, struct conf_segment_chunk *chunk)
+{
+    unsigned i;
+
+    for (chunk->mtime = 0, i = 0; i < chunk->count; i++)
+        if (chunk->mtime < CHUNK_CS(me, chunk, i)->mtime)
+            chunk->mtime = CHUNK_CS(me, chunk, i)->mtime;
+}
+
+/*
+ * Clone a table, sharing all of its chunks.  This is O(chunks) rather than O(segments).
+ */
+bool
+conf_segment_table_clone(struct conf_segment_table *me, const struct conf_segment_table *ome)
+{
+    unsigned c;
+
+    conf_segment_table_init(me, ome->csoffset, ome->refcount_inc, ome->refcount_dec);
+
+    if (ome->chunks) {
+        me->alloc = (ome->chunks + CONF_SEGMENT_TABLE_REFS_INCREMENT - 1) / CONF_SEGMENT_TABLE_REFS_INCREMENT * CONF_SEGMENT_TABLE_REFS_INCREMENT;
+        if ((me->ref = MOCKFAIL(CONF_SEGMENT_TABLE_CLONE, NULL, kit_malloc(me->alloc * sizeof(*me->ref)))) == NULL) {
+            SXEL2("Couldn't allocate %u segment table chunk references", me->alloc);
+            me->alloc = 0;
+            return false;
         }
+
+        memcpy(me->ref, ome->ref, ome->chunks * sizeof(*me->ref));
+        for (c = 0; c < ome->chunks; c++)
+            ATOMIC_INC_INT(&me->ref[c].chunk->refcount);
+        me->chunks = ome->chunks;
+        me->count = ome->count;
     }
 
-    SXEA6(pos == count || id <= CS(me, pos)->id, "Unexpected pos %u looking for %" PRIu32 ", landed on %" PRIu32, pos, id, CS(me, pos)->id);
+    return true;
+}
+
+void
+conf_segment_table_fini(struct conf_segment_table *me)
+{
+    unsigned c;
+
+    for (c = 0; c < me->chunks; c++)
+        conf_segment_chunk_release(me, me->ref[c].chunk);
+    kit_free(me->ref);
+    me->ref = NULL;
+    me->count = me->chunks = me->alloc = 0;
+}
 
-    SXEL7("%s(me=?, id=%" PRIu32 ", count=%u) {} // return %u, val %lld, prev %lld, next %lld", __FUNCTION__, id, count, pos,
-        pos < count ? (long long)CS(me, pos)->id : -1LL,
-        pos ? (long long)CS(me, pos - 1)->id : -1LL,
-        pos + 1 < count ? (long long)CS(me, pos + 1)->id : -1LL);
+/* Return the latest segment mtime in the table */
+time_t
+conf_segment_table_mtime(const struct conf_segment_table *me)
+{
+    time_t mtime = 0;
+    unsigned c;
+
+    for (c = 0; c < me->chunks; c++)
+        if (mtime < me->ref[c].chunk->mtime)
+            mtime = me->ref[c].chunk->mtime;
+
+    return mtime;
+}
+
+/* Return the index of the first chunk whose last id is at least id, or me->chunks if there's none */
+static unsigned
+conf_segment_table_chunk_byid(const struct conf_segment_table *me, uint32_t id)
+{
+    unsigned c, lim, pos;
+
+    for (pos = 0, lim = me->chunks; lim; lim >>= 1) {
+        c = pos + (lim >> 1);
+        if (me->ref[c].last < id) {
+            pos = c + 1;
+            lim--;
+        }
+    }
 
     return pos;
 }
+
+/* Return the index of the chunk holding slot, or the last chunk if slot is past the end of the table */
+static unsigned
+conf_segment_table_chunk_byslot(const struct conf_segment_table *me, unsigned slot)
+{
+    unsigned c, lim, pos;
+
+    SXEA6(me->chunks, "Cannot find a chunk in an empty table");
+
+    for (pos = 0, lim = me->chunks; lim; lim >>= 1) {
+        c = pos + (lim >> 1);
+        if (me->ref[c].start <= slot) {
+            pos = c + 1;
+            lim--;
+        }
+    }
+
+    return pos - 1;
+}
+
+/*
+ * Return the slot of id in the table, or the where-it-should-be position if it's not present
+ */
+unsigned
+conf_segment_table_slot(const struct conf_segment_table *me, uint32_t id)
+{
+    const struct conf_segment_chunk *chunk;
+    unsigned c;
+
+    if ((c = conf_segment_table_chunk_byid(me, id)) == me->chunks)
+        return me->count;
+
+    chunk = me->ref[c].chunk;
+    return me->ref[c].start + conf_segment_ids_slot(chunk->ids, id, chunk->count);
+}
+
+void *
+conf_segment_table_get(const struct conf_segment_table *me, unsigned slot)
+{
+    unsigned c;
+
+    if (slot >= me->count)
+        return NULL;
+
+    c = conf_segment_table_chunk_byslot(me, slot);
+    return me->ref[c].chunk->segs[slot - me->ref[c].start];
+}
+
+/*
+ * Return the segment with the given id, or NULL if it's not present
+ */
+void *
+conf_segment_table_find(const struct conf_segment_table *me, uint32_t id)
+{
+    const struct conf_segment_chunk *chunk;
+    unsigned c, pos;
+
+    if ((c = conf_segment_table_chunk_byid(me, id)) == me->chunks)
+        return NULL;
+
+    chunk = me->ref[c].chunk;
+    pos = conf_segment_ids_slot(chunk->ids, id, chunk->count);
+    return chunk->ids[pos] == id ? chunk->segs[pos] : NULL;
+}
+
+static struct conf_segment_chunk *
+conf_segment_chunk_new(void)
+{
+    struct conf_segment_chunk *chunk;
+
+    if ((chunk = MOCKFAIL(CONF_SEGMENT_TABLE_CHUNK, NULL, kit_malloc(sizeof(*chunk)))) == NULL)
+        SXEL2("Couldn't allocate a segment table chunk");
+    else {
+        chunk->refcount = 1;
+        chunk->count = 0;
+        chunk->mtime = 0;
+    }
+
+    return chunk;
+}
+
+/* Make sure there's room for one more chunk reference */
+static bool
+conf_segment_table_reserve(struct conf_segment_table *me)
+{
+    struct conf_segment_chunkref *ref;
+
+    if (me->chunks == me->alloc) {
+        if ((ref = MOCKFAIL(CONF_SEGMENT_TABLE_REFS, NULL, kit_realloc(me->ref, (me->alloc + CONF_SEGMENT_TABLE_REFS_INCREMENT) * sizeof(*ref)))) == NULL) {
+            SXEL2("Couldn't reallocate %u segment table chunk references", me->alloc + CONF_SEGMENT_TABLE_REFS_INCREMENT);
+            return false;
+        }
+
+        me->ref = ref;
+        me->alloc += CONF_SEGMENT_TABLE_REFS_INCREMENT;
+    }
+
+    return true;
+}
+
+/* Make chunk c private to this table, copying it if it's shared with a clone */
+static bool
+conf_segment_table_own(struct conf_segment_table *me, unsigned c)
+{
+    struct conf_segment_chunk *chunk, *ochunk = me->ref[c].chunk;
+    unsigned i;
+
+    if (ochunk->refcount == 1)
+        return true;
+
+    if ((chunk = conf_segment_chunk_new()) == NULL)
+        return false;
+
+    chunk->count = ochunk->count;
+    chunk->mtime = ochunk->mtime;
+    memcpy(chunk->ids, ochunk->ids, ochunk->count * sizeof(*chunk->ids));
+    memcpy(chunk->segs, ochunk->segs, ochunk->count * sizeof(*chunk->segs));
+    for (i = 0; i < chunk->count; i++)
+        me->refcount_inc(chunk->segs[i]);
+
+    me->ref[c].chunk = chunk;
+    conf_segment_chunk_release(me, ochunk);
+    return true;
+}
+
+/* Insert an empty chunk reference at index c */
+static bool
+conf_segment_table_newchunk(struct conf_segment_table *me, unsigned c, unsigned start)
+{
+    struct conf_segment_chunk *chunk;
+
+    if (!conf_segment_table_reserve(me) || (chunk = conf_segment_chunk_new()) == NULL)
+        return false;
+
+    memmove(me->ref + c + 1, me->ref + c, (me->chunks - c) * sizeof(*me->ref));
+    me->ref[c].chunk = chunk;
+    me->ref[c].last = 0;
+    me->ref[c].start = start;
+    me->chunks++;
+    return true;
+}
+
+/*
+ * Insert a segment at the given slot, taking over the caller's reference to it.  The slot must be the one returned by
+ * conf_segment_table_slot() for the segment's id, and the id must not already be present.
+ */
+bool
+conf_segment_table_insert(struct conf_segment_table *me, unsigned slot, void *seg)
+{
+    const struct conf_segment *cs = (const struct conf_segment *)((uint8_t *)seg + me->csoffset);
+    struct conf_segment_chunk *chunk;
+    unsigned c, half, pos;
+
+    SXEA6(slot <= me->count, "Cannot insert segment %" PRIu32 " at slot %u of %u", cs->id, slot, me->count);
+
+    if (me->chunks == 0 && !conf_segment_table_newchunk(me, 0, 0))
+        return false;
+
+    c = conf_segment_table_chunk_byslot(me, slot);
+    if (!conf_segment_table_own(me, c))
+        return false;
+    pos = slot - me->ref[c].start;
+
+    if (me->ref[c].chunk->count == CONF_SEGMENT_CHUNK_MAX) {
+        if (pos == CONF_SEGMENT_CHUNK_MAX) {
+            /* Appending to a full chunk starts a new one, so tables loaded in id order end up with full chunks */
+            if (!conf_segment_table_newchunk(me, ++c, slot))
+                return false;
+            pos = 0;
+        } else {
+            /* Split the chunk in half */
+            if (!conf_segment_table_newchunk(me, c + 1, me->ref[c].start + CONF_SEGMENT_CHUNK_MAX / 2))
+                return false;
+
+            half = CONF_SEGMENT_CHUNK_MAX / 2;
+            chunk = me->ref[c + 1].chunk;
+            memcpy(chunk->ids, me->ref[c].chunk->ids + half, half * sizeof(*chunk->ids));
+            memcpy(chunk->segs, me->ref[c].chunk->segs + half, half * sizeof(*chunk->segs));
+            chunk->count = half;
+            me->ref[c].chunk->count = half;
+            me->ref[c + 1].last = me->ref[c].last;
+            me->ref[c].last = me->ref[c].chunk->ids[half - 1];
+            conf_segment_chunk_settime(me, me->ref[c].chunk);
+            conf_segment_chunk_settime(me, chunk);
+
+            if (pos > half) {
+                c++;
+                pos -= half;
+            }
+        }
+    }
+
+    chunk = me->ref[c].chunk;
+    memmove(chunk->ids + pos + 1, chunk->ids + pos, (chunk->count - pos) * sizeof(*chunk->ids));
+    memmove(chunk->segs + pos + 1, chunk->segs + pos, (chunk->count - pos) * sizeof(*chunk->segs));
+    chunk->ids[pos] = cs->id;
+    chunk->segs[pos] = seg;
+    chunk->count++;
+    if (chunk->mtime < cs->mtime)
+        chunk->mtime = cs->mtime;
+    me->ref[c].last = chunk->ids[chunk->count - 1];
+
+    for (c++; c < me->chunks; c++)
+        me->ref[c].start++;
+    me->count++;
+
+    return true;
+}
+
+/*
+ * Replace the segment at the given slot with one that has the same id, taking over the caller's reference to the new
+ * segment and releasing the table's reference to the old one.
+ */
+bool
+conf_segment_table_replace(struct conf_segment_table *me, unsigned slot, void *seg)
+{
+    struct conf_segment_chunk *chunk;
+    unsigned c, pos;
+    void *oseg;
+
+    SXEA6(slot < me->count, "Cannot replace slot %u of %u", slot, me->count);
+
+    c = conf_segment_table_chunk_byslot(me, slot);
+    if (!conf_segment_table_own(me, c))
+        return false;
+
+    chunk = me->ref[c].chunk;
+    pos = slot - me->ref[c].start;
+    SXEA6(chunk->ids[pos] == ((const struct conf_segment *)((uint8_t *)seg + me->csoffset))->id,
+          "Cannot replace segment %" PRIu32 " with a different id", chunk->ids[pos]);
+    oseg = chunk->segs[pos];
+    chunk->segs[pos] = seg;
+    me->refcount_dec(oseg);
+    conf_segment_chunk_settime(me, chunk);
+
+    return true;
+}
+
+/*
+ * Remove the segment at the given slot, releasing the table's reference to it
+ *
+ * @return false if the slot's chunk is shared with a clone and couldn't be copied
+ */
+bool
+conf_segment_table_remove(struct conf_segment_table *me, unsigned slot)
+{
+    struct conf_segment_chunk *chunk;
+    unsigned c, pos;
+    void *oseg;
+
+    SXEA1(slot < me->count, "Cannot remove slot %u of %u", slot, me->count);
+
+    c = conf_segment_table_chunk_byslot(me, slot);
+    if (!conf_segment_table_own(me, c))
+        return false;
+
+    chunk = me->ref[c].chunk;
+    pos = slot - me->ref[c].start;
+    oseg = chunk->segs[pos];
+    memmove(chunk->ids + pos, chunk->ids + pos + 1, (chunk->count - pos - 1) * sizeof(*chunk->ids));
+    memmove(chunk->segs + pos, chunk->segs + pos + 1, (chunk->count - pos - 1) * sizeof(*chunk->segs));
+    chunk->count--;
+    me->refcount_dec(oseg);
+
+    if (chunk->count == 0) {
+        conf_segment_chunk_release(me, chunk);
+        memmove(me->ref + c, me->ref + c + 1, (me->chunks - c - 1) * sizeof(*me->ref));
+        me->chunks--;
+    } else {
+        me->ref[c].last = chunk->ids[chunk->count - 1];
+        conf_segment_chunk_settime(me, chunk);
+        c++;
+    }
+
+    for (; c < me->chunks; c++)
+        me->ref[c].start--;
+    me->count--;
+
+    return true;
+}
+
+/*
+ * Insert a segment at the given slot, or replace the segment already there if it has the same id
+ */
+bool
+conf_segment_table_use(struct conf_segment_table *me, unsigned slot, void *seg)
+{
+    const struct conf_segment *cs = (const struct conf_segment *)((uint8_t *)seg + me->csoffset);
+    const struct conf_segment *ocs;
+    void *oseg;
+
+    if ((oseg = conf_segment_table_get(me, slot)) != NULL) {
+        ocs = (const struct conf_segment *)((uint8_t *)oseg + me->csoffset);
+        SXEA6(ocs->id >= cs->id, "Landed on unexpected id %" PRIu32 " when looking for %" PRIu32, ocs->id, cs->id);
+
+        if (ocs->id == cs->id)
+            return conf_segment_table_replace(me, slot, seg);
+    }
+
+    return conf_segment_table_insert(me, slot, seg);
+}
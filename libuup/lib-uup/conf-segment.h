@@ -9,6 +9,7 @@ struct conf_segment {
     uint64_t alloc;
     time_t mtime;
     time_t ctime;
+    uint64_t hash;     /* Fast hash of the raw file contents; see conf_stat */
     bool loaded;       /* Indicates whether the segment is loaded, could be from a last-good file */
     bool failed_load;  /* Indicates that the most recent load attempt failed */
     uint8_t digest[MD5_DIGEST_LENGTH];
@@ -16,6 +17,60 @@ struct conf_segment {
 
 struct conf_loader;
 
+#define CONF_SEGMENT_CHUNK_MAX 64    /* Maximum segments in a conf_segment_table chunk */
+
+/*-
+ * A conf_segment_table is the sorted set of segments held by a segmented conf (dirprefs, cloudprefs, lists, etc).
+ *
+ * Segments are kept in id order in fixed size chunks.  Chunks are reference counted and shared between a conf and its
+ * clones, so cloning a table only copies the chunk references rather than every segment pointer.  A chunk is copied
+ * before it's modified if any other table refers to it (copy on write), so updating a handful of segments in a clone
+ * of a large conf only copies the chunks that hold them.
+ *
+ *            table.ref[0]          table.ref[1]                       table.ref[N]
+ *     .----------------------.----------------------.    ......    .----------------------.
+ *     | chunk, last, start   | chunk, last, start   |              | chunk, last, start   |
+ *     `----------------------+----------------------'              `----------------------'
+ *                 |                      |                                   |
+ *                 v                      v                                   v
+ *     .----------------------.----------------------.              .----------------------.
+ *     | refcount, count      | refcount, count      |   <- shared  | refcount, count      |
+ *     | ids[], segs[]        | ids[], segs[]        |      with    | ids[], segs[]        |
+ *     `----------------------'----------------------'     clones   `----------------------'
+ *
+ * Each chunk holds a reference to each of its segments.  Slots are global across the table, so slot 'n' is the n'th
+ * segment in id order, as it was when the segments were held in a flat array.
+ */
+struct conf_segment_chunk {
+    int refcount;                           /* # tables referring to this chunk */
+    unsigned count;                         /* # segments in the chunk */
+    time_t mtime;                           /* The latest segment mtime */
+    uint32_t ids[CONF_SEGMENT_CHUNK_MAX];   /* segs[n]->id for each segs[n] */
+    void *segs[CONF_SEGMENT_CHUNK_MAX];     /* Segment pointers in id order */
+};
+
+struct conf_segment_chunkref {
+    struct conf_segment_chunk *chunk;
+    uint32_t last;                          /* The id of the chunk's last segment */
+    unsigned start;                         /* The table slot of the chunk's first segment */
+};
+
+struct conf_segment_table {
+    unsigned count;                         /* # segments in the table */
+    unsigned chunks;                        /* # chunks in use */
+    unsigned alloc;                         /* # chunk references allocated */
+    unsigned csoffset;                      /* Offset of the struct conf_segment within each segment */
+    void (*refcount_inc)(void *);           /* Take a reference to a segment */
+    void (*refcount_dec)(void *);           /* Release a reference to a segment */
+    struct conf_segment_chunkref *ref;      /* A block of 'alloc' chunk references, 'chunks' of them in use */
+};
+
+#if defined(SXE_DEBUG) || defined(SXE_COVERAGE)    // Define unique tags for mockfails
+#   define CONF_SEGMENT_TABLE_CLONE ((const char *)conf_segment_table_clone + 0)
+#   define CONF_SEGMENT_TABLE_REFS  ((const char *)conf_segment_table_clone + 1)
+#   define CONF_SEGMENT_TABLE_CHUNK ((const char *)conf_segment_table_clone + 2)
+#endif
+
 #include "conf-segment-proto.h"
 
 #endif
@@ -19,6 +19,7 @@
 #include "prefs-org.h"
 #include "rr-type.h"
 #include "unaligned.h"
+#include "uup-counters.h"
 
 #define SEGMENT_RETRY_FREQUENCY       5     // How frequently to retry loading a segment that fails */
 #define CONF_DEFAULT_REJECT_DIRECTORY ""    // By default, no reject directory is configured
@@ -119,6 +120,16 @@ conf_reload(struct conf_info *info)
 
     base = NULL;
     if (conf_loader_open(&conf_file_loader, info->path, bdir, bsuffix, conf_lastgood_compression, CONF_LOADER_DEFAULT)) {
+        if (!info->failed_load && info->st.hash && info->st.hash == conf_file_loader.st.hash) {
+            /* The file was rewritten with the same content; remember its new stat data so it's not hashed again */
+            info->st = conf_file_loader.st;
+            conf_loader_reset(&conf_file_loader);
+            kit_counter_incr(COUNTER_UUP_CONF_UNCHANGED);
+            INFOLOG(CONF_VERBOSE, "%s is unchanged", info->name);
+            SXEL5("%s is unchanged", info->name);
+            return NULL;
+        }
+
         if ((base = info->type->allocate(info, &conf_file_loader)) != NULL) {
             conf_loader_done(&conf_file_loader, info);
             delivery = info->st.ctime - info->st.mtime;
@@ -182,20 +193,28 @@ conf_remove_segment(struct conf_info *info, const struct preffile *segment)
     const char *basefn;
     char goodfn[PATH_MAX];
     unsigned i = info->seg->id2slot(info->manager->me, segment->id);
+    uint64_t alloc = 0;
+    bool loaded = false;
 
     SXEE7("(info=%p,segment=%p) // path=%s flags=%x", info, segment, segment->path, segment->flags);
 
     SXEA6(segment->flags & PREFFILE_REMOVED, "Segment does not have REMOVED flag set");
 
-    if ((cs = info->seg->slot2segment(info->manager->me, i)) == NULL || cs->id != segment->id)
+    if ((cs = info->seg->slot2segment(info->manager->me, i)) != NULL && cs->id == segment->id) {
+        alloc = cs->alloc;      /* freeslot() may free the segment */
+        loaded = cs->loaded;
+    }
+
+    if (cs == NULL || cs->id != segment->id)
         SXEL6("%s was removed, but I didn't know about it", segment->path);
+    else if (!info->seg->freeslot(info->manager->me, i))
+        SXEL2("%s was removed, but couldn't be released", segment->path);
     else {
-        info->manager->alloc -= cs->alloc;
-        if (cs->loaded) {
+        info->manager->alloc -= alloc;
+        if (loaded) {
             /* Only update the modtime if the segment being removed had been loaded */
             info->seg->settimeatleast(info->manager->me, time(NULL));
         }
-        info->seg->freeslot(info->manager->me, i);
         if (conf_lastgood_directory) {
             basefn = kit_basename(segment->path);
             if (snprintf(goodfn, sizeof(goodfn), "%s/%s.last-good", conf_lastgood_directory, basefn) < (int)sizeof(goodfn))
@@ -395,7 +414,7 @@ conf_reload_segment(struct conf *inbase, struct conf_info *info, const struct pr
 {
     const char *basefn, *bdir, *bsuffix;
     unsigned loadtime;
-    bool failed = false, updated = false, loaded_last_good = false;
+    bool failed = false, updated = false, loaded_last_good = false, unchanged;
     unsigned delivery, latency;
     time_t orgstart;
     struct prefs_org *po, *po_tmp;
@@ -414,6 +433,22 @@ conf_reload_segment(struct conf *inbase, struct conf_info *info, const struct pr
 
     if (!conf_loader_open(&conf_file_loader, segment->path, bdir, bsuffix, conf_lastgood_compression, CONF_LOADER_DEFAULT))
         failed = true;
+    else {
+        pthread_mutex_lock(&info->manager->lock);
+        slot = info->seg->id2slot(info->manager->me, segment->id);
+        cs = info->seg->slot2segment(info->manager->me, slot);
+        unchanged = cs && cs->id == segment->id && cs->loaded && !cs->failed_load && cs->hash
+                 && cs->hash == conf_file_loader.st.hash;
+        pthread_mutex_unlock(&info->manager->lock);
+
+        if (unchanged) {
+            /* The file was rewritten with the same content, so there's nothing to parse */
+            conf_loader_reset(&conf_file_loader);
+            kit_counter_incr(COUNTER_UUP_CONF_UNCHANGED);
+            SXEL6("%s segment %u from file %s is unchanged", info->name, segment->id, segment->path);
+            goto SXE_UNCHANGED;
+        }
+    }
 
     if (((po = (struct prefs_org *)info->seg->newsegment(segment->id, &conf_file_loader, info)) == NULL)
      || (po->fp.loadflags & LOADFLAGS_FP_FAILED)) {
@@ -532,6 +567,7 @@ SXE_EARLY_OUT:
         ATOMIC_INC_INT(&info->manager->updates);
     }
 
+SXE_UNCHANGED:
     ATOMIC_INC_INT(&info->manager->done);
     ATOMIC_DEC_INT_NV(&info->manager->pending);
 
@@ -582,7 +618,7 @@ conf_worker_load(struct conf *obase, struct conf_info *info, const struct preffi
              * without us getting the opportunity to fail a reload... but this
              * code makes our tests easier!
              */
-            if (ret == NULL)
+            if (ret == NULL && info->failed_load)
                 info->st.dev = 0;
         }
     }
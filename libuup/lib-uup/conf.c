@@ -19,6 +19,7 @@
 #include "conf-segment.h"
 #include "conf.h"
 #include "infolog.h"
+#include "uup-counters.h"
 
 
 
@@ -84,6 +85,12 @@ static struct {
     struct confset *set;         /* The current set */
 } current;
 
+static struct {
+    unsigned interval_ms;        /* Minimum time between published generations, or 0 to publish every change */
+    char *priority;              /* Comma separated conf type names that are published as soon as they load */
+    uint64_t published_ms;       /* When the last generation was published */
+} publish;
+
 static struct conf_type loadabletype = {
     "loadabletype",
     NULL,
@@ -611,12 +618,90 @@ confset_load_one(module_conf_t module)    /* COVERAGE EXCLUSION: Was covered by
             current.set = nset;                       /* COVERAGE EXCLUSION: Was covered by opendnscache tests */
             current.generation++;                     /* COVERAGE EXCLUSION: Was covered by opendnscache tests */
             pthread_spin_unlock(&current.genlock);    /* COVERAGE EXCLUSION: Was covered by opendnscache tests */
+            kit_counter_incr(COUNTER_UUP_CONF_GENERATIONS);    /* COVERAGE EXCLUSION: Was covered by opendnscache tests */
         }
 
         confset_free(oset, CONFSET_FREE_IMMEDIATE);    /* COVERAGE EXCLUSION: Was covered by opendnscache tests */
     }
 }    /* COVERAGE EXCLUSION: Was covered by opendnscache tests */
 
+static bool
+conf_publish_is_priority(const struct conf_dispatch *cd)
+{
+    const char *name, *types;
+    size_t len;
+
+    if (CONF_DISPATCH_ISEXIT(*cd))
+        return true;    /* Exiting conf-workers are always harvested */
+
+    if (!CONF_DISPATCH_ISLOAD(*cd) || cd->data == NULL || publish.priority == NULL)
+        return false;
+
+    name = cd->data->type->name;
+    len = strlen(name);
+
+    for (types = publish.priority; (types = strstr(types, name)) != NULL; types += len)
+        if ((types == publish.priority || types[-1] == ',') && (types[len] == ',' || types[len] == '\0'))
+            return true;
+
+    return false;
+}
+
+static bool
+conf_publish_is_pending(const struct conf_dispatch *cd)
+{
+    return CONF_DISPATCH_ISLOAD(*cd) && cd->data != NULL;
+}
+
+/* A loadable conf that didn't change doesn't affect the published set, so can go straight back to the wait queue */
+static bool
+conf_publish_is_unchanged(const struct conf_dispatch *cd)
+{
+    return CONF_DISPATCH_ISLOAD(*cd) && cd->data == NULL && cd->info->loadable;
+}
+
+/*
+ * Decide whether confset_load() should harvest the done queue and publish a
+ * new generation now.  Otherwise, only unchanged results are harvested, and
+ * loaded results are left on the done queue to be coalesced into a later
+ * generation.
+ */
+static bool
+conf_publish_due(void)
+{
+    uint64_t now_ms;
+
+    if (!publish.interval_ms || current.generation <= 1)
+        return true;
+
+    kit_time_cached_update();
+    now_ms = kit_time_cached_nsec() / 1000000ULL;
+
+    if (now_ms - publish.published_ms >= publish.interval_ms || conf_dispatch_done_count(conf_publish_is_priority))
+        return true;
+
+    if (conf_dispatch_done_count(conf_publish_is_pending))
+        kit_counter_incr(COUNTER_UUP_CONF_PUBLISH_DEFERRED);
+
+    return false;
+}
+
+/**
+ * Set the confset publication policy
+ *
+ * @param interval_ms    Minimum time between new confset generations; loads that complete sooner are coalesced, 0 to disable
+ * @param priority_types Comma separated conf type names (e.g. "domainlist,lists") published as soon as they load, or NULL
+ */
+void
+conf_set_publish_options(unsigned interval_ms, const char *priority_types)
+{
+    kit_free(publish.priority);
+    publish.priority = NULL;
+    SXEA1(!priority_types || (publish.priority = kit_strdup(priority_types)), "Couldn't allocate publish priority types");
+    publish.interval_ms = interval_ms;
+    SXEL7("Set conf publish interval to %ums, priority types '%s'", interval_ms, priority_types ?: "");
+}
+
 /* Only called by the conf thread.  Workers need to confset_acquire()
  */
 bool
@@ -625,6 +710,8 @@ confset_load(uint64_t *delay_ms)
     struct confset      *nset, *oset;
     unsigned             items, todo;
     struct conf_dispatch cd;
+    uint64_t             now_ms, lag_ms;
+    bool                 harvest;
     size_t               sz;
 
     SXEE7("(delay_ms=%p) // *delay_ms=%lld", delay_ms, delay_ms ? (long long)*delay_ms : 0LL);
@@ -654,8 +741,14 @@ confset_load(uint64_t *delay_ms)
     /* Harvest all results, stuffing everything that was completed back into the WAIT queue */
     nset = NULL;
     todo = 0;
-    SXEL7("Harvest the conf-dispatch DONE queue blocking=%s", kit_bool_to_str(current.generation <= 1 || !conf_worker_get_target()));
-    while (conf_dispatch_getresult(&cd, current.generation <= 1 || !conf_worker_get_target() ? conf_worker_under_spinlock : NULL)) {
+    lag_ms = 0;
+    harvest = conf_publish_due();
+    kit_time_cached_update();
+    now_ms = kit_time_cached_nsec() / 1000000ULL;
+    SXEL7("Harvest the conf-dispatch DONE queue blocking=%s%s", kit_bool_to_str(current.generation <= 1 || !conf_worker_get_target()),
+          harvest ? "" : " // deferred by the publish interval");
+    while (harvest ? conf_dispatch_getresult(&cd, current.generation <= 1 || !conf_worker_get_target() ? conf_worker_under_spinlock : NULL)
+                   : conf_dispatch_getmatch(&cd, conf_publish_is_unchanged)) {
         SXEA6(!CONF_DISPATCH_ISFREE(cd), "Unexpected dispatch result - FREEs aren't returned!");
         if (CONF_DISPATCH_ISEXIT(cd)) {
             SXEL7("Harvest thread %lu", (unsigned long)cd.thr);
@@ -692,6 +785,7 @@ confset_load(uint64_t *delay_ms)
                     pthread_spin_unlock(&current.lock);
                 }
                 nset->conf[cd.idx] = cd.data;
+                lag_ms += now_ms > cd.done_ms ? now_ms - cd.done_ms : 0;
                 todo++;
             }
             conf_dispatch_put(&cd, CONF_DISPATCH_WAIT);
@@ -722,6 +816,11 @@ confset_load(uint64_t *delay_ms)
         } while (items < current.alloc);
 
         confset_free(oset, CONFSET_FREE_IMMEDIATE);
+
+        publish.published_ms = now_ms;
+        kit_counter_incr(COUNTER_UUP_CONF_GENERATIONS);
+        kit_counter_add(COUNTER_UUP_CONF_PUBLISHED, todo);
+        kit_counter_add(COUNTER_UUP_CONF_PUBLISH_LAG_MS, lag_ms);
     }
 
     conf_state = CONF_LOADED;
@@ -783,6 +882,8 @@ confset_unload(void)
     kit_free(oindex);
 
     conf_worker_finalize();
+    kit_free(publish.priority);
+    memset(&publish, '\0', sizeof(publish));
     current.generation = 0;
     conf_state         = CONF_NOTLOADED;
     SXER6("return");
@@ -866,7 +967,7 @@ confset_get_writable(struct confset *set, module_conf_t m)    /* COVERAGE EXCLUS
 }
 
 void
-confset_foreach(const struct confset *set, void (*fn)(const struct conf *, const struct conf_info *, void *), void *data)
+confset_foreach(const struct confset *set, void (*fn)(const struct conf *, struct conf_info *, void *), void *data)
 {
     struct conf loadableconf = { &loadabletype, 0 };
     unsigned i, *idx, items;
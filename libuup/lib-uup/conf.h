@@ -29,7 +29,7 @@ struct conf_segment_ops {
     const struct conf_segment *(*slot2segment)(const struct conf *base, unsigned slot);
     bool (*slotisempty)(const struct conf *base, unsigned slot);
     void (*slotfailedload)(struct conf *base, unsigned slot, bool value);
-    void (*freeslot)(struct conf *base, unsigned slot);
+    bool (*freeslot)(struct conf *base, unsigned slot);
     void *(*newsegment)(uint32_t id, struct conf_loader *cl, const struct conf_info *info);
     void (*freesegment)(void *seg);
     bool (*usesegment)(struct conf *base, void *seg, unsigned slot, uint64_t *alloc);
@@ -5,6 +5,7 @@
 #endif
 
 #include "devprefs-private.h"
+#include "parseline.h"
 #include "unaligned.h"
 #include "xray.h"
 
@@ -117,13 +118,13 @@ static int    /* returns # bytes consumed */
 devprefs_parsekey(struct fileprefs *fp, int item, const struct conf_loader *cl, const char *line)
 {
     struct devprefs *me = (struct devprefs *)fp;
-    int cmp, consumed;
+    const char *p;
     uint64_t hdevice;
-    char colon;
+    int cmp;
 
     SXEA6(fp->version == DEVPREFS_VERSION, "Trying to parse devprefs key for version %u", fp->version);
 
-    if (sscanf(line, "%" SCNx64 "%c%n", &hdevice, &colon, &consumed) != 2 || colon != ':') {
+    if ((p = parse_xuint(line, &hdevice)) == NULL || *p != ':') {
         SXEL2("%s(): devprefs v%u: %s: %u: Unrecognised line (invalid key format)",
               __FUNCTION__, me->fp.version, conf_loader_path(cl), conf_loader_line(cl));
         return 0;
@@ -136,7 +137,7 @@ devprefs_parsekey(struct fileprefs *fp, int item, const struct conf_loader *cl,
         return 0;
     }
 
-    return consumed;
+    return p + 1 - line;
 }
 
 static const char *
@@ -1,6 +1,8 @@
 #include <dirent.h>
 #include <errno.h>
+#include <kit-alloc.h>
 #include <kit.h>
+#include <mockfail.h>
 #include <stdio.h>
 
 #include "conf.h"
@@ -57,6 +59,10 @@ digest_store_purge(const char *dir, DIR *dsd, time_t now, time_t expire)
 struct digest_data {
     const char *path;
     FILE *fp;
+    char *text;
+    size_t len;
+    size_t size;
+    bool failed;
 };
 
 static void
@@ -68,13 +74,67 @@ digest_cb(void *v, const char *key, const char *value)
 }
 
 static void
-digest_object_cb(const struct conf *base, const struct conf_info *info, void *data)
+digest_text_cb(void *v, const char *key, const char *value)
 {
+    struct digest_data *dd = v;
+    size_t need, size;
+    char *text;
+
+    if (dd->failed)
+        return;
+
+    need = strlen(dd->path) + (key ? strlen(key) + 1 : 0) + strlen(value) + 3;
+    if (dd->len + need > dd->size) {
+        for (size = dd->size ?: 256; size < dd->len + need; size *= 2)
+            ;
+
+        if ((text = MOCKFAIL(DIGEST_STORE_TEXT, NULL, kit_realloc(dd->text, size))) == NULL) {
+            SXEL2("Couldn't allocate %zu bytes of digest text for %s", size, dd->path);
+            dd->failed = true;
+            return;
+        }
+
+        dd->text = text;
+        dd->size = size;
+    }
+
+    dd->len += snprintf(dd->text + dd->len, dd->size - dd->len, "%s %s%s%s\n", dd->path, key ?: "", key ? " " : "", value);
+}
+
+/*
+ * Write an object's digests, reformatting them only if the object has changed since they were last written.  Objects with
+ * many segments are expensive to list, and usually only a few objects change between writes.
+ */
+static void
+digest_object_cb(const struct conf *base, struct conf_info *info, void *data)
+{
+    struct conf_digest_cache *cache = &info->digests;
     struct digest_data dd;
 
+    memset(&dd, '\0', sizeof(dd));
     dd.path = info->name;
     dd.fp = data;
-    conf_query_digest(base, info, "", &dd, digest_cb);
+
+    if (cache->text == NULL || cache->base != base || cache->updates != info->updates || cache->failed_load != info->failed_load) {
+        conf_query_digest(base, info, "", &dd, digest_text_cb);
+        kit_free(cache->text);
+
+        if (dd.failed) {
+            kit_free(dd.text);
+            memset(cache, '\0', sizeof(*cache));
+            conf_query_digest(base, info, "", &dd, digest_cb);
+            return;
+        }
+
+        cache->base = base;
+        cache->updates = info->updates;
+        cache->failed_load = info->failed_load;
+        cache->len = dd.len;
+        cache->text = dd.text;
+    }
+
+    if (cache->len)
+        fwrite(cache->text, 1, cache->len, dd.fp);
 }
 
 static void
@@ -8,4 +8,8 @@ struct confset;
 
 #include "digest-store-proto.h"
 
+#if defined(SXE_DEBUG) || defined(SXE_COVERAGE)    // Define unique tags for mockfails
+#   define DIGEST_STORE_TEXT ((const char *)digest_store_changed + 0)
+#endif
+
 #endif
@@ -1,8 +1,12 @@
 #include <inttypes.h>    /* Required by ubuntu */
+#include <kit-alloc.h>
+#include <mockfail.h>
+#include <murmurhash3.h>
 
 #include "conf-loader.h"
 #include "dirprefs-org.h"
 #include "odns.h"
+#include "parseline.h"
 #include "unaligned.h"
 #include "xray.h"
 
@@ -19,28 +23,135 @@ struct dirprefs_org_key {
 #define DIRPREFS_ORG_KEYS(fp)     ((struct dirprefs_org_key *)(fp)->keys)
 #define DIRPREFS_ORG_KEY(fp, i)   ((struct dirprefs_org_key *)(fp)->keys + (i))
 
-/* Compare two keys */
-static int
-dirprefs_org_compare(const void *k, const void *member)
-{
-    size_t cmpsize = 0;
-    const struct dirprefs_org_key *key = (const struct dirprefs_org_key *)k;
+/*
+ * Orgs with at least DIRPREFS_ORG_INDEX_MIN identities get a hash index over their keys.  Each of the (up to five) lookups
+ * done by dirprefs_org_get() then costs a key type check and a bloom filter test, and a hit usually costs a single probe,
+ * rather than a bsearch() through every key.  Smaller orgs aren't worth the memory and keep using bsearch().
+ */
+#define DIRPREFS_ORG_INDEX_MIN  32
+#define DIRPREFS_ORG_HASH_SEED  0x64697270    /* "dirp" */
 
-    /* Determine how much of the key structure to compare based on its type */
+struct dirprefs_org_slot {
+    uint32_t hash;
+    uint32_t index;                           /* Identity index + 1, or 0 if the slot is empty */
+};
+
+struct dirprefs_org_index {
+    unsigned                  types;          /* Bit mask of the key types present in the org */
+    uint32_t                  mask;           /* Number of slots - 1; the slot count is a power of 2 */
+    uint32_t                  bloommask;      /* Number of bloom filter bits - 1 */
+    uint64_t                 *bloom;          /* Points just after the last slot */
+    struct dirprefs_org_slot  slot[];
+};
+
+struct dirprefs_org {
+    struct prefs_org           po;
+    struct dirprefs_org_index *index;         /* NULL if the org is too small to be indexed */
+};
+
+/* Determine how much of the key structure is significant based on its type */
+static size_t
+dirprefs_org_keysize(const struct dirprefs_org_key *key)
+{
     switch (key->type) {
     case DIRPREFS_TYPE_ORG:
-        cmpsize = sizeof(key->orgid) + sizeof(key->type);
-        break;
+        return sizeof(key->orgid) + sizeof(key->type);
     case DIRPREFS_TYPE_ASSET:
-        cmpsize = sizeof(key->orgid) + sizeof(key->type) + sizeof(key->id.asset);
-        break;
+        return sizeof(key->orgid) + sizeof(key->type) + sizeof(key->id.asset);
     case DIRPREFS_TYPE_GUID:
     case DIRPREFS_TYPE_ALT_UID:
-        cmpsize = sizeof(struct dirprefs_org_key);
-        break;
+        return sizeof(struct dirprefs_org_key);
+    }
+
+    return 0;
+}
+
+/* Compare two keys */
+static int
+dirprefs_org_compare(const void *k, const void *member)
+{
+    const struct dirprefs_org_key *key = (const struct dirprefs_org_key *)k;
+
+    return memcmp(key, member, dirprefs_org_keysize(key));
+}
+
+static uint32_t
+dirprefs_org_hash(const struct dirprefs_org_key *key)
+{
+    return murmur3_32(key, dirprefs_org_keysize(key), DIRPREFS_ORG_HASH_SEED);
+}
+
+/* The two bloom filter bits for a hash; the second is taken from the rotated hash so that it doesn't track the first */
+#define DIRPREFS_ORG_BLOOM_BIT1(idx, h) ((h) & (idx)->bloommask)
+#define DIRPREFS_ORG_BLOOM_BIT2(idx, h) (((h) >> 16 | (h) << 16) & (idx)->bloommask)
+#define DIRPREFS_ORG_BLOOM_TEST(idx, b) ((idx)->bloom[(b) / 64] & (UINT64_C(1) << (b) % 64))
+#define DIRPREFS_ORG_BLOOM_SET(idx, b)  ((idx)->bloom[(b) / 64] |= UINT64_C(1) << (b) % 64)
+
+static void
+dirprefs_org_index_build(struct dirprefs_org *me)
+{
+    const struct dirprefs_org_key *key;
+    struct dirprefs_org_index *index;
+    unsigned count, i, nslots;
+    uint32_t h, s;
+    size_t sz;
+
+    if ((count = PREFS_COUNT(&me->po, identities)) < DIRPREFS_ORG_INDEX_MIN)
+        return;
+
+    /* Keep the slots at most half full, and give the bloom filter 8 bits per key (~5% false positives with 2 bits set) */
+    for (nslots = 2 * DIRPREFS_ORG_INDEX_MIN; nslots < 2 * count; nslots <<= 1) {
+    }
+
+    sz = sizeof(*index) + nslots * sizeof(*index->slot) + nslots / 2;
+    if ((index = MOCKFAIL(DIRPREFS_ORG_INDEX, NULL, kit_calloc(1, sz))) == NULL) {
+        SXEL2("Couldn't allocate %zu bytes for a dirprefs org index of %u keys", sz, count);
+        return;
+    }
+
+    index->mask = nslots - 1;
+    index->bloommask = nslots * 4 - 1;
+    index->bloom = (uint64_t *)(index->slot + nslots);
+
+    for (i = 0; i < count; i++) {
+        key = DIRPREFS_ORG_KEY(&me->po.fp, i);
+        h = dirprefs_org_hash(key);
+        index->types |= 1U << key->type;
+        DIRPREFS_ORG_BLOOM_SET(index, DIRPREFS_ORG_BLOOM_BIT1(index, h));
+        DIRPREFS_ORG_BLOOM_SET(index, DIRPREFS_ORG_BLOOM_BIT2(index, h));
+
+        for (s = h & index->mask; index->slot[s].index; s = (s + 1) & index->mask) {
+        }
+
+        index->slot[s].hash = h;
+        index->slot[s].index = i + 1;
     }
 
-    return memcmp(key, member, cmpsize);
+    me->index = index;
+}
+
+static const struct dirprefs_org_key *
+dirprefs_org_find(const struct prefs_org *po, const struct dirprefs_org_key *find)
+{
+    const struct dirprefs_org_index *index = ((const struct dirprefs_org *)po)->index;
+    const struct dirprefs_org_key *key;
+    uint32_t h, s;
+
+    if (index == NULL)
+        return bsearch(find, po->fp.keys, PREFS_COUNT(po, identities), sizeof(*find), dirprefs_org_compare);
+
+    if (!(index->types & 1U << find->type))
+        return NULL;
+
+    h = dirprefs_org_hash(find);
+    if (!DIRPREFS_ORG_BLOOM_TEST(index, DIRPREFS_ORG_BLOOM_BIT1(index, h)) || !DIRPREFS_ORG_BLOOM_TEST(index, DIRPREFS_ORG_BLOOM_BIT2(index, h)))
+        return NULL;
+
+    for (s = h & index->mask; index->slot[s].index; s = (s + 1) & index->mask)
+        if (index->slot[s].hash == h && dirprefs_org_compare(find, key = DIRPREFS_ORG_KEY(&po->fp, index->slot[s].index - 1)) == 0)
+            return key;
+
+    return NULL;
 }
 
 #if SXE_DEBUG
@@ -79,40 +190,47 @@ static int    /* returns # bytes consumed */
 dirprefs_org_parsekey(struct fileprefs *fp, int item, const struct conf_loader *cl, const char *line)
 {
     struct dirprefs_org_key *k = DIRPREFS_ORG_KEY(fp, item);
-    int cmp, consumed;
-    uint32_t orgid, assetid;
-    char colon;
+    uint64_t orgid, assetid;
+    const char *p;
+    int cmp;
 
     SXEA6(fp->version == DIRPREFS_VERSION, "Trying to parse dirprefs-org key for version %u", fp->version);
 
-    if (sscanf(line, "%" PRIu32 ":0:%c%n", &orgid, &colon, &consumed) == 2 && colon == ':') {
-        k->type = DIRPREFS_TYPE_ORG;
+    /* Keys are orgid:type:id: where the format of id depends on the type */
+    if ((p = parse_uint(line, &orgid)) == NULL || orgid != (uint32_t)orgid || p[0] != ':' || p[1] < '0' || p[1] > '3' || p[2] != ':')
+        p = NULL;
+    else {
         unaligned_htonl(k->orgid, orgid);
-    } else if (sscanf(line, "%" PRIu32 ":1:%" PRIu32 "%c%n", &orgid, &assetid, &colon, &consumed) == 3 && colon == ':') {
-        k->type = DIRPREFS_TYPE_ASSET;
-        unaligned_htonl(k->orgid, orgid);
-        unaligned_htonl(k->id.asset, assetid);
-    } else if (sscanf(line,
-                      "%" PRIu32 ":2:%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%c%n",
-                      &orgid,
-                      &k->id.guid.bytes[0],  &k->id.guid.bytes[1],  &k->id.guid.bytes[2],  &k->id.guid.bytes[3],
-                      &k->id.guid.bytes[4],  &k->id.guid.bytes[5],  &k->id.guid.bytes[6],  &k->id.guid.bytes[7],
-                      &k->id.guid.bytes[8],  &k->id.guid.bytes[9],  &k->id.guid.bytes[10], &k->id.guid.bytes[11],
-                      &k->id.guid.bytes[12], &k->id.guid.bytes[13], &k->id.guid.bytes[14], &k->id.guid.bytes[15],
-                      &colon, &consumed) == 18 && colon == ':') {
-        k->type = DIRPREFS_TYPE_GUID;
-        unaligned_htonl(k->orgid, orgid);
-    } else if (sscanf(line,
-                      "%" PRIu32 ":3:H%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx%c%n",
-                      &orgid,
-                      &k->id.alt_uid.bytes[0],  &k->id.alt_uid.bytes[1],  &k->id.alt_uid.bytes[2],  &k->id.alt_uid.bytes[3],
-                      &k->id.alt_uid.bytes[4],  &k->id.alt_uid.bytes[5],  &k->id.alt_uid.bytes[6],  &k->id.alt_uid.bytes[7],
-                      &k->id.alt_uid.bytes[8],  &k->id.alt_uid.bytes[9],  &k->id.alt_uid.bytes[10], &k->id.alt_uid.bytes[11],
-                      &k->id.alt_uid.bytes[12], &k->id.alt_uid.bytes[13], &k->id.alt_uid.bytes[14], &k->id.alt_uid.bytes[15],
-                      &colon, &consumed) == 18 && colon == ':') {
-        k->type = DIRPREFS_TYPE_ALT_UID;
-        unaligned_htonl(k->orgid, orgid);
-    } else {
+        k->type = p[1] - '0';
+        p += 3;
+
+        switch (k->type) {
+        case DIRPREFS_TYPE_ORG:
+            p = *p == ':' ? p + 1 : NULL;
+            break;
+
+        case DIRPREFS_TYPE_ASSET:
+            if ((p = parse_uint(p, &assetid)) == NULL || assetid != (uint32_t)assetid || *p++ != ':')
+                p = NULL;
+            else
+                unaligned_htonl(k->id.asset, assetid);
+            break;
+
+        case DIRPREFS_TYPE_GUID:
+            p = kit_hex2bin(k->id.guid.bytes, p, KIT_GUID_STR_LEN) == KIT_GUID_SIZE && p[KIT_GUID_STR_LEN] == ':' ? p + KIT_GUID_STR_LEN + 1 : NULL;
+            break;
+
+        case DIRPREFS_TYPE_ALT_UID:
+            p = *p == 'H' && kit_hex2bin(k->id.alt_uid.bytes, p + 1, KIT_MD5_STR_LEN) == KIT_MD5_SIZE && p[KIT_MD5_STR_LEN + 1] == ':'
+              ? p + KIT_MD5_STR_LEN + 2 : NULL;
+            break;
+
+        default:
+            p = NULL;    /* COVERAGE EXCLUSION: Unreachable */
+        }
+    }
+
+    if (p == NULL) {
         SXEL2("%s(): dirprefs v%u: %s: %u: Unrecognised line (invalid key format)", __FUNCTION__, fp->version, conf_loader_path(cl), conf_loader_line(cl));
         return 0;
     }
@@ -125,7 +243,7 @@ dirprefs_org_parsekey(struct fileprefs *fp, int item, const struct conf_loader *
         return 0;
     }
 
-    return consumed;
+    return p - line;
 }
 
 static char
@@ -162,12 +280,19 @@ dirprefs_org_key_to_str(struct fileprefs *fp, unsigned i)
     return txt;
 }
 
+static void
+dirprefs_org_free(struct fileprefs *fp)
+{
+    kit_free(((struct dirprefs_org *)fp)->index);
+    fileprefs_free(fp);
+}
+
 static struct fileprefops dirprefs_org_ops = {
     .type               = "dirprefs",
     .keysz              = sizeof(struct dirprefs_org_key),
     .parsekey           = dirprefs_org_parsekey,
     .key_to_str         = dirprefs_org_key_to_str,
-    .free               = fileprefs_free,
+    .free               = dirprefs_org_free,
     .supported_versions = { DIRPREFS_VERSION, 0 }
 };
 
@@ -176,7 +301,10 @@ dirprefs_org_new(uint32_t orgid, struct conf_loader *cl, const struct conf_info
 {
     struct prefs_org *dpo;
 
-    if ((dpo = (struct prefs_org *)fileprefs_new(cl, &dirprefs_org_ops, sizeof(struct prefs_org), info->loadflags))) {
+    if ((dpo = (struct prefs_org *)fileprefs_new(cl, &dirprefs_org_ops, sizeof(struct dirprefs_org), info->loadflags))) {
+        if (!(dpo->fp.loadflags & LOADFLAGS_FP_FAILED))
+            dirprefs_org_index_build((struct dirprefs_org *)dpo);    /* Before conf_segment_init() so that it's accounted for */
+
         conf_segment_init(&dpo->cs, orgid, cl, dpo->fp.loadflags & LOADFLAGS_FP_FAILED);
 
         if (!(dpo->fp.loadflags & LOADFLAGS_FP_FAILED) && !prefs_org_valid(dpo, conf_loader_path(cl)))
@@ -192,7 +320,8 @@ dirprefs_org_new(uint32_t orgid, struct conf_loader *cl, const struct conf_info
 const char *
 dirprefs_org_get(pref_t *pref, const struct prefs_org *me, const struct odns *odns, struct oolist **other_origins, enum dirprefs_type *type, struct xray *x)
 {
-    struct dirprefs_org_key find, *match;
+    const struct dirprefs_org_key *match;
+    struct dirprefs_org_key find;
     const struct prefidentity *ident;
     const struct prefbundle *bundle;
     const char *best_what, *what;
@@ -208,7 +337,7 @@ dirprefs_org_get(pref_t *pref, const struct prefs_org *me, const struct odns *od
         find.type = DIRPREFS_TYPE_ALT_UID;
         find.id.alt_uid = odns->alt_user_id;
 
-        if ((match = bsearch(&find, me->fp.keys, PREFS_COUNT(me, identities), sizeof(find), dirprefs_org_compare)) != NULL) {
+        if ((match = dirprefs_org_find(me, &find)) != NULL) {
             pref_init_byidentity(&p, me->fp.values, NULL, NULL, match - DIRPREFS_ORG_KEYS(&me->fp));
             ident = PREF_IDENT(&p);
             bundle = PREF_BUNDLE(&p);
@@ -227,7 +356,7 @@ dirprefs_org_get(pref_t *pref, const struct prefs_org *me, const struct odns *od
         find.type    = DIRPREFS_TYPE_GUID;
         find.id.guid = odns->user_id;
 
-        if ((match = bsearch(&find, me->fp.keys, PREFS_COUNT(me, identities), sizeof(find), dirprefs_org_compare)) != NULL) {
+        if ((match = dirprefs_org_find(me, &find)) != NULL) {
             pref_init_byidentity(&p, me->fp.values, NULL, NULL, match - DIRPREFS_ORG_KEYS(&me->fp));
             ident = PREF_IDENT(&p);
             bundle = PREF_BUNDLE(&p);
@@ -246,7 +375,7 @@ dirprefs_org_get(pref_t *pref, const struct prefs_org *me, const struct odns *od
         find.type    = DIRPREFS_TYPE_GUID;
         find.id.guid = odns->host_id;
 
-        if ((match = bsearch(&find, me->fp.keys, PREFS_COUNT(me, identities), sizeof(find), dirprefs_org_compare)) != NULL) {
+        if ((match = dirprefs_org_find(me, &find)) != NULL) {
             pref_init_byidentity(&p, me->fp.values, NULL, NULL, match - DIRPREFS_ORG_KEYS(&me->fp));
             ident = PREF_IDENT(&p);
             bundle = PREF_BUNDLE(&p);
@@ -265,7 +394,7 @@ dirprefs_org_get(pref_t *pref, const struct prefs_org *me, const struct odns *od
         if (!PREF_VALID(pref) || PREF_BUNDLE(pref)->priority > 0) {
             find.type = DIRPREFS_TYPE_ASSET;
             unaligned_htonl(&find.id, odns->va_id);
-            if ((match = bsearch(&find, me->fp.keys, PREFS_COUNT(me, identities), sizeof(find), dirprefs_org_compare)) != NULL) {
+            if ((match = dirprefs_org_find(me, &find)) != NULL) {
                 pref_init_byidentity(&p, me->fp.values, NULL, NULL, match - DIRPREFS_ORG_KEYS(&me->fp));
                 ident = PREF_IDENT(&p);
                 bundle = PREF_BUNDLE(&p);
@@ -283,7 +412,7 @@ dirprefs_org_get(pref_t *pref, const struct prefs_org *me, const struct odns *od
 
     /* Note, there are no known DIRPREFS_TYPE_ORG entries in production dirprefs files */
     find.type = DIRPREFS_TYPE_ORG;
-    if ((match = bsearch(&find, me->fp.keys, PREFS_COUNT(me, identities), sizeof(find), dirprefs_org_compare)) != NULL) {
+    if ((match = dirprefs_org_find(me, &find)) != NULL) {
         pref_init_byidentity(&p, me->fp.values, NULL, NULL, match - DIRPREFS_ORG_KEYS(&me->fp));
         ident = PREF_IDENT(&p);
         bundle = PREF_BUNDLE(&p);
@@ -16,6 +16,10 @@ enum dirprefs_type {
     DIRPREFS_TYPE_ALT_UID = 3
 };
 
+#if defined(SXE_DEBUG) || defined(SXE_COVERAGE)    // Define unique tags for mockfails
+#   define DIRPREFS_ORG_INDEX ((const char *)dirprefs_org_new + 0)
+#endif
+
 #include "dirprefs-org-proto.h"
 
 #endif
@@ -5,13 +5,12 @@
 
 struct dirprefs {
     struct conf conf;
-    unsigned count;            /* # allocated org entries */
     time_t mtime;              /* last modification */
-    struct prefs_org **org;    /* a block of 'count' organization pointers */
+    struct conf_segment_table org; /* prefs_org organizations in id order */
 };
 
 /*-
- * A struct dirprefs is a dynamic array of dirprefs_org structure pointers:
+ * A struct dirprefs is a conf_segment_table of dirprefs_org structure pointers:
  *
  *                        org[0]                                           org[1]                    ........                      org[N]
  *  .----------------------------------------------. .----------------------------------------------.        .----------------------------------------------.
@@ -36,8 +35,6 @@ struct dirprefs {
 
 #if defined(SXE_DEBUG) || defined(SXE_COVERAGE)    // Define unique tags for mockfails
 #   define DIRPREFS_CLONE      ((const char *)dirprefs_register + 0)
-#   define DIRPREFS_CLONE_ORGS ((const char *)dirprefs_register + 1)
-#   define DIRPREFS_MOREORGS   ((const char *)dirprefs_register + 2)
 #endif
 
 #endif
@@ -30,12 +30,9 @@ static void
 dirprefs_free(struct conf *base)
 {
     struct dirprefs *me = CONF2DIRPREFS(base);
-    unsigned i;
 
     SXEA6(base->type == &dirprefsct, "dirprefs_free() with unexpected conf_type %s", base->type->name);
-    for (i = 0; i < me->count; i++)
-        prefs_org_refcount_dec(me->org[i]);
-    kit_free(me->org);
+    conf_segment_table_fini(&me->org);
     kit_free(me);
 }
 
@@ -43,32 +40,20 @@ static struct conf *
 dirprefs_clone(struct conf *obase)
 {
     struct dirprefs *me, *ome;
-    unsigned i;
 
     if ((me = MOCKFAIL(DIRPREFS_CLONE, NULL, kit_malloc(sizeof(*me)))) == NULL)
         SXEL2("Couldn't allocate a dirprefs structure");
     else {
         conf_setup(&me->conf, &dirprefsct);
-        me->count = 0;
         me->mtime = 0;
-        me->org = NULL;
-
-        ome = CONF2DIRPREFS(obase);
-        if (ome && ome->count) {
-            me->count = (ome->count + 9) / 10 * 10;
-            if ((me->org = MOCKFAIL(DIRPREFS_CLONE_ORGS, NULL, kit_malloc(me->count * sizeof(*me->org)))) == NULL) {
-                SXEL2("Couldn't allocate %u new dirprefs org slots", me->count);
-                kit_free(me);
-                me = NULL;
-            } else {
-                me->count = ome->count;
-                for (i = 0; i < me->count; i++) {
-                    prefs_org_refcount_inc(me->org[i] = ome->org[i]);
-                    if (me->mtime < me->org[i]->cs.mtime)
-                        me->mtime = me->org[i]->cs.mtime;
-                }
-            }
-        }
+
+        if ((ome = CONF2DIRPREFS(obase)) == NULL)
+            prefs_org_table_init(&me->org);
+        else if (!conf_segment_table_clone(&me->org, &ome->org)) {
+            kit_free(me);
+            me = NULL;
+        } else
+            me->mtime = conf_segment_table_mtime(&me->org);
     }
 
     return me ? &me->conf : NULL;
@@ -90,23 +75,26 @@ dirprefs_orgid2slot(const struct conf *base, uint32_t orgid)
 {
     const struct dirprefs *me = CONSTCONF2DIRPREFS(base);
 
-    return prefs_org_slot(me->org, orgid, me->count);
+    return prefs_org_slot(&me->org, orgid);
 }
 
 static const struct conf_segment *
 dirprefs_slot2segment(const struct conf *base, unsigned slot)
 {
     const struct dirprefs *me = CONSTCONF2DIRPREFS(base);
+    const struct prefs_org *po = conf_segment_table_get(&me->org, slot);
 
-    return slot < me->count ? &me->org[slot]->cs : NULL;
+    return po ? &po->cs : NULL;
 }
 
 static void
 dirprefs_slotfailedload(struct conf *base, unsigned slot, bool value)
 {
     struct dirprefs *me = CONF2DIRPREFS(base);
-    if (slot < me->count) {
-        me->org[slot]->cs.failed_load = value;
+    struct prefs_org *po;
+
+    if ((po = conf_segment_table_get(&me->org, slot)) != NULL) {
+        po->cs.failed_load = value;
     }
 }
 
@@ -114,19 +102,18 @@ bool
 dirprefs_slotisempty(const struct conf *base, unsigned slot)
 {
     const struct dirprefs *me = CONSTCONF2DIRPREFS(base);
+    const struct prefs_org *po = conf_segment_table_get(&me->org, slot);
 
-    return slot >= me->count || me->org[slot]->fp.total == 0;
+    return po == NULL || po->fp.total == 0;
 }
 
-static void
+static bool
 dirprefs_freeslot(struct conf *base, unsigned slot)
 {
     struct dirprefs *me = CONF2DIRPREFS(base);
 
-    SXEA1(slot < me->count, "Cannot free dirprefs org slot %u (count %u)", slot, me->count);
-    prefs_org_refcount_dec(me->org[slot]);
-    memmove(me->org + slot, me->org + slot + 1, (me->count - slot - 1) * sizeof(*me->org));
-    me->count--;
+    SXEA1(slot < me->org.count, "Cannot free dirprefs org slot %u (count %u)", slot, me->org.count);
+    return conf_segment_table_remove(&me->org, slot);
 }
 
 static bool
@@ -134,30 +121,22 @@ dirprefs_useorg(struct conf *base, void *vdpo, unsigned slot, uint64_t *alloc)
 {
     struct dirprefs *me = CONF2DIRPREFS(base);
     struct prefs_org *dpo = vdpo;
-    struct prefs_org **dpop;
-
-    SXEA6(slot <= me->count, "Oops, Insertion point is at pos %u of %u", slot, me->count);
-    if (!(me->count % 10)) {
-        if ((dpop = MOCKFAIL(DIRPREFS_MOREORGS, NULL, kit_realloc(me->org, (me->count + 10) * sizeof(*me->org)))) == NULL) {
-            SXEL2("Couldn't reallocate %u dirprefs org slots", me->count + 10);
-            return false;
-        }
-        me->org = dpop;
-    }
 
+    SXEA6(slot <= me->org.count, "Oops, Insertion point is at pos %u of %u", slot, me->org.count);
     if (!(dpo->fp.loadflags & LOADFLAGS_FP_FAILED)) {
         dirprefs_settimeatleast(base, dpo->cs.mtime);
     }
-    return prefs_org_fill_slot(dpo, me->org, &me->count, slot, alloc);
+    return prefs_org_fill_slot(dpo, &me->org, slot, alloc);
 }
 
 static void
 dirprefs_loaded(struct conf *base)
 {
     struct dirprefs *me = CONF2DIRPREFS(base);
+    const struct prefs_org *po;
 
-    if (me && me->count)
-        conf_report_load(me->org[0]->fp.ops->type, me->org[0]->fp.version);
+    if (me && (po = conf_segment_table_get(&me->org, 0)) != NULL)
+        conf_report_load(po->fp.ops->type, po->fp.version);
 }
 
 static const struct conf_segment_ops dirprefs_segment_ops = {
@@ -196,12 +175,12 @@ dirprefs_conf_get(const struct confset *set, module_conf_t m)
 const struct prefblock *
 dirprefs_get_prefblock(const struct dirprefs *me, uint32_t orgid)
 {
-    unsigned i;
+    const struct prefs_org *po;
 
-    if (me == NULL || (i = prefs_org_slot(me->org, orgid, me->count)) == me->count || me->org[i]->cs.id != orgid)
+    if (me == NULL || (po = conf_segment_table_find(&me->org, orgid)) == NULL)
         return NULL;
 
-    return me->org[i]->fp.values;
+    return po->fp.values;
 }
 
 /*
@@ -212,9 +191,9 @@ dirprefs_get(pref_t *pref, const struct dirprefs *me, const struct odns *odns, s
 {
     uint32_t global_parent_org = pref_get_globalorg();
     const struct prefblock *pblk, *gblk;
+    const struct prefs_org *po;
     const struct preforg *org;
     const char *what;
-    unsigned i;
 
     SXEE7("(me=%p odns=%p other_origins=%p, type=?, x=?)", me, odns, *other_origins);
     pref_fini(pref);
@@ -223,10 +202,10 @@ dirprefs_get(pref_t *pref, const struct dirprefs *me, const struct odns *odns, s
     if (me == NULL || odns == NULL || !(odns->fields & ODNS_FIELD_ORG))
         goto MATCH_DONE;
 
-    if ((i = prefs_org_slot(me->org, odns->org_id, me->count)) == me->count || me->org[i]->cs.id != odns->org_id)
+    if ((po = conf_segment_table_find(&me->org, odns->org_id)) == NULL)
         goto MATCH_DONE;
 
-    if ((what = dirprefs_org_get(pref, me->org[i], odns, other_origins, type, x)) != NULL) {
+    if ((what = dirprefs_org_get(pref, po, odns, other_origins, type, x)) != NULL) {
         pblk = gblk = NULL;
         if ((org = PREF_ORG(pref)) != NULL && org->parentid && !PREF_PARENTORG(pref))
             pblk = dirprefs_get_prefblock(me, org->parentid);     /* We couldn't find the parent org in the prefblock, find it in its own block */
@@ -1,6 +1,7 @@
 #include <errno.h>
 #include <kit-alloc.h>
 #include <mockfail.h>
+#include <string.h>
 
 #if SXE_DEBUG
 #include <kit-bool.h>
@@ -9,6 +10,7 @@
 #include "cidrlist.h"
 #include "fileprefs.h"
 #include "object-hash.h"
+#include "parseline.h"
 #include "uint32list.h"
 #include "urllist.h"
 
@@ -99,7 +101,7 @@ fileprefs_readlist(struct fileprefs *me, struct prefbuilder *pb, struct conf_loa
     struct object_fingerprint of;
     list_pointer_t            lp;
     const char               *p, *cidr_consumed;
-    uint64_t                  id;
+    uint64_t                  id, ltype64;
     unsigned                  actiontype, elementtype, ltype, len;
     int                       bit, consumed;
     bool                      ltype_requires_empty_bit;
@@ -110,13 +112,16 @@ fileprefs_readlist(struct fileprefs *me, struct prefbuilder *pb, struct conf_loa
     if (me->loadflags & LOADFLAGS_FP_NO_LTYPE) {
         ltype = AT_LIST_NONE;
 
-        if (sscanf(line, "%" PRIu64 "%c%n", &id, &colon, &consumed) != 2 || colon != ':' || id != (uint32_t)id)
+        if ((p = parse_uint(line, &id)) == NULL || *p != ':' || id != (uint32_t)id)
             return fileprefs_log_error(me, line, __FUNCTION__, cl, "list", "id:", pb->list.count, pb->list.alloc);
     }
     else {
-        if (sscanf(line, "%X:%" PRIu64 "%c%n", &ltype, &id, &colon, &consumed) != 3 || colon != ':' || id != (uint32_t)id)
+        if ((p = parse_xuint(line, &ltype64)) == NULL || *p != ':' || (p = parse_uint(p + 1, &id)) == NULL || *p != ':'
+         || id != (uint32_t)id || ltype64 != (uint32_t)ltype64)
             return fileprefs_log_error(me, line, __FUNCTION__, cl, "list", "ltype:id:", pb->list.count, pb->list.alloc);
 
+        ltype = ltype64;
+
         if (!LTYPEVALID(ltype)) {
             SXEL4("%s(): %s v%d: %s: %d: Unrecognised list line (invalid ltype)",
                 __FUNCTION__, me->ops->type, me->version, conf_loader_path(cl), conf_loader_line(cl));
@@ -124,7 +129,7 @@ fileprefs_readlist(struct fileprefs *me, struct prefbuilder *pb, struct conf_loa
         }
     }
 
-    line += consumed;
+    line = p + 1;
 
     if ((p = strchr(line, ':')) == NULL) {
         SXEL2("%s(): %s v%d: %s: %d: Unrecognised list line (no elementtype terminator)",
@@ -369,21 +374,21 @@ static const char *ltype_str[] = {
 static bool
 fileprefs_readbundle(struct fileprefs *me, struct prefbuilder *pb, struct conf_loader *cl, const char *line)
 {
-    uint64_t bundleid, flags, listid, priority, settinggroup_id;
+    uint64_t actype, bundleid, flags, listid, priority, settinggroup_id;
     uint32_t settinggroup_ids[SETTINGGROUP_IDX_COUNT];
     pref_categories_t categories;
-    char colon, *end, term;
-    unsigned actype;
+    const char *p;
+    char *end, term;
     ltype_t ltype;
     int consumed;
     unsigned i;
 
-    if (sscanf(line, "%X:%"PRIu64":%"PRIu64":%"PRIx64"%c%n", &actype, &bundleid, &priority, &flags, &colon, &consumed) != 5
-     || colon != ':')
+    if ((p = parse_xuint(line, &actype)) == NULL || *p != ':' || (p = parse_uint(p + 1, &bundleid)) == NULL || *p != ':'
+     || (p = parse_uint(p + 1, &priority)) == NULL || *p != ':' || (p = parse_xuint(p + 1, &flags)) == NULL || *p != ':')
         return fileprefs_log_error(me, line, __FUNCTION__, cl, "bundle", "actype:bundleid:priority:flags:", pb->bundle.count,
                                    pb->bundle.alloc);
 
-    line += consumed;
+    line = p + 1;
 
     if (bundleid != (uint32_t)bundleid || priority != (uint32_t)priority || flags != (pref_bundleflags_t)flags) {
         SXEL2("%s(): %s v%d: %s: %d: Unrecognised bundle line (overflow in actype:bundleid:priority:flags:)",
@@ -437,7 +442,7 @@ fileprefs_readbundle(struct fileprefs *me, struct prefbuilder *pb, struct conf_l
 
     if (!prefbuilder_addbundle(pb, (actype_t)actype, bundleid, priority, flags, &categories, settinggroup_ids)) {
         SXEL2("%s(): %s v%d: %s: %d: Cannot create bundle %X:%" PRIu64,
-              __FUNCTION__, me->ops->type, me->version, conf_loader_path(cl), conf_loader_line(cl), actype, bundleid);
+              __FUNCTION__, me->ops->type, me->version, conf_loader_path(cl), conf_loader_line(cl), (unsigned)actype, bundleid);
         return false;
     }
 
@@ -453,8 +458,11 @@ fileprefs_readbundle(struct fileprefs *me, struct prefbuilder *pb, struct conf_l
             if (*line == '\0' || *line == term)
                 break;
 
-            if (sscanf(line, "%" PRIu64 "%n", &listid, &consumed) != 1 || (line[consumed] != ' ' && line[consumed] != term)
-             || listid != (uint32_t)listid) {
+            /* On a parse failure, report the unparsable field that starts at the current position */
+            p = parse_uint(line, &listid);
+            consumed = p ? p - line : (int)strcspn(line + 1, " :\n") + 1;
+
+            if (p == NULL || (*p != ' ' && *p != term) || listid != (uint32_t)listid) {
                 SXEL2("%s(): %s v%d: %s: %d: Unrecognised bundle line (invalid %s list '%.*s')", __FUNCTION__,
                       me->ops->type, me->version, conf_loader_path(cl), conf_loader_line(cl), ltype_str[i], consumed, line);
                 return false;
@@ -464,8 +472,8 @@ fileprefs_readbundle(struct fileprefs *me, struct prefbuilder *pb, struct conf_l
 
             if (!prefbuilder_attachlist(pb, bundleid, ltype, listid, LOADFLAGS_FP_TO_ELEMENTTYPES(me->loadflags))) {
                 SXEL2("%s(): %s v%d: %s: %d: Cannot attach bundle %X:%" PRIu64 " to list %02X:%" PRIu64 " (list pos %u)",
-                      __FUNCTION__, me->ops->type, me->version, conf_loader_path(cl), conf_loader_line(cl), actype, bundleid,
-                      ltype, listid, i);
+                      __FUNCTION__, me->ops->type, me->version, conf_loader_path(cl), conf_loader_line(cl), (unsigned)actype,
+                      bundleid, ltype, listid, i);
                 return false;
             }
         }
@@ -551,8 +559,8 @@ fileprefs_readorg(struct fileprefs *me, struct prefbuilder *pb, struct conf_load
 static bool
 fileprefs_readident(struct fileprefs *me, struct prefbuilder *pb, struct conf_loader *cl, const char *line)
 {
-    uint64_t bundleid, orgid, originid, origintypeid;
-    unsigned actype;
+    uint64_t actype, bundleid, orgid, originid, origintypeid;
+    const char *p;
     int consumed;
 
     SXEA6(me->ops->parsekey != NULL, "Reading an identity, but the file type doesn't support parsing keys");
@@ -561,7 +569,9 @@ fileprefs_readident(struct fileprefs *me, struct prefbuilder *pb, struct conf_lo
         return false;
 
     line += consumed;
-    if (sscanf(line, "%" PRIu64 ":%" PRIu64 ":%" PRIu64 ":%X:%" PRIu64 "%n", &originid, &origintypeid, &orgid, &actype, &bundleid, &consumed) != 5) {
+    if ((p = parse_uint(line, &originid)) == NULL || *p != ':' || (p = parse_uint(p + 1, &origintypeid)) == NULL || *p != ':'
+     || (p = parse_uint(p + 1, &orgid)) == NULL || *p != ':' || (p = parse_xuint(p + 1, &actype)) == NULL || *p != ':'
+     || (p = parse_uint(p + 1, &bundleid)) == NULL) {
         SXEL2("%s(): %s v%d: %s: %d: Unrecognised identity line",
               __FUNCTION__, me->ops->type, me->version, conf_loader_path(cl), conf_loader_line(cl));
         return false;
@@ -577,7 +587,7 @@ fileprefs_readident(struct fileprefs *me, struct prefbuilder *pb, struct conf_lo
               __FUNCTION__, me->ops->type, me->version, conf_loader_path(cl), conf_loader_line(cl));
         return false;
     }
-    if (line[consumed] != '\0' && line[consumed] != '\n') {
+    if (*p != '\0' && *p != '\n') {
         SXEL2("%s(): %s v%d: %s: %d: Unrecognised identity line (trailing junk)",
               __FUNCTION__, me->ops->type, me->version, conf_loader_path(cl), conf_loader_line(cl));
         return false;
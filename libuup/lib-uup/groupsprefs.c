@@ -2,7 +2,6 @@
  * Copied from: https://github.office.opendns.com/cdfw/firewall/blob/multi-tenant/src/groupsprefs.c
  */
 
-#include <safe_lib.h>
 #include <mockfail.h>
 
 #include "groupsprefs.h"
@@ -14,8 +13,7 @@
 struct groupsprefs {
     struct conf conf;
     time_t mtime;                    /* last modification */
-    unsigned count;                  /* num allocated groups_per_user_map_t entries */
-    groups_per_user_map_t **gpum;    /* a block of 'count' pointers */
+    struct conf_segment_table gpum;  /* groups_per_user_map_t segments in org id order */
 };
 
 module_conf_t CONF_GROUPSPREFS;
@@ -31,13 +29,9 @@ static void
 groupsprefs_free(struct conf *base)
 {
     struct groupsprefs *me = CONF2GROUPSPREFS(base);
-    unsigned count;
     SXEA6(base, "groupsprefs_free() with NULL base");
     SXEA6(base->type == &gpct, "groupsprefs_free() with unexpected conf_type %s", base->type->name);
-    for (count = 0; count < me->count; count++) {
-        groups_per_user_map_refcount_dec(me->gpum[count]);
-    }
-    kit_free(me->gpum);
+    conf_segment_table_fini(&me->gpum);
     kit_free(me);
 }
 
@@ -45,35 +39,21 @@ static struct conf *
 groupsprefs_clone(struct conf *obase)
 {
     struct groupsprefs *me, *ome;
-    unsigned i;
 
     if ((me = MOCKFAIL(GROUPSPREFS_CLONE, NULL, kit_malloc(sizeof(*me)))) == NULL) {
         SXEL2("Couldn't allocate an groupsprefs structure");
     } else {
         conf_setup(&me->conf, &gpct);
-        me->count = 0;
         me->mtime = 0;
-        me->gpum  = NULL;
-        ome       = CONF2GROUPSPREFS(obase);
-
-        if (ome && ome->count) {
-            me->count = (ome->count + 9) / 10 * 10;
-
-            if ((me->gpum = MOCKFAIL(GROUPSPREFS_CLONE_GPUMS, NULL, kit_malloc(me->count * sizeof(*me->gpum)))) == NULL) {
-                SXEL2("Couldn't allocate %u new groups_per_user_map_t slots", me->count);
-                kit_free(me);
-                me = NULL;
-            } else {
-                me->count = ome->count;
-
-                for (i = 0; i < me->count; i++) {
-                    groups_per_user_map_refcount_inc(me->gpum[i] = ome->gpum[i]);
-
-                    if (me->mtime < me->gpum[i]->cs.mtime) {
-                        me->mtime = me->gpum[i]->cs.mtime;
-                    }
-                }
-            }
+
+        if ((ome = CONF2GROUPSPREFS(obase)) == NULL) {
+            conf_segment_table_init(&me->gpum, offsetof(groups_per_user_map_t, cs), groups_per_user_map_refcount_inc,
+                                    groups_per_user_map_refcount_dec);
+        } else if (!conf_segment_table_clone(&me->gpum, &ome->gpum)) {
+            kit_free(me);
+            me = NULL;
+        } else {
+            me->mtime = conf_segment_table_mtime(&me->gpum);
         }
     }
 
@@ -95,7 +75,7 @@ groupsprefs_orgid2slot(const struct conf *base, uint32_t org_id)
 {
     SXEA6(base != NULL, "groupsprefs_orgid2slot() base pointer is null");
     const struct groupsprefs *me = CONSTCONF2GROUPSPREFS(base);
-    return conf_segment_slot((void *const *const)me->gpum, org_id, me->count, offsetof(groups_per_user_map_t, cs));
+    return conf_segment_table_slot(&me->gpum, org_id);
 }
 
 static const struct conf_segment *
@@ -103,7 +83,8 @@ groupsprefs_slot2segment(const struct conf *base, unsigned slot)
 {
     SXEA6(base != NULL, "groupsprefs_slot2segment() base pointer is null");
     const struct groupsprefs *me = CONSTCONF2GROUPSPREFS(base);
-    return slot < me->count ? &me->gpum[slot]->cs : NULL;
+    const groups_per_user_map_t *gpum = conf_segment_table_get(&me->gpum, slot);
+    return gpum ? &gpum->cs : NULL;
 }
 
 static bool
@@ -112,30 +93,26 @@ groupsprefs_slotisempty(const struct conf *base, unsigned slot)
     SXEA6(base != NULL, "groupsprefs_slotisempty() base pointer is null");
     const struct groupsprefs *me = CONSTCONF2GROUPSPREFS(base);
 
-    // If gpu is changed to a dynamically allocated pointer in the future, have to have the following check:
-    // return slot >= me->count || me->gpum[slot]->gpu == NULL;
-    return slot >= me->count;
+    return slot >= me->gpum.count;
 }
 
 static void
 groupsprefs_slotfailedload(struct conf *base, unsigned slot, bool value)
 {
     struct groupsprefs *me = CONF2GROUPSPREFS(base);
+    groups_per_user_map_t *gpum;
 
-    if (slot < me->count)
-        me->gpum[slot]->cs.failed_load = value;
+    if ((gpum = conf_segment_table_get(&me->gpum, slot)) != NULL)
+        gpum->cs.failed_load = value;
 }
 
-static void
+static bool
 groupsprefs_freeslot(struct conf *base, unsigned slot)
 {
     SXEA6(base != NULL, "groupsprefs_freeslot() base pointer is null");
     struct groupsprefs *me = CONF2GROUPSPREFS(base);
-    SXEA1(slot < me->count, "Cannot free groups_per_user_map_t slot %u (count %u)", slot, me->count);
-    groups_per_user_map_refcount_dec(me->gpum[slot]);
-    memmove_s(me->gpum + slot, (me->count - slot) * sizeof(*me->gpum),
-              me->gpum + slot + 1, (me->count - slot - 1) * sizeof(*me->gpum));
-    me->count--;
+    SXEA1(slot < me->gpum.count, "Cannot free groups_per_user_map_t slot %u (count %u)", slot, me->gpum.count);
+    return conf_segment_table_remove(&me->gpum, slot);
 }
 
 static bool
@@ -143,43 +120,27 @@ groupsprefs_use_groups_per_user_map(struct conf *base, void *vgpum, unsigned slo
 {
     struct groupsprefs *me = CONF2GROUPSPREFS(base);
     groups_per_user_map_t *gpum = vgpum;
-    groups_per_user_map_t **gpump;
+    groups_per_user_map_t *ogpum;
+    uint64_t oalloc = 0;
     SXEA6(me, "groupsprefs_use_groups_per_user_map() null self pointer");
-    SXEA6(slot <= me->count, "Oops, Insertion point is at pos %u of %u", slot, me->count);
+    SXEA6(slot <= me->gpum.count, "Oops, Insertion point is at pos %u of %u", slot, me->gpum.count);
 
-    if (!(me->count % 10)) {
-        if ((gpump = MOCKFAIL(GROUPSPREFS_MORE_ORGS, NULL, kit_realloc(me->gpum, (me->count + 10) * sizeof(*me->gpum))))
-         == NULL) {
-            SXEL2("Couldn't reallocate %u groups_per_user_map_t slots", me->count + 10);
+    if ((ogpum = conf_segment_table_get(&me->gpum, slot)) != NULL && ogpum->cs.id == gpum->cs.id) {
+        SXEL7("Existing groups_per_user_map_t slot %u already contains groupsprefs id %" PRIu32, slot, gpum->cs.id);
+        oalloc = ogpum->cs.alloc;
+
+        if (!conf_segment_table_replace(&me->gpum, slot, gpum))
             return false;
-        }
+    } else {
+        SXEA6(ogpum == NULL || ogpum->cs.id > gpum->cs.id, "Landed on unexpected org_id %" PRIu32 " when looking for org %" PRIu32,
+              ogpum->cs.id, gpum->cs.id);
 
-        me->gpum = gpump;
+        if (!conf_segment_table_insert(&me->gpum, slot, gpum))
+            return false;
     }
 
     groupsprefs_settimeatleast(base, gpum->cs.mtime);
-    *alloc += gpum->cs.alloc;
-
-    if (slot < me->count) {
-        SXEA6(me->gpum[slot]->cs.id >= gpum->cs.id, "Landed on unexpected org_id %" PRIu32 " when looking for org %" PRIu32,
-              me->gpum[slot]->cs.id, gpum->cs.id);
-
-        if (me->gpum[slot]->cs.id > gpum->cs.id) {
-            SXEL7("Existing user_to_group_list_t slot %u org_id %" PRIu32 " exceeds groupsprefs id %" PRIu32,
-                  slot, me->gpum[slot]->cs.id, gpum->cs.id);
-            memmove_s(me->gpum + slot + 1, (me->count - slot + 1) * sizeof(*me->gpum),
-                    me->gpum + slot, (me->count - slot) * sizeof(*me->gpum));
-            me->count++;
-        } else {
-            SXEL7("Existing groups_per_user_map_t slot %u already contains groupsprefs id %" PRIu32, slot, gpum->cs.id);
-            *alloc -= me->gpum[slot]->cs.alloc;
-            groups_per_user_map_refcount_dec(me->gpum[slot]);
-        }
-    } else {
-        me->count++;
-    }
-
-    me->gpum[slot] = gpum;
+    *alloc += gpum->cs.alloc - oalloc;
     return true;
 }
 
@@ -188,7 +149,7 @@ groupsprefs_loaded(struct conf *base)
 {
     struct groupsprefs *me = CONF2GROUPSPREFS(base);
 
-    if (me && me->count) {
+    if (me && me->gpum.count) {
         conf_report_load("groupsprefs", GROUPSPREFS_VERSION);
     }
 }
@@ -223,7 +184,6 @@ groupsprefs_register(module_conf_t *m, const char *name, const char *fn)
 groups_per_user_map_t *
 groupsprefs_get_groups_per_user_map(const struct confset *set, module_conf_t m, uint32_t org_id)
 {
-    unsigned i;
     groups_per_user_map_t *gpum = NULL;
 
     SXEE7("(set=%p, org_id=%u)", set, org_id);
@@ -235,14 +195,8 @@ groupsprefs_get_groups_per_user_map(const struct confset *set, module_conf_t m,
     if (gp == NULL)
         goto MATCH_DONE;
 
-    i = groupsprefs_orgid2slot(base, org_id);
-
-    if (i == gp->count || gp->gpum[i]->cs.id != org_id) {
+    if ((gpum = conf_segment_table_find(&gp->gpum, org_id)) == NULL)
         SXEL2("Couldn't find groupsprefs slot for org_id %u", org_id);
-        goto MATCH_DONE;
-    }
-
-    gpum = gp->gpum[i];
 
 MATCH_DONE:
     SXER7("return %p", gpum);
@@ -16,8 +16,6 @@ groups_per_user_map_t *groupsprefs_get_groups_per_user_map(const struct confset
 
 #if defined(SXE_DEBUG) || defined(SXE_COVERAGE)    // Define unique tags for mockfails
 #   define GROUPSPREFS_CLONE       ((const char *)groupsprefs_register + 0)
-#   define GROUPSPREFS_CLONE_GPUMS ((const char *)groupsprefs_register + 1)
-#   define GROUPSPREFS_MORE_ORGS   ((const char *)groupsprefs_register + 2)
 #endif
 
 #endif
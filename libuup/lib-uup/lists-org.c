@@ -1,16 +1,16 @@
 #include <kit-alloc.h>
 #include <mockfail.h>
-
-#if SXE_DEBUG
-#include "dns-name.h"
-#endif
+#include <string.h>
 
 #include "atomic.h"
 #include "cidrlist.h"
 #include "conf-meta.h"
+#include "dns-name.h"
+#include "domainlist-private.h"    // The domain index is built from our domainlists' name bundles
 #include "fileprefs.h"
 #include "lists.h"
 #include "urllist.h"
+#include "xray.h"
 
 void
 lists_org_refcount_dec(void *obj)
@@ -26,6 +26,8 @@ lists_org_refcount_dec(void *obj)
                 preflist_refcount_dec(&me->lists[i]);
 
             conf_meta_free(me->cm);
+            kit_free(me->domains);
+            kit_free(me->keys);
             kit_free(me->lists);
             kit_free(me);
         }
@@ -41,6 +43,64 @@ lists_org_refcount_inc(void *obj)
         ATOMIC_INC_INT(&me->cs.refcount);
 }
 
+static __thread const char *compar_keys;    // The key store that compar_domain() entries refer to
+
+static int
+compar_domain(const void *va, const void *vb)
+{
+    const struct lists_org_domain *a = va, *b = vb;
+    int cmp;
+
+    return (cmp = strcmp(compar_keys + a->key, compar_keys + b->key)) ? cmp : a->slot < b->slot ? -1 : a->slot > b->slot;
+}
+
+/*-
+ * Build the union of all of the org's domainlists as a single sorted array of (domain, slot) pairs, so that all domainlists
+ * can be searched at once.
+ */
+static bool
+lists_org_index_domains(struct lists_org *me, struct conf_loader *cl)
+{
+    struct domainlist *dl;
+    const char        *name;
+    unsigned           i, n, slot;
+    size_t             len, pos;
+
+    for (len = 0, slot = 0; slot < me->count; slot++)
+        if (me->lists[slot].elementtype == PREF_LIST_ELEMENTTYPE_DOMAIN && (dl = me->lists[slot].lp.domainlist)) {
+            me->domain_count += dl->name_amount;
+            for (n = 0; n < (unsigned)dl->name_amount; n++)
+                len += strlen(dl->name_bundle + DOMAINLIST_NAME_OFFSET(dl, n)) + 1;
+        }
+
+    if (me->domain_count == 0)
+        return true;
+
+    SXEA1(len <= UINT32_MAX, "A domain index key store of %zu bytes is too big", len);
+
+    if ((me->domains = MOCKFAIL(LISTS_ORG_DOMAIN_INDEX, NULL, kit_malloc(me->domain_count * sizeof(*me->domains)))) == NULL
+     || (me->keys = kit_malloc(len)) == NULL) {
+        SXEL2("%s: Cannot allocate a domain index of %u entries (%zu key bytes)", conf_loader_path(cl), me->domain_count, len);
+        return false;
+    }
+
+    for (i = 0, pos = 0, slot = 0; slot < me->count; slot++)
+        if (me->lists[slot].elementtype == PREF_LIST_ELEMENTTYPE_DOMAIN && (dl = me->lists[slot].lp.domainlist))
+            for (n = 0; n < (unsigned)dl->name_amount; n++, i++) {
+                me->domains[i].key  = pos;
+                me->domains[i].slot = slot;
+
+                for (name = dl->name_bundle + DOMAINLIST_NAME_OFFSET(dl, n); *name; name++)
+                    me->keys[pos++] = dns_tolower[(uint8_t)*name];
+
+                me->keys[pos++] = '\0';
+            }
+
+    compar_keys = me->keys;
+    qsort(me->domains, me->domain_count, sizeof(*me->domains), compar_domain);
+    return true;
+}
+
 void *
 lists_org_new(uint32_t orgid, struct conf_loader *cl, const struct conf_info *info)
 {
@@ -108,6 +168,9 @@ lists_org_new(uint32_t orgid, struct conf_loader *cl, const struct conf_info *in
     if (total_count)
         prefbuilder_consumelists(&pref_builder, &me->lists, &me->count);
 
+    if (!lists_org_index_domains(me, cl))
+        goto SXE_EARLY_OUT;
+
     conf_segment_init(&me->cs, orgid, cl, false);
     retme = me;
 
@@ -221,10 +284,11 @@ lists_org_lookup_domainlist(const struct lists_org *me, uint32_t *subset, unsign
             if (!(list = lists_org_find_subset_member(me, PREF_LIST_ELEMENTTYPE_DOMAIN, subset, count, &next, &i)))
                 return 0;
 
-            // The listname is only used in debug (and xray messages, but currently, xray is always NULL)
-#if SXE_DEBUG
-            snprintf(listname, sizeof(listname), "lists %u:domain", list->id);
-#endif
+            // The listname is only used in trace messages (and xray messages, but currently, xray is always NULL)
+            if (XRAY_LOGGING(6))
+                snprintf(listname, sizeof(listname), "lists %u:domain", list->id);
+            else
+                listname[0] = '\0';
 
             if ((match = domainlist_match(list->lp.domainlist, name, DOMAINLIST_MATCH_SUBDOMAIN, NULL, listname))) {
                 if (bit_out)
@@ -320,10 +384,11 @@ lists_org_lookup_cidrlist(const struct lists_org *me, uint32_t *subset, unsigned
             if (!(list = lists_org_find_subset_member(me, PREF_LIST_ELEMENTTYPE_CIDR, subset, count, &next, &i)))
                 return 0;
 
-            // The listname is only used in debug (and xray messages, but currently, xray is always NULL)
-#if SXE_DEBUG
-            snprintf(listname, sizeof(listname), "lists %u:cidr", list->id);
-#endif
+            // The listname is only used in trace messages (and xray messages, but currently, xray is always NULL)
+            if (XRAY_LOGGING(6))
+                snprintf(listname, sizeof(listname), "lists %u:cidr", list->id);
+            else
+                listname[0] = '\0';
 
             if ((match = cidrlist_search(list->lp.cidrlist, ipaddr, NULL, listname))) {
                 if (bit_out)
@@ -338,3 +403,230 @@ lists_org_lookup_cidrlist(const struct lists_org *me, uint32_t *subset, unsigned
 
     return 0;
 }
+
+/*
+ * Return true if the listid is in the sorted subset, or if there is no subset
+ */
+static bool
+lists_org_subset_has(const uint32_t *subset, unsigned count, uint32_t listid)
+{
+    unsigned lo, hi, mid;
+
+    if (!subset)
+        return true;
+
+    for (lo = 0, hi = count; lo < hi;) {
+        mid = lo + (hi - lo) / 2;
+
+        if (subset[mid] == listid)
+            return true;
+
+        if (subset[mid] < listid)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return false;
+}
+
+/*
+ * Add a match to the array unless its list has already matched.  Returns the new number of matches.
+ */
+static unsigned
+lists_org_add_match(struct lists_org_match *matches, unsigned n, const struct preflist *list, const uint8_t *name, unsigned length)
+{
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+        if (matches[i].listid == list->id)
+            return n;
+
+    matches[n].listid = list->id;
+    matches[n].name   = name;
+    matches[n].length = length;
+    matches[n].bit    = list->bit;
+    return n + 1;
+}
+
+/*
+ * Return the index of the first domain index entry whose key is not less than the 'len' byte prefix of 'domain'
+ */
+static unsigned
+lists_org_find_domain(const struct lists_org *me, const char *domain, unsigned len)
+{
+    unsigned lo, hi, mid;
+    const char *key;
+    int cmp;
+
+    for (lo = 0, hi = me->domain_count; lo < hi;) {
+        mid = lo + (hi - lo) / 2;
+        key = me->keys + me->domains[mid].key;
+
+        if ((cmp = strncmp(key, domain, len)) == 0)
+            cmp = (uint8_t)key[len];
+
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**
+ * Find all of the domainlists of a list_org that match a DNS name in a single lookup. Partial matches are returned.
+ *
+ * @param me      Pointer to the list_org to look in
+ * @param subset  NULL to look in all lists, or a sorted array of listids
+ * @param count   Number of listids in the subset
+ * @param name    The DNS name to look for
+ * @param matches Array populated with the matching lists in listid order, each with the longest part of name that matched
+ * @param max     Number of entries in matches
+ *
+ * @return The number of matches; if this is max, there may be more matching lists
+ */
+unsigned
+lists_org_match_domainlists(const struct lists_org *me, const uint32_t *subset, unsigned count, const uint8_t *name,
+                            struct lists_org_match *matches, unsigned max)
+{
+    char                    domain[DNS_MAXLEN_STRING + 1];
+    const struct preflist  *list;
+    struct lists_org_match  swap;
+    unsigned                i, j, n;
+    size_t                  dlen, len;
+
+    SXEA1(!subset || count, "A subset can't be specified with a 0 count");
+    n = 0;
+
+    if (me == NULL || me->domain_count == 0 || !dns_name_to_buf(name, domain, sizeof(domain), &dlen, DNS_NAME_DEFAULT))
+        return 0;
+
+    if (dlen == 1 && *domain == '.')
+        domain[--dlen] = '\0';
+
+    mem_reverse(domain, dlen);
+
+    for (i = 0; i < dlen; i++)
+        domain[i] = dns_tolower[(uint8_t)domain[i]];
+
+    // Look up the name and then each of its parent domains, so that each list's first match is its longest
+    for (len = dlen; n < max; len--) {
+        if (len == dlen || len == 0 || domain[len] == '.')
+            for (i = lists_org_find_domain(me, domain, len); i < me->domain_count && n < max; i++) {
+                if (strncmp(me->keys + me->domains[i].key, domain, len) || me->keys[me->domains[i].key + len] != '\0')
+                    break;
+
+                list = &me->lists[me->domains[i].slot];
+
+                if (lists_org_subset_has(subset, count, list->id))
+                    n = lists_org_add_match(matches, n, list, name + dlen - len + !len - !*name, 0);
+            }
+
+        if (len == 0)
+            break;
+    }
+
+    // Matches are found longest name first; return them in list order
+    for (i = 1; i < n; i++)
+        for (j = i; j > 0 && matches[j - 1].listid > matches[j].listid; j--) {
+            swap           = matches[j];
+            matches[j]     = matches[j - 1];
+            matches[j - 1] = swap;
+        }
+
+    return n;
+}
+
+/**
+ * Find all of the urllists of a list_org that match a URL in a single pass. Partial matches are returned.
+ *
+ * @param me      Pointer to the list_org to look in
+ * @param subset  NULL to look in all lists, or a sorted array of listids
+ * @param count   Number of listids in the subset
+ * @param url     URL to look for
+ * @param length  Length of the URL
+ * @param matches Array populated with the matching lists in listid order, each with the length of the URL that matched
+ * @param max     Number of entries in matches
+ *
+ * @return The number of matches; if this is max, there may be more matching lists
+ */
+unsigned
+lists_org_match_urllists(const struct lists_org *me, const uint32_t *subset, unsigned count, const char *url, unsigned length,
+                         struct lists_org_match *matches, unsigned max)
+{
+    const struct preflist *list;
+    unsigned               i, match, n, slot;
+
+    SXEA1(!subset || count, "A subset can't be specified with a 0 count");
+
+    for (i = n = slot = 0; me && slot < me->count && n < max; slot++) {
+        list = &me->lists[slot];
+
+        if (list->elementtype != PREF_LIST_ELEMENTTYPE_URL)
+            continue;
+
+        if (subset) {    // Lists are in listid order, so the subset is intersected in a single merge
+            for (; i < count && subset[i] < list->id; i++)
+                ;
+
+            if (i == count)
+                break;
+
+            if (subset[i] != list->id)
+                continue;
+        }
+
+        if ((match = urllist_match(list->lp.urllist, url, length)))
+            n = lists_org_add_match(matches, n, list, NULL, match);
+    }
+
+    return n;
+}
+
+/**
+ * Find all of the cidrlists of a list_org that match an address in a single pass. Partial matches are returned.
+ *
+ * @param me      Pointer to the list_org to look in
+ * @param subset  NULL to look in all lists, or a sorted array of listids
+ * @param count   Number of listids in the subset
+ * @param ipaddr  The address to look for
+ * @param matches Array populated with the matching lists in listid order, each with the number of bits matched
+ *                (CIDR_MATCH_ALL for 0.0.0.0/0)
+ * @param max     Number of entries in matches
+ *
+ * @return The number of matches; if this is max, there may be more matching lists
+ */
+unsigned
+lists_org_match_cidrlists(const struct lists_org *me, const uint32_t *subset, unsigned count, struct netaddr *ipaddr,
+                          struct lists_org_match *matches, unsigned max)
+{
+    const struct preflist *list;
+    unsigned               i, match, n, slot;
+
+    SXEA1(!subset || count, "A subset can't be specified with a 0 count");
+
+    for (i = n = slot = 0; me && slot < me->count && n < max; slot++) {
+        list = &me->lists[slot];
+
+        if (list->elementtype != PREF_LIST_ELEMENTTYPE_CIDR)
+            continue;
+
+        if (subset) {    // Lists are in listid order, so the subset is intersected in a single merge
+            for (; i < count && subset[i] < list->id; i++)
+                ;
+
+            if (i == count)
+                break;
+
+            if (subset[i] != list->id)
+                continue;
+        }
+
+        if ((match = cidrlist_search(list->lp.cidrlist, ipaddr, NULL, NULL)))
+            n = lists_org_add_match(matches, n, list, NULL, match);
+    }
+
+    return n;
+}
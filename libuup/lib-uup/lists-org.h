@@ -11,15 +11,34 @@
 struct domainlist;
 struct urllist;
 
+struct lists_org_domain {
+    uint32_t key;                 // Offset of a lower cased, reversed domain in lists_org::keys
+    uint32_t slot;                // Slot of the domainlist in lists_org::lists
+};
+
 struct lists_org {
-    struct preflist    *lists;    // Array of preflists
-    unsigned            count;    // Number of preflists
-    struct conf_meta   *cm;
-    struct conf_segment cs;
+    struct preflist         *lists;           // Array of preflists
+    unsigned                 count;           // Number of preflists
+    struct lists_org_domain *domains;         // Union of the domainlists' domains, sorted by key and then slot
+    unsigned                 domain_count;    // Number of entries in domains
+    char                    *keys;            // Key store for domains
+    struct conf_meta        *cm;
+    struct conf_segment      cs;
+};
+
+struct lists_org_match {
+    uint32_t       listid;        // The listid of the matching list
+    const uint8_t *name;          // For domainlists, the part of the name that matched
+    unsigned       length;        // For urllists, the length of the URL matched; for cidrlists, the number of bits matched
+    uint8_t        bit;           // The list bit (0 if none)
 };
 
 struct conf_loader;
 
+#if defined(SXE_DEBUG) || defined(SXE_COVERAGE)    // Define unique tags for mockfails
+#   define LISTS_ORG_DOMAIN_INDEX ((const char *)lists_org_new + 1)
+#endif
+
 #include "lists-org-proto.h"
 
 #endif
@@ -12,16 +12,13 @@ struct lists_index {
 };
 
 struct lists {
-    struct conf        conf;
-    time_t             mtime;    // last modification
-    unsigned           count;    // # allocated lists_org entries
-    struct lists_org **orgs;     // a block of 'count' pointers to lists_orgs
+    struct conf               conf;
+    time_t                    mtime;    // last modification
+    struct conf_segment_table orgs;     // lists_orgs in org id order
 };
 
 #if defined(SXE_DEBUG) || defined(SXE_COVERAGE)    // Define unique tags for mockfails
 #   define LISTS_CLONE            ((const char *)lists_register + 0)
-#   define LISTS_CLONE_LISTS_ORGS ((const char *)lists_register + 1)
-#   define LISTS_MORE_LISTS_ORGS  ((const char *)lists_register + 2)
 #endif
 
 #endif
@@ -21,14 +21,9 @@ static void
 lists_free(struct conf *base)
 {
     struct lists *me = CONF2LISTS(base);
-    unsigned i;
 
     SXEA6(base->type == &lists_conf_type, "lists_free() with unexpected conf_type %s", base->type->name);
-
-    for (i = 0; i < me->count; i++)
-        lists_org_refcount_dec(me->orgs[i]);
-
-    kit_free(me->orgs);
+    conf_segment_table_fini(&me->orgs);
     kit_free(me);
 }
 
@@ -36,36 +31,21 @@ static struct conf *
 lists_clone(struct conf *obase)
 {
     struct lists *me, *ome;
-    unsigned i;
 
     if ((me = MOCKFAIL(LISTS_CLONE, NULL, kit_malloc(sizeof(*me)))) == NULL)
         SXEL2("Couldn't allocate a lists structure");
     else {
         conf_setup(&me->conf, &lists_conf_type);
-        me->count = 0;
         me->mtime = 0;
-        me->orgs  = NULL;
-        ome       = CONF2LISTS(obase);
-
-        if (ome && ome->count) {
-            me->count = (ome->count + 9) / 10 * 10;
-
-            if ((me->orgs = MOCKFAIL(LISTS_CLONE_LISTS_ORGS, NULL, kit_malloc(me->count * sizeof(*me->orgs)))) == NULL) {
-                SXEL2("Couldn't allocate %u new lists org slots", me->count);
-                kit_free(me);
-                me = NULL;
-            }
-            else {
-                me->count = ome->count;
-
-                for (i = 0; i < me->count; i++) {
-                    lists_org_refcount_inc(me->orgs[i] = ome->orgs[i]);
-
-                    if (me->mtime < me->orgs[i]->cs.mtime)
-                        me->mtime = me->orgs[i]->cs.mtime;
-                }
-            }
+
+        if ((ome = CONF2LISTS(obase)) == NULL)
+            conf_segment_table_init(&me->orgs, offsetof(struct lists_org, cs), lists_org_refcount_inc, lists_org_refcount_dec);
+        else if (!conf_segment_table_clone(&me->orgs, &ome->orgs)) {
+            kit_free(me);
+            me = NULL;
         }
+        else
+            me->mtime = conf_segment_table_mtime(&me->orgs);
     }
 
     return me ? &me->conf : NULL;
@@ -82,54 +62,49 @@ lists_settimeatleast(struct conf *base, time_t t)
     return me->mtime;
 }
 
-static unsigned
-lists_org_slot(struct lists_org *const *const me, uint32_t orgid, unsigned count)
-{
-    return conf_segment_slot((void *const *const)me, orgid, count, offsetof(struct lists_org, cs));
-}
-
 static unsigned
 lists_orgid2slot(const struct conf *base, uint32_t orgid)
 {
     const struct lists *me = CONSTCONF2LISTS(base);
 
-    return lists_org_slot(me->orgs, orgid, me->count);
+    return conf_segment_table_slot(&me->orgs, orgid);
 }
 
 static const struct conf_segment *
 lists_slot2segment(const struct conf *base, unsigned slot)
 {
-    const struct lists *me = CONSTCONF2LISTS(base);
+    const struct lists     *me  = CONSTCONF2LISTS(base);
+    const struct lists_org *org = conf_segment_table_get(&me->orgs, slot);
 
-    return slot < me->count ? &me->orgs[slot]->cs : NULL;
+    return org ? &org->cs : NULL;
 }
 
 static void
 lists_slotfailedload(struct conf *base, unsigned slot, bool value)
 {
-    struct lists *me = CONF2LISTS(base);
+    struct lists     *me = CONF2LISTS(base);
+    struct lists_org *org;
 
-    if (slot < me->count)
-        me->orgs[slot]->cs.failed_load = value;
+    if ((org = conf_segment_table_get(&me->orgs, slot)) != NULL)
+        org->cs.failed_load = value;
 }
 
 static bool
 lists_slotisempty(const struct conf *base, unsigned slot)
 {
-    const struct lists *me = CONSTCONF2LISTS(base);
+    const struct lists     *me  = CONSTCONF2LISTS(base);
+    const struct lists_org *org = conf_segment_table_get(&me->orgs, slot);
 
-    return slot >= me->count || (me->orgs[slot]->lists == NULL);
+    return org == NULL || (org->lists == NULL);
 }
 
-static void
+static bool
 lists_freeslot(struct conf *base, unsigned slot)
 {
     struct lists *me = CONF2LISTS(base);
 
-    SXEA1(slot < me->count, "Cannot free lists org slot %u (count %u)", slot, me->count);
-    lists_org_refcount_dec(me->orgs[slot]);
-    memmove(me->orgs + slot, me->orgs + slot + 1, (me->count - slot - 1) * sizeof(*me->orgs));
-    me->count--;
+    SXEA1(slot < me->orgs.count, "Cannot free lists org slot %u (count %u)", slot, me->orgs.count);
+    return conf_segment_table_remove(&me->orgs, slot);
 }
 
 static bool
@@ -137,40 +112,27 @@ lists_useorg(struct conf *base, void *vorg, unsigned slot, uint64_t *alloc)
 {
     struct lists     *me  = CONF2LISTS(base);
     struct lists_org *org = vorg;
-    struct lists_org **alp;
+    struct lists_org *oorg;
+    uint64_t          oalloc = 0;
 
-    SXEA6(slot <= me->count, "Oops, Insertion point is at pos %u of %u", slot, me->count);
+    SXEA6(slot <= me->orgs.count, "Oops, Insertion point is at pos %u of %u", slot, me->orgs.count);
 
-    if (!(me->count % 10)) {
-        if ((alp = MOCKFAIL(LISTS_MORE_LISTS_ORGS, NULL, kit_realloc(me->orgs, (me->count + 10) * sizeof(*me->orgs)))) == NULL) {
-            SXEL2("Couldn't reallocate %u lists org slots", me->count + 10);
+    if ((oorg = conf_segment_table_get(&me->orgs, slot)) != NULL && oorg->cs.id == org->cs.id) {
+        SXEL7("Existing lists slot %u already contains org id %" PRIu32, slot, org->cs.id);
+        oalloc = oorg->cs.alloc;
+
+        if (!conf_segment_table_replace(&me->orgs, slot, org))
             return false;
-        }
+    } else {
+        SXEA6(oorg == NULL || oorg->cs.id > org->cs.id, "Landed on unexpected orgid %" PRIu32 " when looking for org %" PRIu32,
+              oorg->cs.id, org->cs.id);
 
-        me->orgs = alp;
+        if (!conf_segment_table_insert(&me->orgs, slot, org))
+            return false;
     }
 
     lists_settimeatleast(base, org->cs.mtime);
-    *alloc += org->cs.alloc;
-
-    if (slot < me->count) {
-        SXEA6(me->orgs[slot]->cs.id >= org->cs.id, "Landed on unexpected orgid %" PRIu32 " when looking for org %" PRIu32,
-              me->orgs[slot]->cs.id, org->cs.id);
-
-        if (me->orgs[slot]->cs.id > org->cs.id) {
-            SXEL7("Existing slot %u orgid %" PRIu32 " exceeds lists id %" PRIu32, slot, me->orgs[slot]->cs.id,
-                  org->cs.id);
-            memmove(me->orgs + slot + 1, me->orgs + slot, (me->count - slot) * sizeof(*me->orgs));
-            me->count++;
-        } else {
-            SXEL7("Existing lists slot %u already contains org id %" PRIu32, slot, org->cs.id);
-            *alloc -= me->orgs[slot]->cs.alloc;
-            lists_org_refcount_dec(me->orgs[slot]);
-        }
-    } else
-        me->count++;
-
-    me->orgs[slot] = org;
+    *alloc += org->cs.alloc - oalloc;
     return true;
 }
 
@@ -179,7 +141,7 @@ lists_loaded(struct conf *base)
 {
     struct lists *me = CONF2LISTS(base);
 
-    if (me && me->count)
+    if (me && me->orgs.count)
         conf_report_load("lists", LISTS_VERSION);
 }
 
@@ -221,7 +183,5 @@ lists_conf_get(const struct confset *set, module_conf_t m)
 struct lists_org *
 lists_find_org(const struct lists *me, uint32_t orgid)
 {
-    unsigned slot = lists_org_slot(me->orgs, orgid, me->count);
-
-    return slot >= me->count || me->orgs[slot]->cs.id != orgid ? NULL : me->orgs[slot];
+    return conf_segment_table_find(&me->orgs, orgid);
 }
@@ -8,13 +8,22 @@
 #include "parseline.h"
 
 struct namelist_node {
-    struct namelist_node *next;
+    struct namelist_node *next;     /* All nodes, for freeing */
+    struct namelist_node *hnext;    /* Nodes in the same hash bucket */
     uint8_t name[];
 };
 
+/*
+ * Names are indexed by a hash of their first label, so a prefix match only compares the query name against the names
+ * that start with the same label as it does.  The root name is a prefix of every name, so it's noted separately.
+ */
 struct namelist {
     struct conf conf;
     struct namelist_node *first;
+    unsigned count;                 /* # nodes */
+    unsigned mask;                  /* # buckets - 1 */
+    struct namelist_node **bucket;  /* Nodes hashed by their first label, or NULL if there are none */
+    bool matchall;                  /* The list contains the root name */
 };
 
 #define CONSTCONF2NL(confp) (const struct namelist *)((confp) ? (const char *)(confp) - offsetof(struct namelist, conf) : NULL)
@@ -46,6 +55,45 @@ namelist_conf_get(const struct confset *set, module_conf_t m)
     return CONSTCONF2NL(base);
 }
 
+/* Case insensitive FNV-1a hash of the first label of a DNS name */
+static unsigned
+namelist_label_hash(const uint8_t *name)
+{
+    unsigned hash = 2166136261U, i;
+
+    for (i = 0; i <= *name; i++)
+        hash = (hash ^ dns_tolower[name[i]]) * 16777619U;
+
+    return hash;
+}
+
+static bool
+namelist_index(struct namelist *me)
+{
+    struct namelist_node *node;
+    unsigned buckets, slot;
+
+    for (buckets = 1; buckets < me->count; buckets <<= 1)
+        ;
+
+    if ((me->bucket = MOCKFAIL(NAMELIST_ALLOCATE_INDEX, NULL, kit_calloc(buckets, sizeof(*me->bucket)))) == NULL) {
+        SXEL2("Failed to allocate %u namelist index buckets", buckets);
+        return false;
+    }
+
+    me->mask = buckets - 1;
+    for (node = me->first; node; node = node->next)
+        if (*node->name == 0)
+            me->matchall = true;
+        else {
+            slot = namelist_label_hash(node->name) & me->mask;
+            node->hnext = me->bucket[slot];
+            me->bucket[slot] = node;
+        }
+
+    return true;
+}
+
 static struct conf *
 namelist_allocate(const struct conf_info *info, struct conf_loader *cl)
 {
@@ -64,6 +112,10 @@ namelist_allocate(const struct conf_info *info, struct conf_loader *cl)
 
     conf_setup(&me->conf, info->type);
     me->first = NULL;
+    me->count = 0;
+    me->mask = 0;
+    me->bucket = NULL;
+    me->matchall = false;
 
     while ((line = conf_loader_readline(cl)) != NULL) {
         name_len = sizeof(name);
@@ -80,9 +132,10 @@ namelist_allocate(const struct conf_info *info, struct conf_loader *cl)
         memcpy(node->name, name, name_len);
         node->next = me->first;
         me->first = node;
+        me->count++;
     }
 
-    if (conf_loader_eof(cl) && !conf_loader_err(cl))
+    if (conf_loader_eof(cl) && !conf_loader_err(cl) && (me->count == 0 || namelist_index(me)))
         return &me->conf;
 
 ERROR:                      /* COVERAGE EXCLUSION: Why gcov 7+ do we need this here???? */
@@ -103,6 +156,7 @@ namelist_free(struct conf *base)
             kit_free(me->first);
             me->first = next;
         }
+        kit_free(me->bucket);
         kit_free(me);
     }
 }
@@ -112,7 +166,13 @@ namelist_prefix_match(const struct namelist *me, const uint8_t *name)
 {
     const struct namelist_node *node;
 
-    for (node = me ? me->first : NULL; node; node = node->next)
+    if (me == NULL || me->bucket == NULL)
+        return false;
+
+    if (me->matchall)
+        return true;
+
+    for (node = me->bucket[namelist_label_hash(name) & me->mask]; node; node = node->hnext)
         if (dns_name_has_prefix(name, node->name))
             return true;
 
@@ -8,8 +8,9 @@ extern module_conf_t CONF_TYPO_EXCEPTION_PREFIXES;
 #include "namelist-proto.h"
 
 #if defined(SXE_DEBUG) || defined(SXE_COVERAGE)    // Define unique tags for mockfails
-#   define NAMELIST_ALLOCATE      ((const char *)namelist_register + 0)
-#   define NAMELIST_ALLOCATE_NODE ((const char *)namelist_register + 1)
+#   define NAMELIST_ALLOCATE       ((const char *)namelist_register + 0)
+#   define NAMELIST_ALLOCATE_NODE  ((const char *)namelist_register + 1)
+#   define NAMELIST_ALLOCATE_INDEX ((const char *)namelist_register + 2)
 #endif
 
 #endif
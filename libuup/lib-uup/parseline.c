@@ -5,6 +5,26 @@
 
 #include "parseline.h"
 
+/* The set of separator characters, built once per parseline() call rather than strchr()ing sep for every character */
+struct parseline_sepmap {
+    uint64_t bits[4];
+};
+
+static void
+parseline_sepmap_init(struct parseline_sepmap *map, const char *sep)
+{
+    map->bits[0] = map->bits[1] = map->bits[2] = map->bits[3] = 0;
+
+    for (; *sep; sep++)
+        map->bits[(uint8_t)*sep >> 6] |= 1ULL << ((uint8_t)*sep & 63);
+}
+
+static inline bool
+parseline_issep(const struct parseline_sepmap *map, char c)
+{
+    return map->bits[(uint8_t)c >> 6] >> ((uint8_t)c & 63) & 1;
+}
+
 bool
 word_match(const char *string, const char *word, size_t word_len)
 {
@@ -45,21 +65,23 @@ word_dup(const char *word, size_t word_len)
 int
 parseline(const char *line, const char **key, size_t *key_len, const char **value, size_t *value_len, const char *sep, bool multi)
 {
+    struct parseline_sepmap map;
     const char *end;
 
     *key = *value = NULL;
     *key_len = *value_len = 0;
+    parseline_sepmap_init(&map, sep);
 
     /* Find the start */
     if (multi)
-        while (*line && strchr(sep, *line))
+        while (parseline_issep(&map, *line))
             line++;
 
     /* Find the end */
     if ((end = strchr(line, '#')) == NULL)
         end = line + strlen(line);
     if (multi)
-        while (end > line && strchr(sep, end[-1]))
+        while (end > line && parseline_issep(&map, end[-1]))
             end--;
 
     if (line == end)
@@ -67,7 +89,7 @@ parseline(const char *line, const char **key, size_t *key_len, const char **valu
     *key = line;
 
     /* Advance to key's end */
-    while (line < end && !strchr(sep, *line))
+    while (line < end && !parseline_issep(&map, *line))
         line++;
     *key_len = line - *key;
     if (line == end)
@@ -75,7 +97,7 @@ parseline(const char *line, const char **key, size_t *key_len, const char **valu
 
     /* Advance to value's beginning */
     if (multi)
-        while (*line && strchr(sep, *line))
+        while (parseline_issep(&map, *line))
             line++;
     else
         line++;
@@ -84,3 +106,55 @@ parseline(const char *line, const char **key, size_t *key_len, const char **valu
 
     return 2;
 }
+
+/*
+ * Parse an unsigned decimal number at the start of 'str' into *value.
+ * - Unlike sscanf() and strtoul(), leading whitespace and signs are not accepted
+ * - Values too big for a uint64_t saturate at UINT64_MAX, so callers' range checks still catch them
+ * - Returns a pointer to the first character after the digits, or NULL if there are no digits
+ */
+const char *
+parse_uint(const char *str, uint64_t *value)
+{
+    const char *start = str;
+    uint64_t    val    = 0;
+    unsigned    digit;
+
+    for (; (digit = (uint8_t)*str - '0') < 10; str++)
+        val = val > (UINT64_MAX - digit) / 10 ? UINT64_MAX : val * 10 + digit;
+
+    if (str == start)
+        return NULL;
+
+    *value = val;
+    return str;
+}
+
+/*
+ * Parse an unsigned hexadecimal number (without a 0x prefix) at the start of 'str' into *value.
+ * - Returns a pointer to the first character after the digits, or NULL if there are no digits
+ */
+const char *
+parse_xuint(const char *str, uint64_t *value)
+{
+    const char *start = str;
+    uint64_t    val    = 0;
+    unsigned    digit;
+
+    for (;; str++) {
+        if ((digit = (uint8_t)*str - '0') >= 10) {
+            if ((digit = ((uint8_t)*str | 0x20) - 'a') >= 6)
+                break;
+
+            digit += 10;
+        }
+
+        val = val >> 60 ? UINT64_MAX : val << 4 | digit;
+    }
+
+    if (str == start)
+        return NULL;
+
+    *value = val;
+    return str;
+}
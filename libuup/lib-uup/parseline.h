@@ -2,6 +2,7 @@
 #define PARSELINE_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "parseline-proto.h"
@@ -1,4 +1,5 @@
 #include <kit-alloc.h>
+#include <mockfail.h>
 
 #if SXE_DEBUG
 #include <kit-bool.h>
@@ -233,6 +234,94 @@ preforg_get(const struct preforg *me, unsigned count, uint32_t id)
     return me ? kit_sortedarray_get(&preforg_element, me, count, &id) : NULL;
 }
 
+/*
+ * Keys for the prefblock hash tables.  The fields of each sorted array key are packed into a single integer.
+ */
+#define PREFLIST_HASHKEY(ltype, id, elementtype) ((uint64_t)(id) << 32 | (uint64_t)(ltype) << 24 | (uint64_t)(elementtype))
+#define PREFSETTINGGROUP_HASHKEY(idx, id)        ((uint64_t)(id) << 32 | (uint64_t)(idx))
+#define PREFBUNDLE_HASHKEY(actype, id)           ((uint64_t)(id) << 32 | (uint64_t)(actype))
+#define PREFORG_HASHKEY(id)                      ((uint64_t)(id))
+
+#define PREFHASH_SLOT(hash, key) ((unsigned)(((key) * 0x9E3779B97F4A7C15ULL) >> (hash)->shift))
+
+static uint64_t
+preflist_hashkey(const void *v)
+{
+    const struct preflist *list = v;
+
+    return PREFLIST_HASHKEY(PREFLIST_LTYPE(list), list->id, list->elementtype);
+}
+
+static uint64_t
+prefsettinggroup_hashkey(const void *v)
+{
+    const struct prefsettinggroup *settinggroup = v;
+
+    return PREFSETTINGGROUP_HASHKEY(settinggroup->idx, settinggroup->id);
+}
+
+static uint64_t
+prefbundle_hashkey(const void *v)
+{
+    const struct prefbundle *bundle = v;
+
+    return PREFBUNDLE_HASHKEY(bundle->actype, bundle->id);
+}
+
+static uint64_t
+preforg_hashkey(const void *v)
+{
+    return PREFORG_HASHKEY(((const struct preforg *)v)->id);
+}
+
+/*
+ * Build a hash table over a block of 'count' unique keys.  The table has at least twice as many slots as there are keys, so
+ * linear probe sequences are short.  If the table can't be allocated, lookups in the block fall back to binary searches.
+ */
+static void
+prefhash_build(struct prefhash *me, const void *block, size_t size, unsigned count, uint64_t (*hashkey)(const void *))
+{
+    unsigned bits, i, slot;
+
+    me->slot = NULL;
+
+    if (count == 0)
+        return;
+
+    for (bits = 1; (1ULL << bits) < 2ULL * count; bits++)
+        ;
+
+    if ((me->slot = MOCKFAIL(PREFHASH_BUILD, NULL, kit_calloc(1ULL << bits, sizeof(*me->slot)))) == NULL) {
+        SXEL3("Couldn't allocate a %u slot pref hash table; falling back to binary searches", 1U << bits);
+        return;
+    }
+
+    me->mask  = (1ULL << bits) - 1;
+    me->shift = 64 - bits;
+
+    for (i = 0; i < count; i++) {
+        for (slot = PREFHASH_SLOT(me, hashkey((const char *)block + i * size)); me->slot[slot]; slot = (slot + 1) & me->mask)
+            ;
+
+        me->slot[slot] = i + 1;
+    }
+}
+
+/**
+ * Build the direct lookup tables used by prefblock_list(), prefblock_settinggroup(), prefblock_bundle() and prefblock_org()
+ *
+ * @note Called by prefbuilder_consume() once the prefblock's sorted arrays are final
+ */
+void
+prefblock_hash(struct prefblock *me)
+{
+    prefhash_build(&me->hash.list, me->resource.list, sizeof(*me->resource.list), me->count.lists, preflist_hashkey);
+    prefhash_build(&me->hash.settinggroup, me->resource.settinggroup, sizeof(*me->resource.settinggroup),
+                   me->count.settinggroups, prefsettinggroup_hashkey);
+    prefhash_build(&me->hash.bundle, me->resource.bundle, sizeof(*me->resource.bundle), me->count.bundles, prefbundle_hashkey);
+    prefhash_build(&me->hash.org, me->resource.org, sizeof(*me->resource.org), me->count.orgs, preforg_hashkey);
+}
+
 static const char *pref_list_elementtype_names[] = PREF_LIST_ELEMENTTYPE_NAMES;
 
 /**
@@ -483,6 +572,11 @@ prefblock_free(struct prefblock *me)
         kit_free(me->resource.bundle);
         kit_free(me->resource.org);
         kit_free(me->identity);
+        kit_free(me->hash.list.slot);
+        kit_free(me->hash.settinggroup.slot);
+        kit_free(me->hash.bundle.slot);
+        kit_free(me->hash.org.slot);
+        kit_free(me->cooked);
         kit_free(me);
     }
 }
@@ -520,8 +614,11 @@ pref_domainlist_match(const pref_t *me, pref_categories_t *match, ltype_t ltype,
 
     for (i = 0; (list = PREF_DESTLIST(me, ltype, i)) != NULL; i++)
         if (list->elementtype == PREF_LIST_ELEMENTTYPE_DOMAIN && (!ret || !pref_categories_getbit(&cat, list->bit))) {
-            /* This list is of interest and the list type hasn't been matched yet */
-            snprintf(pname, sizeof(pname), "preflist %02X:%u:%s", ltype | PREF_BUNDLE(me)->actype, list->id, PREF_DESTLIST_NAME(me, ltype, i));
+            /* This list is of interest and the list type hasn't been matched yet; its name is only needed for tracing */
+            if (XRAY_WANTED(x, 6))
+                snprintf(pname, sizeof(pname), "preflist %02X:%u:%s", ltype | PREF_BUNDLE(me)->actype, list->id, PREF_DESTLIST_NAME(me, ltype, i));
+            else
+                pname[0] = '\0';
 
             if (domainlist_match(list->lp.domainlist, name, matchtype, x, pname)) {
                 pref_categories_setbit(&cat, list->bit);
@@ -537,8 +634,11 @@ pref_domainlist_match(const pref_t *me, pref_categories_t *match, ltype_t ltype,
             if (((list = prefblock_list(blk = me->parentblk, ltype, lid, PREF_LIST_ELEMENTTYPE_DOMAIN)) != NULL
               || (list = prefblock_list(blk = me->globalblk, ltype, lid, PREF_LIST_ELEMENTTYPE_DOMAIN)) != NULL)
              && list->elementtype == PREF_LIST_ELEMENTTYPE_DOMAIN && (!ret || !pref_categories_getbit(&cat, list->bit))) {
-                /* This list is of interest and the list type hasn't been matched yet */
-                snprintf(pname, sizeof(pname), "preflist %02X:%u:%s", ltype | PREF_BUNDLE(me)->actype, list->id, pref_list_elementtype_to_name(list->elementtype));
+                /* This list is of interest and the list type hasn't been matched yet; its name is only needed for tracing */
+                if (XRAY_WANTED(x, 6))
+                    snprintf(pname, sizeof(pname), "preflist %02X:%u:%s", ltype | PREF_BUNDLE(me)->actype, list->id, pref_list_elementtype_to_name(list->elementtype));
+                else
+                    pname[0] = '\0';
 
                 if (domainlist_match(list->lp.domainlist, name, matchtype, x, pname)) {
                     pref_categories_setbit(&cat, list->bit);
@@ -1143,58 +1243,142 @@ pref_sorted_list(const pref_t *pref, ltype_t ltype)
 const struct preflist *
 prefblock_list(const struct prefblock *me, ltype_t ltype, uint32_t id, elementtype_t elementtype)
 {
-    return me ? preflist_get(me->resource.list, me->count.lists, ltype, id, elementtype) : NULL;
+    const struct preflist *list;
+    unsigned slot;
+
+    if (!me || !me->hash.list.slot)
+        return me ? preflist_get(me->resource.list, me->count.lists, ltype, id, elementtype) : NULL;
+
+    if (!ltype_matches_elementtype(ltype, elementtype))
+        return NULL;
+
+    for (slot = PREFHASH_SLOT(&me->hash.list, PREFLIST_HASHKEY(ltype, id, elementtype)); me->hash.list.slot[slot];
+         slot = (slot + 1) & me->hash.list.mask) {
+        list = me->resource.list + me->hash.list.slot[slot] - 1;
+
+        if (list->id == id && list->ltype == ltype && list->elementtype == elementtype)
+            return list;
+    }
+
+    return NULL;
 }
 
 const struct prefsettinggroup *
 prefblock_settinggroup(const struct prefblock *me, settinggroup_idx_t idx, uint32_t id)
 {
-    return me ? prefsettinggroup_get(me->resource.settinggroup, me->count.settinggroups, idx, id) : NULL;
+    const struct prefsettinggroup *settinggroup;
+    unsigned slot;
+
+    if (!me || !me->hash.settinggroup.slot)
+        return me ? prefsettinggroup_get(me->resource.settinggroup, me->count.settinggroups, idx, id) : NULL;
+
+    for (slot = PREFHASH_SLOT(&me->hash.settinggroup, PREFSETTINGGROUP_HASHKEY(idx, id)); me->hash.settinggroup.slot[slot];
+         slot = (slot + 1) & me->hash.settinggroup.mask) {
+        settinggroup = me->resource.settinggroup + me->hash.settinggroup.slot[slot] - 1;
+
+        if (settinggroup->id == id && settinggroup->idx == idx)
+            return settinggroup;
+    }
+
+    return NULL;
+}
+
+/*
+ * Apply a bundle's settinggroups, found in its parent org's block or else in the global org's block, and the implicit policy
+ * category bits.
+ */
+static void
+pref_cook_bundle(struct prefcooked *cooked, const struct prefbundle *bundle, const struct prefblock *parentblk,
+                 const struct prefblock *globalblk)
+{
+    const struct prefsettinggroup *psg;
+    unsigned i;
+
+    cooked->bundleflags = bundle->bundleflags;
+    cooked->categories = bundle->base_blocked_categories;
+    cooked->nodecrypt_categories = bundle->base_nodecrypt_categories;
+    cooked->warn_categories = bundle->base_warn_categories;
+
+    for (i = 0; i < SETTINGGROUP_IDX_COUNT; i++) {
+        psg = NULL;
+
+        if (parentblk && bundle->sgids[i])
+            psg = prefblock_settinggroup(parentblk, i, bundle->sgids[i]);
+
+        if (!psg && globalblk && bundle->sgids[i])
+            psg = prefblock_settinggroup(globalblk, i, bundle->sgids[i]);
+
+        if (psg) {
+            cooked->bundleflags |= psg->bundleflags;
+            pref_categories_union(&cooked->categories, &cooked->categories, &psg->blocked_categories);
+            pref_categories_union(&cooked->nodecrypt_categories, &cooked->nodecrypt_categories, &psg->nodecrypt_categories);
+            pref_categories_union(&cooked->warn_categories, &cooked->warn_categories, &psg->warn_categories);
+        }
+    }
+
+    /* These bits are implicitly included in all policies - the "cooked" policy category bits */
+    pref_categories_setbit(&cooked->categories, CATEGORY_BIT_BLOCKLIST);
+    pref_categories_setbit(&cooked->categories, CATEGORY_BIT_ALLOWLIST);
+    pref_categories_setbit(&cooked->categories, CATEGORY_BIT_GLOBAL_ALLOWLIST);
+    pref_categories_setbit(&cooked->categories, CATEGORY_BIT_BLOCKAPP);
+    pref_categories_setbit(&cooked->categories, CATEGORY_BIT_ALLOWAPP);
+}
+
+/**
+ * Build the per bundle policies used by pref_cook() when a pref's parent and global org data are in its own block
+ *
+ * @note Called by prefbuilder_consume() after prefblock_hash(); prefblocks are immutable once built, so the policies are
+ *       replaced along with the block when its conf is reloaded.
+ */
+void
+prefblock_cook(struct prefblock *me)
+{
+    unsigned i;
+
+    me->cooked = NULL;
+
+    if (me->count.bundles == 0)
+        return;
+
+    if ((me->cooked = MOCKFAIL(PREFBLOCK_COOK, NULL, kit_malloc(me->count.bundles * sizeof(*me->cooked)))) == NULL) {
+        SXEL3("Couldn't allocate %u cooked pref bundles; prefs will be cooked per query", me->count.bundles);
+        return;
+    }
+
+    for (i = 0; i < me->count.bundles; i++)
+        pref_cook_bundle(me->cooked + i, me->resource.bundle + i, me, me);
 }
 
 void
 pref_cook(pref_t *me)
 {
-    const struct prefsettinggroup *psg;
     const struct prefbundle *bundle;
+    const struct prefcooked *cooked;
     const struct preforg *org;
-    unsigned i;
+    struct prefcooked local;
 
     SXEA6(PREF_VALID(me), "Invalid pref passed to pref_cook");
 
     if (me->cooked == PREF_COOK_RAW) {
         org = PREF_ORG(me);
         bundle = PREF_BUNDLE(me);
-        me->cooked_orgflags = org ? org->orgflags : 0;
-        me->cooked_bundleflags = bundle->bundleflags;
-        me->cooked_categories = bundle->base_blocked_categories;
-        me->cooked_nodecrypt_categories = bundle->base_nodecrypt_categories;
-        me->cooked_warn_categories = bundle->base_warn_categories;
 
-        for (i = 0; i < SETTINGGROUP_IDX_COUNT; i++) {
-            psg = NULL;
-
-            if (me->parentblk && bundle->sgids[i])
-                psg = prefblock_settinggroup(me->parentblk, i, bundle->sgids[i]);
-
-            if (!psg && me->globalblk && bundle->sgids[i])
-                psg = prefblock_settinggroup(me->globalblk, i, bundle->sgids[i]);
-
-            if (psg) {
-                me->cooked_bundleflags |= psg->bundleflags;
-                pref_categories_union(&me->cooked_categories, &me->cooked_categories, &psg->blocked_categories);
-                pref_categories_union(&me->cooked_nodecrypt_categories, &me->cooked_nodecrypt_categories, &psg->nodecrypt_categories);
-                pref_categories_union(&me->cooked_warn_categories, &me->cooked_warn_categories, &psg->warn_categories);
-            }
+        /* Settinggroups are looked up in the parent block and then the global block, so if both are this block (or absent) the
+         * prefblock's policy for the bundle is the answer.
+         */
+        if (me->blk->cooked && (me->parentblk || me->globalblk)
+         && (!me->parentblk || me->parentblk == me->blk) && (!me->globalblk || me->globalblk == me->blk))
+            cooked = me->blk->cooked + (bundle - me->blk->resource.bundle);
+        else {
+            pref_cook_bundle(&local, bundle, me->parentblk, me->globalblk);
+            cooked = &local;
         }
 
-        /* These bits are implicitly included in all policies - the "cooked" policy category bits */
-        pref_categories_setbit(&me->cooked_categories, CATEGORY_BIT_BLOCKLIST);
-        pref_categories_setbit(&me->cooked_categories, CATEGORY_BIT_ALLOWLIST);
-        pref_categories_setbit(&me->cooked_categories, CATEGORY_BIT_GLOBAL_ALLOWLIST);
-        pref_categories_setbit(&me->cooked_categories, CATEGORY_BIT_BLOCKAPP);
-        pref_categories_setbit(&me->cooked_categories, CATEGORY_BIT_ALLOWAPP);
-
+        me->cooked_orgflags = org ? org->orgflags : 0;
+        me->cooked_bundleflags = cooked->bundleflags;
+        me->cooked_categories = cooked->categories;
+        me->cooked_nodecrypt_categories = cooked->nodecrypt_categories;
+        me->cooked_warn_categories = cooked->warn_categories;
         me->cooked = PREF_COOK_SIMMER;
     }
 }
@@ -1268,13 +1452,40 @@ pref_cook_with_overloads(pref_t *me, const pref_t *listener_pref, pref_orgflags_
 const struct prefbundle *
 prefblock_bundle(const struct prefblock *me, actype_t actype, uint32_t id)
 {
-    return me ? prefbundle_get(me->resource.bundle, me->count.bundles, actype, id) : NULL;
+    const struct prefbundle *bundle;
+    unsigned slot;
+
+    if (!me || !me->hash.bundle.slot)
+        return me ? prefbundle_get(me->resource.bundle, me->count.bundles, actype, id) : NULL;
+
+    for (slot = PREFHASH_SLOT(&me->hash.bundle, PREFBUNDLE_HASHKEY(actype, id)); me->hash.bundle.slot[slot];
+         slot = (slot + 1) & me->hash.bundle.mask) {
+        bundle = me->resource.bundle + me->hash.bundle.slot[slot] - 1;
+
+        if (bundle->id == id && bundle->actype == actype)
+            return bundle;
+    }
+
+    return NULL;
 }
 
 const struct preforg *
 prefblock_org(const struct prefblock *me, uint32_t id)
 {
-    return me ? preforg_get(me->resource.org, me->count.orgs, id) : NULL;
+    const struct preforg *org;
+    unsigned slot;
+
+    if (!me || !me->hash.org.slot)
+        return me ? preforg_get(me->resource.org, me->count.orgs, id) : NULL;
+
+    for (slot = PREFHASH_SLOT(&me->hash.org, PREFORG_HASHKEY(id)); me->hash.org.slot[slot]; slot = (slot + 1) & me->hash.org.mask) {
+        org = me->resource.org + me->hash.org.slot[slot] - 1;
+
+        if (org->id == id)
+            return org;
+    }
+
+    return NULL;
 }
 
 unsigned
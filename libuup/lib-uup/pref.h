@@ -243,6 +243,19 @@ struct prefidentity {
     unsigned bundle;                  /* resource.bundle index */
 } __attribute__((__packed__));
 
+struct prefhash {
+    uint32_t *slot;                             /* 1 + the index of each entry in its block, or 0 for an empty slot */
+    uint32_t  mask;                             /* Number of slots - 1 */
+    unsigned  shift;                            /* 64 - log2(number of slots) */
+};
+
+struct prefcooked {
+    pref_bundleflags_t bundleflags;             /* Bundle flags with settinggroup flags applied */
+    pref_categories_t categories;               /* Blocked categories with settinggroups and implicit bits applied */
+    pref_categories_t nodecrypt_categories;
+    pref_categories_t warn_categories;
+};
+
 struct prefblock {
     struct {
         struct preflist *list;                  /* elements index into resource.names */
@@ -260,6 +273,13 @@ struct prefblock {
         unsigned identities;                    /* Number of identity entries */
     } count;
     struct prefidentity *identity;              /* Elements index into resource.org and resource.bundle */
+    struct {
+        struct prefhash list;
+        struct prefhash settinggroup;
+        struct prefhash bundle;
+        struct prefhash org;
+    } hash;                                     /* Direct lookup tables built by prefblock_hash(); NULL slots if not built */
+    struct prefcooked *cooked;                  /* Per bundle policies built by prefblock_cook(); NULL if not built */
 };
 
 enum pref_index_type {
@@ -322,6 +342,11 @@ struct listener;
 
 #include "pref-proto.h"
 
+#if defined(SXE_DEBUG) || defined(SXE_COVERAGE)    // Define unique tags for mockfails
+#   define PREFHASH_BUILD ((const char *)prefblock_hash + 0)
+#   define PREFBLOCK_COOK ((const char *)prefblock_cook + 0)
+#endif
+
 static inline const pref_categories_t *
 pref_categories(pref_t *me)
 {
@@ -573,6 +573,8 @@ prefbuilder_consume(struct prefbuilder *me)
     pb->count.identities = me->count;
     me->identity         = NULL;
 
+    prefblock_hash(pb);
+    prefblock_cook(pb);
     return pb;
 }
 
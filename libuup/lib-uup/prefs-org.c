@@ -3,10 +3,16 @@
 #include "atomic.h"
 #include "prefs-org.h"
 
+void
+prefs_org_table_init(struct conf_segment_table *orgs)
+{
+    conf_segment_table_init(orgs, offsetof(struct prefs_org, cs), prefs_org_refcount_inc, prefs_org_refcount_dec);
+}
+
 unsigned
-prefs_org_slot(struct prefs_org *const *const me, uint32_t id, unsigned count)
+prefs_org_slot(const struct conf_segment_table *orgs, uint32_t id)
 {
-    return conf_segment_slot((void *const *const)me, id, count, offsetof(struct prefs_org, cs));
+    return conf_segment_table_slot(orgs, id);
 }
 
 bool
@@ -25,7 +31,7 @@ prefs_org_refcount_dec(void *obj)
     struct prefs_org *me = obj;
 
     if (me && ATOMIC_DEC_INT_NV(&me->cs.refcount) == 0)
-        fileprefs_free(&me->fp);
+        me->fp.ops->free(&me->fp);
 }
 
 void
@@ -38,32 +44,33 @@ prefs_org_refcount_inc(void *obj)
 }
 
 /*
- * Insert or replace an org in the org array.
+ * Insert or replace an org in the org table
  */
 bool
-prefs_org_fill_slot(struct prefs_org *po, struct prefs_org **org, unsigned *count, unsigned slot, uint64_t *alloc)
+prefs_org_fill_slot(struct prefs_org *po, struct conf_segment_table *orgs, unsigned slot, uint64_t *alloc)
 {
-    *alloc += po->cs.alloc;
-    if (slot < *count) {
-        SXEA6(org[slot]->cs.id >= po->cs.id, "Landed on unexpected orgid %u when looking for org %u", org[slot]->cs.id, po->cs.id);
-        if (org[slot]->cs.id > po->cs.id) {
-            SXEL7("Existing org slot %u id %u exceeds preffile id %u", slot, org[slot]->cs.id, po->cs.id);
-            memmove(org + slot + 1, org + slot, (*count - slot) * sizeof(*org));
-            (*count)++;
-        } else {
-            /* Only replace an org if the new one doesn't indicate a failure */
-            if ((po->fp.loadflags & LOADFLAGS_FP_FAILED)) {
-                SXEL7("Not replacing existing org with a failed one in slot %u id %u", slot, po->cs.id);
-                return false;
-            }
+    struct prefs_org *opo = conf_segment_table_get(orgs, slot);
+    uint64_t oalloc;
 
-            /* Remove the previous org */
-            SXEL7("Existing org slot %u already contains id %u", slot, po->cs.id);
-            *alloc -= org[slot]->cs.alloc;
-            prefs_org_refcount_dec(org[slot]);
+    if (opo == NULL || opo->cs.id != po->cs.id) {
+        SXEA6(opo == NULL || opo->cs.id > po->cs.id, "Landed on unexpected orgid %u when looking for org %u", opo->cs.id, po->cs.id);
+        if (!conf_segment_table_insert(orgs, slot, po))
+            return false;
+    } else {
+        /* Only replace an org if the new one doesn't indicate a failure */
+        if ((po->fp.loadflags & LOADFLAGS_FP_FAILED)) {
+            SXEL7("Not replacing existing org with a failed one in slot %u id %u", slot, po->cs.id);
+            return false;
         }
-    } else
-        (*count)++;
-    org[slot] = po;
+
+        /* Replace the previous org */
+        SXEL7("Existing org slot %u already contains id %u", slot, po->cs.id);
+        oalloc = opo->cs.alloc;
+        if (!conf_segment_table_replace(orgs, slot, po))
+            return false;
+        *alloc -= oalloc;
+    }
+
+    *alloc += po->cs.alloc;
     return true;
 }
@@ -9,6 +9,8 @@ struct prefs_org {
     struct conf_segment cs;
 };
 
+#define PREFS_ORG_GET(orgs, slot) ((struct prefs_org *)conf_segment_table_get((orgs), (slot)))
+
 #include "prefs-org-proto.h"
 
 #endif
@@ -163,6 +163,34 @@ radixtree128_get(struct radixtree128 *me, const struct in6_addr *ip6addr)
     return value;
 }
 
+/**
+ * Find every struct cidr_ipv6 in the tree that contains an address
+ *
+ * @param found An array of at least RADIXTREE128_MAXDEPTH entries, populated least specific first
+ *
+ * @return The number of entries populated in found
+ */
+unsigned
+radixtree128_get_all(struct radixtree128 *me, const struct in6_addr *ip6addr, struct cidr_ipv6 **found)
+{
+    struct cidr_ipv6 addr = { *ip6addr, 128 };
+    unsigned n = 0;
+    int i;
+
+    while (me != NULL && cidr_ipv6_contains_net(&me->cidr, &addr)) {
+        if (me->value != NULL)
+            found[n++] = me->value;
+        i = CHILD_INDEX(addr, me->cidr.maskbits);
+        if (me->child_is_leaf[i]) {
+            if (cidr_ipv6_contains_net(me->c.child_as_leaf[i], &addr))
+                found[n++] = me->c.child_as_leaf[i];
+            break;
+        }
+        me = me->c.child[i];
+    }
+    return n;
+}
+
 void
 radixtree128_walk(struct radixtree128 *me, void (*callback)(struct cidr_ipv6 *cidr))
 {
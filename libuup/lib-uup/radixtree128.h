@@ -4,6 +4,8 @@
 struct radixtree128;
 struct cidr_ipv6;
 
+#define RADIXTREE128_MAXDEPTH 129    /* The most CIDRs that can contain a single address: /0 to /128 */
+
 #include "radixtree128-proto.h"
 
 #endif
@@ -145,6 +145,33 @@ radixtree32_get(struct radixtree32 *me, struct in_addr addr)
     return value;
 }
 
+/**
+ * Find every struct cidr_ipv4 in the tree that contains an address
+ *
+ * @param found An array of at least RADIXTREE32_MAXDEPTH entries, populated least specific first
+ *
+ * @return The number of entries populated in found
+ */
+unsigned
+radixtree32_get_all(struct radixtree32 *me, struct in_addr addr, struct cidr_ipv4 **found)
+{
+    unsigned n = 0;
+    int i;
+
+    while (me != NULL && CIDR_IPV4_CONTAINS_ADDR(&me->cidr, addr)) {
+        if (me->value != NULL)
+            found[n++] = me->value;
+        i = CHILD_INDEX(ntohl(addr.s_addr), me->cidr.mask);
+        if (me->child_is_leaf[i]) {
+            if (CIDR_IPV4_CONTAINS_ADDR(me->c.child_as_leaf[i], addr))
+                found[n++] = me->c.child_as_leaf[i];
+            break;
+        }
+        me = me->c.child[i];
+    }
+    return n;
+}
+
 void
 radixtree32_walk(struct radixtree32 *me, void (*callback)(struct cidr_ipv4 *cidr))
 {
@@ -5,6 +5,8 @@ struct radixtree32;
 struct cidr_ipv4;
 struct in_addr;
 
+#define RADIXTREE32_MAXDEPTH 33    /* The most CIDRs that can contain a single address: /0 to /32 */
+
 #include "radixtree32-proto.h"
 
 #endif
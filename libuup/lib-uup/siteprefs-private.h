@@ -4,9 +4,16 @@
 #include "fileprefs.h"
 #include "siteprefs.h"
 
+struct siteprefs_index;
+
 struct siteprefs {
     struct fileprefs fp;
     struct conf conf;
+    struct siteprefs_index *index;    /* Per type/asset radix trees; NULL if they couldn't be built */
 };
 
+#if defined(SXE_DEBUG) || defined(SXE_COVERAGE)    // Define unique tags for mockfails
+#   define SITEPREFS_INDEX ((const char *)siteprefs_new + 0)
+#endif
+
 #endif
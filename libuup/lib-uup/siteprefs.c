@@ -14,10 +14,15 @@
 #include <kit.h>
 #endif
 
+#include <kit-alloc.h>
+#include <mockfail.h>
+
 #include "cidr-ipv4.h"
 #include "cidr-ipv6.h"
 #include "odns.h"
 #include "oolist.h"
+#include "radixtree128.h"
+#include "radixtree32.h"
 #include "siteprefs-private.h"
 #include "unaligned.h"
 #include "xray.h"
@@ -63,12 +68,34 @@ struct siteprefs_key {
  *
  * keysz is set to sizeof(struct siteprefs_key).
  *
- * Searches are performed using bsearch() to locate a random
- * record that matches the desired VA.  We then interate
- * backwards and forwards through those records to locate the
- * relevant matches.
+ * The keys are grouped by type and asset (or orgid and asset type),
+ * and each group gets a radixtree32 and a radixtree128 holding its
+ * CIDRs.  Searches locate the group with a binary search and then
+ * walk the trees to find every CIDR containing the address, so the
+ * cost doesn't depend on how many CIDRs the group has.  If the trees
+ * can't be built, kit_sortedarray_find() is used to locate the
+ * search key's position and we iterate backwards through the group's
+ * records to locate the relevant matches.
  */
 
+struct siteprefs_group {
+    unsigned             first;    /* Index of the group's first key */
+    unsigned             count;    /* Number of keys in the group */
+    struct radixtree32  *v4;
+    struct radixtree128 *v6;
+};
+
+union siteprefs_cidr {             /* Aligned copies of the (packed) key CIDRs - these are what the radix trees point to */
+    struct cidr_ipv4 v4;
+    struct cidr_ipv6 v6;
+};
+
+struct siteprefs_index {
+    unsigned                groups;
+    struct siteprefs_group *group;
+    union siteprefs_cidr   *cidr;  /* One per key, so that a radix tree entry's offset in the array is its key index */
+};
+
 #define SITEPREFS_KEYS(me)         ((struct siteprefs_key *)(me)->fp.keys)
 #define SITEPREFS_KEY(me, i)       ((struct siteprefs_key *)(me)->fp.keys + (i))
 #define KEY_MASKBITS_V4            255
@@ -242,15 +269,155 @@ siteprefs_matched(const struct siteprefs *me, uint8_t type, int item, pref_t *pr
     return false;
 }
 
+static void
+siteprefs_index_free(struct siteprefs_index *index)
+{
+    unsigned g;
+
+    if (index) {
+        for (g = 0; g < index->groups; g++) {
+            radixtree32_delete(index->group[g].v4);
+            radixtree128_delete(index->group[g].v6);
+        }
+
+        kit_free(index);
+    }
+}
+
+static struct siteprefs_index *
+siteprefs_index_new(const struct siteprefs *me)
+{
+    struct siteprefs_group *group = NULL;
+    const struct siteprefs_key *key;
+    struct siteprefs_index *index;
+    unsigned count, groups, i;
+    size_t sz;
+
+    count = PREFS_COUNT(me, identities);
+
+    for (groups = i = 0; i < count; i++)
+        if (i == 0 || siteprefs_key_fields_compare(SITEPREFS_KEY(me, i - 1), SITEPREFS_KEY(me, i)) != 0)
+            groups++;
+
+    sz = sizeof(*index) + groups * sizeof(*index->group) + count * sizeof(*index->cidr);
+    if ((index = MOCKFAIL(SITEPREFS_INDEX, NULL, kit_calloc(1, sz))) == NULL) {
+        SXEL2("Couldn't allocate %zu bytes for a siteprefs index", sz);
+        return NULL;
+    }
+
+    index->group = (struct siteprefs_group *)(index + 1);
+    index->cidr  = (union siteprefs_cidr *)(index->group + groups);
+
+    for (i = 0; i < count; i++) {
+        key = SITEPREFS_KEY(me, i);
+
+        if (i == 0 || siteprefs_key_fields_compare(key - 1, key) != 0) {
+            group = index->group + index->groups++;
+            group->first = i;
+        }
+
+        group->count++;
+
+        if (KEY_IS_V4(key)) {
+            index->cidr[i].v4 = key->cidr4;
+
+            if ((group->v4 == NULL && (group->v4 = radixtree32_new()) == NULL) || !radixtree32_put(group->v4, &index->cidr[i].v4))
+                goto ERROR;
+        } else {
+            index->cidr[i].v6 = key->cidr6;
+
+            if ((group->v6 == NULL && (group->v6 = radixtree128_new()) == NULL) || !radixtree128_put(group->v6, &index->cidr[i].v6))
+                goto ERROR;
+        }
+    }
+
+    return index;
+
+ERROR:
+    SXEL2("Couldn't populate a siteprefs index of %u keys", count);
+    siteprefs_index_free(index);
+    return NULL;
+}
+
+static const struct siteprefs_group *
+siteprefs_index_group(const struct siteprefs *me, const struct siteprefs_key *key)
+{
+    const struct siteprefs_index *index = me->index;
+    unsigned lo, hi, mid;
+    int cmp;
+
+    for (lo = 0, hi = index->groups; lo < hi;) {
+        mid = (lo + hi) / 2;
+
+        if ((cmp = siteprefs_key_fields_compare(key, SITEPREFS_KEY(me, index->group[mid].first))) == 0)
+            return index->group + mid;
+
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return NULL;
+}
+
+/* Match every key with the same type/asset as the search key whose CIDR contains it, most specific first.
+ * Returns true if any of them was a better match than the pref passed in.
+ */
+static bool
+siteprefs_match_containing(const struct siteprefs *me, const struct siteprefs_key *key, pref_t *pref,
+                           struct oolist **other_origins, struct xray *x)
+{
+    struct cidr_ipv6 *found6[RADIXTREE128_MAXDEPTH];
+    struct cidr_ipv4 *found4[RADIXTREE32_MAXDEPTH];
+    const struct siteprefs_group *group;
+    struct in_addr addr;
+    bool matched_key;
+    unsigned found;
+    int item;
+
+    matched_key = false;
+
+    if (me->index) {
+        if ((group = siteprefs_index_group(me, key)) == NULL)
+            return false;
+
+        if (KEY_IS_V4(key)) {
+            addr.s_addr = htonl(key->cidr4.addr);
+            for (found = radixtree32_get_all(group->v4, addr, found4); found--;)
+                if (siteprefs_matched(me, key->type, (union siteprefs_cidr *)found4[found] - me->index->cidr, pref, other_origins, x))
+                    matched_key = true;
+        } else
+            for (found = radixtree128_get_all(group->v6, &key->cidr6.addr, found6); found--;)
+                if (siteprefs_matched(me, key->type, (union siteprefs_cidr *)found6[found] - me->index->cidr, pref, other_origins, x))
+                    matched_key = true;
+
+        return matched_key;
+    }
+
+    /* Find the exact match (unlikely) or the first key that is greater than the one we're looking up.
+     */
+    found = kit_sortedarray_find(&siteprefs_key_class, me->fp.keys, PREFS_COUNT(me, identities), key, &matched_key);
+
+    if (matched_key)    // Jackpot: There's a cidr whose key is an exact match
+        siteprefs_matched(me, key->type, found, pref, other_origins, x);
+
+    /* While there is a key less than or equal to the search key whose type/asset matches
+     */
+    for (item = found - 1; item >= 0 && siteprefs_key_fields_compare(SITEPREFS_KEY(me, item), key) == 0; item--)
+        if (siteprefs_key_cidr_contains(SITEPREFS_KEY(me, item), key))   // If the CIDR contains the key
+            if (siteprefs_matched(me, key->type, item, pref, other_origins, x))
+                matched_key = true;
+
+    return matched_key;
+}
+
 /* Lookup a preference based on the IDs passed along from the forwarder.
  */
 bool
 siteprefs_get(pref_t *pref, const struct siteprefs *me, struct odns *odns, struct oolist **other_origins, struct xray *x)
 {
     struct siteprefs_key     key;
-    unsigned                 found;
-    int                      item;
-    bool                     matched_key;
 
     SXEE7("(pref=?,me=%p,odns={%s},other_origins=%p,x=?)", me, odns ? odns_content(odns) : "NULL", *other_origins);
     pref_fini(pref);
@@ -270,21 +437,7 @@ siteprefs_get(pref_t *pref, const struct siteprefs *me, struct odns *odns, struc
             key.cidr6.maskbits = 128;
         }
 
-        /* Find the exact match (unlikely) or the first key that is greater than the one we're looking up.
-         */
-        found = kit_sortedarray_find(&siteprefs_key_class, me->fp.keys, PREFS_COUNT(me, identities), &key, &matched_key);
-
-        if (matched_key)    // Jackpot: There's a cidr whose key is an exact match
-            siteprefs_matched(me, key.type, found, pref, other_origins, x);
-
-        /* While there is a key less than or equal to the search key whose type/asset matches
-         */
-        for (item = found - 1; item >= 0 && siteprefs_key_fields_compare(SITEPREFS_KEY(me, item), &key) == 0; item--)
-            if (siteprefs_key_cidr_contains(SITEPREFS_KEY(me, item), &key))   // If the CIDR contains the key
-                if (siteprefs_matched(me, key.type, item, pref, other_origins, x))
-                    matched_key = true;
-
-        if (!matched_key) {
+        if (!siteprefs_match_containing(me, &key, pref, other_origins, x)) {
             SXEL7(": debug: va %u with cidr %s doesn't match", odns->va_id, siteprefs_key_cidr_to_str(&key));
             goto OUT;
         }
@@ -295,18 +448,7 @@ siteprefs_get(pref_t *pref, const struct siteprefs *me, struct odns *odns, struc
         unaligned_htonl(&key.orgid, PREF_ORG(pref) ? PREF_ORG(pref)->id : 0);
         unaligned_htonl(&key.asset_type, PREF_IDENT(pref)->origintypeid);
 
-        /* Find the exact match (unlikely) or the first key that is greater than the one we're looking up.
-         */
-        found = kit_sortedarray_find(&siteprefs_key_class, me->fp.keys, PREFS_COUNT(me, identities), &key, &matched_key);
-
-        if (matched_key)    // Jackpot: There's a cidr whose key is an exact match
-            siteprefs_matched(me, key.type, found, pref, other_origins, x);
-
-        /* While there is a key less than or equal to the search key whose type/asset matches
-         */
-        for (item = found - 1; item >= 0 && siteprefs_key_fields_compare(SITEPREFS_KEY(me, item), &key) == 0; item--)
-            if (siteprefs_key_cidr_contains(SITEPREFS_KEY(me, item), &key))    // If the CIDR contains the key
-                siteprefs_matched(me, key.type, item, pref, other_origins, x);
+        siteprefs_match_containing(me, &key, pref, other_origins, x);
     }
 
 OUT:
@@ -430,8 +572,10 @@ siteprefs_new(struct conf_loader *cl, unsigned loadflags)
 {
     struct siteprefs *me;
 
-    if ((me = (struct siteprefs *)fileprefs_new(cl, &siteprefs_ops, sizeof(*me), loadflags)) != NULL)
+    if ((me = (struct siteprefs *)fileprefs_new(cl, &siteprefs_ops, sizeof(*me), loadflags)) != NULL) {
         conf_setup(&me->conf, &siteprefsct);
+        me->index = siteprefs_index_new(me);    /* On failure, lookups fall back to scanning the sorted keys */
+    }
 
     return me;
 }
@@ -441,6 +585,7 @@ siteprefs_free(struct conf *base)
 {
     struct siteprefs *me = CONF2SITEPREFS(base);
 
+    siteprefs_index_free(me->index);
     fileprefs_free(&me->fp);
 }
 
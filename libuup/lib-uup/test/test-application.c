@@ -51,7 +51,7 @@ main(void)
     struct conf_info *info;
     struct conf_loader cl;
     char content[4][4096];
-    unsigned expect, r, z;
+    unsigned expect, r, z, n;
     int gen, lines;
     bool ret;
 
@@ -64,7 +64,7 @@ main(void)
         { "application_register", application_register, false },
     };
 
-    plan_tests(426);
+    plan_tests(430);
 
 #ifdef __FreeBSD__
     plan_skip_all("DPT-186 - Need to implement inotify as dtrace event");
@@ -458,11 +458,11 @@ main(void)
             OK_SXEL_ERROR("test-al-4: 4: Cannot allocate 4 name bytes");
             MOCKFAIL_END_TESTS();
 
-            MOCKFAIL_START_TESTS(3, APPLICATION_CLONE_DOMAINLISTS);
+            MOCKFAIL_START_TESTS(3, CONF_SEGMENT_TABLE_CLONE);
             strcat(content[3], "# kick\n");
             create_atomic_file("test-al-4", "%s", content[3]);
             ok(!confset_load(NULL), "Didn't see test-al-4 turn up when application-lists clone fails");
-            OK_SXEL_ERROR("Couldn't allocate 10 new application domainlist slots");
+            OK_SXEL_ERROR("Couldn't allocate 16 segment table chunk references");
             OK_SXEL_ERROR("Couldn't clone a application conf object");
             MOCKFAIL_END_TESTS();
 
@@ -480,10 +480,10 @@ main(void)
             ok(confset_load(NULL), "Noted an update to test-al-4");
 
             ok(set = confset_acquire(&gen), "Acquired the new config");
-            skip_if(set == NULL, 58, "Cannot check content without acquiring config") {
+            skip_if(set == NULL, 60, "Cannot check content without acquiring config") {
                 app = application_conf_get(set, CONF_APPLICATION);
                 ok(app, "Constructed an application from segmented V%u data", APPLICATION_VERSION);
-                skip_if(app == NULL, 53, "Cannot check app") {
+                skip_if(app == NULL, 55, "Cannot check app") {
                     is(app->count, 5, "V%u data has a count of 5 lists", APPLICATION_VERSION);
                     is(app->conf.refcount, 2, "V%u data has a refcount of 2", APPLICATION_VERSION);
 
@@ -491,7 +491,7 @@ main(void)
                     is(app->dindex.count, expect, "application domain super-index has %u entries (registered with %s())", expect, app_reg[r].name);
 
                     is(app->pindex.count, 0, "application proxy super-index has 0 entries (not 2)");
-                    skip_if(app->count != 5, 48, "Cannot verify list counts") {
+                    skip_if(app->count != 5, 50, "Cannot verify list counts") {
                         is(app->al[0]->cs.id, 1, "V%u domainlist in slot 0 is id 1", APPLICATION_VERSION);
                         expect = app_reg[r].reg == application_register ? app->al[0]->dl != 0 : app->al[0]->dl == 0;
                         ok(expect, "V%u domainlist in slot 0 is %sset", APPLICATION_VERSION, expect ? "" : "not ");
@@ -535,6 +535,13 @@ main(void)
                         ret = application_match_domain(app, (const uint8_t *)"\3ten\3bob\3net", NULL, "app");
                         expect = app_reg[r].reg == application_register ? 1 : 0;
                         is(ret, expect, "application %s subdomain ten.bob.com", expect ? "contains" : "doesn't contain");
+                        ret = application_match_domain(app, (const uint8_t *)"\4MAIL\3BoB\3Com", NULL, "app");
+                        expect = app_reg[r].reg == application_register ? 1 : 0;
+                        is(ret, expect, "application %s subdomain MAIL.BoB.Com (case insensitive)", expect ? "contains" : "doesn't contain");
+                        for (expect = 1, n = 1; n < app->dindex.count; n++)
+                            expect = expect && app->dindex.ref[n - 1].key < app->dindex.ref[n].key
+                                  && strcmp(app->keys + app->dindex.ref[n - 1].key, app->keys + app->dindex.ref[n].key) < 0;
+                        ok(expect, "The super-domain-index keys are stored in sorted order");
                         diag("The proxy needs to search a pref_t for application matches");
                         {
                             pref_categories_t cat;
@@ -704,9 +711,9 @@ main(void)
 
             create_atomic_file("test-al-10", "domainlist 1\ncount 0");
 
-            MOCKFAIL_START_TESTS(2, APPLICATION_MOREDOMAINLISTS);
-            ok(!confset_load(NULL), "Cannot load confset when allocating more application domainlists fails");
-            OK_SXEL_ERROR("Couldn't reallocate 20 application domainlist slots");
+            MOCKFAIL_START_TESTS(2, CONF_SEGMENT_TABLE_CHUNK);
+            ok(!confset_load(NULL), "Cannot load confset when copying an application domainlist table chunk fails");
+            OK_SXEL_ERROR("Couldn't allocate a segment table chunk");
             MOCKFAIL_END_TESTS();
 
             create_atomic_file("test-al-10", "domainlist 1\ncount 0\n#changed\n");
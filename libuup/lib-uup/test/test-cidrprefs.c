@@ -62,9 +62,11 @@ main(void)
     struct prefs_org *cidrprefs_org;
     uint64_t start_allocations;
     struct conf_loader cl;
+    char cmd[256];
+    time_t digest_time;
     const char *fn;
 
-    plan_tests(115);
+    plan_tests(123);
 #ifdef __FreeBSD__
     plan_skip_all("DPT-186 - Need to implement inotify as dtrace event");
     exit(0);
@@ -262,7 +264,12 @@ main(void)
         digest_store_set_options(TEST_DIGEST_STORE, DIGEST_STORE_DEFAULT_UPDATE_FREQ, DIGEST_STORE_DEFAULT_MAXIMUM_AGE);
 
         ok(set = confset_acquire(&gen), "Acquired the conf set");
+
+        /* Verify that digests are still written when they can't be cached */
+        MOCKFAIL_START_TESTS(1, DIGEST_STORE_TEXT);
         digest_store_changed(set);
+        OK_SXEL_ERROR("Couldn't allocate 256 bytes of digest text for cidrprefs");
+        MOCKFAIL_END_TESTS();
         last_timestamp = time(NULL);
         confset_release(set);
 
@@ -302,16 +309,16 @@ main(void)
 
             ok(set = confset_acquire(&gen), "Reacquired the new config set");
             ok(cidrprefs = cidrprefs_conf_get(set, CONF_CIDRPREFS), "Got cidrprefs");
-            is(cidrprefs->count, 4, "cidrprefs contains 4 orgs");
-            skip_if(cidrprefs->count != 4, 7, "Cannot verify orgs") {
-                is(cidrprefs->org[0]->cs.id, 1, "Org 1 is present");
-                is(cidrprefs->org[1]->cs.id, 2, "Org 2 is present");
-                is(cidrprefs->org[2]->cs.id, 4, "Org 4 is present");
-                is(cidrprefs->org[3]->cs.id, 2748, "Org 2748 is present");
-
-                ok(!cidrprefs->org[1]->cs.loaded, "Org 2 shows it was not loaded");
-                ok(cidrprefs->org[1]->cs.failed_load, "Org 2 shows a failed load");
-                is(prefblock_count_total(cidrprefs->org[2]->fp.values), 0, "Org 4 is empty");
+            is(cidrprefs->org.count, 4, "cidrprefs contains 4 orgs");
+            skip_if(cidrprefs->org.count != 4, 7, "Cannot verify orgs") {
+                is(PREFS_ORG_GET(&cidrprefs->org, 0)->cs.id, 1, "Org 1 is present");
+                is(PREFS_ORG_GET(&cidrprefs->org, 1)->cs.id, 2, "Org 2 is present");
+                is(PREFS_ORG_GET(&cidrprefs->org, 2)->cs.id, 4, "Org 4 is present");
+                is(PREFS_ORG_GET(&cidrprefs->org, 3)->cs.id, 2748, "Org 2748 is present");
+
+                ok(!PREFS_ORG_GET(&cidrprefs->org, 1)->cs.loaded, "Org 2 shows it was not loaded");
+                ok(PREFS_ORG_GET(&cidrprefs->org, 1)->cs.failed_load, "Org 2 shows a failed load");
+                is(prefblock_count_total(PREFS_ORG_GET(&cidrprefs->org, 2)->fp.values), 0, "Org 4 is empty");
             }
             confset_release(set);
         }
@@ -320,10 +327,10 @@ main(void)
         OK_SXEL_ERROR("fileprefs_new(): cidrprefs v%d: ./test-cidrprefs-4: 5: Incorrect total count 1 - read 0 data lines", CIDRPREFS_VERSION);
         OK_SXEL_ERROR(NULL);
         /* Verify the handling of out-of-memory trying to malloc a cidrprefs-org on reload */
-        MOCKFAIL_START_TESTS(4, CIDRPREFS_CLONE_ORGS);
+        MOCKFAIL_START_TESTS(4, CONF_SEGMENT_TABLE_CLONE);
         create_atomic_file("test-cidrprefs-3", "we'll never even get to see this data");
         ok(!confset_load(NULL), "Didn't see a change to test-cidrprefs-3 due to a cidrprefs-org slot allocation failure");
-        OK_SXEL_ERROR("Couldn't allocate 10 new cidrprefs org slots");
+        OK_SXEL_ERROR("Couldn't allocate 16 segment table chunk references");
         OK_SXEL_ERROR("Couldn't clone a cidrprefs conf object");
         OK_SXEL_ERROR(NULL);
         MOCKFAIL_END_TESTS();
@@ -335,13 +342,28 @@ main(void)
         ok(confset_load(NULL), "Noted an update to test-cidrprefs-[345]");
 
         create_atomic_file("test-cidrprefs-4", "%s", content[3]);
-        ok(confset_load(NULL), "Noted an update after test-cidrprefs-4 was rewritten");
+        ok(!confset_load(NULL), "Noted no update after test-cidrprefs-4 was rewritten with the same content");
 
         ok(set = confset_acquire(&gen), "Acquired the new config");
         wait_next_sec();
         digest_store_changed(set);
         is(system("ls " TEST_DIGEST_STORE), 0, "Listed %s/", TEST_DIGEST_STORE);
 
+        /* Verify that an unchanged conf set's digests are written from the cached listings */
+        digest_store_set_options(TEST_DIGEST_STORE, 0, DIGEST_STORE_DEFAULT_MAXIMUM_AGE);
+        wait_next_sec();
+        digest_store_changed(set);
+        digest_time = time(NULL);
+        wait_next_sec();
+        MOCKFAIL_START_TESTS(2, DIGEST_STORE_TEXT);
+        digest_store_changed(set);
+        OK_SXEL_ERROR(NULL);    /* No digest text was reformatted */
+        snprintf(cmd, sizeof(cmd), "cmp -s %s/%lu %s/%lu", TEST_DIGEST_STORE, (unsigned long)digest_time, TEST_DIGEST_STORE,
+                 (unsigned long)time(NULL));
+        is(system(cmd), 0, "The cached digests match the ones first written");
+        MOCKFAIL_END_TESTS();
+        digest_store_set_options(TEST_DIGEST_STORE, DIGEST_STORE_DEFAULT_UPDATE_FREQ, DIGEST_STORE_DEFAULT_MAXIMUM_AGE);
+
         ok(cidrprefs = cidrprefs_conf_get(set, CONF_CIDRPREFS), "Got the cidrprefs");
 
         skip_if(!cidrprefs, 7, "Cannot run these tests without cidrprefs") {
@@ -473,8 +495,8 @@ main(void)
         confset_release(set);
 
         OK_SXEL_ERROR(NULL);
-        /* Verify the handling of out-of-memory trying to realloc cidrprefs-org slots on reload (realloced every 10+ slots) */
-        MOCKFAIL_START_TESTS(6, CIDRPREFS_MOREORGS);
+        /* Verify the handling of out-of-memory trying to copy cidrprefs-org table chunks on reload */
+        MOCKFAIL_START_TESTS(11, CONF_SEGMENT_TABLE_CHUNK);
         snprintf(content[0], sizeof(content[0]), "cidrprefs %u\ncount 0\n# Different\n", CIDRPREFS_VERSION);
 
         /* Was 106-110 in dirprefs, but bumped up due to eliminating other tests. Also, reverse order to exercise index code */
@@ -483,13 +505,10 @@ main(void)
             create_atomic_file(buf, "%s", content[0]);
         }
 
-        /* Verify that not all 10 orgs were added */
-        ok(!confset_load(NULL) || 1, "Shouldn't see changes to all of test-cidrprefs-106 - test-cidrprefs-115 due to a cidrprefs-org slot re-allocation failure");
-        OK_SXEL_ERROR("Couldn't reallocate 20 cidrprefs org slots");
-        OK_SXEL_ERROR("Couldn't reallocate 20 cidrprefs org slots");
-        OK_SXEL_ERROR("Couldn't reallocate 20 cidrprefs org slots");
-        OK_SXEL_ERROR("Couldn't reallocate 20 cidrprefs org slots");
-        OK_SXEL_ERROR("Couldn't reallocate 20 cidrprefs org slots");
+        /* Verify that none of the 10 orgs were added */
+        ok(!confset_load(NULL), "Didn't see changes to test-cidrprefs-106 - test-cidrprefs-115 due to a cidrprefs-org chunk allocation failure");
+        for (orgid = 106; orgid <= 115; orgid++)
+            OK_SXEL_ERROR("Couldn't allocate a segment table chunk");
         MOCKFAIL_END_TESTS();
     }
 
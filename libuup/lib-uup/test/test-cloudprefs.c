@@ -108,10 +108,10 @@ main(void)
 
         ok(confset_load(NULL), "Noted an update to test-cloudprefs-2133813");
         create_atomic_file("test-cloudprefs-2133813", "we'll never even get to see this data");
-        MOCKFAIL_START_TESTS(3, CLOUDPREFS_CLONE_ORGS);
+        MOCKFAIL_START_TESTS(3, CONF_SEGMENT_TABLE_CLONE);
         ok(!confset_load(NULL), "Didn't see a change to test-cloudprefs-2133813 due to a cloudprefs-origin slot allocation failure");
 
-        OK_SXEL_ERROR("Couldn't allocate 10 new cloudprefs org slots");
+        OK_SXEL_ERROR("Couldn't allocate 16 segment table chunk references");
         OK_SXEL_ERROR("Couldn't clone a cloudprefs conf object");
         MOCKFAIL_END_TESTS();
         unlink("test-cloudprefs-2133813");
@@ -123,14 +123,14 @@ main(void)
         }
         ok(confset_load(NULL), "Loaded test-cloudprefs-100 - test-cloudprefs-109");
 
-        MOCKFAIL_START_TESTS(11, CLOUDPREFS_MOREORGS);
+        MOCKFAIL_START_TESTS(11, CONF_SEGMENT_TABLE_CHUNK);
         for (; origin_id < 120; origin_id++) {
             snprintf(buf, sizeof(buf), "test-cloudprefs-%u", origin_id);
             create_atomic_file(buf, "%s", content);
         }
-        ok(!confset_load(NULL), "Didn't see a change to test-cloudprefs-110 - test-cloudprefs-119 due to a cloudprefs-origin slot re-allocation failure");
+        ok(!confset_load(NULL), "Didn't see a change to test-cloudprefs-110 - test-cloudprefs-119 due to a cloudprefs-origin chunk allocation failure");
         for (int i = 0; i < 10; i++)
-            OK_SXEL_ERROR("Couldn't reallocate 20 cloudprefs org slots");
+            OK_SXEL_ERROR("Couldn't allocate a segment table chunk");
         MOCKFAIL_END_TESTS();
 
         snprintf(content, sizeof(content), "cloudprefs %u\ncount 0\n", CLOUDPREFS_VERSION);
@@ -321,8 +321,8 @@ main(void)
         netaddr_from_str(&addr, "5.6.7.100", AF_INET);
         ok(pref_cidrlist_match(&pref, NULL, AT_LIST_DESTBLOCK, &addr), "Found a CIDR match for 5.6.7.100");
 
-        ok(!cloudprefs_slotisempty(&cp->conf, prefs_org_slot(cp->org, 2133813, cp->count)), "Org 2133813 slot is not empty");
-        ok( cloudprefs_slotisempty(&cp->conf, prefs_org_slot(cp->org, 2133814, cp->count)), "Org 2133814 slot is empty");
+        ok(!cloudprefs_slotisempty(&cp->conf, prefs_org_slot(&cp->org, 2133813)),           "Org 2133813 slot is not empty");
+        ok( cloudprefs_slotisempty(&cp->conf, prefs_org_slot(&cp->org, 2133814)),           "Org 2133814 slot is empty");
         ok(!cloudprefs_get_prefblock(cp, 2133812),                                          "No prefblock for org 2133812");
         ok( cloudprefs_get_prefblock(cp, 2133813),                                          "Got prefblock for org 2133813");
         ok(!cloudprefs_get(&pref, cp, "cloudprefs", 2133814, 1234, &oolist, NULL),                        "Can't get cloudprefs for 2133814");
@@ -0,0 +1,134 @@
+#include <kit-alloc.h>
+#include <kit-counters.h>
+#include <string.h>
+#include <tap.h>
+
+#include "common-test.h"
+#include "conf-dispatch.h"
+#include "conf-info.h"
+#include "pref-segments.h"
+#include "uup-counters.h"
+
+static char bigfn[]    = "conf-dispatch-big";
+static char mediumfn[] = "conf-dispatch-medium";
+static char smallfn[]  = "conf-dispatch-small";
+
+static void
+put_load(struct conf_info *info, const struct preffile *segment)
+{
+    struct conf_dispatch cd;
+
+    memset(&cd, '\0', sizeof(cd));
+    cd.info = info;
+    cd.segment = segment;
+    conf_dispatch_put(&cd, CONF_DISPATCH_TODO);
+}
+
+/* Take the next job off the todo queue and finish it, returning its conf_info or NULL if there was none */
+static struct conf_info *
+take_work(const struct preffile **segment)
+{
+    struct conf_dispatch cd;
+    conf_dispatch_handle_t h;
+
+    if ((h = conf_dispatch_getwork(&cd, false)) == NULL)
+        return NULL;
+
+    conf_dispatch_deadwork(h);
+    *segment = cd.segment;
+    return cd.info;
+}
+
+int
+main(void)
+{
+    struct conf_info big, medium, small, segmented, manager;
+    struct pref_segments segments, managed;
+    const struct preffile *segment;
+    uint64_t start_allocations;
+    struct conf_dispatch cd;
+    char *data;
+
+    plan_tests(19);
+
+    kit_memory_initialize(false);
+    kit_counters_initialize(MAXCOUNTERS, 1, false);
+    uup_counters_init();
+    start_allocations = memory_allocations();
+
+    SXEA1(data = kit_calloc(1, 10000), "Can't allocate file data");
+    memset(data, 'x', 9999);
+    ok(create_atomic_file(bigfn, "%s", data), "Created %s", bigfn);
+    data[999] = '\0';
+    ok(create_atomic_file(mediumfn, "%s", data), "Created %s", mediumfn);
+    data[9] = '\0';
+    ok(create_atomic_file(smallfn, "%s", data), "Created %s", smallfn);
+    kit_free(data);
+
+    memset(&big, '\0', sizeof(big));
+    big.path = bigfn;
+    memset(&medium, '\0', sizeof(medium));
+    medium.path = mediumfn;
+    memset(&small, '\0', sizeof(small));
+    small.path = smallfn;
+
+    memset(&segments, '\0', sizeof(segments));
+    segments.parallel = 2;
+    memset(&segmented, '\0', sizeof(segmented));
+    segmented.manager = &segments;
+
+    memset(&managed, '\0', sizeof(managed));
+    managed.parallel = 1;
+    managed.pending = 1;
+    managed.state = SEGMENT_STATE_REQUEUED;
+    memset(&manager, '\0', sizeof(manager));
+    manager.manager = &managed;
+
+    cd.info = &segmented;
+    cd.segment = (const struct preffile *)&segments;
+    is(conf_dispatch_priority(&cd), CONF_DISPATCH_PRIORITY_SEGMENT, "Segment loads have segment priority");
+    cd.segment = NULL;
+    is(conf_dispatch_priority(&cd), CONF_DISPATCH_PRIORITY_SEGMENT, "Segment managers have segment priority");
+    cd.info = &big;
+    is(conf_dispatch_priority(&cd), CONF_DISPATCH_PRIORITY_FILE, "Whole file loads have file priority");
+
+    diag("Whole files are loaded largest first, and idle segment managers wait for real work");
+    {
+        put_load(&manager, NULL);
+        put_load(&small, NULL);
+        put_load(&medium, NULL);
+        put_load(&big, NULL);
+
+        ok(take_work(&segment) == &big,    "The big file is loaded first");
+        ok(take_work(&segment) == &medium, "The medium file is loaded next");
+        ok(take_work(&segment) == &small,  "The small file is loaded last");
+        ok(take_work(&segment) == &manager, "The idle segment manager runs when there's nothing else to do");
+        ok(take_work(&segment) == NULL,    "There is no more work");
+    }
+
+    diag("Segment updates queued during a large file reload overtake the files still waiting");
+    {
+        put_load(&small, NULL);
+        put_load(&big, NULL);
+        put_load(&medium, NULL);
+        ok(take_work(&segment) == &big, "The big file reload starts");
+
+        put_load(&segmented, NULL);
+        put_load(&segmented, (const struct preffile *)&segments);
+        ok(take_work(&segment) == &segmented && segment == NULL, "The segment manager is next");
+        ok(take_work(&segment) == &segmented && segment != NULL, "The segment it queued follows");
+        ok(take_work(&segment) == &medium, "Then the medium file is loaded");
+        ok(take_work(&segment) == &small,  "And finally the small file");
+    }
+
+    is(kit_counter_get(COUNTER_UUP_CONF_DISPATCH_SEGMENT_JOBS), 3, "Counted 3 segment priority jobs");
+    is(kit_counter_get(COUNTER_UUP_CONF_DISPATCH_FILE_JOBS), 6,    "Counted 6 file priority jobs");
+
+    conf_dispatch_purge(NULL);
+    unlink(bigfn);
+    unlink(mediumfn);
+    unlink(smallfn);
+    is(memory_allocations(), start_allocations, "All memory allocations were freed");
+
+    return exit_status();
+}
@@ -9,11 +9,12 @@ main(void)
 {
     uint64_t start_allocations;
     struct conf_loader loader;
-    const char *filename;
-    char *data;
-    size_t len;
+    const char *filename, *line;
+    char *big, *data, expected[16];
+    size_t biglen, len;
+    unsigned i;
 
-    plan_tests(9);
+    plan_tests(16);
 
     kit_memory_initialize(false);
     ok(start_allocations = memory_allocations(), "Clocked the initial # memory allocations");
@@ -40,6 +41,41 @@ main(void)
     kit_free(data);
 
     unlink(filename);
+
+    diag("Test a file that's big enough to be mapped");
+    {
+        SXEA1(big = kit_malloc(20000 * sizeof(expected)), "Failed to allocate test data");
+        for (biglen = i = 0; i < 20000; i++) {
+            if (i % 100 == 0)
+                biglen += sprintf(big + biglen, "# comment\n\n");
+            biglen += sprintf(big + biglen, "line %05u\n", i);
+        }
+        ok(biglen >= CONF_LOADER_MAP_MINSZ, "Created %zu bytes of test data", biglen);
+        filename = create_binary_data("test-file", big, biglen);
+
+        ok(conf_loader_open(&loader, filename, NULL, NULL, 0, CONF_LOADER_DEFAULT | CONF_LOADER_CHOMP), "Opened the big test file");
+        for (i = 0; (line = conf_loader_readline(&loader)) != NULL; i++) {
+            snprintf(expected, sizeof(expected), "line %05u", i);
+            if (strcmp(line, expected) != 0)
+                break;
+        }
+        is(i, 20000, "Read all 20000 lines from the big test file");
+        ok(conf_loader_eof(&loader), "The loader is at EOF");
+
+        ok(conf_loader_open(&loader, filename, NULL, NULL, 0, 0), "Opened the big test file again");
+        data = conf_loader_readfile(&loader, &len, 0);
+        ok(data && len == biglen && memcmp(data, big, biglen) == 0, "Read the big test file in one go");
+        kit_free(data);
+        unlink(filename);
+
+        big[biglen / 2] = '\0';
+        filename = create_binary_data("test-file", big, biglen);
+        conf_loader_open(&loader, filename, NULL, NULL, 0, 0);
+        ok(!conf_loader_readfile(&loader, &len, 0), "Cannot read a big test file with an embedded NUL");
+        unlink(filename);
+        kit_free(big);
+    }
+
     conf_loader_fini(&loader);
 
     /* KIT_ALLOC_SET_LOG(0); */
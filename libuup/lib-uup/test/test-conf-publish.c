@@ -0,0 +1,88 @@
+#include <kit-alloc.h>
+#include <kit-counters.h>
+#include <tap.h>
+
+#include "common-test.h"
+#include "domainlist.h"
+#include "uup-counters.h"
+#include "urllist.h"
+
+#define HOUR_MS (60 * 60 * 1000)
+
+int
+main(void)
+{
+    module_conf_t domains = 0, urls = 0;
+    uint64_t start_allocations;
+    struct confset *set;
+    int gen = 0;
+
+    plan_tests(22);
+
+    kit_memory_initialize(false);
+    kit_counters_initialize(MAXCOUNTERS, 1, false);
+    uup_counters_init();
+    start_allocations = memory_allocations();
+
+    conf_initialize(".", ".", false, NULL);
+    domainlist_register(&domains, "publish-domains", "test-publish-domains", true);
+    urllist_register(&urls, "publish-urls", "test-publish-urls", true);
+    create_atomic_file("test-publish-domains", "one.com");
+    create_atomic_file("test-publish-urls", "one.com/path");
+
+    conf_set_publish_options(HOUR_MS, NULL);
+    ok(confset_load(NULL), "The first generation is published despite the publish interval");
+    ok(set = confset_acquire(&gen), "Acquired the first generation");
+    confset_release(set);
+    is(kit_counter_get(COUNTER_UUP_CONF_GENERATIONS), 1, "Counted one generation");
+    is(kit_counter_get(COUNTER_UUP_CONF_PUBLISHED), 2,  "Counted two published confs");
+
+    diag("Loads within the publish interval are coalesced");
+    {
+        create_atomic_file("test-publish-urls", "twotwo.com/path");
+        ok(!confset_load(NULL), "A changed urllist is not published within the interval");
+        ok(!confset_acquire(&gen), "There is no new generation");
+        is(kit_counter_get(COUNTER_UUP_CONF_PUBLISH_DEFERRED), 1, "Counted a deferred publication");
+
+        create_atomic_file("test-publish-domains", "twotwo.com");
+        ok(!confset_load(NULL), "A changed domainlist is not published either");
+        is(kit_counter_get(COUNTER_UUP_CONF_PUBLISH_DEFERRED), 2, "Counted another deferred publication");
+
+        conf_set_publish_options(0, NULL);
+        ok(confset_load(NULL), "Both loads are published once the interval is removed");
+        ok(set = confset_acquire(&gen), "Acquired the new generation");
+        ok(urllist_match(urllist_conf_get(set, urls), "twotwo.com/path", 15), "The new urllist is in it");
+        ok(domainlist_match(domainlist_conf_get(set, domains), (const uint8_t *)"\6twotwo\3com", DOMAINLIST_MATCH_EXACT, NULL, NULL),
+           "The new domainlist is in it");
+        confset_release(set);
+        is(kit_counter_get(COUNTER_UUP_CONF_GENERATIONS), 2, "Counted one generation for both loads");
+    }
+
+    diag("Files rewritten with the same content are not reloaded");
+    {
+        create_atomic_file("test-publish-urls", "twotwo.com/path");
+        ok(!confset_load(NULL), "A urllist rewritten with the same content is not a change");
+        is(kit_counter_get(COUNTER_UUP_CONF_UNCHANGED), 1, "Counted an unchanged file");
+        ok(!confset_load(NULL), "Loading again finds nothing to do");
+        is(kit_counter_get(COUNTER_UUP_CONF_UNCHANGED), 1, "The unchanged file's new stat data was remembered");
+    }
+
+    diag("Priority types are published immediately");
+    {
+        conf_set_publish_options(HOUR_MS, "cidrlist,domainlist");
+        create_atomic_file("test-publish-domains", "threethree.com");
+        ok(confset_load(NULL), "A changed domainlist is published within the interval");
+        ok(set = confset_acquire(&gen), "Acquired the new generation");
+        confset_release(set);
+        is(kit_counter_get(COUNTER_UUP_CONF_GENERATIONS), 3, "Counted the priority generation");
+    }
+
+    conf_unregister(domains);
+    conf_unregister(urls);
+    confset_unload();
+    unlink("test-publish-domains");
+    unlink("test-publish-urls");
+    is(memory_allocations(), start_allocations, "All memory allocations were freed");
+
+    return exit_status();
+}
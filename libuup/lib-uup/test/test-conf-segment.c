@@ -0,0 +1,194 @@
+#include <kit-alloc.h>
+#include <mockfail.h>
+#include <stddef.h>
+#include <tap.h>
+
+#include "conf-segment.h"
+
+#include "common-test.h"
+
+struct test_seg {
+    unsigned tag;
+    struct conf_segment cs;
+};
+
+static void
+test_seg_refcount_inc(void *v)
+{
+    struct test_seg *seg = v;
+
+    seg->cs.refcount++;
+}
+
+static void
+test_seg_refcount_dec(void *v)
+{
+    struct test_seg *seg = v;
+
+    if (--seg->cs.refcount == 0)
+        kit_free(seg);
+}
+
+static struct test_seg *
+test_seg_new(uint32_t id, unsigned tag)
+{
+    struct test_seg *seg;
+
+    SXEA1(seg = kit_calloc(1, sizeof(*seg)), "Couldn't allocate a test segment");
+    seg->tag = tag;
+    seg->cs.id = id;
+    seg->cs.refcount = 1;
+    seg->cs.mtime = id;
+    return seg;
+}
+
+static void
+test_table_init(struct conf_segment_table *t)
+{
+    conf_segment_table_init(t, offsetof(struct test_seg, cs), test_seg_refcount_inc, test_seg_refcount_dec);
+}
+
+static bool
+test_table_add(struct conf_segment_table *t, uint32_t id, unsigned tag)
+{
+    struct test_seg *seg = test_seg_new(id, tag);
+
+    if (conf_segment_table_use(t, conf_segment_table_slot(t, id), seg))
+        return true;
+
+    test_seg_refcount_dec(seg);
+    return false;
+}
+
+/* Return the number of slots that don't hold the expected ids in order */
+static unsigned
+test_table_misordered(const struct conf_segment_table *t)
+{
+    const struct test_seg *seg, *prev = NULL;
+    unsigned bad = 0, slot;
+
+    for (slot = 0; slot < t->count; prev = seg, slot++) {
+        seg = conf_segment_table_get(t, slot);
+        bad += seg == NULL || (prev && prev->cs.id >= seg->cs.id) || conf_segment_table_slot(t, seg->cs.id) != slot
+            || conf_segment_table_find(t, seg->cs.id) != seg;
+    }
+
+    return bad;
+}
+
+int
+main(void)
+{
+    struct conf_segment_table t, clone, big, bigclone;
+    uint64_t start_allocations, allocations;
+    const struct test_seg *seg;
+    unsigned i, n;
+    bool ret;
+
+    plan_tests(41);
+
+    kit_memory_initialize(false);
+    test_capture_sxel();
+    start_allocations = memory_allocations();
+
+    diag("An empty table");
+    {
+        test_table_init(&t);
+        ok(conf_segment_table_find(&t, 42) == NULL, "Can't find anything in an empty table");
+        is(conf_segment_table_slot(&t, 42), 0, "Everything belongs in slot 0 of an empty table");
+        ok(conf_segment_table_get(&t, 0) == NULL, "Slot 0 of an empty table is empty");
+    }
+
+    diag("Tables loaded in id order have full chunks, and out of order inserts split them");
+    {
+        for (ret = true, i = 0; i < 1000; i++)
+            ret = test_table_add(&t, i * 2, 0) && ret;
+        ok(ret, "Inserted 1000 even ids");
+        is(t.count, 1000, "The table has 1000 segments");
+        is(t.chunks, (1000 + CONF_SEGMENT_CHUNK_MAX - 1) / CONF_SEGMENT_CHUNK_MAX, "The segments are in full chunks");
+        is(conf_segment_table_mtime(&t), 1998, "The table mtime is the latest segment mtime");
+
+        ok(test_table_add(&t, 1, 0), "Inserted id 1 into the first (full) chunk");
+        is(t.chunks, (1000 + CONF_SEGMENT_CHUNK_MAX - 1) / CONF_SEGMENT_CHUNK_MAX + 1, "The first chunk was split");
+        is(test_table_misordered(&t), 0, "Every segment is in its own slot and can be found");
+        ok(conf_segment_table_find(&t, 3) == NULL, "Id 3 isn't present");
+        is(conf_segment_table_slot(&t, 3), 3, "Id 3 belongs in slot 3");
+        is(conf_segment_table_slot(&t, 5000), t.count, "Id 5000 belongs at the end");
+    }
+
+    diag("Clones share chunks, and copy only the chunks they modify");
+    {
+        allocations = memory_allocations();
+        ok(conf_segment_table_clone(&clone, &t), "Cloned the table");
+        is(memory_allocations() - allocations, 1, "The clone only allocated its chunk references");
+        is(t.ref[0].chunk->refcount, 2, "The first chunk is shared");
+
+        seg = conf_segment_table_find(&t, 500);
+        ok(test_table_add(&clone, 500, 1), "Replaced id 500 in the clone");
+        is(memory_allocations() - allocations, 3, "The replacement and one chunk were allocated");
+        is(((const struct test_seg *)conf_segment_table_find(&clone, 500))->tag, 1, "The clone has the new id 500");
+        ok(conf_segment_table_find(&t, 500) == seg, "The original still has the old id 500");
+        is(seg->cs.refcount, 1, "The old id 500 is only referenced by the original");
+
+        conf_segment_table_remove(&clone, 0);
+        is(clone.count, t.count - 1, "Removed slot 0 from the clone");
+        ok(conf_segment_table_find(&t, 0) != NULL && conf_segment_table_find(&clone, 0) == NULL, "Id 0 is only in the original");
+        is(test_table_misordered(&clone), 0, "The clone is still well ordered");
+
+        while (clone.count)
+            conf_segment_table_remove(&clone, clone.count / 2);
+        is(clone.chunks, 0, "Removing every segment from the clone leaves no chunks");
+        is(test_table_misordered(&t), 0, "The original is unchanged");
+        conf_segment_table_fini(&clone);
+    }
+
+    diag("Cloning a large table only allocates its chunk references");
+    {
+        for (n = 1000; n <= 100000; n *= 10) {
+            test_table_init(&big);
+            for (i = 0; i < n; i++)
+                test_table_add(&big, i, 0);
+
+            allocations = memory_allocations();
+            conf_segment_table_clone(&bigclone, &big);
+            is(memory_allocations() - allocations, 1, "A clone of %u segments made a single allocation", n);
+            conf_segment_table_fini(&bigclone);
+            conf_segment_table_fini(&big);
+        }
+    }
+
+    diag("Allocation failures");
+    {
+        MOCKFAIL_START_TESTS(2, CONF_SEGMENT_TABLE_CLONE);
+        ok(!conf_segment_table_clone(&clone, &t), "Failed to clone when the chunk references can't be allocated");
+        OK_SXEL_ERROR("Couldn't allocate 32 segment table chunk references");
+        MOCKFAIL_END_TESTS();
+
+        MOCKFAIL_START_TESTS(6, CONF_SEGMENT_TABLE_CHUNK);
+        ok(conf_segment_table_clone(&clone, &t), "Cloned the table");
+        ok(!test_table_add(&clone, 500, 2), "Failed to replace a segment when its chunk can't be copied");
+        OK_SXEL_ERROR("Couldn't allocate a segment table chunk");
+        ok(!conf_segment_table_remove(&clone, 0), "Failed to remove a segment when its chunk can't be copied");
+        OK_SXEL_ERROR("Couldn't allocate a segment table chunk");
+        is(clone.count, t.count, "The clone is unchanged");
+        conf_segment_table_fini(&clone);
+        MOCKFAIL_END_TESTS();
+
+        test_table_init(&big);
+        for (i = 0; i < 16 * CONF_SEGMENT_CHUNK_MAX; i++)
+            test_table_add(&big, i, 0);
+
+        MOCKFAIL_START_TESTS(3, CONF_SEGMENT_TABLE_REFS);
+        ok(!test_table_add(&big, i, 0), "Failed to add a chunk when the chunk references can't be reallocated");
+        OK_SXEL_ERROR("Couldn't reallocate 32 segment table chunk references");
+        is(big.count, 16 * CONF_SEGMENT_CHUNK_MAX, "The table is unchanged");
+        MOCKFAIL_END_TESTS();
+        conf_segment_table_fini(&big);
+    }
+
+    conf_segment_table_fini(&t);
+    test_uncapture_sxel();
+    is(memory_allocations(), start_allocations, "All memory allocations were freed");
+
+    return exit_status();
+}
@@ -16,6 +16,49 @@
 #define FreeBSD 0
 #endif
 
+/*
+ * Look up an asset, a user that's present, a user that isn't (falling back to the org entry) and an org that isn't present
+ * in an org with enough identities to be indexed.
+ */
+static void
+check_indexed_org(const struct prefs_org *dpo, struct oolist **ids, const char *how)
+{
+    enum dirprefs_type dt;
+    struct odns odns;
+    const char *what;
+    pref_t pr;
+
+    memset(&odns, '\0', sizeof(odns));
+    odns.org_id = 7;
+    odns.fields = ODNS_FIELD_ORG | ODNS_FIELD_VA;
+    odns.va_id = 1017;
+    what = dirprefs_org_get(&pr, dpo, &odns, ids, &dt, NULL);
+    is_eq(what ?: "<none>", "asset", "%s: Found asset 1017", how);
+    is(PREF_VALID(&pr) ? PREF_IDENT(&pr)->originid : 0, 1017, "%s: Asset 1017 has the correct origin", how);
+
+    odns.fields = ODNS_FIELD_ORG | ODNS_FIELD_USER;
+    odns.user_id.bytes[KIT_GUID_SIZE - 1] = 23;
+    what = dirprefs_org_get(&pr, dpo, &odns, ids, &dt, NULL);
+    is_eq(what ?: "<none>", "user", "%s: Found user 23", how);
+    is(dt, DIRPREFS_TYPE_GUID, "%s: User 23 is a GUID match", how);
+    is(PREF_VALID(&pr) ? PREF_IDENT(&pr)->originid : 0, 2023, "%s: User 23 has the correct origin", how);
+
+    odns.user_id.bytes[KIT_GUID_SIZE - 1] = 99;
+    what = dirprefs_org_get(&pr, dpo, &odns, ids, &dt, NULL);
+    is_eq(what ?: "<none>", "org", "%s: User 99 isn't present, so the org entry is used", how);
+    is(PREF_VALID(&pr) ? PREF_IDENT(&pr)->originid : 0, 77, "%s: The org entry has the correct origin", how);
+
+    odns.org_id = 8;
+    ok(!dirprefs_org_get(&pr, dpo, &odns, ids, &dt, NULL), "%s: Nothing is found for org 8", how);
+    oolist_clear(ids);
+}
+
+static void
+test_prefs_org_noref(void *obj)
+{
+    (void)obj;
+}
+
 int
 main(void)
 {
@@ -41,7 +84,7 @@ main(void)
     unsigned z;
     pref_t pr;
 
-    plan_tests(321);
+    plan_tests(344);
 #ifdef __FreeBSD__
     plan_skip_all("DPT-186 - Need to implement inotify as dtrace event");
     exit(0);
@@ -166,11 +209,11 @@ main(void)
         ok(set = confset_acquire(&gen), "Acquired the failed confset");
         ok(dp = dirprefs_conf_get(set, CONF_DIRPREFS), "Got dirprefs");
         skip_if(!dp, 4, "Skipping dirprefs tests due to NULL dirprefs") {
-            is(dp->count, 1, "dirprefs has a single entry");
-            skip_if(dp->count != 1, 3, "Not looking at dirprefs content due to incorrect count") {
-                is(dp->org[0]->cs.id, 666, "Org 666 is present in dirprefs");
-                ok(!dp->org[0]->cs.loaded, "Org 2 shows it was not loaded");
-                ok(dp->org[0]->cs.failed_load, "Org 2 shows a failed load");
+            is(dp->org.count, 1, "dirprefs has a single entry");
+            skip_if(dp->org.count != 1, 3, "Not looking at dirprefs content due to incorrect count") {
+                is(PREFS_ORG_GET(&dp->org, 0)->cs.id, 666, "Org 666 is present in dirprefs");
+                ok(!PREFS_ORG_GET(&dp->org, 0)->cs.loaded, "Org 2 shows it was not loaded");
+                ok(PREFS_ORG_GET(&dp->org, 0)->cs.failed_load, "Org 2 shows a failed load");
             }
         }
         confset_release(set);
@@ -216,10 +259,10 @@ main(void)
                 dp = dirprefs_conf_get(set, CONF_DIRPREFS);
                 ok(dp, "Constructed struct dirprefs from empty V%u data", DIRPREFS_VERSION);
                 skip_if(dp == NULL, 3, "Cannot check content of NULL struct dirprefs") {
-                    is(dp->count, 1, "V%u data has a count of 1 org", DIRPREFS_VERSION);
+                    is(dp->org.count, 1, "V%u data has a count of 1 org", DIRPREFS_VERSION);
                     is(dp->conf.refcount, 2, "V%u data has a refcount of 2", DIRPREFS_VERSION);
-                    skip_if(!dp->count, 1, "Cannot verify org count")
-                        is(dp->org[0]->fp.total, 0, "V%u data has a record count of 0", DIRPREFS_VERSION);
+                    skip_if(!dp->org.count, 1, "Cannot verify org count")
+                        is(PREFS_ORG_GET(&dp->org, 0)->fp.total, 0, "V%u data has a record count of 0", DIRPREFS_VERSION);
                 }
                 confset_release(set);
                 is(dp ? dp->conf.refcount : 0, 1, "confset_release() dropped the refcount back to 1");
@@ -236,7 +279,7 @@ main(void)
         unsigned i;
 
         create_atomic_file("test-dirprefs-1", "dirprefs %u\ncount 0\n%s%s%s%s%s", DIRPREFS_VERSION, data[0], data[1], data[2], data[3], data[4]);
-        ok(confset_load(NULL), "Noted an update for koshir v%u data", DIRPREFS_VERSION);
+        ok(!confset_load(NULL), "Noted no update for koshir v%u data identical to the last load", DIRPREFS_VERSION);
 
         for (z = 0; z < 5; z++) {
             for (i = 0; i <= z; i++)
@@ -691,10 +734,10 @@ main(void)
         OK_SXEL_ERROR("Couldn't allocate preffile struct with 17 extra bytes");
         MOCKFAIL_END_TESTS();
 
-        MOCKFAIL_START_TESTS(3, DIRPREFS_CLONE_ORGS);
+        MOCKFAIL_START_TESTS(3, CONF_SEGMENT_TABLE_CLONE);
         create_atomic_file("test-dirprefs-3", "we'll never even get to see this data");
-        ok(!confset_load(NULL), "Didn't see a change to test-dirprefs-3 due to a dirprefs-org slot allocation failure");
-        OK_SXEL_ERROR("Couldn't allocate 10 new dirprefs org slots");
+        ok(!confset_load(NULL), "Didn't see a change to test-dirprefs-3 due to a dirprefs-org table allocation failure");
+        OK_SXEL_ERROR("Couldn't allocate 16 segment table chunk references");
         OK_SXEL_ERROR("Couldn't clone a dirprefs conf object");
         MOCKFAIL_END_TESTS();
 
@@ -756,23 +799,30 @@ main(void)
             skip_if(set == NULL, 105, "Cannot check content without acquiring config") {
                 dp = dirprefs_conf_get(set, CONF_DIRPREFS);
                 ok(dp, "Constructed struct dirprefs from segmented V%u data", DIRPREFS_VERSION);
-                is(dp->count, 6, "V%u data has a count of 6 orgs", DIRPREFS_VERSION);
+                is(dp->org.count, 6, "V%u data has a count of 6 orgs", DIRPREFS_VERSION);
                 is(dp->conf.refcount, 2, "V%u data has a refcount of 2", DIRPREFS_VERSION);
 
-                skip_if(dp->count != 5, 6, "Cannot verify org count") {
-                    is(PREFS_COUNT(dp->org[0], identities), 5, "V%u data in slot 0 has an identity count of 5", DIRPREFS_VERSION);
-                    is(PREFS_COUNT(dp->org[1], identities), 1, "V%u data in slot 1 has an identity count of 1", DIRPREFS_VERSION);
-                    is(PREFS_COUNT(dp->org[2], identities), 1, "V%u data in slot 2 has an identity count of 1", DIRPREFS_VERSION);
-                    is(PREFS_COUNT(dp->org[3], identities), 2, "V%u data in slot 3 has an identity count of 2", DIRPREFS_VERSION);
-                    is(PREFS_COUNT(dp->org[4], identities), 1, "V%u data in slot 4 has an identity count of 1", DIRPREFS_VERSION);
-                    is(PREFS_COUNT(dp->org[5], identities), 0, "V%u data in slot 5 has an identity count of 0", DIRPREFS_VERSION);
+                skip_if(dp->org.count != 5, 6, "Cannot verify org count") {
+                    is(PREFS_COUNT(PREFS_ORG_GET(&dp->org, 0), identities), 5, "V%u data in slot 0 has an identity count of 5", DIRPREFS_VERSION);
+                    is(PREFS_COUNT(PREFS_ORG_GET(&dp->org, 1), identities), 1, "V%u data in slot 1 has an identity count of 1", DIRPREFS_VERSION);
+                    is(PREFS_COUNT(PREFS_ORG_GET(&dp->org, 2), identities), 1, "V%u data in slot 2 has an identity count of 1", DIRPREFS_VERSION);
+                    is(PREFS_COUNT(PREFS_ORG_GET(&dp->org, 3), identities), 2, "V%u data in slot 3 has an identity count of 2", DIRPREFS_VERSION);
+                    is(PREFS_COUNT(PREFS_ORG_GET(&dp->org, 4), identities), 1, "V%u data in slot 4 has an identity count of 1", DIRPREFS_VERSION);
+                    is(PREFS_COUNT(PREFS_ORG_GET(&dp->org, 5), identities), 0, "V%u data in slot 5 has an identity count of 0", DIRPREFS_VERSION);
                 }
 
-                ok(!dirprefs_slotisempty(&dp->conf, prefs_org_slot(dp->org, 5, dp->count)), "Org 5 slot is not empty");
-                ok( dirprefs_slotisempty(&dp->conf, prefs_org_slot(dp->org, 6, dp->count)), "Org 6 slot is empty");
+                ok(!dirprefs_slotisempty(&dp->conf, prefs_org_slot(&dp->org, 5)),           "Org 5 slot is not empty");
+                ok( dirprefs_slotisempty(&dp->conf, prefs_org_slot(&dp->org, 6)),           "Org 6 slot is empty");
                 ok( dirprefs_get_prefblock(dp, 5),                                          "Got prefblock for org 5");
                 ok(!dirprefs_get_prefblock(dp, 6),                                          "No prefblock for org 6");
-                ok(prefs_org_slot(dp->org, 6, dp->count) < dp->count,                       "Org 6 does have a slot");
+                ok(prefs_org_slot(&dp->org, 6) < dp->org.count,                             "Org 6 does have a slot");
+
+                for (z = 0; z < dp->org.count; z++)
+                    if (conf_segment_table_find(&dp->org, PREFS_ORG_GET(&dp->org, z)->cs.id) != PREFS_ORG_GET(&dp->org, z)
+                     || prefs_org_slot(&dp->org, PREFS_ORG_GET(&dp->org, z)->cs.id) != z)
+                        break;
+                is(z, dp->org.count,                                                        "Every org is found in its own slot");
+                is(prefs_org_slot(&dp->org, 666), dp->org.count,                            "Missing org 666 gets the end slot");
                 ok(!dirprefs_get_prefblock(dp, 666),                                        "No prefblock for org 666");
 
                 diag("    V%u orgid lookup", DIRPREFS_VERSION);
@@ -803,8 +853,8 @@ main(void)
                         is(bundle->id, 3, "Got the correct bundleid for orgid 1");
                     }
 
-                    org_slot = prefs_org_slot(dp->org, 4, dp->count);    /* Get the index of org 4 */
-                    dpo = dp->org[org_slot];                             /* Get a pointer to the dirprefs for the org */
+                    org_slot = prefs_org_slot(&dp->org, 4);              /* Get the index of org 4 */
+                    dpo = PREFS_ORG_GET(&dp->org, org_slot);                          /* Get a pointer to the dirprefs for the org */
                     is_eq(dpo->fp.ops->key_to_str(&dpo->fp, 0), "4:1:2911559", "Got the correct first key for org 4");
                     is_eq(dpo->fp.ops->key_to_str(&dpo->fp, 1), "4:2:05555555555555555555555555555555",
                                                                                "Got the correct second key for org 4");
@@ -1140,7 +1190,7 @@ main(void)
                     dp = dirprefs_conf_get(set, CONF_DIRPREFS);
                     ok(dp, "Obtained the revised struct dirprefs from segmented V%u data", DIRPREFS_VERSION);
 
-                    ok(prefs_org_slot(dp->org, 4, dp->count) == 3 && dp->org[3]->cs.id != 4, "orgid 4 doesn't exist in struct dirprefs");
+                    ok(prefs_org_slot(&dp->org, 4) == 3 && PREFS_ORG_GET(&dp->org, 3)->cs.id != 4, "orgid 4 doesn't exist in struct dirprefs");
                     ok(access("test-dirprefs-4.last-good", 0) != 0, "The test-dirprefs-4 removal removed test-dirprefs-4.last-good");
                     confset_release(set);
                 }
@@ -1155,14 +1205,14 @@ main(void)
         }
         ok(confset_load(NULL), "Loaded test-dirprefs-100 - test-dirprefs-105");
 
-        MOCKFAIL_START_TESTS(5, DIRPREFS_MOREORGS);
+        MOCKFAIL_START_TESTS(5, CONF_SEGMENT_TABLE_CHUNK);
         for (; orgid < 110; orgid++) {
             snprintf(buf, sizeof(buf), "test-dirprefs-%u", orgid);
             create_atomic_file(buf, "%s", content[0]);
         }
-        ok(!confset_load(NULL), "Didn't see a change to test-dirprefs-106 - test-dirprefs-109  due to a dirprefs-org slot re-allocation failure");
+        ok(!confset_load(NULL), "Didn't see a change to test-dirprefs-106 - test-dirprefs-109  due to a dirprefs-org chunk allocation failure");
         for (orgid = 106; orgid < 110; orgid++)
-            OK_SXEL_ERROR("Couldn't reallocate 20 dirprefs org slots");
+            OK_SXEL_ERROR("Couldn't allocate a segment table chunk");
         MOCKFAIL_END_TESTS();
 
         snprintf(content[0], sizeof(content[0]), "dirprefs %u\ncount 0\n", DIRPREFS_VERSION);
@@ -1197,27 +1247,68 @@ main(void)
 
     OK_SXEL_ERROR(NULL);
 
+    diag("Test V%u lookups in an org with enough identities to be indexed", DIRPREFS_VERSION);
+    {
+        char data[8192];
+        size_t len;
+        unsigned i;
+
+        len = snprintf(data, sizeof(data), "dirprefs %u\ncount 83\n"
+                       "[bundles:1]\n" "0:1:0:32:1400000000007491CD:::::::::::\n"
+                       "[orgs:1]\n" "7:0:0:365:0:1007:0\n"
+                       "[identities:81]\n" "7:0::77:22:7:0:1\n", DIRPREFS_VERSION);
+        for (i = 0; i < 40; i++)
+            len += snprintf(data + len, sizeof(data) - len, "7:1:%u:%u:13:7:0:1\n", 1000 + i, 1000 + i);
+        for (i = 0; i < 40; i++)
+            len += snprintf(data + len, sizeof(data) - len, "7:2:%032x:%u:5:7:0:1\n", i, 2000 + i);
+        fn = create_data("test-dirprefs", "%s", data);
+
+        conf_loader_init(&cl);
+        info = conf_info_new(NULL, "dirprefs", "test-dirprefs", NULL, LOADFLAGS_FP_ALLOW_BUNDLE_EXTREFS, NULL, 0);
+
+        conf_loader_open(&cl, fn, NULL, NULL, 0, CONF_LOADER_DEFAULT);
+        dpo = dirprefs_org_new(7, &cl, info);
+        ok(dpo, "Loaded an org with 81 identities");
+        is(PREFS_COUNT(dpo, identities), 81, "The org has 81 identities");
+        skip_if(!dpo, 8, "Cannot look up identities without an org")
+            check_indexed_org(dpo, &ids, "indexed");
+        prefs_org_refcount_dec(dpo);
+
+        MOCKFAIL_START_TESTS(10, DIRPREFS_ORG_INDEX);
+        conf_loader_open(&cl, fn, NULL, NULL, 0, CONF_LOADER_DEFAULT);
+        dpo = dirprefs_org_new(7, &cl, info);
+        ok(dpo, "Loaded an org with 81 identities when the index can't be allocated");
+        OK_SXEL_ERROR("Couldn't allocate 2200 bytes for a dirprefs org index of 81 keys");
+        skip_if(!dpo, 8, "Cannot look up identities without an org")
+            check_indexed_org(dpo, &ids, "not indexed");
+        prefs_org_refcount_dec(dpo);
+        MOCKFAIL_END_TESTS();
+
+        unlink(fn);
+        conf_info_free(info);
+        conf_loader_fini(&cl);
+    }
+
+    OK_SXEL_ERROR(NULL);
+
     diag("Test prefs_org_slot()");
     {
-        /* This test creates/manages its own dirprefs structure to exercise prefs_org_slot() */
+        /* This test creates/manages its own org table to exercise prefs_org_slot() */
 #define ITERATIONS 100
-        struct prefs_org dorg[ITERATIONS], *dorgp[ITERATIONS];
+        struct prefs_org dorg[ITERATIONS];
+        struct conf_segment_table d;
         int ahead, behind, hit, miss, overflow;
         uint32_t nextid;
-        struct dirprefs d;
         unsigned i;
 
-        memset(&d, '\0', sizeof d);
-        d.org = dorgp;
+        memset(dorg, '\0', sizeof(dorg));
+        conf_segment_table_init(&d, offsetof(struct prefs_org, cs), test_prefs_org_noref, test_prefs_org_noref);
         ahead = behind = hit = miss = overflow = 0;
 
-        for (i = 0; i < ITERATIONS; i++)
-            dorgp[i] = dorg + i;
-
-        for (d.count = 0; d.count < ITERATIONS; d.count++) {
+        while (d.count < ITERATIONS) {
             nextid = (d.count << 1) + 1;
             for (orgid = 0; orgid < nextid; orgid++) {
-                i = prefs_org_slot(d.org, orgid, d.count);
+                i = prefs_org_slot(&d, orgid);
                 if (i > d.count) {
                     diag("ERROR: Looking for %u, got pos %u (count %u) - expected pos <=%u", orgid, i, d.count, d.count);
                     overflow++;
@@ -1225,26 +1316,28 @@ main(void)
                     if (i == d.count) {
                         diag("ERROR: Looking for %u, found <end> (count %u) - expected to find %u", orgid, d.count, orgid);
                         miss++;
-                    } else if (d.org[i]->cs.id != orgid) {
+                    } else if (PREFS_ORG_GET(&d, i)->cs.id != orgid) {
                         diag("ERROR: Looking for %u, found %u at pos %u (count %u) - expected to find %u", orgid,
-                             d.org[i]->cs.id, i, d.count, orgid);
+                             PREFS_ORG_GET(&d, i)->cs.id, i, d.count, orgid);
                         miss++;
                     }
-                } else if (i < d.count && d.org[i]->cs.id == orgid) {
+                } else if (i < d.count && PREFS_ORG_GET(&d, i)->cs.id == orgid) {
                     diag("ERROR: Looking for %u, but found it pos %u (count %u) - expected >%u", orgid, i, d.count, orgid);
                     hit++;
-                } else if (i && d.org[i - 1]->cs.id >= orgid) {
+                } else if (i && PREFS_ORG_GET(&d, i - 1)->cs.id >= orgid) {
                     diag("ERROR: Looking for %u, found %u at pos %u, but the previous element is %u (count %u) - expected <%u",
-                          orgid, d.org[i]->cs.id, i, d.org[i - 1]->cs.id, d.count, orgid);
+                          orgid, PREFS_ORG_GET(&d, i)->cs.id, i, PREFS_ORG_GET(&d, i - 1)->cs.id, d.count, orgid);
                     ahead++;
-                } else if (i < d.count && d.org[i]->cs.id < orgid) {
+                } else if (i < d.count && PREFS_ORG_GET(&d, i)->cs.id < orgid) {
                     diag("ERROR: Looking for %u, but found %u at pos %u (count %u) - expected >%u",
-                         orgid, d.org[i]->cs.id, i, d.count, orgid);
+                         orgid, PREFS_ORG_GET(&d, i)->cs.id, i, d.count, orgid);
                     behind++;
                 }
             }
-            d.org[d.count]->cs.id = nextid;
+            dorg[d.count].cs.id = nextid;
+            SXEA1(conf_segment_table_insert(&d, d.count, dorg + d.count), "Couldn't insert org %u", nextid);
         }
+        conf_segment_table_fini(&d);
         is(overflow, 0, "No overflows were received from prefs_org_slot()");
         is(ahead, 0, "No results from prefs_org_slot() were too large");
         is(behind, 0, "No results from prefs_org_slot() were too small");
@@ -163,7 +163,7 @@ main(void)
         error_capture();
         gpum = groups_per_user_map_new(&cl);
         ok(!gpum, "Failed to read a file when groups per user maps could not be allocated");
-        error_test("Failed to allocate 72 bytes for groups_per_user_map", NULL);
+        error_test("Failed to allocate 80 bytes for groups_per_user_map", NULL);
         MOCKFAIL_END_TESTS();
 
         MOCKFAIL_START_TESTS(3, GPUM_ALLOC_GPU);
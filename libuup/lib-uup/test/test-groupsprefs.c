@@ -83,11 +83,11 @@ main(void)
     ok(gpum = groupsprefs_get_groups_per_user_map(set, CONF_GROUPSPREFS, 1), "Found groups per user for org 1");
     confset_release(set);
 
-    MOCKFAIL_START_TESTS(3, GROUPSPREFS_CLONE_GPUMS);
+    MOCKFAIL_START_TESTS(3, CONF_SEGMENT_TABLE_CLONE);
     error_capture();
     create_atomic_file("test-groupsprefs-2", "version 1\ncount 2\n1:11 12\n2:11 13\n");
     ok(!confset_load(NULL), "Noted no update");
-    error_test2("Couldn't allocate 10 new groups_per_user_map_t slots", "Couldn't clone a groupsprefs conf object");
+    error_test2("Couldn't allocate 16 segment table chunk references", "Couldn't clone a groupsprefs conf object");
     MOCKFAIL_END_TESTS();
 
     create_atomic_file("test-groupsprefs-2", "version 1\ncount 2\n1:11 12\n2:11 13\n");
@@ -98,7 +98,6 @@ main(void)
     ok(groupsprefs_get_groups_per_user_map(set, CONF_GROUPSPREFS, 2), "Found groups per user for org 2");
     confset_release(set);
 
-    MOCKFAIL_START_TESTS(4, GROUPSPREFS_MORE_ORGS);
     error_capture();
 
     for (i = 3; i <= 10; i++) {
@@ -109,9 +108,11 @@ main(void)
 
     ok(confset_load(NULL), "Noted an update");
     OK_SXEL_ERROR(NULL);
+
+    MOCKFAIL_START_TESTS(2, CONF_SEGMENT_TABLE_CHUNK);
     create_atomic_file("test-groupsprefs-0", "%s", "version 1\ncount 2\n1:11 12\n2:11 13\n");
     ok(!confset_load(NULL), "Noted no update");
-    error_test1("Couldn't reallocate 20 groups_per_user_map_t slots");
+    error_test1("Couldn't allocate a segment table chunk");
     MOCKFAIL_END_TESTS();
 
     // Actually insert out of order to cover this case
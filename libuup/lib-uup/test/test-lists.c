@@ -49,7 +49,7 @@ main(void)
     int                 gen, lines;
     char                content[4][4096];
 
-    plan_tests(168);
+    plan_tests(193);
 
     #ifdef __FreeBSD__
         plan_skip_all("DPT-186 - Need to implement inotify as dtrace event");
@@ -280,11 +280,11 @@ main(void)
             ok(lists, "Constructed lists from empty V%u data", LISTS_VERSION);
 
             skip_if(lists == NULL, 7, "Cannot check content of NULL lists") {
-                is(lists->count, 1, "V%u data has a count of 1 list", LISTS_VERSION);
+                is(lists->orgs.count, 1, "V%u data has a count of 1 list", LISTS_VERSION);
                 is(lists->conf.refcount, 2, "V%u data has a refcount of 2", LISTS_VERSION);
 
-                skip_if(!lists->count, 1, "Cannot verify org count")
-                    ok(lists->orgs[0]->lists == NULL, "V%u data has a NULL lists", LISTS_VERSION);
+                skip_if(!lists->orgs.count, 1, "Cannot verify org count")
+                    ok(((struct lists_org *)conf_segment_table_get(&lists->orgs, 0))->lists == NULL, "V%u data has a NULL lists", LISTS_VERSION);
 
                 ok(org = lists_find_org(lists, 1), "Found org 1 in the list");
 
@@ -359,20 +359,19 @@ main(void)
         OK_SXEL_ERROR("Couldn't clone a lists conf object");
         MOCKFAIL_END_TESTS();
 
-        MOCKFAIL_START_TESTS(3, LISTS_CLONE_LISTS_ORGS);
+        MOCKFAIL_START_TESTS(3, CONF_SEGMENT_TABLE_CLONE);
         create_atomic_file("test-lists-1", "%s", content[0]);
         ok(!confset_load(NULL), "Noted no update");
-        OK_SXEL_ERROR("Couldn't allocate 10 new lists org slots");
+        OK_SXEL_ERROR("Couldn't allocate 16 segment table chunk references");
         OK_SXEL_ERROR("Couldn't clone a lists conf object");
         MOCKFAIL_END_TESTS();
 
         MOCKFAIL_START_TESTS(2, lists_org_new);
         create_atomic_file("test-lists-1", "%s", content[0]);
         ok(!confset_load(NULL), "Noted no update");
-        OK_SXEL_ERROR("Cannot allocate 80 bytes for a lists_org object");
+        OK_SXEL_ERROR("Cannot allocate 112 bytes for a lists_org object");
         MOCKFAIL_END_TESTS();
 
-        MOCKFAIL_START_TESTS(4, LISTS_MORE_LISTS_ORGS);
         char filename[32];
 
         for (i = 1; i <= 10; i++) {
@@ -382,9 +381,11 @@ main(void)
 
         ok(confset_load(NULL), "Noted an update");
         OK_SXEL_ERROR(NULL);
+
+        MOCKFAIL_START_TESTS(2, CONF_SEGMENT_TABLE_CHUNK);
         create_atomic_file("test-lists-0", "%s", content[0]);
         ok(!confset_load(NULL), "Noted no update");
-        OK_SXEL_ERROR("Couldn't reallocate 20 lists org slots");
+        OK_SXEL_ERROR("Couldn't allocate a segment table chunk");
         MOCKFAIL_END_TESTS();
 
         create_atomic_file("test-lists-0", "%s", content[0]);    // Actually insert out of order to cover this case
@@ -399,6 +400,12 @@ main(void)
         OK_SXEL_ERROR("Failed to realloc prefbuilder list block to 1 elements");
         MOCKFAIL_END_TESTS();
 
+        MOCKFAIL_START_TESTS(2, LISTS_ORG_DOMAIN_INDEX);
+        create_atomic_file("test-lists-1", "%s", content[0]);
+        ok(!confset_load(NULL), "Noted no update");
+        OK_SXEL_ERROR("Cannot allocate a domain index of 2 entries (22 key bytes)");
+        MOCKFAIL_END_TESTS();
+
         unlink_test_files();
         ok(confset_load(NULL), "Noted an update");
     }
@@ -424,14 +431,14 @@ main(void)
         ok(confset_load(NULL), "Noted an update to test-lists-1");
         ok(set = confset_acquire(&gen), "Acquired the config set that includes urlprefs");
 
-        skip_if (!set, 59, "Tests that need the config set") {
+        skip_if (!set, 82, "Tests that need the config set") {
             ok(lists = lists_conf_get(set, CONF_LISTS), "Extracted the lists from the confset");
 
-            skip_if (!lists, 58, "Tests that need the lists") {
+            skip_if (!lists, 81, "Tests that need the lists") {
                 is(lists_find_org(lists, 2), NULL, "Didn't find org 2; there can only be 1");
                 ok(org = lists_find_org(lists, 1), "Found org 1 in the list");
 
-                skip_if (!org, 56, "Tests that need the org") {
+                skip_if (!org, 79, "Tests that need the org") {
                     diag("Test unfiltered domainlist lookups");
 
                     const uint8_t *name  = (const uint8_t *)"\6amazon\3com";
@@ -570,6 +577,52 @@ main(void)
                     subset[2] = 88888;
                     next      = lists_org_lookup_cidrlist(org, subset, count, 0, &ipaddr, &listid, &length, &bit);
                     is(next, 0, "5.6.7.8 found in cidrlist in {33333, 55555, 88888}");
+
+                    diag("Test multi-match lookups");
+
+                    struct lists_org_match matches[4];
+                    uint32_t               multi[] = {11111, 22222, 55555, 77777};
+
+                    name = (const uint8_t *)"\x8SHOPPING\6Amazon\3com";
+                    is(lists_org_match_domainlists(org, NULL, 0, name, matches, 4), 2, "SHOPPING.Amazon.com matched 2 domainlists");
+                    is(matches[0].listid,                                                11111, "The first match is listid 11111");
+                    is(matches[0].bit,                                                   70,    "bit is 70");
+                    is(dns_name_cmp((const uint8_t *)"\6amazon\3com", matches[0].name), 0,     "matched name is Amazon.com");
+                    is(matches[1].listid,                                                44444, "The second match is listid 44444");
+                    is(dns_name_cmp(name, matches[1].name),                              0,     "matched name is SHOPPING.Amazon.com");
+                    is(lists_org_match_domainlists(org, multi, 4, name, matches, 4), 1, "SHOPPING.Amazon.com matched 1 domainlist in the subset");
+                    is(lists_org_match_domainlists(org, NULL, 0, name, matches, 1), 1, "Only 1 match is returned when there's room for 1");
+                    is(lists_org_match_domainlists(org, NULL, 0, (const uint8_t *)"\6amazon\3net", matches, 4), 0,
+                       "amazon.net matched no domainlists");
+
+                    struct conf_info *rinfo = conf_info_new(NULL, "lists", "test-lists", NULL, LOADFLAGS_LISTS, NULL, 0);
+                    struct lists_org *rorg;
+
+                    fn = create_data("test-lists", "lists %u\ncount 1\n[lists:1]\n"
+                                     "99999:domain:80:0000000000000000000000000000000000000009:.\n", LISTS_VERSION);
+                    conf_loader_open(&cl, fn, NULL, NULL, 0, CONF_LOADER_DEFAULT);
+                    rorg = lists_org_new(0, &cl, rinfo);
+                    conf_loader_fini(&cl);
+                    unlink(fn);
+                    ok(rorg, "Read a domainlist with a root entry");
+                    is(lists_org_match_domainlists(rorg, NULL, 0, name, matches, 4), 1, "SHOPPING.Amazon.com matched the root domainlist");
+                    is(dns_name_cmp((const uint8_t *)"", matches[0].name), 0, "matched name is the root");
+                    is(lists_org_match_domainlists(rorg, NULL, 0, (const uint8_t *)"", matches, 4), 1, "The root matched the root domainlist");
+                    is(dns_name_cmp((const uint8_t *)"", matches[0].name), 0, "matched name is the root");
+                    lists_org_refcount_dec(rorg);
+                    conf_info_free(rinfo);
+
+                    is(lists_org_match_urllists(org, NULL, 0, url, strlen(url), matches, 4), 3, "amazon.com/shopping/books matched 3 urllists");
+                    is(matches[1].listid, 33333,                         "The second match is listid 33333");
+                    is(matches[1].length, strlen("amazon.com/shopping"), "matched url is amazon.com/shopping");
+                    is(lists_org_match_urllists(org, multi, 4, url, strlen(url), matches, 4), 2,
+                       "amazon.com/shopping/books matched 2 urllists in the subset");
+                    is(matches[1].listid, 55555,                         "The second match is listid 55555");
+
+                    is(lists_org_match_cidrlists(org, NULL, 0, &ipaddr, matches, 4), 2, "5.6.7.8 matched 2 cidrlists");
+                    is(matches[1].length, CIDR_MATCH_ALL, "The second match is 0.0.0.0/0 (match all)");
+                    is(lists_org_match_cidrlists(org, multi, 4, &ipaddr, matches, 4), 1, "5.6.7.8 matched 1 cidrlist in the subset");
+                    is(matches[0].listid, 77777,          "The match is listid 77777");
                 }
 
                 diag("Test the digest store directory");
@@ -2,10 +2,14 @@
 #include <mockfail.h>
 #include <tap.h>
 
+#include "dns-name.h"
 #include "namelist.h"
 
 #include "common-test.h"
 
+#define TEST_PREFIXES 64
+#define TEST_QUERIES  (2 * TEST_PREFIXES)
+
 int
 main(void)
 {
@@ -16,7 +20,7 @@ main(void)
     size_t len;
     int gen;
 
-    plan_tests(18);
+    plan_tests(27);
 
     kit_memory_initialize(false);
     /* KIT_ALLOC_SET_LOG(1); */
@@ -65,6 +69,11 @@ main(void)
         ok(!confset_load(NULL), "Cannot see an update to test-typo-exception-prefixes when namelist_allocate() fails to allocate a node");
         MOCKFAIL_END_TESTS();
 
+        MOCKFAIL_START_TESTS(1, NAMELIST_ALLOCATE_INDEX);
+        create_atomic_file("test-typo-exception-prefixes", "x\na.b\nc.d\n# Yet another comment\n");
+        ok(!confset_load(NULL), "Cannot see an update to test-typo-exception-prefixes when namelist_allocate() fails to allocate the index");
+        MOCKFAIL_END_TESTS();
+
         create_atomic_file("test-typo-exception-prefixes", "x\na.b\nc.d");
         ok(confset_load(NULL), "Noted an update to test-typo-exception-prefixes");
     }
@@ -85,6 +94,55 @@ main(void)
         }
     }
 
+    diag("The root name is a prefix of every name");
+    {
+        create_atomic_file("test-typo-exception-prefixes", "x\n.\n");
+        ok(confset_load(NULL), "Noted an update to test-typo-exception-prefixes");
+        ok(set = confset_acquire(&gen), "Acquired the new conf set");
+        skip_if(set == NULL, 2, "Cannot check content without acquiring config") {
+            tep = namelist_conf_get(set, CONF_TYPO_EXCEPTION_PREFIXES);
+            ok(namelist_prefix_match(tep, (const uint8_t *)"\1d\1d\7opendns\3com"), "d.d.opendns.com matches the root name");
+            ok(namelist_prefix_match(tep, (const uint8_t *)""), "The root matches the root name");
+            confset_release(set);
+        }
+    }
+
+    diag("Many prefixes are matched through the index");
+    {
+        uint8_t prefixes[TEST_PREFIXES][DNS_MAXLEN_NAME], query[DNS_MAXLEN_NAME];
+        char data[TEST_PREFIXES * 16], str[64];
+        unsigned i, j, linear, matched, mismatched;
+        size_t dlen;
+
+        for (dlen = 0, i = 0; i < TEST_PREFIXES; i++) {
+            snprintf(str, sizeof(str), i % 2 ? "p%u" : "q%u.R", i);
+            dlen += snprintf(data + dlen, sizeof(data) - dlen, "%s\n", str);
+            dns_name_sscan(str, "", prefixes[i]);
+        }
+
+        create_atomic_file("test-typo-exception-prefixes", "%s", data);
+        ok(confset_load(NULL), "Loaded %u prefixes", TEST_PREFIXES);
+        ok(set = confset_acquire(&gen), "Acquired the new conf set");
+        skip_if(set == NULL, 2, "Cannot check content without acquiring config") {
+            tep = namelist_conf_get(set, CONF_TYPO_EXCEPTION_PREFIXES);
+
+            for (matched = mismatched = i = 0; i < TEST_QUERIES; i++) {
+                snprintf(str, sizeof(str), i % 2 ? "P%u.example.com" : "q%u.r.example.com", i);
+                dns_name_sscan(str, "", query);
+
+                for (linear = j = 0; j < TEST_PREFIXES && !linear; j++)
+                    linear = dns_name_has_prefix(query, prefixes[j]);
+
+                matched += linear;
+                mismatched += namelist_prefix_match(tep, query) != linear;
+            }
+
+            is(mismatched, 0, "The index matches the same queries as a linear scan");
+            is(matched, TEST_PREFIXES, "Half of the queries matched");
+            confset_release(set);
+        }
+    }
+
     unlink("test-typo-exception-prefixes");
     confset_unload();
     is(memory_allocations(), start_allocations, "All memory allocations were freed after conf interaction tests");
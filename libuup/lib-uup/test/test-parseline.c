@@ -8,12 +8,13 @@
 int
 main(void)
 {
-    const char *key, *value;
+    const char *key, *value, *end;
     char buf[1024], *p;
     size_t klen, vlen;
+    uint64_t val;
     int n;
 
-    plan_tests(36);
+    plan_tests(49);
 
     diag("Comments at the end of lines are removed");
     {
@@ -104,6 +105,24 @@ main(void)
         ok(word_match("field5", key, klen), "The first token is 'field5'");
     }
 
+    diag("Numbers can be parsed without sscanf()");
+    {
+        ok((end = parse_uint("1234567890:", &val)) && *end == ':', "Parsed a decimal number up to the terminator");
+        is(val, 1234567890, "The decimal value is correct");
+        ok((end = parse_uint("18446744073709551615", &val)) && *end == '\0', "Parsed UINT64_MAX");
+        is(val, UINT64_MAX, "The UINT64_MAX value is correct");
+        ok(parse_uint("18446744073709551616", &val), "Parsed a number bigger than UINT64_MAX");
+        is(val, UINT64_MAX, "The overflowed value saturates at UINT64_MAX");
+        ok(!parse_uint(":1", &val), "A number must start with a digit");
+        ok(!parse_uint(" 1", &val), "Leading whitespace is not skipped");
+        ok(!parse_uint("-1", &val), "Signs are not accepted");
+
+        ok((end = parse_xuint("0123456789abcdefABCDEFg", &val)) && *end == 'g', "Parsed a hex number up to the first non-hex digit");
+        is(val, UINT64_MAX, "The overflowed hex value saturates at UINT64_MAX");
+        ok((end = parse_xuint("fF:", &val)) && *end == ':' && val == 0xff, "Parsed a mixed case hex number");
+        ok(!parse_xuint("x1", &val), "A hex number must start with a hex digit");
+    }
+
     diag("Test allocation failure");
     {
         MOCKFAIL_START_TESTS(1, word_dup);
@@ -46,7 +46,7 @@ main(void)
     int                bit, i;
     pref_t             pr;
 
-    plan_tests(201 + 3 * ((PREF_CATEGORIES_MAX_BITS + 11) / 12));
+    plan_tests(224 + 3 * ((PREF_CATEGORIES_MAX_BITS + 11) / 12));
 
     conf_initialize(NULL, ".", false, NULL);
     kit_memory_initialize(false);
@@ -446,6 +446,138 @@ main(void)
         confset_unload();    // Finalize conf subsytem
     }
 
+    diag("Prefblock lookups use the hash tables built by prefbuilder_consume()");
+    {
+        unsigned bad, id, n;
+
+        n = 1000;
+        prefbuilder_init(&pbuild, 0, NULL, NULL);
+        ok(prefbuilder_allocident(&pbuild, 1) && prefbuilder_alloclist(&pbuild, 1) && prefbuilder_allocorg(&pbuild, n)
+           && prefbuilder_allocbundle(&pbuild, n), "Allocated space for %u orgs and bundles", n);
+
+        for (bad = 0, id = 0; id < n; id++)
+            bad += !prefbuilder_addorg(&pbuild, 2 * id + 1, 0, &cat, 365, 0, 1001, 0)
+                 + !prefbuilder_addbundle(&pbuild, AT_BUNDLE, 3 * id + 1, 0, 0, &cat, sgids_zero);
+
+        is(bad, 0, "Added %u orgs with odd ids and %u bundles with every third id", n, n);
+        ok(prefbuilder_addidentityforbundle(&pbuild, 0, ORIGINTYPE_SITE, 1, AT_BUNDLE, 1), "Added an identity");
+        ok(pblk = prefbuilder_consume(&pbuild), "Consumed the prefbuilder");
+        ok(pblk->hash.org.slot && pblk->hash.bundle.slot, "Built the org and bundle hash tables");
+
+        for (bad = 0, id = 0; id < 2 * n + 2; id++)
+            bad += prefblock_org(pblk, id) != preforg_get(pblk->resource.org, pblk->count.orgs, id);
+
+        is(bad, 0, "Hashed org lookups agree with binary searches for every id");
+
+        for (bad = 0, id = 0; id < 3 * n + 3; id++)
+            bad += prefblock_bundle(pblk, AT_BUNDLE, id) != prefbundle_get(pblk->resource.bundle, pblk->count.bundles, AT_BUNDLE, id)
+                 + (prefblock_bundle(pblk, AT_ORIGIN, id) != NULL);
+
+        is(bad, 0, "Hashed bundle lookups agree with binary searches for every id and actype");
+
+        prefblock_free(pblk);
+
+        prefbuilder_init(&pbuild, 0, NULL, NULL);
+        prefbuilder_allocident(&pbuild, 1);
+        prefbuilder_alloclist(&pbuild, 1);
+        prefbuilder_allocbundle(&pbuild, 1);
+        prefbuilder_addbundle(&pbuild, AT_BUNDLE, 42, 0, 0, &cat, sgids_zero);
+        prefbuilder_addidentityforbundle(&pbuild, 0, ORIGINTYPE_SITE, 0, AT_BUNDLE, 42);
+        pblk = NULL;
+
+        MOCKFAIL_START_TESTS(3, PREFHASH_BUILD);
+        ok(pblk = prefbuilder_consume(&pbuild), "Consumed a prefbuilder when its bundle hash table can't be allocated");
+        ok(pblk && !pblk->hash.bundle.slot, "The bundle hash table wasn't built");
+        ok(pblk && prefblock_bundle(pblk, AT_BUNDLE, 42), "Bundle lookups fall back to binary searches");
+        MOCKFAIL_END_TESTS();
+
+        prefbuilder_fini(&pbuild);
+        prefblock_free(pblk);
+    }
+
+    diag("Prefs are cooked from the per bundle policies built by prefbuilder_consume()");
+    {
+        uint32_t sgids[SETTINGGROUP_IDX_COUNT] = {0, 22, 23, 0, 0};
+        pref_categories_t sgcat, extcat;
+        struct prefcooked *cooked;
+        struct prefblock *eblk;
+        pref_t fallback;
+
+        /* An external parent org with settinggroup 22
+         */
+        pref_categories_setnone(&cat);
+        pref_categories_setnone(&extcat);
+        pref_categories_setbit(&extcat, 7);
+        prefbuilder_init(&pbuild, PREFBUILDER_FLAG_NONE, NULL, NULL);
+        prefbuilder_allocsettinggroup(&pbuild, 1);
+        prefbuilder_addsettinggroup(&pbuild, 1, 22, PREF_BUNDLEFLAGS_TYPO_CORRECTION, &extcat, &cat, &cat);
+        prefbuilder_allocorg(&pbuild, 1);
+        prefbuilder_addorg(&pbuild, 3, 0, &cat, 0, 0, 3, 0);
+        ok(eblk = prefbuilder_consume(&pbuild), "Built the external parent org's prefblock");
+
+        /* A child org with settinggroup 23, and two bundles referring to settinggroups 22 and 23
+         */
+        pref_categories_setnone(&sgcat);
+        pref_categories_setbit(&sgcat, 8);
+        prefbuilder_init(&pbuild, PREFBUILDER_FLAG_NONE, NULL, NULL);
+        prefbuilder_allocident(&pbuild, 1);
+        prefbuilder_alloclist(&pbuild, 1);
+        prefbuilder_allocsettinggroup(&pbuild, 1);
+        prefbuilder_addsettinggroup(&pbuild, 2, 23, 0, &sgcat, &cat, &cat);
+        prefbuilder_allocbundle(&pbuild, 2);
+        prefbuilder_addbundle(&pbuild, AT_BUNDLE, 1, 0, 0, &cat, sgids_zero);
+        prefbuilder_addbundle(&pbuild, AT_BUNDLE, 2, 0, 0, &cat, sgids);
+        prefbuilder_allocorg(&pbuild, 1);
+        prefbuilder_addorg(&pbuild, 4, 0, &cat, 0, 0, 4, 3);
+        prefbuilder_addidentityforbundle(&pbuild, 0, ORIGINTYPE_SITE, 4, AT_BUNDLE, 2);
+        ok(pblk = prefbuilder_consume(&pbuild), "Consumed a prefbuilder with a settinggroup and two bundles");
+        ok(pblk->cooked, "Built the per bundle policies");
+
+        pref_init_bybundle(&pr, pblk, NULL, NULL, 4, 1);
+        ok(pref_categories_getbit(pref_categories(&pr), 8), "Bundle 2 blocks its own org's settinggroup's category");
+        ok(!pref_categories_getbit(pref_categories(&pr), 7), "Bundle 2 can't see the external settinggroup");
+
+        pref_init_bybundle(&pr, pblk, NULL, NULL, 4, 0);
+        ok(!pref_categories_getbit(pref_categories(&pr), 8) && pref_categories_getbit(pref_categories(&pr), CATEGORY_BIT_BLOCKLIST),
+           "Bundle 1 only blocks the implicit categories");
+
+        pref_init_bybundle(&pr, pblk, NULL, NULL, 4, 1);
+        cooked = pblk->cooked;
+        pblk->cooked = NULL;
+        pref_init_bybundle(&fallback, pblk, NULL, NULL, 4, 1);
+        ok(pref_categories_equal(pref_categories(&pr), pref_categories(&fallback)), "Cooking per query gives the same categories");
+        is(pref_bundleflags(&pr), pref_bundleflags(&fallback), "Cooking per query gives the same bundle flags");
+
+        pblk->cooked = cooked;
+
+        pref_init_bybundle(&pr, pblk, eblk, NULL, 4, 1);
+        ok(pref_categories_getbit(pref_categories(&pr), 7) && pref_categories_getbit(pref_categories(&pr), 8),
+           "With an external parent org, bundle 2 is cooked per query and blocks both settinggroups' categories");
+        ok(pref_bundleflags(&pr) & PREF_BUNDLEFLAGS_TYPO_CORRECTION, "Bundle 2 has the external settinggroup's bundle flag");
+        prefblock_free(eblk);
+        prefblock_free(pblk);
+
+        prefbuilder_init(&pbuild, PREFBUILDER_FLAG_NONE, NULL, NULL);
+        prefbuilder_allocident(&pbuild, 1);
+        prefbuilder_alloclist(&pbuild, 1);
+        prefbuilder_allocsettinggroup(&pbuild, 1);
+        prefbuilder_addsettinggroup(&pbuild, 2, 23, 0, &sgcat, &cat, &cat);
+        prefbuilder_allocbundle(&pbuild, 1);
+        prefbuilder_addbundle(&pbuild, AT_BUNDLE, 2, 0, 0, &cat, sgids);
+        prefbuilder_addidentityforbundle(&pbuild, 0, ORIGINTYPE_SITE, 0, AT_BUNDLE, 2);
+        pblk = NULL;
+
+        MOCKFAIL_START_TESTS(3, PREFBLOCK_COOK);
+        ok(pblk = prefbuilder_consume(&pbuild), "Consumed a prefbuilder when its per bundle policies can't be allocated");
+        ok(pblk && !pblk->cooked, "The per bundle policies weren't built");
+        pref_init_bybundle(&pr, pblk, NULL, NULL, 0, 0);
+        ok(pref_categories_getbit(pref_categories(&pr), 8), "Prefs are cooked per query instead");
+        MOCKFAIL_END_TESTS();
+
+        prefbuilder_fini(&pbuild);
+        prefblock_free(pblk);
+    }
+
     is(memory_allocations(), start_allocations, "All memory allocations were freed after conf interaction tests");
     /* KIT_ALLOC_SET_LOG(0); */
 
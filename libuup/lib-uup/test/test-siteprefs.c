@@ -6,6 +6,7 @@
 
 #include "odns.h"
 #include "oolist.h"
+#include "radixtree128.h"
 #include "siteprefs-private.h"
 #include "uint32list.h"
 #include "xray.h"
@@ -15,6 +16,60 @@
 #define LOADFLAGS_SITEPREFS \
             (LOADFLAGS_FP_ALLOW_OTHER_TYPES| LOADFLAGS_FP_ELEMENTTYPE_DOMAIN | LOADFLAGS_FP_ELEMENTTYPE_APPLICATION)
 
+/*
+ * Look up addresses in an asset with hundreds of nested CIDRs; all containing CIDRs are collected, most specific first
+ */
+static void
+check_many_cidrs(struct siteprefs *sp, struct oolist **ids, const char *how)
+{
+    struct odns odns;
+    char buf[4096];
+    pref_t pr;
+
+    memset(&odns, '\0', sizeof(odns));
+    odns.fields          = ODNS_FIELD_REMOTEIP4 | ODNS_FIELD_VA;
+    odns.va_id           = 7;
+    odns.remoteip.family = AF_INET;
+    inet_aton("10.1.5.7", &odns.remoteip.in_addr);
+    oolist_clear(ids);
+    ok(siteprefs_get(&pr, sp, &odns, ids, NULL), "%s: Got prefs for 10.1.5.7", how);
+    is_eq(oolist_origins_to_buf(*ids, buf, sizeof(buf)), "32:21:0:0:0,24005:21:0:0:0,16:21:0:0:0,8:21:0:0:0",
+          "%s: Collected the /32, /24, /16 and /8 origins for 10.1.5.7", how);
+    is(PREF_VALID(&pr) ? PREF_IDENT(&pr)->originid : 0, 16, "%s: The priority 0 /16 was selected for 10.1.5.7", how);
+
+    inet_aton("10.1.150.1", &odns.remoteip.in_addr);
+    oolist_clear(ids);
+    siteprefs_get(&pr, sp, &odns, ids, NULL);
+    is_eq(oolist_origins_to_buf(*ids, buf, sizeof(buf)), "24150:21:0:0:0,16:21:0:0:0,8:21:0:0:0",
+          "%s: Collected the /24, /16 and /8 origins for 10.1.150.1", how);
+
+    inet_aton("10.2.0.1", &odns.remoteip.in_addr);
+    siteprefs_get(&pr, sp, &odns, ids, NULL);
+    is(PREF_VALID(&pr) ? PREF_IDENT(&pr)->originid : 0, 8, "%s: Only the /8 contains 10.2.0.1", how);
+
+    inet_aton("11.0.0.1", &odns.remoteip.in_addr);
+    ok(!siteprefs_get(&pr, sp, &odns, ids, NULL), "%s: Nothing contains 11.0.0.1", how);
+
+    odns.va_id = 8;
+    inet_aton("10.1.5.7", &odns.remoteip.in_addr);
+    siteprefs_get(&pr, sp, &odns, ids, NULL);
+    is(PREF_VALID(&pr) ? PREF_IDENT(&pr)->originid : 0, 99, "%s: Asset 8 has its own CIDR for 10.1.5.7", how);
+
+    odns.va_id = 6;
+    ok(!siteprefs_get(&pr, sp, &odns, ids, NULL), "%s: Asset 6 has no CIDRs", how);
+
+    odns.va_id           = 7;
+    odns.fields          = ODNS_FIELD_REMOTEIP6 | ODNS_FIELD_VA;
+    odns.remoteip.family = AF_INET6;
+    inet_pton(AF_INET6, "2001:db8:63::1", &odns.remoteip.in6_addr);
+    oolist_clear(ids);
+    siteprefs_get(&pr, sp, &odns, ids, NULL);
+    is_eq(oolist_origins_to_buf(*ids, buf, sizeof(buf)), "648099:21:0:0:0,632:21:0:0:0",
+          "%s: Collected the /48 and /32 origins for 2001:db8:63::1", how);
+    is(PREF_VALID(&pr) ? PREF_IDENT(&pr)->originid : 0, 648099, "%s: The narrowest CIDR wins a priority tie", how);
+    oolist_clear(ids);
+}
+
 int
 main(void)
 {
@@ -31,7 +86,7 @@ main(void)
     unsigned i;
     pref_t pr;
 
-    plan_tests(216);
+    plan_tests(247);
 
     conf_initialize(".", ".", false, NULL);
     kit_memory_initialize(false);
@@ -580,6 +635,7 @@ main(void)
                                   "1:6789971::1.2.3.4/32:6789971:21:2748:0:1\n";
         const char *withcolon = ":";
         const char *withoutcolon = "";
+        const char *withjunk = "x5";
 
         fn = create_data("test-siteprefs", "siteprefs %u\ncount 8\n%s%s%s", SITEPREFS_VERSION, precontent, withoutcolon, postcontent);
         conf_loader_open(&cl, fn, NULL, NULL, 0, CONF_LOADER_DEFAULT);
@@ -594,6 +650,13 @@ main(void)
         unlink(fn);
         ok(!sp, "Failed to read version %u data with invalid bundle lists", SITEPREFS_VERSION);
         OK_SXEL_ERROR(": 10: Unrecognised bundle line (invalid warn app list ':')");
+
+        fn = create_data("test-siteprefs", "siteprefs %u\ncount 8\n%s%s%s", SITEPREFS_VERSION, precontent, withjunk, postcontent);
+        conf_loader_open(&cl, fn, NULL, NULL, 0, CONF_LOADER_DEFAULT);
+        sp = siteprefs_new(&cl, LOADFLAGS_SITEPREFS);
+        unlink(fn);
+        ok(!sp, "Failed to read version %u data with a non-numeric bundle list", SITEPREFS_VERSION);
+        OK_SXEL_ERROR(": 10: Unrecognised bundle line (invalid warn app list 'x5')");
     }
 
     diag("Test V%u data load with invalid application lists", SITEPREFS_VERSION);
@@ -1123,6 +1186,55 @@ main(void)
         }
     }
 
+    diag("Test V%u lookups with hundreds of CIDRs for an asset", SITEPREFS_VERSION);
+    {
+        char data[32768];
+        size_t len;
+
+        len = snprintf(data, sizeof(data), "siteprefs %u\ncount 307\n[bundles:2]\n"
+                                           "0:1:1:40:F0000000000000000:::::::::::\n"
+                                           "0:2:0:40:F0000000000000000:::::::::::\n"
+                                           "[identities:305]\n"
+                                           "1:7::2001:db8::/32:632:21:0:0:1\n", SITEPREFS_VERSION);
+        for (i = 0; i < 100; i++)
+            len += snprintf(data + len, sizeof(data) - len, "1:7::2001:db8:%x::/48:%u:21:0:0:1\n", i, 648000 + i);
+        len += snprintf(data + len, sizeof(data) - len, "1:7::10.0.0.0/8:8:21:0:0:1\n1:7::10.1.0.0/16:16:21:0:0:2\n");
+        for (i = 0; i < 200; i++)
+            len += snprintf(data + len, sizeof(data) - len, "1:7::10.1.%u.0/24:%u:21:0:0:1\n%s", i, 24000 + i,
+                            i == 5 ? "1:7::10.1.5.7/32:32:21:0:0:1\n" : "");
+        snprintf(data + len, sizeof(data) - len, "1:8::10.1.5.0/24:99:21:0:0:1\n");
+
+        fn = create_data("test-siteprefs", "%s", data);
+        conf_loader_open(&cl, fn, NULL, NULL, 0, CONF_LOADER_DEFAULT);
+        ok(sp = siteprefs_new(&cl, LOADFLAGS_SITEPREFS), "Constructed struct siteprefs with 305 identities");
+        skip_if(!sp, 11, "Cannot run these tests without siteprefs") {
+            ok(sp->index, "The siteprefs have an index");
+            check_many_cidrs(sp, &ids, "indexed");
+            siteprefs_refcount_dec(sp);
+        }
+
+        MOCKFAIL_START_TESTS(13, SITEPREFS_INDEX);
+        conf_loader_open(&cl, fn, NULL, NULL, 0, CONF_LOADER_DEFAULT);
+        ok(sp = siteprefs_new(&cl, LOADFLAGS_SITEPREFS), "Constructed struct siteprefs without an index");
+        OK_SXEL_ERROR("Couldn't allocate ");
+        ok(!sp->index, "The siteprefs have no index");
+        check_many_cidrs(sp, &ids, "not indexed");
+        siteprefs_refcount_dec(sp);
+        MOCKFAIL_END_TESTS();
+
+        MOCKFAIL_START_TESTS(4, radixtree128_new);
+        MOCKFAIL_SET_FREQ(3);
+        conf_loader_open(&cl, fn, NULL, NULL, 0, CONF_LOADER_DEFAULT);
+        ok(sp = siteprefs_new(&cl, LOADFLAGS_SITEPREFS), "Constructed struct siteprefs when a radix tree node can't be allocated");
+        OK_SXEL_ERROR("Couldn't allocate ");
+        OK_SXEL_ERROR("Couldn't populate a siteprefs index of 305 keys");
+        ok(!sp->index, "The siteprefs have no index");
+        siteprefs_refcount_dec(sp);
+        MOCKFAIL_END_TESTS();
+
+        unlink(fn);
+    }
+
     /* Based on the pref-priotities.test "netprefs.win + dirprefs/dirprefs.va + siteprefs.win"
      */
     diag("Test error that escaped coverage testing: level 2 should override level 1 if it's priority is a smaller number");
@@ -102,7 +102,7 @@ main(void)
     pref_t pr;
     int gen;
 
-    plan_tests(79);
+    plan_tests(84);
 
 #ifdef __FreeBSD__
     plan_skip_all("DPT-186 - Need to implement inotify as dtrace event");
@@ -316,14 +316,14 @@ main(void)
             ok(set = confset_acquire(&gen), "Acquired the new config set");
             ok(urlprefs = urlprefs_conf_get(set, CONF_URLPREFS), "Got urlprefs");
             skip_if(!urlprefs, 5, "Cannot test urlprefs NULL value") {
-                is(urlprefs->count, 2, "urlprefs contains 2 org");
+                is(urlprefs->org.count, 2, "urlprefs contains 2 org");
 
-                skip_if(urlprefs->count != 2, 4, "Not looking at urlprefs content due to incorrect count") {
-                    is(urlprefs->org[0]->cs.id, 2748, "Org 2748 is present");
-                    is(urlprefs->org[1]->cs.id, 9876, "Org 9876 is present");
+                skip_if(urlprefs->org.count != 2, 4, "Not looking at urlprefs content due to incorrect count") {
+                    is(PREFS_ORG_GET(&urlprefs->org, 0)->cs.id, 2748, "Org 2748 is present");
+                    is(PREFS_ORG_GET(&urlprefs->org, 1)->cs.id, 9876, "Org 9876 is present");
 
-                    ok(!urlprefs->org[1]->cs.loaded, "Org 9876 shows it was not loaded");
-                    ok(urlprefs->org[1]->cs.failed_load, "Org 9876 shows a failed load");
+                    ok(!PREFS_ORG_GET(&urlprefs->org, 1)->cs.loaded, "Org 9876 shows it was not loaded");
+                    ok(PREFS_ORG_GET(&urlprefs->org, 1)->cs.failed_load, "Org 9876 shows a failed load");
                 }
             }
             confset_release(set);
@@ -367,31 +367,31 @@ main(void)
             ok(set = confset_acquire(&gen), "Reacquired the new config set");
             ok(urlprefs = urlprefs_conf_get(set, CONF_URLPREFS), "Got urlprefs");
             skip_if(!urlprefs, 8, "Cannot test urlprefs NULL value") {
-                is(urlprefs->count, 4, "urlprefs contains 4 orgs");
+                is(urlprefs->org.count, 4, "urlprefs contains 4 orgs");
 
-                skip_if(urlprefs->count != 4, 7, "Not looking at urlprefs content due to incorrect count") {
-                    is(urlprefs->org[0]->cs.id, 1, "Org 1 is present");
-                    is(urlprefs->org[1]->cs.id, 2, "Org 2 is present");
-                    is(urlprefs->org[2]->cs.id, 4, "Org 4 is present");
-                    is(urlprefs->org[3]->cs.id, 2748, "Org 2748 is present");
+                skip_if(urlprefs->org.count != 4, 7, "Not looking at urlprefs content due to incorrect count") {
+                    is(PREFS_ORG_GET(&urlprefs->org, 0)->cs.id, 1, "Org 1 is present");
+                    is(PREFS_ORG_GET(&urlprefs->org, 1)->cs.id, 2, "Org 2 is present");
+                    is(PREFS_ORG_GET(&urlprefs->org, 2)->cs.id, 4, "Org 4 is present");
+                    is(PREFS_ORG_GET(&urlprefs->org, 3)->cs.id, 2748, "Org 2748 is present");
 
-                    ok(!urlprefs->org[1]->cs.loaded, "Org 2 shows it was not loaded");
-                    ok(urlprefs->org[1]->cs.failed_load, "Org 2 shows a failed load");
-                    is(prefblock_count_total(urlprefs->org[2]->fp.values), 0, "Org 4 is empty");
+                    ok(!PREFS_ORG_GET(&urlprefs->org, 1)->cs.loaded, "Org 2 shows it was not loaded");
+                    ok(PREFS_ORG_GET(&urlprefs->org, 1)->cs.failed_load, "Org 2 shows a failed load");
+                    is(prefblock_count_total(PREFS_ORG_GET(&urlprefs->org, 2)->fp.values), 0, "Org 4 is empty");
                 }
-                if (urlprefs->count != 4)
-                    for (i = 0; i < urlprefs->count; i++)
-                        diag("Org %u has id %u", i, urlprefs->org[i]->cs.id);
+                if (urlprefs->org.count != 4)
+                    for (i = 0; i < urlprefs->org.count; i++)
+                        diag("Org %u has id %u", i, PREFS_ORG_GET(&urlprefs->org, i)->cs.id);
             }
 
             confset_release(set);
         }
 
         /* Verify the handling of out-of-memory trying to malloc a urlprefs-org on reload */
-        MOCKFAIL_START_TESTS(4, URLPREFS_CLONE_ORGS);
+        MOCKFAIL_START_TESTS(4, CONF_SEGMENT_TABLE_CLONE);
         create_atomic_file("test-urlprefs-3", "we'll never even get to see this data");
         ok(!confset_load(NULL), "Didn't see a change to test-urlprefs-3 due to a urlprefs-org slot allocation failure");
-        OK_SXEL_ERROR("Couldn't allocate 10 new urlprefs org slots");
+        OK_SXEL_ERROR("Couldn't allocate 16 segment table chunk references");
         OK_SXEL_ERROR("Couldn't clone a urlprefs conf object");
         OK_SXEL_ERROR(NULL);
         MOCKFAIL_END_TESTS();
@@ -403,7 +403,7 @@ main(void)
         ok(confset_load(NULL), "Noted an update to test-urlprefs-[345]");
 
         create_atomic_file("test-urlprefs-4", "%s", content[3]);
-        ok(confset_load(NULL), "Noted an update after test-urlprefs-4 was rewritten");
+        ok(!confset_load(NULL), "Noted no update after test-urlprefs-4 was rewritten with the same content");
 
         ok(set = confset_acquire(&gen), "Acquired the new config");
         wait_next_sec();
@@ -453,8 +453,8 @@ main(void)
 
         confset_release(set);
 
-        /* Verify the handling of out-of-memory trying to realloc urlprefs-org slots on reload (realloced every 10+ slots) */
-        MOCKFAIL_START_TESTS(3, URLPREFS_MOREORGS);
+        /* Verify the handling of out-of-memory trying to copy urlprefs-org table chunks on reload */
+        MOCKFAIL_START_TESTS(8, CONF_SEGMENT_TABLE_CHUNK);
         snprintf(content[0], sizeof(content[0]), "urlprefs %u\ncount 0\n# Different\n", URLPREFS_VERSION);
 
         /* Was 106-110 in dirprefs, but bumped up due to eliminating other tests. Also, reverse order to exercise index code */
@@ -463,10 +463,10 @@ main(void)
             create_atomic_file(buf, "%s", content[0]);
         }
 
-        /* Doesn't always fail. TODO: Verify that not all 10 orgs were added (using info.updates?) */
-        ok(!confset_load(NULL) || 1, "Shouldn't see changes to all of test-urlprefs-106 - test-urlprefs-115 due to a urlprefs-org slot re-allocation failure");
-        OK_SXEL_ERROR("Couldn't reallocate 20 urlprefs org slots");
-        OK_SXEL_ERROR("Couldn't reallocate 20 urlprefs org slots");
+        /* Verify that none of the 7 orgs were added */
+        ok(!confset_load(NULL), "Didn't see changes to test-urlprefs-109 - test-urlprefs-115 due to a urlprefs-org chunk allocation failure");
+        for (orgid = 109; orgid <= 115; orgid++)
+            OK_SXEL_ERROR("Couldn't allocate a segment table chunk");
         MOCKFAIL_END_TESTS();
         OK_SXEL_ERROR(NULL);
     }
@@ -11,10 +11,10 @@ main(void)
     char buf[271], buf2[271], buf3[521];
     uint64_t start_allocations;
     const char *sxediag;
-    struct xray x;
+    struct xray x, *xp = &x;
     unsigned i, pid;
 
-    plan_tests(45);
+    plan_tests(48);
 
     /* SXELOG adds the PID to each log entry on FreeBSD, so adjust the size for including this */
 #if __FreeBSD__
@@ -44,9 +44,13 @@ main(void)
     xray(&x, 6, "This diagnostic goes nowhere, x is not uninitialized");
     is(x.used, 0, "Our xray() call did nothing");
 
+    ok(!XRAYING(xp), "An uninitialized 'x' isn't xraying");
+    is(XRAY_WANTED(xp, 6), XRAY_LOGGING(6), "An uninitialized 'x' only wants XRAY6 arguments if they're being logged");
+
     diag("Test normal initalization");
     ok(xray_init_for_client(&x, 100), "xray_init_for_client() succeeds");
     ok(x.addr, "xray_init_for_client() set its address");
+    ok(XRAY_WANTED(xp, 7), "An initialized 'x' wants XRAY7 arguments");
     ok(xraying_for_client(&x), "xraying_for_client() succeeds");
     xray_fini_for_client(&x);
     ok(!x.addr, "xray_fini() cleared the address");
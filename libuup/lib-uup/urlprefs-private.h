@@ -4,19 +4,16 @@
 #include "urlprefs.h"
 
 /*
- * A struct urlprefs is a dynamic array of urlprefs_org structure pointers
+ * A struct urlprefs is a conf_segment_table of urlprefs_org structure pointers
  */
 struct urlprefs {
     struct conf conf;
-    unsigned count;            /* # allocated org entries */
     time_t mtime;              /* last modification */
-    struct prefs_org **org;    /* a block of 'count' organization pointers */
+    struct conf_segment_table org; /* prefs_org organizations in id order */
 };
 
 #if defined(SXE_DEBUG) || defined(SXE_COVERAGE)    // Define unique tags for mockfails
 #   define URLPREFS_CLONE      ((const char *)urlprefs_register + 0)
-#   define URLPREFS_CLONE_ORGS ((const char *)urlprefs_register + 1)
-#   define URLPREFS_MOREORGS   ((const char *)urlprefs_register + 2)
 #endif
 
 #endif
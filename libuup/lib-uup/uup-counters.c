@@ -8,4 +8,15 @@ uup_counters_init(void)
     uup_counters.object_hash_hit       = kit_counter_new("uup.object-hash.hit");
     uup_counters.object_hash_miss      = kit_counter_new("uup.object-hash.miss");
     uup_counters.object_hash_overflows = kit_counter_new("uup.object-hash.overflows");
+
+    uup_counters.conf_dispatch_segment_jobs    = kit_counter_new("uup.conf-dispatch.segment.jobs");
+    uup_counters.conf_dispatch_segment_wait_ms = kit_counter_new("uup.conf-dispatch.segment.wait-ms");
+    uup_counters.conf_dispatch_file_jobs       = kit_counter_new("uup.conf-dispatch.file.jobs");
+    uup_counters.conf_dispatch_file_wait_ms    = kit_counter_new("uup.conf-dispatch.file.wait-ms");
+
+    uup_counters.conf_generations      = kit_counter_new("uup.conf.generations");
+    uup_counters.conf_published        = kit_counter_new("uup.conf.published");
+    uup_counters.conf_publish_lag_ms   = kit_counter_new("uup.conf.publish-lag-ms");
+    uup_counters.conf_publish_deferred = kit_counter_new("uup.conf.publish-deferred");
+    uup_counters.conf_unchanged        = kit_counter_new("uup.conf.unchanged");
 }
@@ -7,6 +7,15 @@ struct uup_counters {
     kit_counter_t object_hash_hit;
     kit_counter_t object_hash_miss;
     kit_counter_t object_hash_overflows;
+    kit_counter_t conf_dispatch_segment_jobs;
+    kit_counter_t conf_dispatch_segment_wait_ms;
+    kit_counter_t conf_dispatch_file_jobs;
+    kit_counter_t conf_dispatch_file_wait_ms;
+    kit_counter_t conf_generations;
+    kit_counter_t conf_published;
+    kit_counter_t conf_publish_lag_ms;
+    kit_counter_t conf_publish_deferred;
+    kit_counter_t conf_unchanged;
 };
 
 extern struct uup_counters uup_counters;
@@ -15,6 +24,17 @@ extern struct uup_counters uup_counters;
 #define COUNTER_UUP_OBJECT_HASH_HIT        (uup_counters.object_hash_hit)
 #define COUNTER_UUP_OBJECT_HASH_OVERFLOWS (uup_counters.object_hash_overflows)
 
+#define COUNTER_UUP_CONF_DISPATCH_SEGMENT_JOBS    (uup_counters.conf_dispatch_segment_jobs)
+#define COUNTER_UUP_CONF_DISPATCH_SEGMENT_WAIT_MS (uup_counters.conf_dispatch_segment_wait_ms)
+#define COUNTER_UUP_CONF_DISPATCH_FILE_JOBS       (uup_counters.conf_dispatch_file_jobs)
+#define COUNTER_UUP_CONF_DISPATCH_FILE_WAIT_MS    (uup_counters.conf_dispatch_file_wait_ms)
+
+#define COUNTER_UUP_CONF_GENERATIONS      (uup_counters.conf_generations)
+#define COUNTER_UUP_CONF_PUBLISHED        (uup_counters.conf_published)
+#define COUNTER_UUP_CONF_PUBLISH_LAG_MS   (uup_counters.conf_publish_lag_ms)
+#define COUNTER_UUP_CONF_PUBLISH_DEFERRED (uup_counters.conf_publish_deferred)
+#define COUNTER_UUP_CONF_UNCHANGED        (uup_counters.conf_unchanged)
+
 #include "uup-counters-proto.h"
 
 #endif
@@ -32,6 +32,17 @@
  *         xray(x, 6, "%s", data);
  *     }
  *
+ * Arguments that are only formatted for XRAY6() or XRAY7() (a list name passed
+ * down to a lookup, for example) shouldn't be built on every call.  XRAY_WANTED()
+ * is true only when the message would be seen, either in the xray or (for debug
+ * builds) in the log:
+ *
+ *     if (XRAY_WANTED(x, 6))
+ *         snprintf(listname, sizeof(listname), "preflist %u", id);
+ *
+ * XRAY_LOGGING() is the same test without an xray, and is always false in
+ * release builds.
+ *
  * Sometimes data is so interesting that we don't want to truncate it at all.
  * To split data up into multiple XRAY6() calls, use
  *
@@ -41,7 +52,7 @@
  * prefix the data with a constant string.
  */
 
-#define XRAYING(x)            ((x) && (x)->addr)
+#define XRAYING(x)            __builtin_expect((x) && (x)->addr, 0)    /* Tracing is rare; keep the disabled path inline */
 #define XRAYING_FOR_CLIENT(x) (XRAYING(x) && xraying_for_client(x))
 #define XRAYN(x, n, ...)                 \
     do {                                 \
@@ -51,6 +62,14 @@
             SXEL##n(__VA_ARGS__);        \
         }                                \
     } while (0)
+
+#if SXE_DEBUG
+#   define XRAY_LOGGING(n)    ((n) <= sxe_log_control.level)
+#else
+#   define XRAY_LOGGING(n)    0
+#endif
+#define XRAY_WANTED(x, n)     (XRAYING(x) || XRAY_LOGGING(n))
+
 #define XRAY6(x, ...) XRAYN(x, 6, __VA_ARGS__)
 #define XRAY7(x, ...) XRAYN(x, 7, __VA_ARGS__)
 